@@ -0,0 +1,212 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include "cacheutil.h"
+
+// Every binary cache file starts with this tag. Bump the version when a solver change
+//    would make old results wrong.
+#define CA_MAGIC "USC1"
+
+void cacheutilerror(char *error_text) {
+	printf("Critical error in cacheutil.c\nError message follows:\n");
+	printf("%s\n", error_text);
+	exit(1);
+}
+
+cache* CA_open(char *dir) {
+	if (mkdir(dir, 0755) && errno != EEXIST) cacheutilerror("CA_open: could not create cache directory");
+
+	cache *c = (cache *) malloc(sizeof (cache));
+	if (!c) cacheutilerror("CA_open: failure to allocate cache");
+	c->dir = (char *) malloc(strlen(dir) + 1);
+	if (!c->dir) cacheutilerror("CA_open: failure to allocate dir");
+	strcpy(c->dir, dir);
+	return c;
+}
+
+void CA_close(cache *c) {
+	free(c->dir);
+	free(c);
+}
+
+static void CA_path(cache *c, unsigned long long geom, unsigned long long load, int has_load,
+		char *ext, char *path, size_t size) {
+	if (has_load) snprintf(path, size, "%s/%016llx-%016llx.%s", c->dir, geom, load, ext);
+	else snprintf(path, size, "%s/%016llx.%s", c->dir, geom, ext);
+}
+
+static FILE* CA_fopen(cache *c, unsigned long long geom, unsigned long long load, int has_load, char *ext) {
+	char path[1024];
+	CA_path(c, geom, load, has_load, ext, path, sizeof path);
+	return fopen(path, "rb");
+}
+
+// Entries are written to a temporary file in the cache directory and renamed into place once
+//    every write has succeeded, so a crashed or concurrent run never leaves a truncated entry
+//    under the final name (rename replaces it atomically).
+
+static FILE* CA_begin(cache *c, unsigned long long geom, unsigned long long load, int has_load,
+		char *ext, char *path, char *tmp, size_t size) {
+	CA_path(c, geom, load, has_load, ext, path, size);
+	snprintf(tmp, size, "%s.XXXXXX", path);
+	int fd = mkstemp(tmp);
+	if (fd == -1) return NULL;
+	mode_t mask = umask(0);
+	umask(mask);
+	fchmod(fd, 0666 & ~mask);
+	FILE *fp = fdopen(fd, "wb");
+	if (!fp) {
+		close(fd);
+		remove(tmp);
+		return NULL;
+	}
+	if (fwrite(CA_MAGIC, 1, 4, fp) != 4) {
+		fclose(fp);
+		remove(tmp);
+		return NULL;
+	}
+	return fp;
+}
+
+static int CA_commit(FILE *fp, int ok, char *path, char *tmp) {
+	// Closes a file from CA_begin and renames it into place if ok and the close succeed
+	if (fclose(fp)) ok = 0;
+	if (ok && rename(tmp, path)) ok = 0;
+	if (!ok) remove(tmp);
+	return ok;
+}
+
+static int CA_read_header(FILE *fp) {
+	char tag[4];
+	if (fread(tag, 1, 4, fp) != 4) return 0;
+	return !memcmp(tag, CA_MAGIC, 4);
+}
+
+lu_factor* CA_load_factor(cache *c, unsigned long long geom) {
+	FILE *fp = CA_fopen(c, geom, 0, 0, "lu");
+	if (!fp) return NULL;
+
+	int n;
+	if (!CA_read_header(fp) || fread(&n, sizeof (int), 1, fp) != 1 || n <= 0) {
+		fclose(fp);
+		return NULL;
+	}
+
+	lu_factor *f = (lu_factor *) malloc(sizeof (lu_factor));
+	if (!f) cacheutilerror("CA_load_factor: failure to allocate factor");
+	f->n = n;
+	f->lu = MAT_matrix(n, n, MAT_NO);
+	f->perm = (int *) malloc(n * sizeof (int));
+	if (!f->perm) cacheutilerror("CA_load_factor: failure to allocate perm");
+
+	int ok = fread(f->perm, sizeof (int), n, fp) == (size_t) n;
+	for (int i = 0; ok && i < n; i++) {
+		ok = fread(f->lu->mat[i], sizeof (float), n, fp) == (size_t) n;
+	}
+	fclose(fp);
+	if (!ok) {
+		MAT_freelu(f);
+		return NULL;
+	}
+	return f;
+}
+
+void CA_store_factor(cache *c, unsigned long long geom, lu_factor *f) {
+	char path[1024], tmp[1024];
+	FILE *fp = CA_begin(c, geom, 0, 0, "lu", path, tmp, sizeof path);
+	int ok = fp != NULL;
+	if (ok) {
+		ok = fwrite(&f->n, sizeof (int), 1, fp) == 1;
+		ok = ok && fwrite(f->perm, sizeof (int), f->n, fp) == (size_t) f->n;
+		for (int i = 0; ok && i < f->n; i++) {
+			ok = fwrite(f->lu->mat[i], sizeof (float), f->n, fp) == (size_t) f->n;
+		}
+		ok = CA_commit(fp, ok, path, tmp);
+	}
+	if (!ok) fprintf(stderr, "Warning: could not write factor to cache\n");
+}
+
+vector* CA_load_solution(cache *c, unsigned long long geom, unsigned long long load) {
+	FILE *fp = CA_fopen(c, geom, load, 1, "sol");
+	if (!fp) return NULL;
+
+	int n;
+	if (!CA_read_header(fp) || fread(&n, sizeof (int), 1, fp) != 1 || n <= 0) {
+		fclose(fp);
+		return NULL;
+	}
+	vector *v = MAT_vector(n, MAT_NO);
+	int ok = fread(v->vec, sizeof (float), n, fp) == (size_t) n;
+	fclose(fp);
+	if (!ok) {
+		MAT_freevector(v);
+		return NULL;
+	}
+	return v;
+}
+
+void CA_store_solution(cache *c, unsigned long long geom, unsigned long long load, vector *v) {
+	char path[1024], tmp[1024];
+	FILE *fp = CA_begin(c, geom, load, 1, "sol", path, tmp, sizeof path);
+	int ok = fp != NULL;
+	if (ok) {
+		ok = fwrite(&v->rows, sizeof (int), 1, fp) == 1;
+		ok = ok && fwrite(v->vec, sizeof (float), v->rows, fp) == (size_t) v->rows;
+		ok = CA_commit(fp, ok, path, tmp);
+	}
+	if (!ok) fprintf(stderr, "Warning: could not write solution to cache\n");
+}
+
+static int CA_copy_file(FILE *in, FILE *out, long long length) {
+	// Copies length bytes; fails if in ends early
+	char buff[4096];
+	size_t n;
+	while (length > 0) {
+		n = fread(buff, 1, length < (long long) sizeof buff ? (size_t) length : sizeof buff, in);
+		if (n == 0 || fwrite(buff, 1, n, out) != n) return 0;
+		length -= n;
+	}
+	return 1;
+}
+
+int CA_load_image(cache *c, unsigned long long geom, unsigned long long load, char *dest) {
+	// Copies a cached image to dest. Returns nonzero on a hit.
+	FILE *in = CA_fopen(c, geom, load, 1, "png");
+	if (!in) return 0;
+	long long length;
+	if (!CA_read_header(in) || fread(&length, sizeof (long long), 1, in) != 1 || length <= 0) {
+		fclose(in);
+		return 0;
+	}
+	FILE *out = fopen(dest, "wb");
+	if (!out) {
+		fclose(in);
+		return 0;
+	}
+	int ok = CA_copy_file(in, out, length) && fgetc(in) == EOF;
+	fclose(in);
+	if (fclose(out)) ok = 0;
+	return ok;
+}
+
+void CA_store_image(cache *c, unsigned long long geom, unsigned long long load, char *src) {
+	// The image is stored after the header and its length in bytes, which a load checks
+	FILE *in = fopen(src, "rb");
+	if (!in) return;
+	long long length = -1;
+	if (!fseek(in, 0, SEEK_END)) length = ftell(in);
+	rewind(in);
+	char path[1024], tmp[1024];
+	FILE *out = length > 0 ? CA_begin(c, geom, load, 1, "png", path, tmp, sizeof path) : NULL;
+	int ok = out != NULL;
+	if (ok) {
+		ok = fwrite(&length, sizeof (long long), 1, out) == 1;
+		ok = ok && CA_copy_file(in, out, length);
+		ok = CA_commit(out, ok, path, tmp);
+	}
+	fclose(in);
+	if (!ok) fprintf(stderr, "Warning: could not write image to cache\n");
+}
@@ -0,0 +1,36 @@
+#ifndef _CACHEUTIL_
+#define _CACHEUTIL_
+
+#include "matutil.h"
+
+/*
+On-disk cache of solver results, addressed by frame hashes (see UN_hash_geometry, UN_hash_loads).
+A cache directory holds:
+ - <geometry hash>.lu                  factorization of the connectivity matrix
+ - <geometry hash>-<load hash>.sol     solution vector
+ - <geometry hash>-<load hash>.png     rendered frame, after the header and its length
+A geometry-only hit lets the caller skip assembly and factorization; a full hit skips the solve too.
+Unreadable or mismatched entries are treated as misses. Entries are written under a temporary name
+   and renamed into place when complete, so concurrent runs can share a directory.
+*/
+
+typedef struct cache cache;
+struct cache {
+	char *dir;
+};
+
+void cacheutilerror(char *error_text);
+
+cache* CA_open(char *dir);
+void CA_close(cache *c);
+
+lu_factor* CA_load_factor(cache *c, unsigned long long geom);
+void CA_store_factor(cache *c, unsigned long long geom, lu_factor *f);
+
+vector* CA_load_solution(cache *c, unsigned long long geom, unsigned long long load);
+void CA_store_solution(cache *c, unsigned long long geom, unsigned long long load, vector *v);
+
+int CA_load_image(cache *c, unsigned long long geom, unsigned long long load, char *dest);
+void CA_store_image(cache *c, unsigned long long geom, unsigned long long load, char *src);
+
+#endif
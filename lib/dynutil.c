@@ -0,0 +1,787 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <math.h>
+#include <string.h>
+#include "dynutil.h"
+
+void dynutilerror(char *error_text) {
+	printf("Critical error in dynutil.c\nError message follows:\n");
+	printf("%s\n", error_text);
+	exit(1);
+}
+
+static int DY_colour(frame *f, int *colour, int *count) {
+	// Greedy edge colouring: sweeps the uncoloured beams once per colour, taking every beam whose
+	//    nodes no beam of that colour has used yet. Fills each beam's colour and the number of beams
+	//    per colour, and returns the number of colours (at most twice the largest node degree).
+	int *stamp = (int *) malloc((f->nodecount + 1) * sizeof (int));
+	if (!stamp) dynutilerror("DY_colour: failure to allocate stamp");
+	for (int i = 0; i < f->nodecount; i++) stamp[i] = -1;
+	for (int i = 0; i < f->beamcount; i++) colour[i] = -1;
+	int left = f->beamcount, c = 0, a, b;
+	while (left) {
+		count[c] = 0;
+		for (int i = 0; i < f->beamcount; i++) {
+			if (colour[i] != -1) continue;
+			a = f->beams[i].n1_idx;
+			b = f->beams[i].n2_idx;
+			if (stamp[a] == c || stamp[b] == c) continue;
+			stamp[a] = c;
+			stamp[b] = c;
+			colour[i] = c;
+			count[c]++;
+			left--;
+		}
+		c++;
+	}
+	free(stamp);
+	return c;
+}
+
+static dyload* DY_load(frame *f) {
+	dyload *l = (dyload *) malloc(sizeof (dyload));
+	if (!l) dynutilerror("DY_load: failure to allocate loads");
+	int c = l->count = f->forcecount;
+	l->node = (int *) malloc((c + 1) * sizeof (int));
+	l->fx = (double *) malloc((c + 1) * sizeof (double));
+	l->fy = (double *) malloc((c + 1) * sizeof (double));
+	l->hist = (history **) malloc((c + 1) * sizeof (history *));
+	if (!l->node || !l->fx || !l->fy || !l->hist) dynutilerror("DY_load: failure to allocate loads");
+	l->timed = 0;
+	for (int i = 0; i < c; i++) {
+		l->node[i] = UN_get_node_idx(f, f->forces[i].n_id);
+		if (l->node[i] == -1) dynutilerror("DY_load: force on a missing node");
+		l->fx[i] = f->forces[i].mag * cos(f->forces[i].theta);
+		l->fy[i] = f->forces[i].mag * sin(f->forces[i].theta);
+		l->hist[i] = f->forces[i].hist;
+		if (l->hist[i]) l->timed = 1;
+	}
+	return l;
+}
+
+static void DY_free_load(dyload *l) {
+	free(l->node);
+	free(l->fx);
+	free(l->fy);
+	free(l->hist);
+	free(l);
+}
+
+static void DY_load_at(dyload *l, double t, double *px, double *py) {
+	// Node forces at time t. Only the loaded nodes are written, so px and py must start out zero.
+	double s;
+	for (int i = 0; i < l->count; i++) px[l->node[i]] = py[l->node[i]] = 0;
+	for (int i = 0; i < l->count; i++) {
+		s = UN_history_factor(l->hist[i], t);
+		px[l->node[i]] += s * l->fx[i];
+		py[l->node[i]] += s * l->fy[i];
+	}
+}
+
+static double* DY_lumped_mass(frame *f) {
+	// Half of each beam's mass (mass per unit length times unstressed length) on each of its nodes
+	double *m = (double *) calloc(f->nodecount + 1, sizeof (double));
+	if (!m) dynutilerror("DY_lumped_mass: failure to allocate masses");
+	beam *b;
+	for (int i = 0; i < f->beamcount; i++) {
+		b = f->beams + i;
+		if (b->orig_length <= 0) dynutilerror("DY_lumped_mass: beam has no unstressed length");
+		m[b->n1_idx] += 0.5 * b->density * b->orig_length;
+		m[b->n2_idx] += 0.5 * b->density * b->orig_length;
+	}
+	for (int i = 0; i < f->nodecount; i++) {
+		if (m[i] <= 0) {
+			fprintf(stderr, "Node id %d\n", f->nodes[i].id);
+			dynutilerror("DY_lumped_mass: node has no mass (no beams, or beams of zero mass)");
+		}
+	}
+	return m;
+}
+
+static double* DY_dof_mass(frame *f, dofmap *dm) {
+	// Lumped mass of each free dof of the stiffness solvers
+	double *mass = DY_lumped_mass(f);
+	double *m = (double *) malloc((dm->dofcount + 1) * sizeof (double));
+	if (!m) dynutilerror("DY_dof_mass: failure to allocate masses");
+	coor e;
+	for (int i = 0; i < f->nodecount; i++) {
+		for (int k = 0; k < dm->ndof[i]; k++) {
+			e = dm->basis[2 * i + k];
+			m[dm->first[i] + k] = mass[i] * (e.x * e.x + e.y * e.y);
+		}
+	}
+	free(mass);
+	return m;
+}
+
+dyframe* DY_frame(frame *f) {
+	// Builds the time stepping state of f at rest in its unloaded position.
+	// Beam lengths and node indices must be current (UN_compute_beam_vals).
+	if (f->instancecount) dynutilerror("DY_frame: module instances are not supported");
+	dyframe *d = (dyframe *) malloc(sizeof (dyframe));
+	if (!d) dynutilerror("DY_frame: failure to allocate state");
+	int n = d->nodecount = f->nodecount;
+	int nb = d->beamcount = f->beamcount;
+	d->f = f;
+	d->x = (double *) malloc((n + 1) * sizeof (double));
+	d->y = (double *) malloc((n + 1) * sizeof (double));
+	d->vx = (double *) calloc(n + 1, sizeof (double));
+	d->vy = (double *) calloc(n + 1, sizeof (double));
+	d->fx = (double *) calloc(n + 1, sizeof (double));
+	d->fy = (double *) calloc(n + 1, sizeof (double));
+	d->px = (double *) calloc(n + 1, sizeof (double));
+	d->py = (double *) calloc(n + 1, sizeof (double));
+	d->minv = DY_lumped_mass(f);
+	d->pxx = (double *) malloc((n + 1) * sizeof (double));
+	d->pxy = (double *) malloc((n + 1) * sizeof (double));
+	d->pyy = (double *) malloc((n + 1) * sizeof (double));
+	d->n1 = (int *) malloc((nb + 1) * sizeof (int));
+	d->n2 = (int *) malloc((nb + 1) * sizeof (int));
+	d->k = (double *) malloc((nb + 1) * sizeof (double));
+	d->len0 = (double *) malloc((nb + 1) * sizeof (double));
+	d->force = (double *) calloc(nb + 1, sizeof (double));
+	d->order = (int *) malloc((nb + 1) * sizeof (int));
+	d->colour = (int *) calloc(2 * nb + 2, sizeof (int));
+	int *bcolour = (int *) malloc((nb + 1) * sizeof (int));
+	if (!d->x || !d->y || !d->vx || !d->vy || !d->fx || !d->fy || !d->px || !d->py || !d->minv
+		|| !d->pxx || !d->pxy || !d->pyy || !d->n1 || !d->n2 || !d->k || !d->len0 || !d->force
+		|| !d->order || !d->colour || !bcolour) {
+		dynutilerror("DY_frame: failure to allocate state");
+	}
+
+	for (int i = 0; i < n; i++) {
+		d->x[i] = f->nodes[i].loc.x;
+		d->y[i] = f->nodes[i].loc.y;
+		d->minv[i] = 1 / d->minv[i];
+	}
+	d->load = DY_load(f);
+	DY_load_at(d->load, 0, d->px, d->py);
+
+	// Beams sorted by colour (counting sort)
+	d->colourcount = DY_colour(f, bcolour, d->colour + 1);
+	for (int c = 0; c < d->colourcount; c++) d->colour[c + 1] += d->colour[c];
+	int *fill = (int *) malloc((d->colourcount + 1) * sizeof (int));
+	if (!fill) dynutilerror("DY_frame: failure to allocate fill");
+	for (int c = 0; c < d->colourcount; c++) fill[c] = d->colour[c];
+	beam *b;
+	int s;
+	for (int i = 0; i < nb; i++) {
+		b = f->beams + i;
+		if (b->stiffness <= 0) dynutilerror("DY_frame: beam stiffness must be positive");
+		s = fill[bcolour[i]]++;
+		d->order[s] = i;
+		d->n1[s] = b->n1_idx;
+		d->n2[s] = b->n2_idx;
+		// A beam without its own unstressed length is stress free as placed: its length in double
+		//    precision, as the positions are kept, so float rounding does not prestress stiff beams
+		d->len0[s] = b->orig_length;
+		if (b->orig_length == b->length) {
+			d->len0[s] = hypot((double) f->nodes[b->n2_idx].loc.x - f->nodes[b->n1_idx].loc.x,
+				(double) f->nodes[b->n2_idx].loc.y - f->nodes[b->n1_idx].loc.y);
+		}
+		d->k[s] = b->stiffness / d->len0[s];
+	}
+	free(fill);
+	free(bcolour);
+
+	// Free directions of each node, as in the stiffness solvers
+	dofmap *dm = ST_dofmap(f);
+	coor v;
+	for (int i = 0; i < n; i++) {
+		d->pxx[i] = d->pxy[i] = d->pyy[i] = 0;
+		for (int q = 0; q < dm->ndof[i]; q++) {
+			v = dm->basis[2 * i + q];
+			d->pxx[i] += v.x * v.x;
+			d->pxy[i] += v.x * v.y;
+			d->pyy[i] += v.y * v.y;
+		}
+	}
+	ST_free_dofmap(dm);
+
+	d->damping = 0;
+	d->lambda = 0;
+	d->t = 0;
+	d->steps = 0;
+	d->started = 0;
+	d->dt = DY_critical_step(d);
+	return d;
+}
+
+void DY_free(dyframe *d) {
+	free(d->x);
+	free(d->y);
+	free(d->vx);
+	free(d->vy);
+	free(d->fx);
+	free(d->fy);
+	free(d->px);
+	free(d->py);
+	DY_free_load(d->load);
+	free(d->minv);
+	free(d->pxx);
+	free(d->pxy);
+	free(d->pyy);
+	free(d->n1);
+	free(d->n2);
+	free(d->k);
+	free(d->len0);
+	free(d->force);
+	free(d->order);
+	free(d->colour);
+	free(d);
+}
+
+static void DY_row_sums(dyframe *d, double *rx, double *ry) {
+	// Row sums of |K| at the current positions for each node's x and y rows. A beam adds k (e e^T)
+	//    to both its nodes' diagonal blocks and -k (e e^T) between them, plus N / l (I - e e^T)
+	//    likewise while it carries force N.
+	for (int q = 0; q < d->nodecount; q++) rx[q] = ry[q] = 0;
+	double dx, dy, l, ex, ey, g, sx, sy;
+	int i, j;
+	for (int b = 0; b < d->beamcount; b++) {
+		i = d->n1[b];
+		j = d->n2[b];
+		dx = d->x[j] - d->x[i];
+		dy = d->y[j] - d->y[i];
+		l = sqrt(dx * dx + dy * dy);
+		ex = dx / l;
+		ey = dy / l;
+		g = fabs(d->force[b]) / l;
+		sx = d->k[b] * (ex * ex + fabs(ex * ey)) + g * (ey * ey + fabs(ex * ey));
+		sy = d->k[b] * (ey * ey + fabs(ex * ey)) + g * (ex * ex + fabs(ex * ey));
+		rx[i] += 2 * sx;
+		rx[j] += 2 * sx;
+		ry[i] += 2 * sy;
+		ry[j] += 2 * sy;
+	}
+}
+
+double DY_critical_step(dyframe *d) {
+	// DY_CFL times 2 / omega_max, with omega_max^2 bounded by the largest row sum of |M^-1 K| at the
+	//    current positions (Gershgorin)
+	int n = d->nodecount;
+	double *rx = (double *) malloc((n + 1) * sizeof (double));
+	double *ry = (double *) malloc((n + 1) * sizeof (double));
+	if (!rx || !ry) dynutilerror("DY_critical_step: failure to allocate rows");
+	DY_row_sums(d, rx, ry);
+	double w2 = 0;
+	for (int q = 0; q < n; q++) w2 = fmax(w2, d->minv[q] * fmax(rx[q], ry[q]));
+	free(rx);
+	free(ry);
+	if (w2 <= 0) dynutilerror("DY_critical_step: frame has no stiffness");
+	return DY_CFL * 2 / sqrt(w2);
+}
+
+static void DY_accumulate(dyframe *d, double lambda) {
+	// Net force on every node at the current positions: lambda times the applied forces plus the
+	//    pull of every beam. Beam forces are left in d->force.
+	// Worksharing only: called from inside a parallel region.
+	int n = d->nodecount;
+	double *x = d->x, *y = d->y, *fx = d->fx, *fy = d->fy;
+	#pragma omp for simd schedule(static)
+	for (int i = 0; i < n; i++) {
+		fx[i] = lambda * d->px[i];
+		fy[i] = lambda * d->py[i];
+	}
+	for (int c = 0; c < d->colourcount; c++) {
+		// No two beams of a colour share a node, so the scatter below never collides
+		#pragma omp for simd schedule(static)
+		for (int b = d->colour[c]; b < d->colour[c + 1]; b++) {
+			int i = d->n1[b], j = d->n2[b];
+			double dx = x[j] - x[i], dy = y[j] - y[i];
+			double l = sqrt(dx * dx + dy * dy);
+			double nb = d->k[b] * (l - d->len0[b]);
+			double s = nb / l;
+			d->force[b] = nb;
+			fx[i] += s * dx;
+			fy[i] += s * dy;
+			fx[j] -= s * dx;
+			fy[j] -= s * dy;
+		}
+	}
+}
+
+void DY_forces(dyframe *d, double lambda) {
+	#pragma omp parallel
+	DY_accumulate(d, lambda);
+	d->lambda = lambda;
+}
+
+void DY_step(dyframe *d, int steps, double lambda) {
+	// Advances steps central difference steps of d->dt under lambda times the applied forces.
+	// With mass proportional damping c, v(n + 1/2) = ((1 - c dt / 2) v(n - 1/2) + dt a(n)) / (1 + c dt / 2).
+	// The first step ever taken is a half step for the velocities, from rest.
+	// One parallel region covers all the steps; the barriers between its loops are the only
+	//    synchronization.
+	int n = d->nodecount;
+	double dt = d->dt, t = d->t;
+	double h = d->damping * dt / 2;
+	double *x = d->x, *y = d->y, *vx = d->vx, *vy = d->vy;
+	int started = d->started, timed = d->load->timed;
+	#pragma omp parallel
+	for (int s = 0; s < steps; s++) {
+		if (timed) {
+			#pragma omp single
+			DY_load_at(d->load, t + s * dt, d->px, d->py);
+		}
+		DY_accumulate(d, lambda);
+		double c1 = (1 - h) / (1 + h), c2 = dt / (1 + h);
+		if (!started && s == 0) {
+			c1 = 1;
+			c2 = dt / 2;
+		}
+		#pragma omp for simd schedule(static)
+		for (int i = 0; i < n; i++) {
+			double ax = d->minv[i] * d->fx[i], ay = d->minv[i] * d->fy[i];
+			vx[i] = c1 * vx[i] + c2 * (d->pxx[i] * ax + d->pxy[i] * ay);
+			vy[i] = c1 * vy[i] + c2 * (d->pxy[i] * ax + d->pyy[i] * ay);
+			x[i] += dt * vx[i];
+			y[i] += dt * vy[i];
+		}
+	}
+	if (steps > 0) d->started = 1;
+	d->lambda = lambda;
+	d->t += steps * dt;
+	d->steps += steps;
+}
+
+double DY_kinetic_energy(dyframe *d) {
+	// At the half step velocities
+	double e = 0;
+	for (int i = 0; i < d->nodecount; i++) e += (d->vx[i] * d->vx[i] + d->vy[i] * d->vy[i]) / d->minv[i];
+	return e / 2;
+}
+
+void DY_store(dyframe *d) {
+	// Writes the current state back into the frame: node.disp, beam.force, and constraint.force
+	//    from the net force left at each constrained node under the last load factor
+	frame *f = d->f;
+	int n = d->nodecount;
+	if (d->load->timed) DY_load_at(d->load, d->t, d->px, d->py);
+	DY_forces(d, d->lambda);
+	for (int i = 0; i < n; i++) {
+		f->nodes[i].disp = (coor) {d->x[i] - f->nodes[i].loc.x, d->y[i] - f->nodes[i].loc.y};
+	}
+	for (int b = 0; b < d->beamcount; b++) f->beams[d->order[b]].force = d->force[b];
+	float *resid = (float *) malloc((2 * n + 1) * sizeof (float));
+	if (!resid) dynutilerror("DY_store: failure to allocate resid");
+	for (int i = 0; i < n; i++) {
+		resid[i] = d->fx[i];
+		resid[i + n] = d->fy[i];
+	}
+	ST_split_reactions(f, resid);
+	free(resid);
+}
+
+int DY_relax(dyframe *d, double lambda, double tol, int maxsteps, dyrelax *rep) {
+	// Dynamic relaxation from the current positions to equilibrium under lambda times the applied
+	//    forces at the current time: unit central difference steps with fictitious masses, half the
+	//    Gershgorin row sum of K at each node (twice what unit steps need to stay stable). Whenever
+	//    the kinetic energy drops, the last step is undone, the frame is stopped dead and the masses
+	//    are refitted to the current stiffness. Converged once the out-of-balance force in the free
+	//    directions is at most tol times the applied load (or tol, without load).
+	// Leaves the frame at rest and returns nonzero if converged; rep (if not NULL) gets the details.
+	int n = d->nodecount;
+	double *x = d->x, *y = d->y, *vx = d->vx, *vy = d->vy, *fx = d->fx, *fy = d->fy;
+	double *mi = (double *) malloc((n + 1) * sizeof (double)); // inverse fictitious masses
+	double *ry = (double *) malloc((n + 1) * sizeof (double));
+	if (!mi || !ry) dynutilerror("DY_relax: failure to allocate masses");
+	if (d->load->timed) DY_load_at(d->load, d->t, d->px, d->py);
+	double fnorm = 0;
+	for (int i = 0; i < n; i++) {
+		fnorm += d->px[i] * d->px[i] + d->py[i] * d->py[i];
+		vx[i] = vy[i] = 0;
+	}
+	fnorm = fabs(lambda) * sqrt(fnorm);
+	double rtol = tol * (fnorm > 0 ? fnorm : 1);
+
+	double ke = 0, prev = 0, r2 = 0;
+	int steps = 0, peaks = 0, refit = 1, peak = 0, converged = 0;
+	#pragma omp parallel
+	for (int s = 0; s < maxsteps; s++) {
+		DY_accumulate(d, lambda);
+		#pragma omp single
+		{
+			if (refit) {
+				DY_row_sums(d, mi, ry);
+				for (int i = 0; i < n; i++) mi[i] = 2 / fmax(mi[i], ry[i]);
+			}
+			r2 = ke = 0;
+		}
+		// From rest the first step is a half step, as in DY_step
+		double c = refit ? 0.5 : 1;
+		#pragma omp for simd schedule(static) reduction(+:r2, ke)
+		for (int i = 0; i < n; i++) {
+			double rx = d->pxx[i] * fx[i] + d->pxy[i] * fy[i];
+			double ryy = d->pxy[i] * fx[i] + d->pyy[i] * fy[i];
+			r2 += rx * rx + ryy * ryy;
+			vx[i] += c * mi[i] * rx;
+			vy[i] += c * mi[i] * ryy;
+			ke += (vx[i] * vx[i] + vy[i] * vy[i]) / mi[i];
+			x[i] += vx[i];
+			y[i] += vy[i];
+		}
+		#pragma omp single
+		{
+			steps++;
+			converged = sqrt(r2) <= rtol;
+			peak = !converged && ke < prev;
+			refit = peak;
+			prev = peak ? 0 : ke;
+			if (peak) peaks++;
+		}
+		if (converged || peak) {
+			// Back to the positions the residual (or the energy peak) belongs to, at rest
+			#pragma omp for simd schedule(static)
+			for (int i = 0; i < n; i++) {
+				x[i] -= vx[i];
+				y[i] -= vy[i];
+				vx[i] = vy[i] = 0;
+			}
+		}
+		if (converged) break;
+	}
+	free(mi);
+	free(ry);
+	for (int i = 0; i < n; i++) vx[i] = vy[i] = 0;
+	d->started = 0;
+	d->lambda = lambda;
+	if (rep) {
+		rep->steps = steps;
+		rep->peaks = peaks;
+		rep->converged = converged;
+		rep->rnorm = sqrt(r2);
+		rep->fnorm = fnorm;
+	}
+	return converged;
+}
+
+dynewmark* DY_newmark(frame *f, double dt, double damping) {
+	// Sets up average acceleration Newmark steps of dt for f at rest in its unloaded position, and
+	//    factors the effective stiffness. Beam lengths and node indices must be current.
+	if (f->instancecount) dynutilerror("DY_newmark: module instances are not supported");
+	if (dt <= 0) dynutilerror("DY_newmark: time step must be positive");
+	dynewmark *d = (dynewmark *) malloc(sizeof (dynewmark));
+	if (!d) dynutilerror("DY_newmark: failure to allocate state");
+	int nn = f->nodecount;
+	d->f = f;
+	d->dm = ST_dofmap(f);
+	int n = d->n = d->dm->dofcount;
+	if (n == 0) dynutilerror("DY_newmark: frame has no free degrees of freedom");
+	d->u = (double *) calloc(n + 1, sizeof (double));
+	d->v = (double *) calloc(n + 1, sizeof (double));
+	d->a = (double *) calloc(n + 1, sizeof (double));
+	d->m = DY_dof_mass(f, d->dm);
+	d->r = (double *) malloc((n + 1) * sizeof (double));
+	d->work = (double *) malloc((n + 1) * sizeof (double));
+	d->px = (double *) calloc(nn + 1, sizeof (double));
+	d->py = (double *) calloc(nn + 1, sizeof (double));
+	if (!d->u || !d->v || !d->a || !d->m || !d->r || !d->work || !d->px || !d->py) {
+		dynutilerror("DY_newmark: failure to allocate state");
+	}
+	d->load = DY_load(f);
+	d->damping = damping;
+	d->dt = dt;
+	d->t = 0;
+	d->steps = 0;
+
+	// Initial accelerations M^-1 F(0) (from rest, K u = 0)
+	DY_load_at(d->load, 0, d->px, d->py);
+	coor e;
+	int q;
+	for (int i = 0; i < nn; i++) {
+		for (int k = 0; k < d->dm->ndof[i]; k++) {
+			q = d->dm->first[i] + k;
+			e = d->dm->basis[2 * i + k];
+			d->a[q] = (d->px[i] * e.x + d->py[i] * e.y) / d->m[q];
+		}
+	}
+
+	// K + (4 / dt^2 + 2 c / dt) M: the mass only adds to the diagonal, which the assembly always stores
+	spmatrix *k = ST_assemble_stiffness(f, d->dm);
+	double c0 = 4 / (dt * dt) + 2 * damping / dt;
+	int p;
+	for (int j = 0; j < n; j++) {
+		for (p = k->colptr[j]; p < k->colptr[j + 1] && k->rowidx[p] != j; p++);
+		if (p == k->colptr[j + 1]) dynutilerror("DY_newmark: stiffness matrix has no diagonal entry");
+		k->val[p] += c0 * d->m[j];
+	}
+	d->lf = ST_factor(f, k);
+	MAT_freespmatrix(k);
+	return d;
+}
+
+void DY_free_newmark(dynewmark *d) {
+	ST_free_dofmap(d->dm);
+	MAT_freeldl(d->lf);
+	DY_free_load(d->load);
+	free(d->u);
+	free(d->v);
+	free(d->a);
+	free(d->m);
+	free(d->r);
+	free(d->work);
+	free(d->px);
+	free(d->py);
+	free(d);
+}
+
+void DY_newmark_step(dynewmark *d, int steps) {
+	// Advances steps steps of d->dt. With beta = 1/4, gamma = 1/2 and C = c M, the new displacements
+	//    solve (K + (4 / dt^2 + 2 c / dt) M) u1 = F1 + M ((4 / dt^2 + 2 c / dt) u0 + (4 / dt + c) v0 + a0),
+	//    and then a1 = 4 (u1 - u0) / dt^2 - 4 v0 / dt - a0, v1 = v0 + dt (a0 + a1) / 2.
+	int n = d->n, nn = d->f->nodecount;
+	double dt = d->dt;
+	double c0 = 4 / (dt * dt) + 2 * d->damping / dt, c1 = 4 / dt + d->damping;
+	double a1;
+	dofmap *dm = d->dm;
+	coor e;
+	int q;
+	for (int s = 0; s < steps; s++) {
+		d->t += dt;
+		DY_load_at(d->load, d->t, d->px, d->py);
+		for (int i = 0; i < nn; i++) {
+			for (int k = 0; k < dm->ndof[i]; k++) {
+				q = dm->first[i] + k;
+				e = dm->basis[2 * i + k];
+				d->r[q] = d->px[i] * e.x + d->py[i] * e.y + d->m[q] * (c0 * d->u[q] + c1 * d->v[q] + d->a[q]);
+			}
+		}
+		MAT_solve_ldl_array(d->lf, d->r, d->work);
+		for (int i = 0; i < n; i++) {
+			a1 = 4 * (d->r[i] - d->u[i]) / (dt * dt) - 4 * d->v[i] / dt - d->a[i];
+			d->v[i] += dt * (d->a[i] + a1) / 2;
+			d->a[i] = a1;
+			d->u[i] = d->r[i];
+		}
+		d->steps++;
+	}
+}
+
+double DY_newmark_kinetic_energy(dynewmark *d) {
+	double e = 0;
+	for (int i = 0; i < d->n; i++) e += d->m[i] * d->v[i] * d->v[i];
+	return e / 2;
+}
+
+void DY_newmark_store(dynewmark *d) {
+	// Writes the current state back into the frame: node.disp, beam.force, and constraint.force
+	//    from the applied forces at the current time less the inertia of each node
+	frame *f = d->f;
+	int nn = f->nodecount;
+	float *applied = (float *) malloc((2 * nn + 1) * sizeof (float));
+	if (!applied) dynutilerror("DY_newmark_store: failure to allocate applied");
+	DY_load_at(d->load, d->t, d->px, d->py);
+	double mass, ax, ay;
+	coor e;
+	int q;
+	for (int i = 0; i < nn; i++) {
+		f->nodes[i].disp = (coor) {0, 0};
+		ax = ay = mass = 0;
+		for (int k = 0; k < d->dm->ndof[i]; k++) {
+			q = d->dm->first[i] + k;
+			e = d->dm->basis[2 * i + k];
+			f->nodes[i].disp.x += d->u[q] * e.x;
+			f->nodes[i].disp.y += d->u[q] * e.y;
+			ax += d->a[q] * e.x;
+			ay += d->a[q] * e.y;
+			mass = d->m[q];
+		}
+		applied[i] = d->px[i] - mass * ax;
+		applied[i + nn] = d->py[i] - mass * ay;
+	}
+	ST_recover_forces_from(f, applied);
+	free(applied);
+}
+
+eigen* DY_modes(frame *f, dofmap *dm, int count) {
+	// The count lowest natural modes of the linear frame about its unloaded position: K phi =
+	//    omega^2 M phi over the free dofs of dm, with lumped masses (MAT_eigs_sym). The values are
+	//    omega^2 and the shapes are mass normalised.
+	if (f->instancecount) dynutilerror("DY_modes: module instances are not supported");
+	int n = dm->dofcount;
+	if (n == 0) dynutilerror("DY_modes: frame has no free degrees of freedom");
+	spmatrix *k = ST_assemble_stiffness(f, dm);
+	double *mass = DY_dof_mass(f, dm);
+	triplet *t = MAT_triplet(n, n, n);
+	for (int i = 0; i < n; i++) MAT_triplet_add(t, i, i, mass[i]);
+	spmatrix *m = MAT_compress(t);
+	MAT_freetriplet(t);
+	free(mass);
+	int dim = 2 * count + DY_MODES_EXTRA;
+	eigen *e = MAT_eigs_sym(k, m, 0, count, DY_MODES_TOL, dim > n ? n : dim);
+	MAT_freespmatrix(k);
+	MAT_freespmatrix(m);
+	return e;
+}
+
+dyharmonic* DY_harmonic(frame *f, double damping, int modes) {
+	// Sets up steady state harmonic solves of the linear frame about its unloaded position, under
+	//    the applied forces at full magnitude (time histories are ignored) and mass proportional
+	//    damping C = c M. With modes > 0 it finds that many natural modes (DY_modes) and solves by
+	//    modal superposition; otherwise every frequency refactors the dynamic stiffness.
+	if (f->instancecount) dynutilerror("DY_harmonic: module instances are not supported");
+	dyharmonic *h = (dyharmonic *) malloc(sizeof (dyharmonic));
+	if (!h) dynutilerror("DY_harmonic: failure to allocate state");
+	h->f = f;
+	h->dm = ST_dofmap(f);
+	int n = h->n = h->dm->dofcount;
+	if (n == 0) dynutilerror("DY_harmonic: frame has no free degrees of freedom");
+	h->m = DY_dof_mass(f, h->dm);
+	h->p = (double *) calloc(n + 1, sizeof (double));
+	h->ur = (double *) calloc(n + 1, sizeof (double));
+	h->ui = (double *) calloc(n + 1, sizeof (double));
+	h->work = (double *) malloc((2 * n + 1) * sizeof (double));
+	if (!h->p || !h->ur || !h->ui || !h->work) dynutilerror("DY_harmonic: failure to allocate state");
+	h->damping = damping;
+	h->omega = 0;
+	h->solves = 0;
+
+	// Load vector over the free dofs
+	dyload *l = DY_load(f);
+	coor e;
+	int q;
+	for (int i = 0; i < l->count; i++) {
+		for (int k = 0; k < h->dm->ndof[l->node[i]]; k++) {
+			q = h->dm->first[l->node[i]] + k;
+			e = h->dm->basis[2 * l->node[i] + k];
+			h->p[q] += l->fx[i] * e.x + l->fy[i] * e.y;
+		}
+	}
+	DY_free_load(l);
+
+	spmatrix *k = ST_assemble_stiffness(f, h->dm);
+	h->modes = NULL;
+	h->pm = h->ures = NULL;
+	h->k = NULL;
+	h->ki = h->kdiag = NULL;
+	h->diag = NULL;
+	h->lf = NULL;
+	if (modes > 0) {
+		// Modal loads, and the static response of the modes left out (mode acceleration) so that
+		//    the truncated sum stays exact at low frequencies
+		h->modes = DY_modes(f, h->dm, modes);
+		int count = h->modes->count;
+		h->pm = (double *) calloc(count + 1, sizeof (double));
+		h->ures = (double *) malloc((n + 1) * sizeof (double));
+		if (!h->pm || !h->ures) dynutilerror("DY_harmonic: failure to allocate modal loads");
+		spfactor *lf = ST_factor(f, k);
+		memcpy(h->ures, h->p, n * sizeof (double));
+		MAT_solve_ldl_array(lf, h->ures, h->work);
+		MAT_freeldl(lf);
+		MAT_freespmatrix(k);
+		double *phi;
+		for (int j = 0; j < count; j++) {
+			phi = h->modes->vectors + (long long) j * n;
+			for (int i = 0; i < n; i++) h->pm[j] += phi[i] * h->p[i];
+			for (int i = 0; i < n; i++) h->ures[i] -= phi[i] * h->pm[j] / h->modes->values[j];
+		}
+		return h;
+	}
+
+	// Direct solves: K - omega^2 M + i omega c M only changes on the diagonal, which the assembly
+	//    always stores, so every frequency refactors on the one symbolic analysis of K
+	h->k = k;
+	h->ki = (double *) calloc(k->nnz + 1, sizeof (double));
+	h->kdiag = (double *) malloc((n + 1) * sizeof (double));
+	h->diag = (int *) malloc((n + 1) * sizeof (int));
+	if (!h->ki || !h->kdiag || !h->diag) dynutilerror("DY_harmonic: failure to allocate dynamic stiffness");
+	int p;
+	for (int j = 0; j < n; j++) {
+		for (p = k->colptr[j]; p < k->colptr[j + 1] && k->rowidx[p] != j; p++);
+		if (p == k->colptr[j + 1]) dynutilerror("DY_harmonic: stiffness matrix has no diagonal entry");
+		h->diag[j] = p;
+		h->kdiag[j] = k->val[p];
+	}
+	h->lf = MAT_factor_ldl_z(k, h->ki, ST_symbolic(f, k));
+	return h;
+}
+
+void DY_free_harmonic(dyharmonic *h) {
+	ST_free_dofmap(h->dm);
+	if (h->modes) MAT_freeeigen(h->modes);
+	if (h->k) MAT_freespmatrix(h->k);
+	if (h->lf) MAT_freeldl_z(h->lf);
+	free(h->m);
+	free(h->p);
+	free(h->pm);
+	free(h->ures);
+	free(h->ki);
+	free(h->kdiag);
+	free(h->diag);
+	free(h->ur);
+	free(h->ui);
+	free(h->work);
+	free(h);
+}
+
+void DY_harmonic_solve(dyharmonic *h, double omega) {
+	// Complex amplitudes U (in h->ur, h->ui) of the response at omega, (K - omega^2 M + i omega c M) U = P
+	int n = h->n;
+	double c = h->damping * omega;
+	h->omega = omega;
+	if (h->modes) {
+		// Modal superposition: the damping is proportional, so the modes stay uncoupled and
+		//    U = ures + sum_j phi_j pm_j / (omega_j^2 - omega^2 + i omega c)
+		memcpy(h->ur, h->ures, n * sizeof (double));
+		memset(h->ui, 0, n * sizeof (double));
+		double a, dd, sr, si, *phi;
+		for (int j = 0; j < h->modes->count; j++) {
+			phi = h->modes->vectors + (long long) j * n;
+			a = h->modes->values[j] - omega * omega;
+			dd = a * a + c * c;
+			if (dd == 0) dynutilerror("DY_harmonic_solve: undamped response at a natural frequency");
+			sr = h->pm[j] * a / dd;
+			si = -h->pm[j] * c / dd;
+			for (int i = 0; i < n; i++) {
+				h->ur[i] += phi[i] * sr;
+				h->ui[i] += phi[i] * si;
+			}
+		}
+		return;
+	}
+
+	for (int j = 0; j < n; j++) {
+		h->k->val[h->diag[j]] = h->kdiag[j] - omega * omega * h->m[j];
+		h->ki[h->diag[j]] = c * h->m[j];
+	}
+	if (MAT_refactor_ldl_z(h->lf, h->k, h->ki) != -1) {
+		dynutilerror("DY_harmonic_solve: dynamic stiffness is singular (undamped at a natural frequency)");
+	}
+	h->solves++;
+	memcpy(h->ur, h->p, n * sizeof (double));
+	memset(h->ui, 0, n * sizeof (double));
+	MAT_solve_ldl_z(h->lf, h->ur, h->ui, h->work);
+}
+
+void DY_harmonic_forces(dyharmonic *h, double *amp) {
+	// Amplitude of each beam's axial force at the last solve, |EA / l e . (U2 - U1)|
+	frame *f = h->f;
+	dofmap *dm = h->dm;
+	int nn = f->nodecount, q;
+	double *d = (double *) calloc(4 * nn + 1, sizeof (double));
+	if (!d) dynutilerror("DY_harmonic_forces: failure to allocate displacements");
+	double *dxr = d, *dyr = d + nn, *dxi = d + 2 * nn, *dyi = d + 3 * nn;
+	coor e;
+	for (int i = 0; i < nn; i++) {
+		for (int k = 0; k < dm->ndof[i]; k++) {
+			q = dm->first[i] + k;
+			e = dm->basis[2 * i + k];
+			dxr[i] += h->ur[q] * e.x;
+			dyr[i] += h->ur[q] * e.y;
+			dxi[i] += h->ui[q] * e.x;
+			dyi[i] += h->ui[q] * e.y;
+		}
+	}
+	beam *b;
+	double ex, ey, s;
+	for (int i = 0; i < f->beamcount; i++) {
+		b = f->beams + i;
+		ex = f->nodes[b->n2_idx].loc.x - f->nodes[b->n1_idx].loc.x;
+		ey = f->nodes[b->n2_idx].loc.y - f->nodes[b->n1_idx].loc.y;
+		s = b->stiffness / (b->length * b->length);
+		amp[i] = s * hypot(ex * (dxr[b->n2_idx] - dxr[b->n1_idx]) + ey * (dyr[b->n2_idx] - dyr[b->n1_idx]),
+			ex * (dxi[b->n2_idx] - dxi[b->n1_idx]) + ey * (dyi[b->n2_idx] - dyi[b->n1_idx]));
+	}
+	free(d);
+}
\ No newline at end of file
@@ -0,0 +1,173 @@
+#ifndef _DYNUTIL_
+#define _DYNUTIL_
+
+#include "undefs.h"
+#include "stiffutil.h"
+
+/*
+Time-domain dynamics of pin-jointed frames.
+Mass is lumped at the nodes: each beam puts half its mass (mass per unit length times unstressed
+   length) on each end. Beam forces follow the current geometry, EA (l - L) / L with L the beam's
+   unstressed length (orig_length), so large displacements and rotations are exact.
+Explicit stepping is central difference (leapfrog): velocities live at half steps, positions at
+   whole ones, and each step costs one pass over the beams and one over the nodes, with no matrix.
+   It is stable for time steps below 2 / omega_max; DY_critical_step bounds omega_max from the
+   stiffness and mass at each node (Gershgorin), so the step it returns is always stable for the
+   unloaded frame.
+State is kept as a structure of arrays. Beams are sorted by colour, no two beams of one colour
+   sharing a node, so the beams of a colour scatter their forces onto nodes in parallel and in SIMD
+   lanes without two writes ever landing on the same node.
+Constraints are rollers as in stiffutil: accelerations are projected onto each node's free
+   directions.
+Slow loading over long times would take far too many explicit steps. DY_newmark integrates the
+   linear (small displacement) frame implicitly instead, by the average acceleration Newmark method,
+   which is stable for any time step. With lumped masses and mass proportional damping the
+   effective stiffness K + (4 / dt^2 + 2 c / dt) M does not change between steps, so it is factored
+   once and each step costs one back substitution plus a few passes over the free dofs.
+Forces may follow time histories (force.hist); forces without one are constant from t = 0.
+DY_modes finds the lowest natural frequencies and mode shapes of the linear frame with the same
+   lumped masses, by shift-invert Lanczos on the factored stiffness (MAT_eigs_sym).
+DY_relax finds static equilibrium without factoring anything (dynamic relaxation): the explicit
+   steps run with fictitious masses fitted to the stiffness, and kinetic damping stops the frame
+   dead at every peak of its kinetic energy until the out-of-balance forces vanish. It needs only
+   the explicit state, and follows large displacements, slack and prestress like the explicit steps.
+DY_harmonic sweeps the steady state response to the applied forces varying as cos(omega t). Each
+   frequency solves the complex system (K - omega^2 M + i omega c M) U = P. Directly, only the
+   diagonal changes with omega, so it is refactored (complex symmetric LDL^T) on the one symbolic
+   analysis of K. Given a modal basis the modes uncouple under mass proportional damping, and each
+   frequency costs one pass over the modes. The static response of the modes left out is added back,
+   so the truncation error is small below the highest mode kept.
+*/
+
+#define DY_CFL 0.9 // fraction of the critical time step DY_critical_step returns
+#define DY_MODES_TOL 1e-8 // Lanczos residual of converged modes, relative to 1 / omega^2
+#define DY_MODES_EXTRA 20 // Lanczos steps allowed beyond twice the modes requested
+#define DY_RELAX_TOL 1e-6 // out-of-balance force at equilibrium, relative to the applied load
+
+typedef struct dyload dyload;
+struct dyload {
+	// Applied forces as functions of time
+	int count;
+	int *node; // node index of each force
+	double *fx; // components at full magnitude
+	double *fy;
+	history **hist; // NULL for constant forces
+	int timed; // nonzero if any force has a time history
+};
+
+typedef struct dyframe dyframe;
+struct dyframe {
+	frame *f; // not owned
+	int nodecount;
+	int beamcount;
+	double *x; // current node positions
+	double *y;
+	double *vx; // velocities (half a step behind the positions once stepping has started)
+	double *vy;
+	double *fx; // net force on each node at the current positions
+	double *fy;
+	double *px; // applied forces at load factor 1 (at the current time)
+	double *py;
+	dyload *load;
+	double *minv; // inverse lumped mass
+	double *pxx; // projection of each node's acceleration onto its free directions
+	double *pxy;
+	double *pyy;
+	int *n1; // beam ends, sorted by colour
+	int *n2;
+	double *k; // EA / L
+	double *len0; // unstressed length L
+	double *force; // axial force, tension positive
+	int *order; // sorted beam i is f->beams[order[i]]
+	int colourcount;
+	int *colour; // beams of colour c are colour[c] ... colour[c + 1] - 1
+	double damping; // mass proportional damping (per unit time), 0 by default
+	double lambda; // load factor of the last step
+	double t;
+	double dt;
+	long long steps;
+	int started;
+};
+
+typedef struct dyrelax dyrelax;
+struct dyrelax {
+	// Outcome of DY_relax
+	int steps;
+	int peaks; // kinetic energy peaks, each a restart from rest
+	int converged;
+	double rnorm; // out-of-balance force at the end
+	double fnorm; // applied load
+};
+
+typedef struct dyharmonic dyharmonic;
+struct dyharmonic {
+	// Steady state harmonic response of the linear frame over its free dofs (stiffutil dofmap): the
+	//    applied forces P cos(omega t) give displacements Re(U e^(i omega t)), U = ur + i ui
+	frame *f; // not owned
+	dofmap *dm;
+	int n; // free dofs
+	double *m; // lumped mass of each free dof
+	double *p; // load vector (forces at full magnitude)
+	double damping; // mass proportional damping (per unit time)
+	eigen *modes; // modal basis, or NULL for direct solves
+	double *pm; // modal loads phi_j . p
+	double *ures; // static response of the modes left out, K^-1 p - sum_j phi_j pm_j / omega_j^2
+	spmatrix *k; // direct solves: K - omega^2 M (real part), on K's pattern
+	double *ki; // imaginary part omega c M on the pattern of k
+	double *kdiag; // diagonal of K
+	int *diag; // position of each diagonal entry in k
+	spzfactor *lf;
+	double *ur; // amplitudes at the last frequency
+	double *ui;
+	double *work;
+	double omega;
+	int solves; // direct refactorizations
+};
+
+typedef struct dynewmark dynewmark;
+struct dynewmark {
+	// Implicit integration of the linear frame over its free dofs (stiffutil dofmap)
+	frame *f; // not owned
+	dofmap *dm;
+	spfactor *lf; // effective stiffness K + (4 / dt^2 + 2 c / dt) M
+	dyload *load;
+	int n; // free dofs
+	double *u; // displacements, velocities and accelerations of the free dofs
+	double *v;
+	double *a;
+	double *m; // lumped mass of each free dof
+	double *r; // right hand side, then the new displacements
+	double *work;
+	double *px; // applied forces at the current time
+	double *py;
+	double damping; // mass proportional damping (per unit time)
+	double t;
+	double dt;
+	long long steps;
+};
+
+void dynutilerror(char *error_text);
+
+dyframe* DY_frame(frame *f);
+void DY_free(dyframe *d);
+double DY_critical_step(dyframe *d);
+void DY_forces(dyframe *d, double lambda);
+void DY_step(dyframe *d, int steps, double lambda);
+double DY_kinetic_energy(dyframe *d);
+void DY_store(dyframe *d);
+int DY_relax(dyframe *d, double lambda, double tol, int maxsteps, dyrelax *rep);
+
+dynewmark* DY_newmark(frame *f, double dt, double damping);
+void DY_free_newmark(dynewmark *d);
+void DY_newmark_step(dynewmark *d, int steps);
+double DY_newmark_kinetic_energy(dynewmark *d);
+void DY_newmark_store(dynewmark *d);
+
+eigen* DY_modes(frame *f, dofmap *dm, int count);
+
+dyharmonic* DY_harmonic(frame *f, double damping, int modes);
+void DY_free_harmonic(dyharmonic *h);
+void DY_harmonic_solve(dyharmonic *h, double omega);
+void DY_harmonic_forces(dyharmonic *h, double *amp);
+
+#endif
\ No newline at end of file
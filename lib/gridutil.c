@@ -0,0 +1,99 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <math.h>
+#include "gridutil.h"
+
+void gridutilerror(char *error_text) {
+	printf("Critical error in gridutil.c\nError message follows:\n");
+	printf("%s\n", error_text);
+	exit(1);
+}
+
+static int GR_column_rows(grid *g, wall *w, int ix, int *lo, int *hi) {
+	// Rows of column ix that the wall's line crosses; returns 0 if it misses the column
+	float xa = g->x0 + ix * g->h;
+	float ya = w->m * xa + w->b;
+	float yb = w->m * (xa + g->h) + w->b;
+	*lo = (int) floorf((fminf(ya, yb) - g->y0) / g->h);
+	*hi = (int) floorf((fmaxf(ya, yb) - g->y0) / g->h);
+	if (*hi < 0 || *lo >= g->ny) return 0;
+	if (*lo < 0) *lo = 0;
+	if (*hi >= g->ny) *hi = g->ny - 1;
+	return 1;
+}
+
+grid* GR_grid(wall *walls, int wallcount, float x0, float y0, float x1, float y1, float h) {
+	// Grid of cells of size h covering the box (x0, y0) - (x1, y1), with the walls crossing each cell
+	if (h <= 0 || x1 < x0 || y1 < y0) gridutilerror("GR_grid: bad box or cell size");
+	grid *g = (grid *) malloc(sizeof (grid));
+	if (!g) gridutilerror("GR_grid: failure to allocate grid");
+	g->x0 = x0;
+	g->y0 = y0;
+	g->h = h;
+	g->nx = (int) ceilf((x1 - x0) / h) + 1;
+	g->ny = (int) ceilf((y1 - y0) / h) + 1;
+	g->wallcount = wallcount;
+	int cells = g->nx * g->ny;
+	g->start = (int *) calloc(cells + 1, sizeof (int));
+	g->stamp = (int *) calloc(wallcount + 1, sizeof (int));
+	if (!g->start || !g->stamp) gridutilerror("GR_grid: failure to allocate grid");
+	g->query = 0;
+
+	// Count, then fill, the cells each line crosses, one column at a time
+	int lo, hi;
+	for (int j = 0; j < wallcount; j++) {
+		for (int ix = 0; ix < g->nx; ix++) {
+			if (!GR_column_rows(g, walls + j, ix, &lo, &hi)) continue;
+			for (int iy = lo; iy <= hi; iy++) g->start[iy * g->nx + ix + 1]++;
+		}
+	}
+	for (int c = 0; c < cells; c++) g->start[c + 1] += g->start[c];
+	g->item = (int *) malloc((g->start[cells] + 1) * sizeof (int));
+	int *fill = (int *) malloc((cells + 1) * sizeof (int));
+	if (!g->item || !fill) gridutilerror("GR_grid: failure to allocate cell lists");
+	for (int c = 0; c < cells; c++) fill[c] = g->start[c];
+	for (int j = 0; j < wallcount; j++) {
+		for (int ix = 0; ix < g->nx; ix++) {
+			if (!GR_column_rows(g, walls + j, ix, &lo, &hi)) continue;
+			for (int iy = lo; iy <= hi; iy++) g->item[fill[iy * g->nx + ix]++] = j;
+		}
+	}
+	free(fill);
+	return g;
+}
+
+void GR_free(grid *g) {
+	free(g->start);
+	free(g->item);
+	free(g->stamp);
+	free(g);
+}
+
+int GR_cell(grid *g, coor p) {
+	// Index of the cell holding p, or -1 if p is not at least one cell inside the box
+	int ix = (int) floorf((p.x - g->x0) / g->h);
+	int iy = (int) floorf((p.y - g->y0) / g->h);
+	if (ix < 1 || iy < 1 || ix > g->nx - 2 || iy > g->ny - 2) return -1;
+	return iy * g->nx + ix;
+}
+
+int GR_near_walls(grid *g, coor p, int *res) {
+	// Fills res (room for wallcount) with the walls listed around p, each once, and returns their
+	//    number, or -1 if p is too close to the edge of the box (GR_cell)
+	int c = GR_cell(g, p);
+	if (c == -1) return -1;
+	int count = 0, cell, j;
+	g->query++;
+	for (int dy = -1; dy <= 1; dy++) {
+		for (int dx = -1; dx <= 1; dx++) {
+			cell = c + dy * g->nx + dx;
+			for (int q = g->start[cell]; q < g->start[cell + 1]; q++) {
+				j = g->item[q];
+				if (g->stamp[j] == g->query) continue;
+				g->stamp[j] = g->query;
+				res[count++] = j;
+			}
+		}
+	}
+	return count;
+}
\ No newline at end of file
@@ -0,0 +1,37 @@
+#ifndef _GRIDUTIL_
+#define _GRIDUTIL_
+
+#include "undefs.h"
+
+/*
+Broad phase for node-wall contact: a uniform grid of square cells over a box, listing the walls whose
+   line crosses each cell. Walls are the infinite lines y = m x + b, clipped to the box.
+A point's near walls are those listed in its own cell and the eight around it. That includes every
+   wall whose line passes within one cell size of the point, as long as the point is at least one
+   cell size inside the box (GR_near_walls refuses points closer to the edge, so that the caller
+   can rebuild the grid over a larger box).
+Building the grid costs O(walls x cells crossed); a query costs the length of nine cell lists.
+*/
+
+typedef struct grid grid;
+struct grid {
+	float x0; // lower left corner
+	float y0;
+	float h; // cell size
+	int nx;
+	int ny;
+	int wallcount;
+	int *start; // walls crossing cell c = iy nx + ix are item[start[c]] to item[start[c + 1] - 1]
+	int *item;
+	int *stamp; // per wall: the last query it was returned by, to return each wall once
+	int query;
+};
+
+void gridutilerror(char *error_text);
+
+grid* GR_grid(wall *walls, int wallcount, float x0, float y0, float x1, float y1, float h);
+void GR_free(grid *g);
+int GR_cell(grid *g, coor p);
+int GR_near_walls(grid *g, coor p, int *res);
+
+#endif
\ No newline at end of file
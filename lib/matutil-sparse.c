@@ -0,0 +1,1876 @@
+// Sparse additions to matutil
+// Unlike the dense routines, sparse values are stored as doubles: the stiffness matrices of
+//    large or slender frames are too ill-conditioned to solve reliably in single precision.
+// Vectors passed in and out are still ordinary (float) matutil vectors.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <math.h>
+#ifdef _OPENMP
+#include <omp.h>
+#endif
+#include "matutil.h"
+
+triplet* MAT_triplet(int r, int c, int cap) {
+	triplet *t = (triplet *) malloc(sizeof (triplet));
+	if (!t) matutilerror("MAT_triplet: failure to allocate t");
+	if (cap < 1) cap = 1;
+	t->rows = r;
+	t->cols = c;
+	t->count = 0;
+	t->cap = cap;
+	t->r = (int *) malloc(cap * sizeof (int));
+	t->c = (int *) malloc(cap * sizeof (int));
+	t->v = (double *) malloc(cap * sizeof (double));
+	if (!t->r || !t->c || !t->v) matutilerror("MAT_triplet: failure to allocate entries");
+	return t;
+}
+
+void MAT_triplet_add(triplet *t, int r, int c, double v) {
+	// Appends an entry. Repeated (r, c) pairs are summed on compression.
+	if (r < 0 || r >= t->rows || c < 0 || c >= t->cols) matutilerror("MAT_triplet_add: index out of range");
+	if (t->count == t->cap) {
+		t->cap *= 2;
+		t->r = (int *) realloc(t->r, t->cap * sizeof (int));
+		t->c = (int *) realloc(t->c, t->cap * sizeof (int));
+		t->v = (double *) realloc(t->v, t->cap * sizeof (double));
+		if (!t->r || !t->c || !t->v) matutilerror("MAT_triplet_add: failure to grow entries");
+	}
+	t->r[t->count] = r;
+	t->c[t->count] = c;
+	t->v[t->count] = v;
+	t->count++;
+}
+
+void MAT_freetriplet(triplet *t) {
+	free(t->r);
+	free(t->c);
+	free(t->v);
+	free(t);
+}
+
+spmatrix* MAT_compress(triplet *t) {
+	// Column compression by counting sort, summing duplicates. O(rows + cols + count)
+	int rows = t->rows;
+	int cols = t->cols;
+
+	// Bucket entries by row first, so a stable pass by column leaves rows ascending
+	int *rowptr = (int *) calloc(rows + 1, sizeof (int));
+	int *order = (int *) malloc((t->count + 1) * sizeof (int));
+	if (!rowptr || !order) matutilerror("MAT_compress: failure to allocate workspace");
+	for (int k = 0; k < t->count; k++) rowptr[t->r[k] + 1]++;
+	for (int i = 0; i < rows; i++) rowptr[i + 1] += rowptr[i];
+	for (int k = 0; k < t->count; k++) order[rowptr[t->r[k]]++] = k;
+
+	int *colcount = (int *) calloc(cols + 1, sizeof (int));
+	int *sorted = (int *) malloc((t->count + 1) * sizeof (int));
+	if (!colcount || !sorted) matutilerror("MAT_compress: failure to allocate workspace");
+	for (int k = 0; k < t->count; k++) colcount[t->c[k] + 1]++;
+	for (int j = 0; j < cols; j++) colcount[j + 1] += colcount[j];
+	for (int q = 0; q < t->count; q++) sorted[colcount[t->c[order[q]]]++] = order[q];
+	// colcount[j] now holds the end of column j
+
+	spmatrix *m = (spmatrix *) malloc(sizeof (spmatrix));
+	if (!m) matutilerror("MAT_compress: failure to allocate m");
+	m->rows = rows;
+	m->cols = cols;
+	m->colptr = (int *) malloc((cols + 1) * sizeof (int));
+	m->rowidx = (int *) malloc((t->count + 1) * sizeof (int));
+	m->val = (double *) malloc((t->count + 1) * sizeof (double));
+	if (!m->colptr || !m->rowidx || !m->val) matutilerror("MAT_compress: failure to allocate storage");
+
+	int nnz = 0;
+	int start = 0;
+	int k;
+	for (int j = 0; j < cols; j++) {
+		m->colptr[j] = nnz;
+		for (int q = start; q < colcount[j]; q++) {
+			k = sorted[q];
+			if (nnz > m->colptr[j] && m->rowidx[nnz - 1] == t->r[k]) {
+				m->val[nnz - 1] += t->v[k];
+			}
+			else {
+				m->rowidx[nnz] = t->r[k];
+				m->val[nnz] = t->v[k];
+				nnz++;
+			}
+		}
+		start = colcount[j];
+	}
+	m->colptr[cols] = nnz;
+	m->nnz = nnz;
+
+	free(rowptr);
+	free(order);
+	free(colcount);
+	free(sorted);
+	return m;
+}
+
+spmatrix* MAT_symmetry_spblock(spmatrix *m, symbasis *rows, symbasis *cols, int c) {
+	// Block c of m in the symmetry-adapted bases, as MAT_symmetry_block. Every entry of m lands
+	//    in at most one entry of the block, so the block has no more entries than m.
+	if (m->rows != rows->n || m->cols != cols->n) matutilerror("MAT_symmetry_spblock: matrix does not match the bases");
+	triplet *t = MAT_triplet(rows->size[c], cols->size[c], m->nnz + 1);
+	int *rcol = rows->col + (long long) c * rows->n;
+	int *ccol = cols->col + (long long) c * cols->n;
+	double *rcoef = rows->coef + (long long) c * rows->n;
+	double *ccoef = cols->coef + (long long) c * cols->n;
+	int i;
+	for (int j = 0; j < m->cols; j++) {
+		if (ccol[j] == -1) continue;
+		for (int p = m->colptr[j]; p < m->colptr[j + 1]; p++) {
+			i = m->rowidx[p];
+			if (rcol[i] != -1) MAT_triplet_add(t, rcol[i], ccol[j], rcoef[i] * ccoef[j] * m->val[p]);
+		}
+	}
+	spmatrix *res = MAT_compress(t);
+	MAT_freetriplet(t);
+	return res;
+}
+
+void MAT_freespmatrix(spmatrix *m) {
+	free(m->colptr);
+	free(m->rowidx);
+	free(m->val);
+	free(m);
+}
+
+vector* MAT_multiply_spv(spmatrix *m, vector *v) {
+	if (m->cols != v->rows) {
+		fprintf(stderr, "Matrix column count %d Vector row count %d", m->cols, v->rows);
+		matutilerror("MAT_multiply_spv: input matrix / vector misaligned");
+	}
+	double *acc = (double *) calloc(m->rows, sizeof (double));
+	if (!acc) matutilerror("MAT_multiply_spv: failure to allocate acc");
+	double x;
+	for (int j = 0; j < m->cols; j++) {
+		x = v->vec[j];
+		if (x == 0) continue;
+		for (int p = m->colptr[j]; p < m->colptr[j + 1]; p++) {
+			acc[m->rowidx[p]] += m->val[p] * x;
+		}
+	}
+	vector *res = MAT_vector(m->rows, MAT_NO);
+	for (int i = 0; i < m->rows; i++) res->vec[i] = (float) acc[i];
+	free(acc);
+	return res;
+}
+
+static void MAT_spmv_sym(spmatrix *m, double *x, double *y) {
+	// y = M . x for a symmetric M stored in full (both triangles)
+	// With column storage the transpose product is the gather form, which is equal for symmetric M
+	double temp;
+	for (int j = 0; j < m->cols; j++) {
+		temp = 0;
+		for (int p = m->colptr[j]; p < m->colptr[j + 1]; p++) {
+			temp += m->val[p] * x[m->rowidx[p]];
+		}
+		y[j] = temp;
+	}
+}
+
+vector* MAT_solve_pcg(spmatrix *m, vector *v, float tol, int maxiter) {
+	// Jacobi-preconditioned conjugate gradients for symmetric positive definite M (both triangles stored)
+	// Stops when |r| <= tol |b|. Never forms anything denser than M itself.
+	int n = m->cols;
+	if (m->rows != n) matutilerror("MAT_solve_pcg: input matrix is not square");
+	if (v->rows != n) {
+		fprintf(stderr, "Matrix column count %d Vector row count %d\n", m->cols, v->rows);
+		matutilerror("MAT_solve_pcg: input vector / matrix sizes misaligned");
+	}
+
+	double *x = (double *) calloc(n, sizeof (double));
+	double *r = (double *) malloc(n * sizeof (double));
+	double *z = (double *) malloc(n * sizeof (double));
+	double *p = (double *) malloc(n * sizeof (double));
+	double *q = (double *) malloc(n * sizeof (double));
+	double *dinv = (double *) malloc(n * sizeof (double));
+	if (!x || !r || !z || !p || !q || !dinv) matutilerror("MAT_solve_pcg: failure to allocate workspace");
+
+	for (int j = 0; j < n; j++) {
+		dinv[j] = 0;
+		for (int k = m->colptr[j]; k < m->colptr[j + 1]; k++) {
+			if (m->rowidx[k] == j) dinv[j] = m->val[k];
+		}
+		if (dinv[j] <= 0) {
+			fprintf(stderr, "Diagonal entry %d is %g\n", j, dinv[j]);
+			matutilerror("MAT_solve_pcg: matrix is not positive definite");
+		}
+		dinv[j] = 1 / dinv[j];
+	}
+
+	double bnorm = 0, rz = 0, rz_old, alpha, pq, rnorm;
+	for (int i = 0; i < n; i++) {
+		r[i] = v->vec[i];
+		z[i] = dinv[i] * r[i];
+		p[i] = z[i];
+		bnorm += r[i] * r[i];
+		rz += r[i] * z[i];
+	}
+	bnorm = sqrt(bnorm);
+
+	int iter;
+	rnorm = bnorm;
+	for (iter = 0; iter < maxiter && rnorm > tol * bnorm; iter++) {
+		MAT_spmv_sym(m, p, q);
+		pq = 0;
+		for (int i = 0; i < n; i++) pq += p[i] * q[i];
+		if (pq <= 0) matutilerror("MAT_solve_pcg: matrix is not positive definite (singular or unstable system)");
+		alpha = rz / pq;
+		rnorm = 0;
+		for (int i = 0; i < n; i++) {
+			x[i] += alpha * p[i];
+			r[i] -= alpha * q[i];
+			rnorm += r[i] * r[i];
+		}
+		rnorm = sqrt(rnorm);
+		rz_old = rz;
+		rz = 0;
+		for (int i = 0; i < n; i++) {
+			z[i] = dinv[i] * r[i];
+			rz += r[i] * z[i];
+		}
+		for (int i = 0; i < n; i++) p[i] = z[i] + (rz / rz_old) * p[i];
+	}
+	if (rnorm > tol * bnorm) {
+		fprintf(stderr, "Warning: MAT_solve_pcg stopped after %d iterations, relative residual %g\n",
+			iter, rnorm / bnorm);
+	}
+
+	vector *res = MAT_vector(n, MAT_NO);
+	for (int i = 0; i < n; i++) res->vec[i] = (float) x[i];
+
+	free(x);
+	free(r);
+	free(z);
+	free(p);
+	free(q);
+	free(dinv);
+	return res;
+}
+
+vector* MAT_multiply_sptv(spmatrix *m, vector *v) {
+	// M^T . v, the gather form of column storage
+	if (m->rows != v->rows) {
+		fprintf(stderr, "Matrix row count %d Vector row count %d", m->rows, v->rows);
+		matutilerror("MAT_multiply_sptv: input matrix / vector misaligned");
+	}
+	vector *res = MAT_vector(m->cols, MAT_NO);
+	double temp;
+	for (int j = 0; j < m->cols; j++) {
+		temp = 0;
+		for (int p = m->colptr[j]; p < m->colptr[j + 1]; p++) temp += m->val[p] * v->vec[m->rowidx[p]];
+		res->vec[j] = (float) temp;
+	}
+	return res;
+}
+
+static double MAT_norm(double *x, int n) {
+	double sum = 0;
+	for (int i = 0; i < n; i++) sum += x[i] * x[i];
+	return sqrt(sum);
+}
+
+vector* MAT_solve_lsqr(spmatrix *m, vector *v, float tol, int maxiter, lsq_report *rep) {
+	// LSQR (Paige and Saunders) for rectangular M: minimizes |v - M x|, and of all minimizers
+	//    returns the one of least norm, so it covers over- and under-determined systems and rank
+	//    deficient ones alike. Golub-Kahan bidiagonalization, one product with M and one with M^T
+	//    per iteration; M^T M is never formed, so the work is that of CG on the normal equations
+	//    without squaring their condition number in rounding.
+	// Stops when the system is consistent to |r| <= tol (|M| |x| + |v|), or when x is a least
+	//    squares solution to |M^T r| <= tol |M| |r|. rep (may be NULL) gets how it finished.
+	int rows = m->rows, cols = m->cols;
+	if (v->rows != rows) {
+		fprintf(stderr, "Matrix row count %d Vector row count %d\n", rows, v->rows);
+		matutilerror("MAT_solve_lsqr: input vector / matrix sizes misaligned");
+	}
+	double *x = (double *) calloc(cols, sizeof (double));
+	double *u = (double *) malloc((rows + 1) * sizeof (double));
+	double *w = (double *) malloc(cols * sizeof (double));
+	double *z = (double *) malloc(cols * sizeof (double)); // v of the bidiagonalization
+	if (!x || !u || !w || !z) matutilerror("MAT_solve_lsqr: failure to allocate workspace");
+
+	double alpha, beta, temp;
+	for (int i = 0; i < rows; i++) u[i] = v->vec[i];
+	beta = MAT_norm(u, rows);
+	double bnorm = beta;
+	if (beta > 0) for (int i = 0; i < rows; i++) u[i] /= beta;
+	for (int j = 0; j < cols; j++) {
+		temp = 0;
+		for (int p = m->colptr[j]; p < m->colptr[j + 1]; p++) temp += m->val[p] * u[m->rowidx[p]];
+		z[j] = temp;
+	}
+	alpha = MAT_norm(z, cols);
+	if (alpha > 0) for (int j = 0; j < cols; j++) z[j] /= alpha;
+	for (int j = 0; j < cols; j++) w[j] = z[j];
+
+	double phibar = beta, rhobar = alpha, rho, c = 1, s, theta, phi;
+	double anorm = 0, rnorm = beta, arnorm = alpha * beta, xnorm = 0;
+	int iter = 0, converged = arnorm == 0;
+	while (!converged && iter < maxiter) {
+		iter++;
+		// u = M z - alpha u
+		for (int i = 0; i < rows; i++) u[i] *= -alpha;
+		for (int j = 0; j < cols; j++) {
+			for (int p = m->colptr[j]; p < m->colptr[j + 1]; p++) u[m->rowidx[p]] += m->val[p] * z[j];
+		}
+		beta = MAT_norm(u, rows);
+		if (beta > 0) for (int i = 0; i < rows; i++) u[i] /= beta;
+		anorm = sqrt(anorm * anorm + alpha * alpha + beta * beta);
+		// z = M^T u - beta z
+		for (int j = 0; j < cols; j++) {
+			temp = -beta * z[j];
+			for (int p = m->colptr[j]; p < m->colptr[j + 1]; p++) temp += m->val[p] * u[m->rowidx[p]];
+			z[j] = temp;
+		}
+		alpha = MAT_norm(z, cols);
+		if (alpha > 0) for (int j = 0; j < cols; j++) z[j] /= alpha;
+
+		// Plane rotation eliminating beta from the lower bidiagonal
+		rho = sqrt(rhobar * rhobar + beta * beta);
+		c = rhobar / rho;
+		s = beta / rho;
+		theta = s * alpha;
+		rhobar = -c * alpha;
+		phi = c * phibar;
+		phibar = s * phibar;
+		for (int j = 0; j < cols; j++) {
+			x[j] += (phi / rho) * w[j];
+			w[j] = z[j] - (theta / rho) * w[j];
+		}
+
+		xnorm = MAT_norm(x, cols);
+		rnorm = phibar;
+		arnorm = phibar * alpha * fabs(c);
+		converged = rnorm <= tol * (anorm * xnorm + bnorm) || arnorm <= tol * anorm * rnorm;
+	}
+	if (!converged) {
+		fprintf(stderr, "Warning: MAT_solve_lsqr stopped after %d iterations, residual %g, normal residual %g\n",
+			iter, rnorm, arnorm);
+	}
+	if (rep) *rep = (lsq_report) {iter, converged, rnorm, arnorm, anorm, xnorm};
+
+	vector *res = MAT_vector(cols, MAT_NO);
+	for (int j = 0; j < cols; j++) res->vec[j] = (float) x[j];
+	free(x);
+	free(u);
+	free(w);
+	free(z);
+	return res;
+}
+
+// ---- Sparse LDL^T factorization ----
+// Split into a symbolic phase (ordering, elimination tree, column counts) that depends only on
+//    the sparsity pattern, and a numeric phase that fills in values. Callers whose pattern stays
+//    fixed keep the spsymbolic and call MAT_factor_ldl / MAT_refactor_ldl repeatedly.
+// Both triangles of the matrix are stored, as assembled; only the upper triangle is read.
+
+// Subgraphs at or below this size are not dissected further
+#define MAT_ND_LEAF 64
+
+static int MAT_bfs_levels(spmatrix *m, int root, int *mark, int tag, int *level, int *queue) {
+	// Breadth first search from root over vertices with mark == tag.
+	// Fills queue with the vertices reached (in level order) and level[] with their depth.
+	// Returns the number of vertices reached.
+	int head = 0, tail = 0, v, w;
+	queue[tail++] = root;
+	level[root] = 0;
+	mark[root] = -tag; // visited
+	while (head < tail) {
+		v = queue[head++];
+		for (int p = m->colptr[v]; p < m->colptr[v + 1]; p++) {
+			w = m->rowidx[p];
+			if (mark[w] != tag) continue;
+			mark[w] = -tag;
+			level[w] = level[v] + 1;
+			queue[tail++] = w;
+		}
+	}
+	for (int i = 0; i < tail; i++) mark[queue[i]] = tag;
+	return tail;
+}
+
+static int MAT_nd_split(spmatrix *m, int *verts, int count, double frac, int *mark, int *tagp, int *level,
+		int *queue, int *scratch, int *na, int *nb) {
+	// Splits verts in place into two halves followed by a separator, with about frac of the vertices
+	//    before the separator. Halves are never adjacent. Returns 0 if verts could not be split usefully.
+	int tag = ++(*tagp);
+	for (int i = 0; i < count; i++) mark[verts[i]] = tag;
+
+	// Pseudo-peripheral root: restart from a deepest vertex a couple of times
+	int root = verts[0];
+	int reached = 0, depth = -1, newdepth;
+	for (int pass = 0; pass < 3; pass++) {
+		reached = MAT_bfs_levels(m, root, mark, tag, level, queue);
+		newdepth = level[queue[reached - 1]];
+		if (newdepth <= depth) break;
+		depth = newdepth;
+		root = queue[reached - 1];
+	}
+	reached = MAT_bfs_levels(m, root, mark, tag, level, queue);
+	depth = level[queue[reached - 1]];
+
+	if (reached < count) {
+		// Disconnected: the component containing root first, then the rest, no separator
+		int a = 0, b = reached;
+		for (int i = 0; i < reached; i++) scratch[a++] = queue[i];
+		for (int i = 0; i < reached; i++) mark[queue[i]] = 0;
+		for (int i = 0; i < count; i++) {
+			if (mark[verts[i]] == tag) scratch[b++] = verts[i];
+		}
+		for (int i = 0; i < count; i++) {
+			verts[i] = scratch[i];
+			mark[verts[i]] = 0;
+		}
+		*na = reached;
+		*nb = count - reached;
+		return 1;
+	}
+	if (depth < 2) {
+		for (int i = 0; i < count; i++) mark[verts[i]] = 0;
+		return 0; // too densely connected to split usefully
+	}
+
+	// Separator: the level at which frac of the vertices have been seen
+	int sep_level = 1;
+	for (int i = 0; i < count; i++) {
+		if (i >= (int) (frac * count)) {
+			sep_level = level[queue[i]];
+			break;
+		}
+	}
+	if (sep_level < 1) sep_level = 1;
+	if (sep_level >= depth) sep_level = depth - 1;
+
+	// Separator vertices without a neighbour beyond the separator can join the near half
+	int v, w, far;
+	for (int i = 0; i < count; i++) {
+		v = queue[i];
+		if (level[v] != sep_level) continue;
+		far = 0;
+		for (int p = m->colptr[v]; p < m->colptr[v + 1] && !far; p++) {
+			w = m->rowidx[p];
+			if (mark[w] == tag && level[w] > sep_level) far = 1;
+		}
+		if (!far) level[v] = sep_level - 1;
+	}
+
+	*na = 0;
+	*nb = 0;
+	for (int i = 0; i < count; i++) {
+		v = queue[i];
+		if (level[v] < sep_level) (*na)++;
+		else if (level[v] > sep_level) (*nb)++;
+	}
+	int a = 0, b = *na, sp = *na + *nb;
+	for (int i = 0; i < count; i++) {
+		v = queue[i];
+		if (level[v] < sep_level) scratch[a++] = v;
+		else if (level[v] > sep_level) scratch[b++] = v;
+		else scratch[sp++] = v;
+	}
+	for (int i = 0; i < count; i++) {
+		verts[i] = scratch[i];
+		mark[verts[i]] = 0;
+	}
+	return 1;
+}
+
+static void MAT_nd_recurse(spmatrix *m, int *verts, int count, int *mark, int *tagp, int *level,
+		int *queue, int *scratch) {
+	// Orders verts in place: the two halves first, the separator last.
+	if (count <= MAT_ND_LEAF) return;
+	int na, nb;
+	if (!MAT_nd_split(m, verts, count, 0.5, mark, tagp, level, queue, scratch, &na, &nb)) return;
+	MAT_nd_recurse(m, verts, na, mark, tagp, level, queue, scratch);
+	MAT_nd_recurse(m, verts + na, nb, mark, tagp, level, queue, scratch);
+}
+
+void MAT_order_nd(spmatrix *m, int *perm) {
+	// Nested dissection ordering of the graph of symmetric m, with level-structure separators.
+	// perm[k] is the original index of the k-th vertex in the new order.
+	int n = m->cols;
+	if (m->rows != n) matutilerror("MAT_order_nd: input matrix is not square");
+	int *mark = (int *) calloc(n + 1, sizeof (int));
+	int *level = (int *) malloc((n + 1) * sizeof (int));
+	int *queue = (int *) malloc((n + 1) * sizeof (int));
+	int *scratch = (int *) malloc((n + 1) * sizeof (int));
+	if (!mark || !level || !queue || !scratch) matutilerror("MAT_order_nd: failure to allocate workspace");
+	for (int i = 0; i < n; i++) perm[i] = i;
+	int tag = 0;
+	MAT_nd_recurse(m, perm, n, mark, &tag, level, queue, scratch);
+	free(mark);
+	free(level);
+	free(queue);
+	free(scratch);
+}
+
+static unsigned long long MAT_pattern_hash(spmatrix *m) {
+	// FNV-1a over the column pointers and row indices
+	unsigned long long h = 14695981039346656037ULL;
+	for (int j = 0; j <= m->cols; j++) h = (h ^ (unsigned int) m->colptr[j]) * 1099511628211ULL;
+	for (int p = 0; p < m->nnz; p++) h = (h ^ (unsigned int) m->rowidx[p]) * 1099511628211ULL;
+	return h;
+}
+
+static int MAT_cmp_int(const void *a, const void *b) {
+	int ia = *(const int *) a;
+	int ib = *(const int *) b;
+	return (ia > ib) - (ia < ib);
+}
+
+// Whether a supernode of width w may store this many explicit zeros
+#define MAT_SN_RELAX(w, zeros, stored) ((zeros) == 0 || (w) <= 4 || ((w) <= 16 && (zeros) < 0.5 * (stored)) || ((w) <= 64 && (zeros) < 0.05 * (stored)))
+
+static void MAT_analyse_supernodes(spsymbolic *s, spmatrix *m) {
+	// Relaxed supernodes: column j joins the supernode of column j - 1 when it is that column's
+	//    parent and the explicit zeros the merge would store stay within MAT_SN_RELAX. Columns of a
+	//    parent chain share the structure of the last one below the block, so the merge is always valid.
+	int n = s->n;
+	int *col_super = (int *) malloc((n + 1) * sizeof (int));
+	s->super = (int *) malloc((n + 1) * sizeof (int));
+	if (!col_super || !s->super) matutilerror("MAT_analyse_supernodes: failure to allocate");
+
+	int ns = 0;
+	int c0 = 0;
+	double actual = 0; // true entries of L (diagonal included) in the current supernode
+	double w, r, stored, zeros;
+	for (int j = 0; j < n; j++) {
+		r = s->lcolptr[j + 1] - s->lcolptr[j];
+		if (j > 0 && s->parent[j - 1] == j) {
+			w = j - c0 + 1;
+			stored = w * (w + 1) / 2 + w * r;
+			zeros = stored - (actual + r + 1);
+			if (!MAT_SN_RELAX(w, zeros, stored)) {
+				s->super[ns++] = j;
+				c0 = j;
+				actual = 0;
+			}
+		}
+		else {
+			s->super[ns++] = j;
+			c0 = j;
+			actual = 0;
+		}
+		actual += r + 1;
+		col_super[j] = ns - 1;
+	}
+	s->super[ns] = n;
+	s->nsuper = ns;
+	s->super = (int *) realloc(s->super, (ns + 1) * sizeof (int));
+
+	s->sparent = (int *) malloc((ns + 1) * sizeof (int));
+	s->srowptr = (int *) malloc((ns + 1) * sizeof (int));
+	s->snptr = (long long *) malloc((ns + 1) * sizeof (long long));
+	if (!s->sparent || !s->srowptr || !s->snptr) matutilerror("MAT_analyse_supernodes: failure to allocate");
+	int last;
+	s->srowptr[0] = 0;
+	s->snptr[0] = 0;
+	for (int k = 0; k < ns; k++) {
+		last = s->super[k + 1] - 1;
+		s->sparent[k] = s->parent[last] == -1 ? -1 : col_super[s->parent[last]];
+		// The rows below the block are exactly the structure of the last column
+		s->srowptr[k + 1] = s->srowptr[k] + s->lcolptr[last + 1] - s->lcolptr[last];
+		w = s->super[k + 1] - s->super[k];
+		r = s->srowptr[k + 1] - s->srowptr[k];
+		s->snptr[k + 1] = s->snptr[k] + (long long) ((w + r) * w);
+	}
+
+	// Row structures: entries of A below the block, plus child structures below the block
+	int *head = (int *) malloc((ns + 1) * sizeof (int));
+	int *next = (int *) malloc((ns + 1) * sizeof (int));
+	int *mark = (int *) malloc((n + 1) * sizeof (int));
+	s->srowidx = (int *) malloc((s->srowptr[ns] + 1) * sizeof (int));
+	if (!head || !next || !mark || !s->srowidx) matutilerror("MAT_analyse_supernodes: failure to allocate");
+	for (int k = 0; k < ns; k++) head[k] = -1;
+	for (int k = ns - 1; k >= 0; k--) {
+		if (s->sparent[k] != -1) {
+			next[k] = head[s->sparent[k]];
+			head[s->sparent[k]] = k;
+		}
+	}
+	for (int i = 0; i < n; i++) mark[i] = -1;
+
+	int i, len, c1;
+	int *rows;
+	for (int k = 0; k < ns; k++) {
+		c0 = s->super[k];
+		c1 = s->super[k + 1];
+		rows = s->srowidx + s->srowptr[k];
+		len = 0;
+		for (int j = c0; j < c1; j++) {
+			int jj = s->perm[j];
+			for (int p = m->colptr[jj]; p < m->colptr[jj + 1]; p++) {
+				i = s->iperm[m->rowidx[p]];
+				if (i >= c1 && mark[i] != k) {
+					mark[i] = k;
+					rows[len++] = i;
+				}
+			}
+		}
+		for (int c = head[k]; c != -1; c = next[c]) {
+			for (int q = s->srowptr[c]; q < s->srowptr[c + 1]; q++) {
+				i = s->srowidx[q];
+				if (i >= c1 && mark[i] != k) {
+					mark[i] = k;
+					rows[len++] = i;
+				}
+			}
+		}
+		if (len != s->srowptr[k + 1] - s->srowptr[k]) {
+			matutilerror("MAT_analyse_supernodes: supernode structure disagrees with column counts");
+		}
+		qsort(rows, len, sizeof (int), MAT_cmp_int);
+	}
+
+	free(col_super);
+	free(head);
+	free(next);
+	free(mark);
+}
+
+spsymbolic* MAT_analyse_sym(spmatrix *m) {
+	// Ordering, elimination tree and column counts of L (as in Davis' LDL package)
+	int n = m->cols;
+	if (m->rows != n) matutilerror("MAT_analyse_sym: input matrix is not square");
+
+	spsymbolic *s = (spsymbolic *) malloc(sizeof (spsymbolic));
+	if (!s) matutilerror("MAT_analyse_sym: failure to allocate s");
+	s->n = n;
+	s->nnz = m->nnz;
+	s->pattern = MAT_pattern_hash(m);
+	s->perm = (int *) malloc((n + 1) * sizeof (int));
+	s->iperm = (int *) malloc((n + 1) * sizeof (int));
+	s->parent = (int *) malloc((n + 1) * sizeof (int));
+	s->lcolptr = (int *) malloc((n + 1) * sizeof (int));
+	int *lnz = (int *) malloc((n + 1) * sizeof (int));
+	int *flag = (int *) malloc((n + 1) * sizeof (int));
+	if (!s->perm || !s->iperm || !s->parent || !s->lcolptr || !lnz || !flag) {
+		matutilerror("MAT_analyse_sym: failure to allocate analysis");
+	}
+
+	MAT_order_nd(m, s->perm);
+	for (int k = 0; k < n; k++) s->iperm[s->perm[k]] = k;
+
+	int kk, i;
+	for (int k = 0; k < n; k++) {
+		s->parent[k] = -1;
+		flag[k] = k;
+		lnz[k] = 0;
+		kk = s->perm[k];
+		for (int p = m->colptr[kk]; p < m->colptr[kk + 1]; p++) {
+			i = s->iperm[m->rowidx[p]];
+			if (i >= k) continue;
+			// Walk up the tree from i until reaching a node already on row k's path
+			for (; flag[i] != k; i = s->parent[i]) {
+				if (s->parent[i] == -1) s->parent[i] = k;
+				lnz[i]++;
+				flag[i] = k;
+			}
+		}
+	}
+	s->lcolptr[0] = 0;
+	for (int k = 0; k < n; k++) s->lcolptr[k + 1] = s->lcolptr[k] + lnz[k];
+	s->lnz = s->lcolptr[n];
+
+	MAT_analyse_supernodes(s, m);
+
+	free(lnz);
+	free(flag);
+	return s;
+}
+
+int MAT_symbolic_matches(spsymbolic *s, spmatrix *m) {
+	// Nonzero if s was computed from a matrix with the same sparsity pattern as m
+	return s->n == m->cols && s->nnz == m->nnz && s->pattern == MAT_pattern_hash(m);
+}
+
+void MAT_freesymbolic(spsymbolic *s) {
+	free(s->perm);
+	free(s->iperm);
+	free(s->parent);
+	free(s->lcolptr);
+	free(s->super);
+	free(s->sparent);
+	free(s->srowptr);
+	free(s->srowidx);
+	free(s->snptr);
+	free(s);
+}
+
+static spfactor* MAT_alloc_ldl(spsymbolic *s) {
+	// Simplicial factor storage for the symbolic analysis s
+	spfactor *f = (spfactor *) malloc(sizeof (spfactor));
+	if (!f) matutilerror("MAT_factor_ldl: failure to allocate f");
+	f->sym = s;
+	f->snval = NULL;
+	f->lrowidx = (int *) malloc((s->lnz + 1) * sizeof (int));
+	f->lval = (double *) malloc((s->lnz + 1) * sizeof (double));
+	f->d = (double *) malloc((s->n + 1) * sizeof (double));
+	if (!f->lrowidx || !f->lval || !f->d) matutilerror("MAT_factor_ldl: failure to allocate factor");
+	return f;
+}
+
+spfactor* MAT_factor_ldl(spmatrix *m, spsymbolic *s) {
+	// Numeric factorization using a prior symbolic analysis. Exits if m is singular.
+	spfactor *f = MAT_alloc_ldl(s);
+	int k = MAT_refactor_ldl(f, m);
+	if (k != -1) {
+		fprintf(stderr, "Zero pivot at (permuted) column %d\n", k);
+		matutilerror("MAT_factor_ldl: factorization error (matrix singular)");
+	}
+	return f;
+}
+
+spfactor* MAT_try_factor_ldl(spmatrix *m, spsymbolic *s) {
+	// As MAT_factor_ldl, but returns NULL if m is singular (as MAT_factor_chol_sn does if m is not
+	//    positive definite)
+	spfactor *f = MAT_alloc_ldl(s);
+	if (MAT_refactor_ldl(f, m) != -1) {
+		MAT_freeldl(f);
+		return NULL;
+	}
+	return f;
+}
+
+int MAT_refactor_ldl(spfactor *f, spmatrix *m) {
+	// Up-looking numeric LDL^T into the storage of an existing factor. The pattern of m must
+	//    match the factor's symbolic analysis. Returns -1 on success, or the (permuted) column
+	//    at which a zero pivot was found.
+	spsymbolic *s = f->sym;
+	int n = s->n;
+	if (!MAT_symbolic_matches(s, m)) matutilerror("MAT_refactor_ldl: matrix pattern does not match analysis");
+
+	double *y = (double *) calloc(n + 1, sizeof (double));
+	int *pattern = (int *) malloc((n + 1) * sizeof (int));
+	int *flag = (int *) malloc((n + 1) * sizeof (int));
+	int *lnz = (int *) malloc((n + 1) * sizeof (int));
+	if (!y || !pattern || !flag || !lnz) matutilerror("MAT_refactor_ldl: failure to allocate workspace");
+
+	// Scale for the singularity test
+	double amax = 0;
+	for (int p = 0; p < m->nnz; p++) {
+		if (fabs(m->val[p]) > amax) amax = fabs(m->val[p]);
+	}
+
+	int kk, i, top, len, p2, bad = -1;
+	double yi, l_ki;
+	for (int k = 0; k < n && bad == -1; k++) {
+		// Nonzero pattern of row k of L from the elimination tree, scatter A(:, k) into y
+		top = n;
+		flag[k] = k;
+		lnz[k] = 0;
+		kk = s->perm[k];
+		for (int p = m->colptr[kk]; p < m->colptr[kk + 1]; p++) {
+			i = s->iperm[m->rowidx[p]];
+			if (i > k) continue;
+			y[i] += m->val[p];
+			for (len = 0; flag[i] != k; i = s->parent[i]) {
+				pattern[len++] = i;
+				flag[i] = k;
+			}
+			while (len > 0) pattern[--top] = pattern[--len];
+		}
+
+		// Sparse triangular solve for row k, then the diagonal entry
+		f->d[k] = y[k];
+		y[k] = 0;
+		for (; top < n; top++) {
+			i = pattern[top];
+			yi = y[i];
+			y[i] = 0;
+			p2 = s->lcolptr[i] + lnz[i];
+			for (int p = s->lcolptr[i]; p < p2; p++) {
+				y[f->lrowidx[p]] -= f->lval[p] * yi;
+			}
+			l_ki = yi / f->d[i];
+			f->d[k] -= l_ki * yi;
+			f->lrowidx[p2] = k;
+			f->lval[p2] = l_ki;
+			lnz[i]++;
+		}
+		if (fabs(f->d[k]) <= 1e-12 * amax) bad = k;
+	}
+
+	free(y);
+	free(pattern);
+	free(flag);
+	free(lnz);
+	return bad;
+}
+
+// ---- Supernodal (multifrontal) Cholesky ----
+// Each supernode gets a dense frontal matrix over its columns and the rows below them. The front
+//    is assembled from A and the update matrices of its children, partially factored with the
+//    dense kernels (potrf on the diagonal block, trsm below it, syrk for the update passed to the
+//    parent), and its first columns are kept as the supernode's block of L.
+// Independent subtrees of the supernodal elimination tree are factored as parallel tasks.
+
+// Subtrees with less estimated work than this (in flops) are not split into further tasks
+#define MAT_SN_TASK_WORK 2e6
+
+typedef struct MAT_sn_work MAT_sn_work;
+struct MAT_sn_work {
+	spmatrix *m;
+	spfactor *f;
+	double **update; // update matrix left by each supernode for its parent
+	int *head; // child lists of the supernodal tree
+	int *next;
+	double *subtree_work;
+	int **relmap; // per thread map from permuted index to front row
+	double tol; // pivots at or below this are treated as singular
+	int failed;
+};
+
+static void MAT_sn_front(MAT_sn_work *wk, int k) {
+	spsymbolic *s = wk->f->sym;
+	spmatrix *m = wk->m;
+	int tid = 0;
+#ifdef _OPENMP
+	tid = omp_get_thread_num();
+#endif
+	int *relmap = wk->relmap[tid];
+	int c0 = s->super[k];
+	int w = s->super[k + 1] - c0;
+	int r = s->srowptr[k + 1] - s->srowptr[k];
+	int *rows = s->srowidx + s->srowptr[k];
+	int fm = w + r;
+
+	// The first w columns of the front are this supernode's block of L, stored in place
+	double *l = wk->f->snval + s->snptr[k];
+	double *upd = r ? (double *) calloc((long long) r * r, sizeof (double)) : NULL;
+	if (r && !upd) matutilerror("MAT_factor_chol_sn: failure to allocate update matrix");
+	for (long long q = 0; q < (long long) fm * w; q++) l[q] = 0;
+
+	for (int t = 0; t < w; t++) relmap[c0 + t] = t;
+	for (int q = 0; q < r; q++) relmap[rows[q]] = w + q;
+
+	// Assemble the lower triangle of A's columns
+	int jj, i;
+	for (int j = 0; j < w; j++) {
+		jj = s->perm[c0 + j];
+		for (int p = m->colptr[jj]; p < m->colptr[jj + 1]; p++) {
+			i = s->iperm[m->rowidx[p]];
+			if (i >= c0 + j) l[relmap[i] + (long long) j * fm] += m->val[p];
+		}
+	}
+
+	// Extend-add the children's update matrices
+	int cr, a_row, b_col;
+	int *crows;
+	double *cu;
+	for (int c = wk->head[k]; c != -1; c = wk->next[c]) {
+		cr = s->srowptr[c + 1] - s->srowptr[c];
+		crows = s->srowidx + s->srowptr[c];
+		cu = wk->update[c];
+		if (!cu) {
+			// A child failed to factor; nothing above it can succeed
+			free(upd);
+			return;
+		}
+		for (int b = 0; b < cr; b++) {
+			b_col = relmap[crows[b]];
+			for (int a = b; a < cr; a++) {
+				a_row = relmap[crows[a]];
+				if (b_col < w) l[a_row + (long long) b_col * fm] += cu[a + (long long) b * cr];
+				else upd[(a_row - w) + (long long) (b_col - w) * r] += cu[a + (long long) b * cr];
+			}
+		}
+		free(cu);
+		wk->update[c] = NULL;
+	}
+
+	// Partial factorization
+	int bad = MAT_kernel_potrf(l, w, fm) != -1;
+	for (int j = 0; j < w && !bad; j++) bad = l[j + (long long) j * fm] * l[j + (long long) j * fm] <= wk->tol;
+	if (bad) {
+		wk->failed = 1;
+		free(upd);
+		return;
+	}
+	if (r) {
+		MAT_kernel_trsm(l, w, fm, l + w, r, fm);
+		MAT_kernel_syrk(l + w, r, w, fm, upd, r);
+	}
+	wk->update[k] = upd;
+}
+
+static void MAT_sn_subtree(MAT_sn_work *wk, int k) {
+	for (int c = wk->head[k]; c != -1; c = wk->next[c]) {
+		if (wk->subtree_work[c] > MAT_SN_TASK_WORK) {
+			#pragma omp task firstprivate(c)
+			MAT_sn_subtree(wk, c);
+		}
+		else MAT_sn_subtree(wk, c);
+	}
+	#pragma omp taskwait
+	MAT_sn_front(wk, k);
+}
+
+spfactor* MAT_factor_chol_sn(spmatrix *m, spsymbolic *s) {
+	// Supernodal Cholesky of symmetric positive definite m using a prior symbolic analysis.
+	// Returns NULL if m is not positive definite.
+	if (!MAT_symbolic_matches(s, m)) matutilerror("MAT_factor_chol_sn: matrix pattern does not match analysis");
+	int ns = s->nsuper;
+
+	spfactor *f = (spfactor *) malloc(sizeof (spfactor));
+	if (!f) matutilerror("MAT_factor_chol_sn: failure to allocate f");
+	f->sym = s;
+	f->lrowidx = NULL;
+	f->lval = NULL;
+	f->d = NULL;
+	f->snval = (double *) malloc((s->snptr[ns] + 1) * sizeof (double));
+	if (!f->snval) matutilerror("MAT_factor_chol_sn: failure to allocate factor");
+
+	MAT_sn_work wk;
+	wk.m = m;
+	wk.f = f;
+	wk.failed = 0;
+	wk.tol = 0;
+	for (int p = 0; p < m->nnz; p++) {
+		if (fabs(m->val[p]) > wk.tol) wk.tol = fabs(m->val[p]);
+	}
+	wk.tol *= 1e-12;
+	wk.update = (double **) calloc(ns + 1, sizeof (double *));
+	wk.head = (int *) malloc((ns + 1) * sizeof (int));
+	wk.next = (int *) malloc((ns + 1) * sizeof (int));
+	wk.subtree_work = (double *) malloc((ns + 1) * sizeof (double));
+	if (!wk.update || !wk.head || !wk.next || !wk.subtree_work) matutilerror("MAT_factor_chol_sn: failure to allocate workspace");
+
+	for (int k = 0; k < ns; k++) wk.head[k] = -1;
+	for (int k = ns - 1; k >= 0; k--) {
+		if (s->sparent[k] != -1) {
+			wk.next[k] = wk.head[s->sparent[k]];
+			wk.head[s->sparent[k]] = k;
+		}
+	}
+	// Children precede parents, so one forward pass accumulates subtree work
+	double w, r;
+	for (int k = 0; k < ns; k++) {
+		w = s->super[k + 1] - s->super[k];
+		r = s->srowptr[k + 1] - s->srowptr[k];
+		wk.subtree_work[k] = w * (w + r) * (w + r);
+	}
+	for (int k = 0; k < ns; k++) {
+		if (s->sparent[k] != -1) wk.subtree_work[s->sparent[k]] += wk.subtree_work[k];
+	}
+
+	int threads = 1;
+#ifdef _OPENMP
+	threads = omp_get_max_threads();
+#endif
+	wk.relmap = (int **) malloc(threads * sizeof (int *));
+	if (!wk.relmap) matutilerror("MAT_factor_chol_sn: failure to allocate workspace");
+	for (int t = 0; t < threads; t++) {
+		wk.relmap[t] = (int *) malloc((s->n + 1) * sizeof (int));
+		if (!wk.relmap[t]) matutilerror("MAT_factor_chol_sn: failure to allocate workspace");
+	}
+
+	#pragma omp parallel num_threads(threads)
+	{
+		#pragma omp single
+		{
+			for (int k = 0; k < ns; k++) {
+				if (s->sparent[k] != -1) continue;
+				#pragma omp task firstprivate(k)
+				MAT_sn_subtree(&wk, k);
+			}
+			#pragma omp taskwait
+		}
+	}
+
+	for (int k = 0; k < ns; k++) free(wk.update[k]);
+	for (int t = 0; t < threads; t++) free(wk.relmap[t]);
+	free(wk.relmap);
+	free(wk.update);
+	free(wk.head);
+	free(wk.next);
+	free(wk.subtree_work);
+
+	if (wk.failed) {
+		MAT_freeldl(f);
+		return NULL;
+	}
+	return f;
+}
+
+static void MAT_solve_chol_sn(spfactor *f, double *x) {
+	// In-place solve of L . transpose(L) . x = b on the permuted right hand side
+	spsymbolic *s = f->sym;
+	int c0, w, r, fm;
+	int *rows;
+	double *l, temp;
+	for (int k = 0; k < s->nsuper; k++) {
+		c0 = s->super[k];
+		w = s->super[k + 1] - c0;
+		r = s->srowptr[k + 1] - s->srowptr[k];
+		fm = w + r;
+		rows = s->srowidx + s->srowptr[k];
+		l = f->snval + s->snptr[k];
+		for (int j = 0; j < w; j++) {
+			x[c0 + j] /= l[j + (long long) j * fm];
+			temp = x[c0 + j];
+			for (int i = j + 1; i < w; i++) x[c0 + i] -= l[i + (long long) j * fm] * temp;
+			for (int q = 0; q < r; q++) x[rows[q]] -= l[w + q + (long long) j * fm] * temp;
+		}
+	}
+	for (int k = s->nsuper - 1; k >= 0; k--) {
+		c0 = s->super[k];
+		w = s->super[k + 1] - c0;
+		r = s->srowptr[k + 1] - s->srowptr[k];
+		fm = w + r;
+		rows = s->srowidx + s->srowptr[k];
+		l = f->snval + s->snptr[k];
+		for (int j = w - 1; j >= 0; j--) {
+			temp = x[c0 + j];
+			for (int q = 0; q < r; q++) temp -= l[w + q + (long long) j * fm] * x[rows[q]];
+			for (int i = j + 1; i < w; i++) temp -= l[i + (long long) j * fm] * x[c0 + i];
+			x[c0 + j] = temp / l[j + (long long) j * fm];
+		}
+	}
+}
+
+static void MAT_solve_factor_perm(spfactor *f, double *x) {
+	// In-place solve on a right hand side already in the factor's (permuted) order
+	spsymbolic *s = f->sym;
+	int n = s->n;
+	if (f->snval) {
+		MAT_solve_chol_sn(f, x);
+		return;
+	}
+	for (int j = 0; j < n; j++) {
+		for (int p = s->lcolptr[j]; p < s->lcolptr[j + 1]; p++) x[f->lrowidx[p]] -= f->lval[p] * x[j];
+	}
+	for (int j = 0; j < n; j++) x[j] /= f->d[j];
+	for (int j = n - 1; j >= 0; j--) {
+		for (int p = s->lcolptr[j]; p < s->lcolptr[j + 1]; p++) x[j] -= f->lval[p] * x[f->lrowidx[p]];
+	}
+}
+
+vector* MAT_solve_ldl(spfactor *f, vector *v) {
+	// Solves A . x = b with either kind of factor
+	spsymbolic *s = f->sym;
+	int n = s->n;
+	if (v->rows != n) {
+		fprintf(stderr, "Factor size %d Vector row count %d\n", n, v->rows);
+		matutilerror("MAT_solve_ldl: input vector / factor sizes misaligned");
+	}
+
+	double *x = (double *) malloc((n + 1) * sizeof (double));
+	if (!x) matutilerror("MAT_solve_ldl: failure to allocate x");
+	for (int k = 0; k < n; k++) x[k] = v->vec[s->perm[k]];
+
+	MAT_solve_factor_perm(f, x);
+
+	vector *res = MAT_vector(n, MAT_NO);
+	for (int k = 0; k < n; k++) res->vec[s->perm[k]] = (float) x[k];
+	free(x);
+	return res;
+}
+
+void MAT_solve_ldl_array(spfactor *f, double *x, double *work) {
+	// In-place double precision solve of A . x = b (x holds b on entry), with work of length n
+	spsymbolic *s = f->sym;
+	for (int k = 0; k < s->n; k++) work[k] = x[s->perm[k]];
+	MAT_solve_factor_perm(f, work);
+	for (int k = 0; k < s->n; k++) x[s->perm[k]] = work[k];
+}
+
+void MAT_freeldl(spfactor *f) {
+	free(f->lrowidx);
+	free(f->lval);
+	free(f->d);
+	free(f->snval);
+	free(f);
+}
+
+// ---- Complex symmetric LDL^T ----
+// Shifted systems such as K - omega^2 M + i omega C are complex symmetric (A^T = A, not
+//    Hermitian), so the up-looking LDL^T carries over with complex arithmetic and no conjugates.
+//    Real and imaginary parts share the real matrix's pattern and so its symbolic analysis: a
+//    sweep over many shifts analyses once and only refactors. There is no pivoting, as in the real
+//    LDL^T; damping keeps the pivots off zero.
+
+spzfactor* MAT_factor_ldl_z(spmatrix *m, double *mi, spsymbolic *s) {
+	// Numeric factorization of m + i mi (mi on the pattern of m) using a prior symbolic analysis.
+	//    Exits if the matrix is singular.
+	spzfactor *f = (spzfactor *) malloc(sizeof (spzfactor));
+	if (!f) matutilerror("MAT_factor_ldl_z: failure to allocate f");
+	f->sym = s;
+	f->lrowidx = (int *) malloc((s->lnz + 1) * sizeof (int));
+	f->lval = (double *) malloc((s->lnz + 1) * sizeof (double));
+	f->lvali = (double *) malloc((s->lnz + 1) * sizeof (double));
+	f->d = (double *) malloc((s->n + 1) * sizeof (double));
+	f->di = (double *) malloc((s->n + 1) * sizeof (double));
+	if (!f->lrowidx || !f->lval || !f->lvali || !f->d || !f->di) {
+		matutilerror("MAT_factor_ldl_z: failure to allocate factor");
+	}
+
+	int k = MAT_refactor_ldl_z(f, m, mi);
+	if (k != -1) {
+		fprintf(stderr, "Zero pivot at (permuted) column %d\n", k);
+		matutilerror("MAT_factor_ldl_z: factorization error (matrix singular)");
+	}
+	return f;
+}
+
+int MAT_refactor_ldl_z(spzfactor *f, spmatrix *m, double *mi) {
+	// Up-looking numeric LDL^T of m + i mi into the storage of an existing factor, as
+	//    MAT_refactor_ldl. Returns -1 on success, or the (permuted) column of a zero pivot.
+	spsymbolic *s = f->sym;
+	int n = s->n;
+	if (!MAT_symbolic_matches(s, m)) matutilerror("MAT_refactor_ldl_z: matrix pattern does not match analysis");
+
+	double *y = (double *) calloc(n + 1, sizeof (double));
+	double *yi = (double *) calloc(n + 1, sizeof (double));
+	int *pattern = (int *) malloc((n + 1) * sizeof (int));
+	int *flag = (int *) malloc((n + 1) * sizeof (int));
+	int *lnz = (int *) malloc((n + 1) * sizeof (int));
+	if (!y || !yi || !pattern || !flag || !lnz) matutilerror("MAT_refactor_ldl_z: failure to allocate workspace");
+
+	double amax = 0;
+	for (int p = 0; p < m->nnz; p++) {
+		if (hypot(m->val[p], mi[p]) > amax) amax = hypot(m->val[p], mi[p]);
+	}
+
+	int kk, i, top, len, p2, bad = -1;
+	double ar, ai, lr, li, dd;
+	for (int k = 0; k < n && bad == -1; k++) {
+		top = n;
+		flag[k] = k;
+		lnz[k] = 0;
+		kk = s->perm[k];
+		for (int p = m->colptr[kk]; p < m->colptr[kk + 1]; p++) {
+			i = s->iperm[m->rowidx[p]];
+			if (i > k) continue;
+			y[i] += m->val[p];
+			yi[i] += mi[p];
+			for (len = 0; flag[i] != k; i = s->parent[i]) {
+				pattern[len++] = i;
+				flag[i] = k;
+			}
+			while (len > 0) pattern[--top] = pattern[--len];
+		}
+
+		f->d[k] = y[k];
+		f->di[k] = yi[k];
+		y[k] = yi[k] = 0;
+		for (; top < n; top++) {
+			i = pattern[top];
+			ar = y[i];
+			ai = yi[i];
+			y[i] = yi[i] = 0;
+			p2 = s->lcolptr[i] + lnz[i];
+			for (int p = s->lcolptr[i]; p < p2; p++) {
+				y[f->lrowidx[p]] -= f->lval[p] * ar - f->lvali[p] * ai;
+				yi[f->lrowidx[p]] -= f->lval[p] * ai + f->lvali[p] * ar;
+			}
+			// l_ki = a / d_i, and d_k -= l_ki a
+			dd = f->d[i] * f->d[i] + f->di[i] * f->di[i];
+			lr = (ar * f->d[i] + ai * f->di[i]) / dd;
+			li = (ai * f->d[i] - ar * f->di[i]) / dd;
+			f->d[k] -= lr * ar - li * ai;
+			f->di[k] -= lr * ai + li * ar;
+			f->lrowidx[p2] = k;
+			f->lval[p2] = lr;
+			f->lvali[p2] = li;
+			lnz[i]++;
+		}
+		if (hypot(f->d[k], f->di[k]) <= 1e-12 * amax) bad = k;
+	}
+
+	free(y);
+	free(yi);
+	free(pattern);
+	free(flag);
+	free(lnz);
+	return bad;
+}
+
+void MAT_solve_ldl_z(spzfactor *f, double *x, double *xi, double *work) {
+	// In-place solve of A . x = b for complex b = x + i xi, with work of length 2 n
+	spsymbolic *s = f->sym;
+	int n = s->n, r;
+	double *wr = work, *wi = work + n, dd, ar, ai;
+	for (int k = 0; k < n; k++) {
+		wr[k] = x[s->perm[k]];
+		wi[k] = xi[s->perm[k]];
+	}
+	for (int j = 0; j < n; j++) {
+		for (int p = s->lcolptr[j]; p < s->lcolptr[j + 1]; p++) {
+			r = f->lrowidx[p];
+			wr[r] -= f->lval[p] * wr[j] - f->lvali[p] * wi[j];
+			wi[r] -= f->lval[p] * wi[j] + f->lvali[p] * wr[j];
+		}
+	}
+	for (int j = 0; j < n; j++) {
+		dd = f->d[j] * f->d[j] + f->di[j] * f->di[j];
+		ar = wr[j];
+		ai = wi[j];
+		wr[j] = (ar * f->d[j] + ai * f->di[j]) / dd;
+		wi[j] = (ai * f->d[j] - ar * f->di[j]) / dd;
+	}
+	for (int j = n - 1; j >= 0; j--) {
+		for (int p = s->lcolptr[j]; p < s->lcolptr[j + 1]; p++) {
+			r = f->lrowidx[p];
+			wr[j] -= f->lval[p] * wr[r] - f->lvali[p] * wi[r];
+			wi[j] -= f->lval[p] * wi[r] + f->lvali[p] * wr[r];
+		}
+	}
+	for (int k = 0; k < n; k++) {
+		x[s->perm[k]] = wr[k];
+		xi[s->perm[k]] = wi[k];
+	}
+}
+
+void MAT_freeldl_z(spzfactor *f) {
+	free(f->lrowidx);
+	free(f->lval);
+	free(f->lvali);
+	free(f->d);
+	free(f->di);
+	free(f);
+}
+
+// ---- Sparse eigenvalues ----
+// Lanczos for generalized symmetric problems, on an operator OP = F^-1 P with one factored matrix
+//    F. For K x = lambda M x (M positive definite) it is shift-invert: F = K - sigma M is factored
+//    once and OP = (K - sigma M)^-1 M, which is self-adjoint in the M inner product and has
+//    eigenvalues theta = 1 / (lambda - sigma), so the eigenvalues nearest sigma come out first and
+//    fastest. Buckling, (K + lambda G) x = 0, runs on OP = K^-1 (-G) with the elastic factor of K.
+//    The Lanczos vectors are kept and fully reorthogonalized (classical Gram-Schmidt, twice), and
+//    the eigenpairs of the small tridiagonal matrix are found by implicit QL. Nothing denser than
+//    the factor is ever formed.
+
+static void MAT_tridiag_eig(double *d, double *e, double *z, int n) {
+	// Eigenvalues (into d) and eigenvectors (columns of z, n x n column major, which must hold the
+	//    identity on entry) of the symmetric tridiagonal matrix with diagonal d and off-diagonal
+	//    e[0] ... e[n - 2], by implicit QL with Wilkinson shifts. e is destroyed.
+	double f, g, p, r, s, c, b, dd;
+	int m, i, iter;
+	e[n - 1] = 0;
+	for (int l = 0; l < n; l++) {
+		iter = 0;
+		do {
+			for (m = l; m < n - 1; m++) {
+				dd = fabs(d[m]) + fabs(d[m + 1]);
+				if (fabs(e[m]) <= 1e-16 * dd) break;
+			}
+			if (m == l) break;
+			if (iter++ == 60) matutilerror("MAT_tridiag_eig: QL iteration does not converge");
+			g = (d[l + 1] - d[l]) / (2 * e[l]);
+			r = hypot(g, 1);
+			g = d[m] - d[l] + e[l] / (g + copysign(r, g));
+			s = c = 1;
+			p = 0;
+			for (i = m - 1; i >= l; i--) {
+				f = s * e[i];
+				b = c * e[i];
+				r = hypot(f, g);
+				e[i + 1] = r;
+				if (r == 0) {
+					// Underflow: the matrix has split, start over on the smaller block
+					d[i + 1] -= p;
+					e[m] = 0;
+					break;
+				}
+				s = f / r;
+				c = g / r;
+				g = d[i + 1] - p;
+				r = (d[i] - g) * s + 2 * c * b;
+				p = s * r;
+				d[i + 1] = g + p;
+				g = c * r - b;
+				for (int k = 0; k < n; k++) {
+					f = z[(i + 1) * n + k];
+					z[(i + 1) * n + k] = s * z[i * n + k] + c * f;
+					z[i * n + k] = c * z[i * n + k] - s * f;
+				}
+			}
+			if (r == 0 && i >= l) continue;
+			d[l] -= p;
+			e[l] = g;
+			e[m] = 0;
+		} while (1);
+	}
+}
+
+static void MAT_m_orthogonalize(double *q, int count, int n, double *w, double *mw, double *c, spmatrix *m) {
+	// w -= Q Q^T M w over the first count Lanczos vectors (M-orthonormal), leaving M w in mw
+	MAT_spmv_sym(m, w, mw);
+	#pragma omp parallel for schedule(static)
+	for (int i = 0; i < count; i++) {
+		double t = 0;
+		for (int r = 0; r < n; r++) t += q[(long long) i * n + r] * mw[r];
+		c[i] = t;
+	}
+	#pragma omp parallel for schedule(static)
+	for (int r = 0; r < n; r++) {
+		double t = w[r];
+		for (int i = 0; i < count; i++) t -= c[i] * q[(long long) i * n + r];
+		w[r] = t;
+	}
+	MAT_spmv_sym(m, w, mw);
+}
+
+static eigen* MAT_lanczos(spfactor *lf, spmatrix *p, double pscale, spmatrix *b, double sigma, int nev,
+		float tol, int maxdim, int positive) {
+	// Lanczos on OP = F^-1 (pscale P), with F factored as lf, which must be self-adjoint in the
+	//    inner product of the positive definite B. Ritz values theta map to lambda = sigma + 1 / theta.
+	// Keeps the nev Ritz values of largest |theta|, or with positive set the nev largest positive
+	//    ones, and stops once their residuals are at most tol |theta|; the tridiagonal problem is
+	//    re-solved every few steps. Returns the pairs by increasing lambda, B-orthonormal.
+	int n = b->rows;
+	if (nev > n) nev = n;
+	if (maxdim > n) maxdim = n;
+	if (maxdim < nev) maxdim = nev;
+	double *q = (double *) malloc(((long long) maxdim * n + 1) * sizeof (double));
+	double *w = (double *) malloc((n + 1) * sizeof (double));
+	double *bw = (double *) malloc((n + 1) * sizeof (double));
+	double *work = (double *) malloc((n + 1) * sizeof (double));
+	double *alpha = (double *) malloc((maxdim + 1) * sizeof (double));
+	double *beta = (double *) malloc((maxdim + 1) * sizeof (double));
+	double *c = (double *) malloc((maxdim + 1) * sizeof (double));
+	double *d = (double *) malloc((maxdim + 1) * sizeof (double));
+	double *e = (double *) malloc((maxdim + 1) * sizeof (double));
+	double *z = (double *) malloc(((long long) maxdim * maxdim + 1) * sizeof (double));
+	int *pick = (int *) malloc((maxdim + 1) * sizeof (int));
+	if (!q || !w || !bw || !work || !alpha || !beta || !c || !d || !e || !z || !pick) {
+		matutilerror("MAT_lanczos: failure to allocate workspace");
+	}
+
+	// Start from OP applied to a fixed pseudo-random vector, which lies in the range of OP
+	unsigned long long seed = 0x9E3779B97F4A7C15ULL;
+	for (int r = 0; r < n; r++) {
+		seed ^= seed << 13;
+		seed ^= seed >> 7;
+		seed ^= seed << 17;
+		work[r] = (double) (seed >> 11) / 9007199254740992.0 - 0.5;
+	}
+	MAT_spmv_sym(p, work, w);
+	for (int r = 0; r < n; r++) w[r] *= pscale;
+	MAT_solve_ldl_array(lf, w, work);
+	MAT_spmv_sym(b, w, bw);
+	double s = 0, theta;
+	for (int r = 0; r < n; r++) s += w[r] * bw[r];
+	if (s <= 0) matutilerror("MAT_lanczos: operator has no range");
+	s = sqrt(s);
+	for (int r = 0; r < n; r++) q[r] = w[r] / s;
+
+	int j = 0, converged = 0, split = 0, want = 0, cand, cur, tmp;
+	double *qj;
+	while (j < maxdim) {
+		// w = OP q_j, then the three-term recurrence and full reorthogonalization
+		qj = q + (long long) j * n;
+		MAT_spmv_sym(p, qj, w);
+		for (int r = 0; r < n; r++) w[r] *= pscale;
+		MAT_solve_ldl_array(lf, w, work);
+		MAT_spmv_sym(b, qj, bw);
+		alpha[j] = 0;
+		for (int r = 0; r < n; r++) alpha[j] += w[r] * bw[r];
+		for (int r = 0; r < n; r++) {
+			w[r] -= alpha[j] * qj[r];
+			if (j) w[r] -= beta[j - 1] * qj[r - n];
+		}
+		MAT_m_orthogonalize(q, j + 1, n, w, bw, c, b);
+		MAT_m_orthogonalize(q, j + 1, n, w, bw, c, b);
+		s = 0;
+		for (int r = 0; r < n; r++) s += w[r] * bw[r];
+		beta[j] = sqrt(fmax(s, 0));
+		j++;
+		// An (almost) vanishing beta means the Krylov space is invariant: every eigenpair it holds is exact
+		split = beta[j - 1] <= 1e-12 * fabs(alpha[j - 1]) || j == n;
+
+		if (split || (j >= nev && (j == maxdim || j % 5 == 0))) {
+			for (int i = 0; i < j; i++) {
+				d[i] = alpha[i];
+				e[i] = beta[i];
+				for (int r = 0; r < j; r++) z[i * j + r] = i == r;
+			}
+			MAT_tridiag_eig(d, e, z, j);
+			// The wanted Ritz values, by selection
+			cand = 0;
+			for (int i = 0; i < j; i++) if (!positive || d[i] > 0) pick[cand++] = i;
+			want = cand < nev ? cand : nev;
+			for (int i = 0; i < want; i++) {
+				cur = i;
+				for (int r = i + 1; r < cand; r++) {
+					if (positive ? d[pick[r]] > d[pick[cur]] : fabs(d[pick[r]]) > fabs(d[pick[cur]])) cur = r;
+				}
+				tmp = pick[i];
+				pick[i] = pick[cur];
+				pick[cur] = tmp;
+			}
+			converged = 0;
+			for (int i = 0; i < want; i++) {
+				theta = d[pick[i]];
+				if (split || beta[j - 1] * fabs(z[pick[i] * j + j - 1]) <= tol * fabs(theta)) converged++;
+			}
+			if (converged == nev || split || j == maxdim) break;
+		}
+		if (split) break;
+		for (int r = 0; r < n; r++) q[(long long) j * n + r] = w[r] / beta[j - 1];
+	}
+	if (converged < want) {
+		fprintf(stderr, "Warning: MAT_lanczos converged %d of %d eigenpairs after %d steps\n", converged, want, j);
+	}
+
+	// Ritz vectors x = Q s, in increasing order of lambda = sigma + 1 / theta
+	eigen *res = (eigen *) malloc(sizeof (eigen));
+	if (!res) matutilerror("MAT_lanczos: failure to allocate result");
+	res->n = n;
+	res->count = want;
+	res->steps = j;
+	res->converged = converged;
+	res->values = (double *) malloc((want + 1) * sizeof (double));
+	res->vectors = (double *) malloc(((long long) want * n + 1) * sizeof (double));
+	if (!res->values || !res->vectors) matutilerror("MAT_lanczos: failure to allocate result");
+	for (int i = 0; i < want; i++) {
+		for (int r = i + 1; r < want; r++) {
+			if (sigma + 1 / d[pick[r]] < sigma + 1 / d[pick[i]]) {
+				tmp = pick[i];
+				pick[i] = pick[r];
+				pick[r] = tmp;
+			}
+		}
+		res->values[i] = sigma + 1 / d[pick[i]];
+	}
+	#pragma omp parallel for schedule(static)
+	for (int r = 0; r < n; r++) {
+		for (int i = 0; i < want; i++) {
+			double t = 0;
+			for (int l = 0; l < j; l++) t += q[(long long) l * n + r] * z[pick[i] * j + l];
+			res->vectors[(long long) i * n + r] = t;
+		}
+	}
+
+	free(q);
+	free(w);
+	free(bw);
+	free(work);
+	free(alpha);
+	free(beta);
+	free(c);
+	free(d);
+	free(e);
+	free(z);
+	free(pick);
+	return res;
+}
+
+eigen* MAT_eigs_sym(spmatrix *k, spmatrix *m, double sigma, int nev, float tol, int maxdim) {
+	// The nev eigenpairs of K x = lambda M x with lambda nearest sigma (both matrices symmetric,
+	//    both triangles stored, M positive definite), by shift-invert Lanczos with at most maxdim
+	//    steps: OP = (K - sigma M)^-1 M, self-adjoint in the M inner product. K - sigma M must be
+	//    nonsingular: sigma = 0 finds the lowest modes of a stable structure. Inside the spectrum
+	//    it is indefinite and factored by LDL^T without pivoting, so sigma should not sit right on
+	//    an eigenvalue.
+	int n = k->rows;
+	if (k->cols != n || m->rows != n || m->cols != n) matutilerror("MAT_eigs_sym: matrix sizes misaligned");
+	if (nev < 1) matutilerror("MAT_eigs_sym: no eigenpairs requested");
+
+	// Factor K - sigma M (supernodal while it is positive definite)
+	spmatrix *a = k;
+	if (sigma != 0) {
+		triplet *t = MAT_triplet(n, n, k->nnz + m->nnz);
+		for (int j = 0; j < n; j++) {
+			for (int p = k->colptr[j]; p < k->colptr[j + 1]; p++) MAT_triplet_add(t, k->rowidx[p], j, k->val[p]);
+			for (int p = m->colptr[j]; p < m->colptr[j + 1]; p++) MAT_triplet_add(t, m->rowidx[p], j, -sigma * m->val[p]);
+		}
+		a = MAT_compress(t);
+		MAT_freetriplet(t);
+	}
+	spsymbolic *sym = MAT_analyse_sym(a);
+	spfactor *lf = MAT_factor_chol_sn(a, sym);
+	if (!lf) lf = MAT_factor_ldl(a, sym);
+	if (a != k) MAT_freespmatrix(a);
+
+	eigen *res = MAT_lanczos(lf, m, 1, m, sigma, nev, tol, maxdim, 0);
+	MAT_freeldl(lf);
+	MAT_freesymbolic(sym);
+	return res;
+}
+
+eigen* MAT_eigs_buckling(spmatrix *k, spfactor *lf, spmatrix *g, int nev, float tol, int maxdim) {
+	// The nev smallest positive lambda with (K + lambda G) x = 0, for K positive definite and
+	//    already factored as lf (G symmetric, possibly indefinite or singular, as geometric
+	//    stiffness is). Lanczos on OP = K^-1 (-G), self-adjoint in the K inner product, whose
+	//    eigenvalues are 1 / lambda, with at most maxdim steps and no further factorization. Fewer
+	//    than nev pairs come back if there are fewer positive lambda (count may be 0).
+	int n = k->rows;
+	if (k->cols != n || g->rows != n || g->cols != n || lf->sym->n != n) {
+		matutilerror("MAT_eigs_buckling: matrix sizes misaligned");
+	}
+	if (nev < 1) matutilerror("MAT_eigs_buckling: no eigenpairs requested");
+	return MAT_lanczos(lf, g, -1, k, 0, nev, tol, maxdim, 1);
+}
+
+void MAT_freeeigen(eigen *e) {
+	free(e->values);
+	free(e->vectors);
+	free(e);
+}
+
+// ---- Domain decomposition ----
+// The graph of M is cut into parts by recursive bisection with the nested dissection separators;
+//    the separator vertices form the interface and the rest are part interiors, which never touch
+//    each other. Each interior block is factored on its own thread, and the interface unknowns are
+//    found by conjugate gradients on the Schur complement
+//    S = A_GG - sum_p A_Gp A_pp^-1 A_pG,
+//    which is applied part by part and never formed. Interior unknowns follow by back substitution.
+
+// Interiors at least this large use the supernodal factorization
+#define MAT_DD_SUPERNODAL_MIN 2000
+
+static void MAT_partition_recurse(spmatrix *m, int *verts, int count, int parts, int first, int *part,
+		int *mark, int *tagp, int *level, int *queue, int *scratch) {
+	int na, nb;
+	if (parts <= 1 || !MAT_nd_split(m, verts, count, (double) (parts / 2) / parts, mark, tagp, level, queue, scratch, &na, &nb)) {
+		for (int i = 0; i < count; i++) part[verts[i]] = first;
+		return;
+	}
+	for (int i = na + nb; i < count; i++) part[verts[i]] = -1;
+	MAT_partition_recurse(m, verts, na, parts / 2, first, part, mark, tagp, level, queue, scratch);
+	MAT_partition_recurse(m, verts + na, nb, parts - parts / 2, first + parts / 2, part, mark, tagp, level, queue, scratch);
+}
+
+void MAT_partition(spmatrix *m, int nparts, int *part) {
+	// Splits the graph of symmetric m into nparts interiors (part[v] = 0 ... nparts - 1) and an
+	//    interface (part[v] = -1) such that no two interiors are adjacent. Parts may come out empty.
+	int n = m->cols;
+	if (m->rows != n) matutilerror("MAT_partition: input matrix is not square");
+	int *verts = (int *) malloc((n + 1) * sizeof (int));
+	int *mark = (int *) calloc(n + 1, sizeof (int));
+	int *level = (int *) malloc((n + 1) * sizeof (int));
+	int *queue = (int *) malloc((n + 1) * sizeof (int));
+	int *scratch = (int *) malloc((n + 1) * sizeof (int));
+	if (!verts || !mark || !level || !queue || !scratch) matutilerror("MAT_partition: failure to allocate workspace");
+	for (int i = 0; i < n; i++) verts[i] = i;
+	int tag = 0;
+	if (n) MAT_partition_recurse(m, verts, n, nparts, 0, part, mark, &tag, level, queue, scratch);
+	free(verts);
+	free(mark);
+	free(level);
+	free(queue);
+	free(scratch);
+}
+
+typedef struct MAT_domain MAT_domain;
+struct MAT_domain {
+	int n; // interior size
+	int *verts; // original index of each interior vertex
+	spmatrix *a; // interior block
+	spsymbolic *sym;
+	spfactor *f;
+	int ng; // interface vertices coupled to this interior
+	int *gamma; // their interface indices
+	int *cptr; // coupling A_Gp by interior column: rows crow (positions in gamma), values cval
+	int *crow;
+	double *cval;
+	double *t; // workspace
+	double *u;
+	double *work;
+	double *z;
+};
+
+static void MAT_domain_schur(MAT_domain *d, double *xg) {
+	// d->z = A_Gp A_pp^-1 A_pG xg, over this domain's interface vertices
+	for (int j = 0; j < d->n; j++) {
+		d->t[j] = 0;
+		for (int p = d->cptr[j]; p < d->cptr[j + 1]; p++) d->t[j] += d->cval[p] * xg[d->gamma[d->crow[p]]];
+	}
+	MAT_solve_ldl_array(d->f, d->t, d->work);
+	for (int q = 0; q < d->ng; q++) d->z[q] = 0;
+	for (int j = 0; j < d->n; j++) {
+		for (int p = d->cptr[j]; p < d->cptr[j + 1]; p++) d->z[d->crow[p]] += d->cval[p] * d->t[j];
+	}
+}
+
+static void MAT_apply_schur(MAT_domain *dom, int nparts, spmatrix *agg, double *x, double *y) {
+	// y = S . x
+	MAT_spmv_sym(agg, x, y);
+	#pragma omp parallel for schedule(dynamic)
+	for (int p = 0; p < nparts; p++) {
+		if (dom[p].n) MAT_domain_schur(dom + p, x);
+	}
+	for (int p = 0; p < nparts; p++) {
+		for (int q = 0; q < dom[p].ng; q++) y[dom[p].gamma[q]] -= dom[p].z[q];
+	}
+}
+
+static void MAT_dd_precondition(spfactor *gf, double *r, double *z, double *work) {
+	// z = A_GG^-1 r
+	if (!gf) return;
+	for (int k = 0; k < gf->sym->n; k++) z[k] = r[k];
+	MAT_solve_ldl_array(gf, z, work);
+}
+
+vector* MAT_solve_dd(spmatrix *m, int nparts, vector *v, float tol, int maxiter) {
+	// Solves M . x = b for symmetric positive definite M by domain decomposition into nparts interiors.
+	// The interface system is solved by preconditioned CG to |r| <= tol |r0|.
+	int n = m->cols;
+	if (m->rows != n) matutilerror("MAT_solve_dd: input matrix is not square");
+	if (v->rows != n) {
+		fprintf(stderr, "Matrix column count %d Vector row count %d\n", m->cols, v->rows);
+		matutilerror("MAT_solve_dd: input vector / matrix sizes misaligned");
+	}
+	if (nparts < 1) nparts = 1;
+
+	int *part = (int *) malloc((n + 1) * sizeof (int));
+	int *local = (int *) malloc((n + 1) * sizeof (int)); // index within its interior or the interface
+	int *gmark = (int *) malloc((n + 1) * sizeof (int));
+	MAT_domain *dom = (MAT_domain *) calloc(nparts, sizeof (MAT_domain));
+	if (!part || !local || !gmark || !dom) matutilerror("MAT_solve_dd: failure to allocate workspace");
+	MAT_partition(m, nparts, part);
+
+	int ngamma = 0;
+	for (int i = 0; i < n; i++) {
+		if (part[i] == -1) local[i] = ngamma++;
+		else local[i] = dom[part[i]].n++;
+	}
+	int *gverts = (int *) malloc((ngamma + 1) * sizeof (int));
+	if (!gverts) matutilerror("MAT_solve_dd: failure to allocate workspace");
+	for (int p = 0; p < nparts; p++) {
+		dom[p].verts = (int *) malloc((dom[p].n + 1) * sizeof (int));
+		if (!dom[p].verts) matutilerror("MAT_solve_dd: failure to allocate domain");
+	}
+	for (int i = 0; i < n; i++) {
+		if (part[i] == -1) gverts[local[i]] = i;
+		else dom[part[i]].verts[local[i]] = i;
+	}
+
+	// Interface block A_GG
+	spmatrix *agg = (spmatrix *) malloc(sizeof (spmatrix));
+	if (!agg) matutilerror("MAT_solve_dd: failure to allocate interface block");
+	agg->rows = ngamma;
+	agg->cols = ngamma;
+	agg->colptr = (int *) malloc((ngamma + 1) * sizeof (int));
+	if (!agg->colptr) matutilerror("MAT_solve_dd: failure to allocate interface block");
+	agg->colptr[0] = 0;
+	for (int j = 0; j < ngamma; j++) {
+		agg->colptr[j + 1] = agg->colptr[j];
+		for (int p = m->colptr[gverts[j]]; p < m->colptr[gverts[j] + 1]; p++) {
+			if (part[m->rowidx[p]] == -1) agg->colptr[j + 1]++;
+		}
+	}
+	agg->nnz = agg->colptr[ngamma];
+	agg->rowidx = (int *) malloc((agg->nnz + 1) * sizeof (int));
+	agg->val = (double *) malloc((agg->nnz + 1) * sizeof (double));
+	if (!agg->rowidx || !agg->val) matutilerror("MAT_solve_dd: failure to allocate interface block");
+	int q = 0;
+	for (int j = 0; j < ngamma; j++) {
+		for (int p = m->colptr[gverts[j]]; p < m->colptr[gverts[j] + 1]; p++) {
+			if (part[m->rowidx[p]] != -1) continue;
+			agg->rowidx[q] = local[m->rowidx[p]];
+			agg->val[q++] = m->val[p];
+		}
+	}
+
+	// Interior blocks and their coupling to the interface
+	for (int i = 0; i < n; i++) gmark[i] = -1;
+	int r, v_idx;
+	MAT_domain *d;
+	for (int pi = 0; pi < nparts; pi++) {
+		d = dom + pi;
+		if (!d->n) continue;
+		d->a = (spmatrix *) malloc(sizeof (spmatrix));
+		d->cptr = (int *) malloc((d->n + 1) * sizeof (int));
+		if (!d->a || !d->cptr) matutilerror("MAT_solve_dd: failure to allocate domain");
+		d->a->rows = d->n;
+		d->a->cols = d->n;
+		d->a->colptr = (int *) malloc((d->n + 1) * sizeof (int));
+		if (!d->a->colptr) matutilerror("MAT_solve_dd: failure to allocate domain");
+		d->a->colptr[0] = 0;
+		d->cptr[0] = 0;
+		d->ng = 0;
+		for (int j = 0; j < d->n; j++) {
+			v_idx = d->verts[j];
+			d->a->colptr[j + 1] = d->a->colptr[j];
+			d->cptr[j + 1] = d->cptr[j];
+			for (int p = m->colptr[v_idx]; p < m->colptr[v_idx + 1]; p++) {
+				r = m->rowidx[p];
+				if (part[r] == pi) d->a->colptr[j + 1]++;
+				else if (part[r] == -1) {
+					d->cptr[j + 1]++;
+					if (gmark[r] != pi) {
+						gmark[r] = pi;
+						d->ng++;
+					}
+				}
+				else matutilerror("MAT_solve_dd: partition interiors are coupled");
+			}
+		}
+		d->a->nnz = d->a->colptr[d->n];
+		d->a->rowidx = (int *) malloc((d->a->nnz + 1) * sizeof (int));
+		d->a->val = (double *) malloc((d->a->nnz + 1) * sizeof (double));
+		d->crow = (int *) malloc((d->cptr[d->n] + 1) * sizeof (int));
+		d->cval = (double *) malloc((d->cptr[d->n] + 1) * sizeof (double));
+		d->gamma = (int *) malloc((d->ng + 1) * sizeof (int));
+		d->t = (double *) malloc((d->n + 1) * sizeof (double));
+		d->u = (double *) malloc((d->n + 1) * sizeof (double));
+		d->work = (double *) malloc((d->n + 1) * sizeof (double));
+		d->z = (double *) malloc((d->ng + 1) * sizeof (double));
+		if (!d->a->rowidx || !d->a->val || !d->crow || !d->cval || !d->gamma || !d->t || !d->u || !d->work || !d->z) {
+			matutilerror("MAT_solve_dd: failure to allocate domain");
+		}
+		// gmark now maps interface vertices to their position in gamma
+		int a_q = 0, c_q = 0, g_q = 0;
+		for (int j = 0; j < d->n; j++) {
+			v_idx = d->verts[j];
+			for (int p = m->colptr[v_idx]; p < m->colptr[v_idx + 1]; p++) {
+				r = m->rowidx[p];
+				if (part[r] == pi) {
+					d->a->rowidx[a_q] = local[r];
+					d->a->val[a_q++] = m->val[p];
+				}
+				else {
+					if (gmark[r] == pi) {
+						d->gamma[g_q] = local[r];
+						gmark[r] = -2 - g_q++;
+					}
+					d->crow[c_q] = -2 - gmark[r];
+					d->cval[c_q++] = m->val[p];
+				}
+			}
+		}
+		for (int k = 0; k < d->ng; k++) gmark[gverts[d->gamma[k]]] = -1;
+	}
+
+	// Factor the interiors in parallel
+	#pragma omp parallel for schedule(dynamic)
+	for (int pi = 0; pi < nparts; pi++) {
+		MAT_domain *dp = dom + pi;
+		if (!dp->n) continue;
+		dp->sym = MAT_analyse_sym(dp->a);
+		if (dp->n >= MAT_DD_SUPERNODAL_MIN) {
+			dp->f = MAT_factor_chol_sn(dp->a, dp->sym);
+			if (!dp->f) matutilerror("MAT_solve_dd: interior block is not positive definite");
+		}
+		else dp->f = MAT_factor_ldl(dp->a, dp->sym);
+	}
+
+	// Interface right hand side g = b_G - sum_p A_Gp A_pp^-1 b_p
+	double *x = (double *) malloc((n + 1) * sizeof (double));
+	double *g = (double *) malloc((ngamma + 1) * sizeof (double));
+	double *xg = (double *) calloc(ngamma + 1, sizeof (double));
+	double *res = (double *) malloc((ngamma + 1) * sizeof (double));
+	double *z = (double *) malloc((ngamma + 1) * sizeof (double));
+	double *pdir = (double *) malloc((ngamma + 1) * sizeof (double));
+	double *sp = (double *) malloc((ngamma + 1) * sizeof (double));
+	double *gwork = (double *) malloc((ngamma + 1) * sizeof (double));
+	if (!x || !g || !xg || !res || !z || !pdir || !sp || !gwork) matutilerror("MAT_solve_dd: failure to allocate workspace");
+	for (int j = 0; j < ngamma; j++) g[j] = v->vec[gverts[j]];
+	#pragma omp parallel for schedule(dynamic)
+	for (int pi = 0; pi < nparts; pi++) {
+		MAT_domain *dp = dom + pi;
+		if (!dp->n) continue;
+		for (int j = 0; j < dp->n; j++) dp->u[j] = v->vec[dp->verts[j]];
+		MAT_solve_ldl_array(dp->f, dp->u, dp->work);
+		for (int k = 0; k < dp->ng; k++) dp->z[k] = 0;
+		for (int j = 0; j < dp->n; j++) {
+			for (int p = dp->cptr[j]; p < dp->cptr[j + 1]; p++) dp->z[dp->crow[p]] += dp->cval[p] * dp->u[j];
+		}
+	}
+	for (int pi = 0; pi < nparts; pi++) {
+		for (int k = 0; k < dom[pi].ng; k++) g[dom[pi].gamma[k]] -= dom[pi].z[k];
+	}
+
+	// Preconditioned CG on S . xg = g. The preconditioner is A_GG itself, factored once: S differs
+	//    from it by the (smoother) interior corrections, and the interface is small.
+	spsymbolic *gsym = NULL;
+	spfactor *gf = NULL;
+	if (ngamma) {
+		gsym = MAT_analyse_sym(agg);
+		gf = MAT_factor_ldl(agg, gsym);
+	}
+	double gnorm = 0, rz = 0, rz_old, alpha, pq, rnorm;
+	for (int j = 0; j < ngamma; j++) {
+		res[j] = g[j];
+		gnorm += res[j] * res[j];
+	}
+	gnorm = sqrt(gnorm);
+	MAT_dd_precondition(gf, res, z, gwork);
+	for (int j = 0; j < ngamma; j++) {
+		pdir[j] = z[j];
+		rz += res[j] * z[j];
+	}
+	rnorm = gnorm;
+	int iter;
+	for (iter = 0; iter < maxiter && rnorm > tol * gnorm; iter++) {
+		MAT_apply_schur(dom, nparts, agg, pdir, sp);
+		pq = 0;
+		for (int j = 0; j < ngamma; j++) pq += pdir[j] * sp[j];
+		if (pq <= 0) matutilerror("MAT_solve_dd: matrix is not positive definite (singular or unstable system)");
+		alpha = rz / pq;
+		rnorm = 0;
+		for (int j = 0; j < ngamma; j++) {
+			xg[j] += alpha * pdir[j];
+			res[j] -= alpha * sp[j];
+			rnorm += res[j] * res[j];
+		}
+		rnorm = sqrt(rnorm);
+		rz_old = rz;
+		rz = 0;
+		MAT_dd_precondition(gf, res, z, gwork);
+		for (int j = 0; j < ngamma; j++) rz += res[j] * z[j];
+		for (int j = 0; j < ngamma; j++) pdir[j] = z[j] + (rz / rz_old) * pdir[j];
+	}
+	if (rnorm > tol * gnorm) {
+		fprintf(stderr, "Warning: MAT_solve_dd stopped after %d iterations, relative residual %g\n",
+			iter, rnorm / gnorm);
+	}
+
+	// Interiors: x_p = A_pp^-1 (b_p - A_pG xg)
+	for (int j = 0; j < ngamma; j++) x[gverts[j]] = xg[j];
+	#pragma omp parallel for schedule(dynamic)
+	for (int pi = 0; pi < nparts; pi++) {
+		MAT_domain *dp = dom + pi;
+		if (!dp->n) continue;
+		for (int j = 0; j < dp->n; j++) {
+			dp->u[j] = v->vec[dp->verts[j]];
+			for (int p = dp->cptr[j]; p < dp->cptr[j + 1]; p++) dp->u[j] -= dp->cval[p] * xg[dp->gamma[dp->crow[p]]];
+		}
+		MAT_solve_ldl_array(dp->f, dp->u, dp->work);
+		for (int j = 0; j < dp->n; j++) x[dp->verts[j]] = dp->u[j];
+	}
+
+	vector *result = MAT_vector(n, MAT_NO);
+	for (int i = 0; i < n; i++) result->vec[i] = (float) x[i];
+
+	for (int pi = 0; pi < nparts; pi++) {
+		d = dom + pi;
+		free(d->verts);
+		if (!d->n) continue;
+		MAT_freeldl(d->f);
+		MAT_freesymbolic(d->sym);
+		MAT_freespmatrix(d->a);
+		free(d->cptr);
+		free(d->crow);
+		free(d->cval);
+		free(d->gamma);
+		free(d->t);
+		free(d->u);
+		free(d->work);
+		free(d->z);
+	}
+	MAT_freespmatrix(agg);
+	free(dom);
+	free(part);
+	free(local);
+	free(gmark);
+	free(gverts);
+	free(x);
+	free(g);
+	free(xg);
+	free(res);
+	free(z);
+	free(pdir);
+	free(sp);
+	free(gwork);
+	if (gf) {
+		MAT_freeldl(gf);
+		MAT_freesymbolic(gsym);
+	}
+	return result;
+}
@@ -267,4 +267,440 @@ vector* MAT_solve_gausselim(matrix *m, vector *v) {
 	MAT_freevector(b);
 
 	return x;
+}
+
+lu_factor* MAT_factor_lu(matrix *m) {
+	// LU factorization with partial pivoting. The factors can be reused for any number of
+	//    right hand sides through MAT_solve_lu, which only costs a forward and back substitution.
+	int n = m->cols;
+	if (m->rows != n) matutilerror("MAT_factor_lu: input matrix is not square");
+
+	lu_factor *f = (lu_factor *) malloc(sizeof (lu_factor));
+	if (!f) matutilerror("MAT_factor_lu: failure to allocate factor");
+	f->n = n;
+	f->lu = MAT_matrix(n, n, MAT_NO);
+	f->perm = (int *) malloc(n * sizeof (int));
+	if (!f->perm) matutilerror("MAT_factor_lu: failure to allocate perm");
+
+	MAT_refactor_lu(f, m);
+	return f;
+}
+
+void MAT_refactor_lu(lu_factor *f, matrix *m) {
+	// Factors m into the storage of an existing factor of the same size (no allocation)
+	int n = f->n;
+	if (m->rows != n || m->cols != n) matutilerror("MAT_refactor_lu: matrix / factor sizes misaligned");
+	for (int i = 0; i < n; i++) {
+		f->perm[i] = i;
+		for (int j = 0; j < n; j++) f->lu->mat[i][j] = m->mat[i][j];
+	}
+
+	float **a = f->lu->mat;
+	int max_row, itemp;
+	float max_value, temp, scaling;
+	float *rtemp;
+
+	for (int col = 0; col < n; col++) {
+		max_row = -1;
+		max_value = 0;
+		for (int i = col; i < n; i++) {
+			temp = fabsf(a[i][col]);
+			if (temp > max_value) {
+				max_row = i;
+				max_value = temp;
+			}
+		}
+		if (max_row == -1) {
+			fprintf(stderr, "\nCurrent column %d\n", col);
+			matutilerror("MAT_refactor_lu: factorization error (matrix possibly singular)");
+		}
+
+		// Swap row pointers rather than row contents
+		rtemp = a[col];
+		a[col] = a[max_row];
+		a[max_row] = rtemp;
+		itemp = f->perm[col];
+		f->perm[col] = f->perm[max_row];
+		f->perm[max_row] = itemp;
+
+		// Store the multipliers in place of the eliminated entries
+		for (int row = col + 1; row < n; row++) {
+			scaling = a[row][col] / a[col][col];
+			a[row][col] = scaling;
+			if (scaling == 0) continue;
+			for (int i = col + 1; i < n; i++) {
+				a[row][i] -= scaling * a[col][i];
+			}
+		}
+	}
+}
+
+vector* MAT_solve_lu(lu_factor *f, vector *v) {
+	// Solves A . x = b given the factors of A
+	int n = f->n;
+	if (v->rows != n) {
+		fprintf(stderr, "Factor size %d Vector row count %d\n", n, v->rows);
+		matutilerror("MAT_solve_lu: input vector / factor sizes misaligned");
+	}
+
+	float **a = f->lu->mat;
+	vector *x = MAT_vector(n, MAT_NO);
+	float temp;
+
+	// Forward substitution through L (with the permutation applied to b)
+	for (int row = 0; row < n; row++) {
+		temp = v->vec[f->perm[row]];
+		for (int j = 0; j < row; j++) {
+			temp -= a[row][j] * x->vec[j];
+		}
+		x->vec[row] = temp;
+	}
+	// Backsubstitution through U
+	for (int row = n - 1; row >= 0; row--) {
+		temp = x->vec[row];
+		for (int j = row + 1; j < n; j++) {
+			temp -= a[row][j] * x->vec[j];
+		}
+		x->vec[row] = temp / a[row][row];
+	}
+
+	return x;
+}
+
+matrix* MAT_solve_lu_block(lu_factor *f, matrix *b) {
+	// Solves A . X = B for every column of B at once. Rows are walked in the same order as
+	//    MAT_solve_lu, but each factor entry is applied across a whole row of right hand sides.
+	int n = f->n;
+	int k = b->cols;
+	if (b->rows != n) {
+		fprintf(stderr, "Factor size %d Matrix row count %d\n", n, b->rows);
+		matutilerror("MAT_solve_lu_block: input matrix / factor sizes misaligned");
+	}
+
+	float **a = f->lu->mat;
+	matrix *x = MAT_matrix(n, k, MAT_NO);
+	float *xrow, *xj;
+	float scaling;
+
+	for (int row = 0; row < n; row++) {
+		xrow = x->mat[row];
+		for (int c = 0; c < k; c++) xrow[c] = b->mat[f->perm[row]][c];
+		for (int j = 0; j < row; j++) {
+			scaling = a[row][j];
+			if (scaling == 0) continue;
+			xj = x->mat[j];
+			for (int c = 0; c < k; c++) xrow[c] -= scaling * xj[c];
+		}
+	}
+	for (int row = n - 1; row >= 0; row--) {
+		xrow = x->mat[row];
+		for (int j = row + 1; j < n; j++) {
+			scaling = a[row][j];
+			if (scaling == 0) continue;
+			xj = x->mat[j];
+			for (int c = 0; c < k; c++) xrow[c] -= scaling * xj[c];
+		}
+		scaling = 1 / a[row][row];
+		for (int c = 0; c < k; c++) xrow[c] *= scaling;
+	}
+
+	return x;
+}
+
+matrix* MAT_solve_lu_transpose_block(lu_factor *f, matrix *b) {
+	// Solves transpose(A) . X = B using the factors of A, for every column of B.
+	// With P . A = L . U: solve transpose(U) . Z = B, then transpose(L) . W = Z, then undo P.
+	// Both sweeps walk rows of the packed factors, as transpose(U) and transpose(L) are never formed.
+	int n = f->n;
+	int k = b->cols;
+	if (b->rows != n) {
+		fprintf(stderr, "Factor size %d Matrix row count %d\n", n, b->rows);
+		matutilerror("MAT_solve_lu_transpose_block: input matrix / factor sizes misaligned");
+	}
+
+	float **a = f->lu->mat;
+	matrix *w = MAT_copymatrix(b);
+	float *wrow, *wi;
+	float scaling;
+
+	// Forward sweep through transpose(U)
+	for (int j = 0; j < n; j++) {
+		wrow = w->mat[j];
+		scaling = 1 / a[j][j];
+		for (int c = 0; c < k; c++) wrow[c] *= scaling;
+		for (int i = j + 1; i < n; i++) {
+			scaling = a[j][i];
+			if (scaling == 0) continue;
+			wi = w->mat[i];
+			for (int c = 0; c < k; c++) wi[c] -= scaling * wrow[c];
+		}
+	}
+	// Backward sweep through transpose(L) (unit diagonal)
+	for (int j = n - 1; j >= 0; j--) {
+		wrow = w->mat[j];
+		for (int i = 0; i < j; i++) {
+			scaling = a[j][i];
+			if (scaling == 0) continue;
+			wi = w->mat[i];
+			for (int c = 0; c < k; c++) wi[c] -= scaling * wrow[c];
+		}
+	}
+
+	// Undo the row permutation
+	matrix *x = MAT_matrix(n, k, MAT_NO);
+	for (int i = 0; i < n; i++) {
+		for (int c = 0; c < k; c++) x->mat[f->perm[i]][c] = w->mat[i][c];
+	}
+	MAT_freematrix(w);
+	return x;
+}
+
+void MAT_freelu(lu_factor *f) {
+	MAT_freematrix(f->lu);
+	free(f->perm);
+	free(f);
+}
+
+symbasis* MAT_symbasis(int n, int ngen, int **perm, int **sign) {
+	// Builds the symmetry-adapted basis for generators g (0 <= g < ngen <= 2), where g maps unit
+	//    vector e_i to sign[g][i] e_perm[g][i]. Each orbit of coordinates under the group gives at
+	//    most one vector per block, the projection sum over group elements h of chi_c(h) h e_i.
+	// Returns NULL if the generators are not involutions or do not commute.
+	if (ngen < 1 || ngen > 2) matutilerror("MAT_symbasis: one or two generators supported");
+	int nel = 1 << ngen; // group elements: identity, g0, g1, g0 g1
+	symbasis *b = (symbasis *) malloc(sizeof (symbasis));
+	if (!b) matutilerror("MAT_symbasis: failure to allocate");
+	b->n = n;
+	b->nblock = nel;
+	b->size = (int *) calloc(nel, sizeof (int));
+	b->col = (int *) malloc(((long long) nel * n + 1) * sizeof (int));
+	b->coef = (double *) calloc((long long) nel * n + 1, sizeof (double));
+	char *seen = (char *) calloc(n + 1, sizeof (char));
+	if (!b->size || !b->col || !b->coef || !seen) matutilerror("MAT_symbasis: failure to allocate");
+	for (long long i = 0; i < (long long) nel * n; i++) b->col[i] = -1;
+
+	int ok = 1;
+	for (int g = 0; g < ngen && ok; g++) {
+		for (int i = 0; i < n && ok; i++) ok = perm[g][perm[g][i]] == i && sign[g][perm[g][i]] == sign[g][i];
+	}
+	for (int i = 0; i < n && ok && ngen == 2; i++) {
+		ok = perm[0][perm[1][i]] == perm[1][perm[0][i]]
+			&& sign[1][i] * sign[0][perm[1][i]] == sign[0][i] * sign[1][perm[0][i]];
+	}
+	if (!ok) {
+		free(seen);
+		MAT_freesymbasis(b);
+		return NULL;
+	}
+
+	int dof[4], sgn[4], idx[4], m;
+	double val[4], norm;
+	for (int i = 0; i < n; i++) {
+		if (seen[i]) continue;
+		// Images of e_i under identity, g0, g1, g0 g1
+		dof[0] = i;
+		sgn[0] = 1;
+		dof[1] = perm[0][i];
+		sgn[1] = sign[0][i];
+		if (ngen == 2) {
+			dof[2] = perm[1][i];
+			sgn[2] = sign[1][i];
+			dof[3] = perm[0][dof[2]];
+			sgn[3] = sgn[2] * sign[0][dof[2]];
+		}
+		for (int h = 0; h < nel; h++) seen[dof[h]] = 1;
+		for (int c = 0; c < nel; c++) {
+			m = 0;
+			for (int h = 0; h < nel; h++) {
+				// chi_c(h): -1 for every generator in h whose bit is set in c
+				int chi = __builtin_popcount(c & h) % 2 ? -1 : 1;
+				int k = 0;
+				while (k < m && idx[k] != dof[h]) k++;
+				if (k == m) {
+					idx[m] = dof[h];
+					val[m++] = 0;
+				}
+				val[k] += chi * sgn[h];
+			}
+			norm = 0;
+			for (int k = 0; k < m; k++) norm += val[k] * val[k];
+			if (norm < 0.5) continue; // the coefficients are integers, so the projection vanished
+			norm = sqrt(norm);
+			for (int k = 0; k < m; k++) {
+				if (val[k] == 0) continue;
+				b->col[(long long) c * n + idx[k]] = b->size[c];
+				b->coef[(long long) c * n + idx[k]] = val[k] / norm;
+			}
+			b->size[c]++;
+		}
+	}
+	free(seen);
+	return b;
+}
+
+void MAT_freesymbasis(symbasis *b) {
+	free(b->size);
+	free(b->col);
+	free(b->coef);
+	free(b);
+}
+
+vector* MAT_symmetry_project(symbasis *b, int c, vector *v) {
+	// Coordinates of v in block c of the basis (T_c^T v)
+	if (v->rows != b->n) matutilerror("MAT_symmetry_project: vector does not match the basis");
+	vector *res = MAT_vector(b->size[c], MAT_YES);
+	int *col = b->col + (long long) c * b->n;
+	double *coef = b->coef + (long long) c * b->n;
+	for (int i = 0; i < b->n; i++) {
+		if (col[i] != -1) res->vec[col[i]] += coef[i] * v->vec[i];
+	}
+	return res;
+}
+
+void MAT_symmetry_expand(symbasis *b, int c, vector *vc, vector *v) {
+	// Adds the vector with coordinates vc in block c to v (v += T_c vc)
+	if (v->rows != b->n || vc->rows != b->size[c]) matutilerror("MAT_symmetry_expand: vectors do not match the basis");
+	int *col = b->col + (long long) c * b->n;
+	double *coef = b->coef + (long long) c * b->n;
+	for (int i = 0; i < b->n; i++) {
+		if (col[i] != -1) v->vec[i] += coef[i] * vc->vec[col[i]];
+	}
+}
+
+matrix* MAT_symmetry_block(matrix *m, symbasis *rows, symbasis *cols, int c) {
+	// Block c of m in the symmetry-adapted bases, T_c^T . m . S_c (rows in T, columns in S)
+	if (m->rows != rows->n || m->cols != cols->n) matutilerror("MAT_symmetry_block: matrix does not match the bases");
+	matrix *res = MAT_matrix(rows->size[c], cols->size[c], MAT_YES);
+	int *rcol = rows->col + (long long) c * rows->n;
+	int *ccol = cols->col + (long long) c * cols->n;
+	double *rcoef = rows->coef + (long long) c * rows->n;
+	double *ccoef = cols->coef + (long long) c * cols->n;
+	for (int i = 0; i < m->rows; i++) {
+		if (rcol[i] == -1) continue;
+		for (int j = 0; j < m->cols; j++) {
+			if (ccol[j] == -1 || m->mat[i][j] == 0) continue;
+			res->mat[rcol[i]][ccol[j]] += rcoef[i] * ccoef[j] * m->mat[i][j];
+		}
+	}
+	return res;
+}
+
+// ---- Dense kernels ----
+// Operate on raw column-major double blocks, element (i, j) at a[i + j * lda], so that callers
+//    (the supernodal factorization) can run them on slices of larger arrays.
+// Loops are tiled in MAT_KERNEL_BLOCK column panels and the innermost loop always runs down a
+//    column, which keeps the working set in cache and lets the compiler vectorize it.
+
+#define MAT_KERNEL_BLOCK 64
+#define MAT_KERNEL_ROWS 256 // row block of the update kernels
+
+void MAT_kernel_syrk(double *a, int m, int k, int lda, double *c, int ldc) {
+	// C -= A . transpose(A) on the lower triangle of C (m x m), with A m x k.
+	// Four columns of C are updated per pass over a block of A, so each loaded A entry is used four times.
+	double a0, a1, a2, a3, x;
+	double *c0, *c1, *c2, *c3, *acol;
+	int j, i, iend, start;
+	for (int kb = 0; kb < k; kb += MAT_KERNEL_BLOCK) {
+		int kend = kb + MAT_KERNEL_BLOCK < k ? kb + MAT_KERNEL_BLOCK : k;
+		for (int ib = 0; ib < m; ib += MAT_KERNEL_ROWS) {
+			iend = ib + MAT_KERNEL_ROWS < m ? ib + MAT_KERNEL_ROWS : m;
+			for (j = 0; j + 3 < iend; j += 4) {
+				c0 = c + (long long) j * ldc;
+				c1 = c0 + ldc;
+				c2 = c1 + ldc;
+				c3 = c2 + ldc;
+				start = j + 4 > ib ? j + 4 : ib;
+				for (int q = kb; q < kend; q++) {
+					acol = a + (long long) q * lda;
+					a0 = acol[j];
+					a1 = acol[j + 1];
+					a2 = acol[j + 2];
+					a3 = acol[j + 3];
+					if (j >= ib) {
+						// Triangle of the diagonal 4 x 4 block
+						c0[j] -= acol[j] * a0;
+						c0[j + 1] -= acol[j + 1] * a0;
+						c0[j + 2] -= acol[j + 2] * a0;
+						c0[j + 3] -= acol[j + 3] * a0;
+						c1[j + 1] -= acol[j + 1] * a1;
+						c1[j + 2] -= acol[j + 2] * a1;
+						c1[j + 3] -= acol[j + 3] * a1;
+						c2[j + 2] -= acol[j + 2] * a2;
+						c2[j + 3] -= acol[j + 3] * a2;
+						c3[j + 3] -= acol[j + 3] * a3;
+					}
+					for (i = start; i < iend; i++) {
+						x = acol[i];
+						c0[i] -= x * a0;
+						c1[i] -= x * a1;
+						c2[i] -= x * a2;
+						c3[i] -= x * a3;
+					}
+				}
+			}
+			// Remaining columns (fewer than four) meeting this row block
+			for (; j < iend; j++) {
+				c0 = c + (long long) j * ldc;
+				start = j > ib ? j : ib;
+				for (int q = kb; q < kend; q++) {
+					acol = a + (long long) q * lda;
+					a0 = acol[j];
+					for (i = start; i < iend; i++) c0[i] -= acol[i] * a0;
+				}
+			}
+		}
+	}
+}
+
+void MAT_kernel_trsm(double *l, int n, int ldl, double *b, int m, int ldb) {
+	// B = B . inverse(transpose(L)) for lower triangular L (n x n) and B (m x n)
+	double ljk;
+	double *bcol, *bk;
+	for (int j = 0; j < n; j++) {
+		bcol = b + (long long) j * ldb;
+		for (int q = 0; q < j; q++) {
+			ljk = l[j + (long long) q * ldl];
+			if (ljk == 0) continue;
+			bk = b + (long long) q * ldb;
+			for (int i = 0; i < m; i++) bcol[i] -= bk[i] * ljk;
+		}
+		ljk = 1 / l[j + (long long) j * ldl];
+		for (int i = 0; i < m; i++) bcol[i] *= ljk;
+	}
+}
+
+static int MAT_kernel_potf2(double *a, int n, int lda) {
+	// Unblocked lower Cholesky (left-looking by columns)
+	double *acol, *ak;
+	double ajk;
+	for (int j = 0; j < n; j++) {
+		acol = a + (long long) j * lda;
+		for (int q = 0; q < j; q++) {
+			ak = a + (long long) q * lda;
+			ajk = ak[j];
+			for (int i = j; i < n; i++) acol[i] -= ak[i] * ajk;
+		}
+		if (!(acol[j] > 0)) return j;
+		ajk = sqrt(acol[j]);
+		for (int i = j; i < n; i++) acol[i] /= ajk;
+	}
+	return -1;
+}
+
+int MAT_kernel_potrf(double *a, int n, int lda) {
+	// Blocked right-looking Cholesky of the lower triangle of A (n x n), in place.
+	// Returns -1 on success, or the column where A was found not to be positive definite.
+	int nb, res;
+	for (int jb = 0; jb < n; jb += MAT_KERNEL_BLOCK) {
+		nb = n - jb < MAT_KERNEL_BLOCK ? n - jb : MAT_KERNEL_BLOCK;
+		double *diag = a + jb + (long long) jb * lda;
+		res = MAT_kernel_potf2(diag, nb, lda);
+		if (res != -1) return jb + res;
+		if (jb + nb < n) {
+			double *panel = diag + nb;
+			MAT_kernel_trsm(diag, nb, lda, panel, n - jb - nb, lda);
+			MAT_kernel_syrk(panel, n - jb - nb, nb, lda, panel + (long long) nb * lda, lda);
+		}
+	}
+	return -1;
 }
\ No newline at end of file
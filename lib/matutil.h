@@ -25,6 +25,124 @@ struct vector {
 	float *vec;
 };
 
+typedef struct lu_factor lu_factor;
+struct lu_factor {
+	// Packed LU factorization with partial pivoting, P . A = L . U
+	// L is unit lower triangular (diagonal not stored), U occupies the diagonal and above
+	int n;
+	matrix *lu;
+	int *perm; // row i of the factors is row perm[i] of the original matrix
+};
+
+typedef struct symbasis symbasis;
+struct symbasis {
+	// Symmetry-adapted basis of R^n for the group generated by one or two commuting signed
+	//    permutations (mirror symmetries). Block c collects the basis vectors that each generator
+	//    maps to +v or -v (bit g of c set for -v), so a matrix commuting with the group is block
+	//    diagonal in this basis. A coordinate is used by at most one vector of each block, so the
+	//    basis is stored per coordinate: col[c * n + i] is the vector of block c using coordinate i
+	//    (-1 if none) and coef[c * n + i] its coefficient. The vectors are orthonormal.
+	int n;
+	int nblock;
+	int *size; // vectors in each block
+	int *col;
+	double *coef;
+};
+
+// Sparse matrices (matutil-sparse.c)
+// Assembled as a list of (row, col, value) triplets, then compressed to column storage.
+
+typedef struct triplet triplet;
+struct triplet {
+	int rows;
+	int cols;
+	int count;
+	int cap;
+	int *r;
+	int *c;
+	double *v;
+};
+
+typedef struct spmatrix spmatrix;
+struct spmatrix {
+	// Compressed sparse column storage: the entries of column j are
+	//    val[colptr[j]] ... val[colptr[j + 1] - 1], in rows rowidx[...] (ascending)
+	int rows;
+	int cols;
+	int nnz;
+	int *colptr;
+	int *rowidx;
+	double *val; // sparse values are double precision (see matutil-sparse.c)
+};
+
+typedef struct lsq_report lsq_report;
+struct lsq_report {
+	// How MAT_solve_lsqr finished
+	int iter;
+	int converged;
+	double rnorm; // |v - M x|
+	double arnorm; // |M^T (v - M x)|, zero at a least squares solution
+	double anorm; // estimate of the Frobenius norm of M
+	double xnorm;
+};
+
+typedef struct eigen eigen;
+struct eigen {
+	// Eigenpairs from MAT_eigs_sym or MAT_eigs_buckling, by increasing eigenvalue
+	int n;
+	int count;
+	double *values;
+	double *vectors; // vector i is vectors[i * n] ... vectors[i * n + n - 1], M- (or K-) orthonormal
+	int steps; // Lanczos steps (one solve each)
+	int converged; // pairs whose residual met the tolerance
+};
+
+typedef struct spsymbolic spsymbolic;
+struct spsymbolic {
+	// Symbolic analysis of a symmetric sparse matrix for LDL^T factorization.
+	// Depends only on the sparsity pattern, so it can be reused while the pattern is unchanged.
+	int n;
+	int nnz; // of the analysed matrix
+	unsigned long long pattern; // hash of the analysed pattern, see MAT_symbolic_matches
+	int *perm; // fill-reducing ordering: row / column k of the factored matrix is perm[k] of the original
+	int *iperm;
+	int *parent; // elimination tree (-1 at roots)
+	int *lcolptr; // column pointers of L, from the column counts
+	int lnz;
+	// Supernodes: runs of consecutive columns of L sharing one structure below the diagonal block
+	int nsuper;
+	int *super; // supernode s holds columns super[s] ... super[s + 1] - 1
+	int *sparent; // supernodal elimination tree (-1 at roots)
+	int *srowptr; // rows below the diagonal block: srowidx[srowptr[s]] ... srowidx[srowptr[s + 1] - 1]
+	int *srowidx;
+	long long *snptr; // offset of supernode s in the supernodal value array
+};
+
+typedef struct spfactor spfactor;
+struct spfactor {
+	// Numeric factor of P A P^T, in one of two forms:
+	// - simplicial LDL^T (MAT_factor_ldl): unit lower triangular L by columns (diagonal not stored), D
+	// - supernodal Cholesky L L^T (MAT_factor_chol_sn): snval holds one dense column-major block per
+	//   supernode, (width + rows below) x width, and the simplicial arrays are NULL
+	spsymbolic *sym; // not owned
+	int *lrowidx;
+	double *lval;
+	double *d;
+	double *snval;
+};
+
+typedef struct spzfactor spzfactor;
+struct spzfactor {
+	// Simplicial LDL^T of a complex symmetric P A P^T (MAT_factor_ldl_z), real and imaginary parts
+	//    apart, on the symbolic analysis of A's (real) pattern
+	spsymbolic *sym; // not owned
+	int *lrowidx;
+	double *lval;
+	double *lvali;
+	double *d;
+	double *di;
+};
+
 void matutilerror(char *error_text);
 
 matrix* MAT_matrix(int r, int c, int init_zeros);
@@ -50,4 +168,55 @@ vector* MAT_multiply_mv(matrix *m, vector *v);
 
 vector* MAT_solve_gausselim(matrix *m, vector *v);
 
+lu_factor* MAT_factor_lu(matrix *m);
+void MAT_refactor_lu(lu_factor *f, matrix *m);
+vector* MAT_solve_lu(lu_factor *f, vector *v);
+matrix* MAT_solve_lu_block(lu_factor *f, matrix *b);
+matrix* MAT_solve_lu_transpose_block(lu_factor *f, matrix *b);
+void MAT_freelu(lu_factor *f);
+
+symbasis* MAT_symbasis(int n, int ngen, int **perm, int **sign);
+void MAT_freesymbasis(symbasis *b);
+vector* MAT_symmetry_project(symbasis *b, int c, vector *v);
+void MAT_symmetry_expand(symbasis *b, int c, vector *vc, vector *v);
+matrix* MAT_symmetry_block(matrix *m, symbasis *rows, symbasis *cols, int c);
+
+triplet* MAT_triplet(int r, int c, int cap);
+void MAT_triplet_add(triplet *t, int r, int c, double v);
+void MAT_freetriplet(triplet *t);
+spmatrix* MAT_compress(triplet *t);
+spmatrix* MAT_symmetry_spblock(spmatrix *m, symbasis *rows, symbasis *cols, int c);
+void MAT_freespmatrix(spmatrix *m);
+vector* MAT_multiply_spv(spmatrix *m, vector *v);
+vector* MAT_multiply_sptv(spmatrix *m, vector *v);
+
+vector* MAT_solve_pcg(spmatrix *m, vector *v, float tol, int maxiter);
+vector* MAT_solve_lsqr(spmatrix *m, vector *v, float tol, int maxiter, lsq_report *rep);
+void MAT_partition(spmatrix *m, int nparts, int *part);
+vector* MAT_solve_dd(spmatrix *m, int nparts, vector *v, float tol, int maxiter);
+
+int MAT_kernel_potrf(double *a, int n, int lda);
+void MAT_kernel_trsm(double *l, int n, int ldl, double *b, int m, int ldb);
+void MAT_kernel_syrk(double *a, int m, int k, int lda, double *c, int ldc);
+
+void MAT_order_nd(spmatrix *m, int *perm);
+spsymbolic* MAT_analyse_sym(spmatrix *m);
+int MAT_symbolic_matches(spsymbolic *s, spmatrix *m);
+void MAT_freesymbolic(spsymbolic *s);
+spfactor* MAT_factor_ldl(spmatrix *m, spsymbolic *s);
+spfactor* MAT_try_factor_ldl(spmatrix *m, spsymbolic *s);
+int MAT_refactor_ldl(spfactor *f, spmatrix *m);
+spfactor* MAT_factor_chol_sn(spmatrix *m, spsymbolic *s);
+vector* MAT_solve_ldl(spfactor *f, vector *v);
+void MAT_solve_ldl_array(spfactor *f, double *x, double *work);
+void MAT_freeldl(spfactor *f);
+spzfactor* MAT_factor_ldl_z(spmatrix *m, double *mi, spsymbolic *s);
+int MAT_refactor_ldl_z(spzfactor *f, spmatrix *m, double *mi);
+void MAT_solve_ldl_z(spzfactor *f, double *x, double *xi, double *work);
+void MAT_freeldl_z(spzfactor *f);
+
+eigen* MAT_eigs_sym(spmatrix *k, spmatrix *m, double sigma, int nev, float tol, int maxdim);
+eigen* MAT_eigs_buckling(spmatrix *k, spfactor *lf, spmatrix *g, int nev, float tol, int maxdim);
+void MAT_freeeigen(eigen *e);
+
 #endif
\ No newline at end of file
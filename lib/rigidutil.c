@@ -0,0 +1,405 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <math.h>
+#include "rigidutil.h"
+
+// Smallest |sin| of the angle between the two members solved at a joint (below it the joint is singular)
+#define RG_JOINT_TOL 1e-6
+
+void rigidutilerror(char *error_text) {
+	printf("Critical error in rigidutil.c\nError message follows:\n");
+	printf("%s\n", error_text);
+	exit(1);
+}
+
+typedef struct pebbles pebbles;
+struct pebbles {
+	// Pebble game state: every vertex holds two pebbles, each either free or covering one of the
+	//    vertex's outgoing edges, so out-degree plus free pebbles is always 2.
+	int n;
+	int *free;
+	int *out; // out[2 v], out[2 v + 1]: heads of v's outgoing edges (-1 if unused)
+	int *seen; // search marks
+	int *from; // search tree
+	int *stack;
+	int stamp;
+};
+
+static int RG_find_pebble(pebbles *p, int root, int keep) {
+	// Moves a free pebble to root from a vertex reachable along outgoing edges, reversing the path.
+	// keep is the other end of the edge being tested and must not give up its pebbles.
+	// Returns 0 if no pebble can be reached.
+	p->stamp++;
+	int top = 0, v, w, found = -1;
+	p->seen[root] = p->stamp;
+	p->seen[keep] = p->stamp;
+	p->from[root] = -1;
+	p->stack[top++] = root;
+	while (top && found == -1) {
+		v = p->stack[--top];
+		for (int k = 0; k < 2; k++) {
+			w = p->out[2 * v + k];
+			if (w == -1 || p->seen[w] == p->stamp) continue;
+			p->seen[w] = p->stamp;
+			p->from[w] = v;
+			if (p->free[w]) {
+				found = w;
+				break;
+			}
+			p->stack[top++] = w;
+		}
+	}
+	if (found == -1) return 0;
+
+	// Reverse the path root -> ... -> found; the pebble at found now covers the reversed last edge
+	p->free[found]--;
+	w = found;
+	while (p->from[w] != -1) {
+		v = p->from[w];
+		for (int k = 0; k < 2; k++) {
+			if (p->out[2 * v + k] == w) {
+				p->out[2 * v + k] = -1;
+				break;
+			}
+		}
+		for (int k = 0; k < 2; k++) {
+			if (p->out[2 * w + k] == -1) {
+				p->out[2 * w + k] = v;
+				break;
+			}
+		}
+		w = v;
+	}
+	p->free[root]++;
+	return 1;
+}
+
+static int RG_add_edge(pebbles *p, int u, int v) {
+	// Inserts edge uv if it is independent of the edges so far, which holds exactly when
+	//    l + 1 = 4 pebbles can be gathered on u and v together (two on each).
+	// Returns 0 for a redundant edge, which is not inserted.
+	if (u == v) return 0;
+	while (p->free[u] < 2) {
+		if (!RG_find_pebble(p, u, v)) return 0;
+	}
+	while (p->free[v] < 2) {
+		if (!RG_find_pebble(p, v, u)) return 0;
+	}
+
+	p->free[u]--;
+	for (int k = 0; k < 2; k++) {
+		if (p->out[2 * u + k] == -1) {
+			p->out[2 * u + k] = v;
+			break;
+		}
+	}
+	return 1;
+}
+
+rigidity* RG_check(frame *f) {
+	// Runs the pebble game over the frame's beams (and module instances) and constraints
+	module *m = f->module;
+	int inner = m ? f->instancecount * m->icount : 0; // internal module nodes, numbered after the frame's
+	int ground = f->nodecount + inner;
+	int n = ground + 3 + f->constraintcount; // ground triangle, then one vertex per constraint at most
+
+	pebbles p;
+	p.n = n;
+	p.free = (int *) malloc(n * sizeof (int));
+	p.out = (int *) malloc(2 * n * sizeof (int));
+	p.seen = (int *) calloc(n, sizeof (int));
+	p.from = (int *) malloc(n * sizeof (int));
+	p.stack = (int *) malloc((n + 1) * sizeof (int));
+	p.stamp = 0;
+	rigidity *r = (rigidity *) malloc(sizeof (rigidity));
+	if (!p.free || !p.out || !p.seen || !p.from || !p.stack || !r) rigidutilerror("RG_check: failure to allocate");
+	for (int i = 0; i < n; i++) {
+		p.free[i] = 2;
+		p.out[2 * i] = -1;
+		p.out[2 * i + 1] = -1;
+	}
+	r->redundant = (int *) malloc((f->beamcount + 1) * sizeof (int));
+	if (!r->redundant) rigidutilerror("RG_check: failure to allocate");
+	r->redundantcount = 0;
+	r->redundant_constraints = 0;
+	r->redundant_module = 0;
+
+	// The ground triangle
+	int independent = 0;
+	independent += RG_add_edge(&p, ground, ground + 1);
+	independent += RG_add_edge(&p, ground + 1, ground + 2);
+	independent += RG_add_edge(&p, ground + 2, ground);
+
+	beam *b;
+	for (int i = 0; i < f->beamcount; i++) {
+		b = f->beams + i;
+		if (RG_add_edge(&p, b->n1_idx, b->n2_idx)) independent++;
+		else r->redundant[r->redundantcount++] = b->id;
+	}
+
+	// Module instances: interface nodes map to frame nodes, internal ones to fresh vertices
+	int *vert = m ? (int *) malloc((m->nodecount + 1) * sizeof (int)) : NULL;
+	if (m && !vert) rigidutilerror("RG_check: failure to allocate");
+	int next = f->nodecount;
+	for (int i = 0; i < f->instancecount; i++) {
+		for (int q = 0; q < m->bcount; q++) vert[m->bnodes[q]] = f->instances[i].frame_idx[q];
+		for (int q = 0; q < m->icount; q++) vert[m->inodes[q]] = next++;
+		for (int j = 0; j < m->beamcount; j++) {
+			if (RG_add_edge(&p, vert[m->beams[j].n1_idx], vert[m->beams[j].n2_idx])) independent++;
+			else r->redundant_module++;
+		}
+	}
+	free(vert);
+
+	// Constraints: bars to the ground. Each gets a ground vertex of its own, fixed to the ground
+	//    triangle by two bars (Henneberg type I), so constraints are never made concurrent by sharing
+	//    a ground vertex. Parallel constraints at one node share a vertex and so count as redundant.
+	int *ccount = (int *) calloc(f->nodecount + 1, sizeof (int));
+	float *ctheta = (float *) malloc(3 * (f->nodecount + 1) * sizeof (float));
+	int *cground = (int *) malloc(3 * (f->nodecount + 1) * sizeof (int));
+	if (!ccount || !ctheta || !cground) rigidutilerror("RG_check: failure to allocate");
+	int idx, g, extra = ground + 3;
+	float theta;
+	for (int i = 0; i < f->constraintcount; i++) {
+		idx = UN_get_node_idx(f, f->constraints[i].n_id);
+		if (idx == -1) rigidutilerror("RG_check: bad node reference in constraint");
+		theta = f->constraints[i].theta;
+		g = -1;
+		for (int k = 0; k < ccount[idx]; k++) {
+			if (fabsf(sinf(theta - ctheta[3 * idx + k])) <= UN_PARALLEL_TOL) g = cground[3 * idx + k];
+		}
+		if (g == -1 && ccount[idx] < 3) {
+			g = extra++;
+			independent += RG_add_edge(&p, g, ground);
+			independent += RG_add_edge(&p, g, ground + 1);
+			ctheta[3 * idx + ccount[idx]] = theta;
+			cground[3 * idx + ccount[idx]++] = g;
+		}
+		if (g != -1 && RG_add_edge(&p, idx, g)) independent++;
+		else r->redundant_constraints++;
+	}
+	free(ccount);
+	free(ctheta);
+	free(cground);
+
+	// Rigid when the whole graph, ground included, has 2 n - 3 independent edges (over the vertices used)
+	r->dof = 2 * extra - 3 - independent;
+
+	free(p.free);
+	free(p.out);
+	free(p.seen);
+	free(p.from);
+	free(p.stack);
+	return r;
+}
+
+void RG_free(rigidity *r) {
+	free(r->redundant);
+	free(r);
+}
+
+joints* RG_joint_order(frame *f) {
+	// Finds a method of joints order for a statically determinate frame. The three reactions come
+	//    from whole-body equilibrium first; then a node with at most two unsolved beams is taken
+	//    at a time, and its beams' other ends lose one unknown each.
+	// Returns NULL if the frame is not a simple truss (the peeling gets stuck).
+	int n = f->nodecount;
+	if (f->beamcount != 2 * n - 3 || f->constraintcount != 3 || f->instancecount) return NULL;
+
+	// Node -> beam incidence, compressed
+	int *start = (int *) calloc(n + 1, sizeof (int));
+	int *inc = (int *) malloc((2 * f->beamcount + 1) * sizeof (int));
+	int *unknown = (int *) malloc((n + 1) * sizeof (int));
+	char *solved = (char *) calloc(f->beamcount + 1, sizeof (char));
+	int *queue = (int *) malloc((n + 1) * sizeof (int));
+	joints *j = (joints *) malloc(sizeof (joints));
+	if (!start || !inc || !unknown || !solved || !queue || !j) rigidutilerror("RG_joint_order: failure to allocate");
+	j->node = (int *) malloc((n + 1) * sizeof (int));
+	j->member = (int *) malloc(2 * (n + 1) * sizeof (int));
+	if (!j->node || !j->member) rigidutilerror("RG_joint_order: failure to allocate");
+
+	for (int i = 0; i < f->beamcount; i++) {
+		start[f->beams[i].n1_idx + 1]++;
+		start[f->beams[i].n2_idx + 1]++;
+	}
+	for (int i = 0; i < n; i++) start[i + 1] += start[i];
+	for (int i = 0; i < n; i++) unknown[i] = start[i];
+	for (int i = 0; i < f->beamcount; i++) {
+		inc[unknown[f->beams[i].n1_idx]++] = i;
+		inc[unknown[f->beams[i].n2_idx]++] = i;
+	}
+
+	int head = 0, tail = 0;
+	for (int i = 0; i < n; i++) {
+		unknown[i] = start[i + 1] - start[i];
+		if (unknown[i] <= 2) queue[tail++] = i;
+	}
+
+	// Each node is queued once: at the start, or when its unknowns drop to two
+	int k, q, mb, other, nsolved = 0;
+	j->count = 0;
+	while (head < tail) {
+		k = queue[head++];
+		if (!unknown[k]) continue; // both equations already hold by global equilibrium
+		q = 0;
+		j->member[2 * j->count + 1] = -1;
+		for (int e = start[k]; e < start[k + 1]; e++) {
+			if (!solved[inc[e]]) j->member[2 * j->count + q++] = inc[e];
+		}
+		j->node[j->count] = k;
+		for (q = 0; q < unknown[k]; q++) {
+			mb = j->member[2 * j->count + q];
+			solved[mb] = 1;
+			nsolved++;
+			other = f->beams[mb].n1_idx == k ? f->beams[mb].n2_idx : f->beams[mb].n1_idx;
+			if (--unknown[other] == 2) queue[tail++] = other;
+		}
+		unknown[k] = 0;
+		j->count++;
+	}
+
+	free(start);
+	free(inc);
+	free(unknown);
+	free(solved);
+	free(queue);
+	if (nsolved != f->beamcount) {
+		RG_free_joints(j);
+		return NULL;
+	}
+	return j;
+}
+
+static void RG_member_dir(frame *f, int mb, int k, double *cx, double *cy) {
+	// Force on node k per unit beam force, as in the connectivity matrix (tension positive)
+	beam *b = f->beams + mb;
+	node *n1 = f->nodes + b->n1_idx;
+	node *n2 = f->nodes + b->n2_idx;
+	double sign = b->n1_idx == k ? 1 : -1;
+	*cx = sign * (n1->loc.x - n2->loc.x) / b->length;
+	*cy = sign * (n1->loc.y - n2->loc.y) / b->length;
+}
+
+static int RG_reactions(frame *f, vector *node_forces, double *r) {
+	// Solves the three constraint forces from whole-body equilibrium (x, y, and moments about the
+	//    first constrained node, scaled by the constraint spread to keep the rows comparable).
+	// Returns 0 if the constraints are (nearly) parallel or concurrent.
+	int n = f->nodecount;
+	int idx[3];
+	for (int c = 0; c < 3; c++) idx[c] = UN_get_node_idx(f, f->constraints[c].n_id);
+	coor o = f->nodes[idx[0]].loc;
+	double scale = 0, dx, dy;
+	for (int c = 1; c < 3; c++) {
+		dx = fabs(f->nodes[idx[c]].loc.x - o.x);
+		dy = fabs(f->nodes[idx[c]].loc.y - o.y);
+		if (dx > scale) scale = dx;
+		if (dy > scale) scale = dy;
+	}
+	if (scale == 0) return 0; // all on one node: concurrent
+
+	double a[3][4] = {{0}};
+	for (int c = 0; c < 3; c++) {
+		double th = f->constraints[c].theta;
+		a[0][c] = cos(th);
+		a[1][c] = sin(th);
+		a[2][c] = ((f->nodes[idx[c]].loc.x - o.x) * sin(th) - (f->nodes[idx[c]].loc.y - o.y) * cos(th)) / scale;
+	}
+	for (int i = 0; i < n; i++) {
+		a[0][3] += node_forces->vec[i];
+		a[1][3] += node_forces->vec[i + n];
+		a[2][3] += ((f->nodes[i].loc.x - o.x) * node_forces->vec[i + n] - (f->nodes[i].loc.y - o.y) * node_forces->vec[i]) / scale;
+	}
+
+	// Gaussian elimination with partial pivoting
+	int p;
+	double t;
+	for (int c = 0; c < 3; c++) {
+		p = c;
+		for (int i = c + 1; i < 3; i++) if (fabs(a[i][c]) > fabs(a[p][c])) p = i;
+		if (fabs(a[p][c]) <= RG_JOINT_TOL) return 0;
+		for (int q = 0; q < 4; q++) {
+			t = a[c][q];
+			a[c][q] = a[p][q];
+			a[p][q] = t;
+		}
+		for (int i = c + 1; i < 3; i++) {
+			t = a[i][c] / a[c][c];
+			for (int q = c; q < 4; q++) a[i][q] -= t * a[c][q];
+		}
+	}
+	for (int c = 2; c >= 0; c--) {
+		t = a[c][3];
+		for (int q = c + 1; q < 3; q++) t -= a[c][q] * r[q];
+		r[c] = t / a[c][c];
+	}
+	return 1;
+}
+
+vector* RG_solve_joints(frame *f, joints *j, vector *node_forces) {
+	// Solves beam and constraint forces joint by joint in the order j, pushing each solved beam
+	//    force on to the unbalanced load at its other end.
+	// Returns the same vector as solving the connectivity matrix, or NULL if the reactions or a
+	//    joint are (nearly) singular, in which case the caller should fall back to a factorization.
+	int n = f->nodecount;
+	double r[3];
+	if (!RG_reactions(f, node_forces, r)) return NULL;
+
+	double *rx = (double *) malloc((n + 1) * sizeof (double));
+	double *ry = (double *) malloc((n + 1) * sizeof (double));
+	if (!rx || !ry) rigidutilerror("RG_solve_joints: failure to allocate");
+	for (int i = 0; i < n; i++) {
+		rx[i] = node_forces->vec[i];
+		ry[i] = node_forces->vec[i + n];
+	}
+	vector *res = MAT_vector(2 * n, MAT_NO);
+	int k;
+	for (int c = 0; c < 3; c++) {
+		res->vec[f->beamcount + c] = r[c];
+		k = UN_get_node_idx(f, f->constraints[c].n_id);
+		rx[k] -= r[c] * cos(f->constraints[c].theta);
+		ry[k] -= r[c] * sin(f->constraints[c].theta);
+	}
+
+	int a, b, other;
+	double ax, ay, bx, by, det, s[2];
+	for (int step = 0; step < j->count; step++) {
+		k = j->node[step];
+		a = j->member[2 * step];
+		b = j->member[2 * step + 1];
+		RG_member_dir(f, a, k, &ax, &ay);
+		if (b == -1) {
+			// One beam left: its force is the load along it (the other component balances globally)
+			s[0] = rx[k] * ax + ry[k] * ay;
+		}
+		else {
+			RG_member_dir(f, b, k, &bx, &by);
+			det = ax * by - ay * bx;
+			if (fabs(det) <= RG_JOINT_TOL) {
+				free(rx);
+				free(ry);
+				MAT_freevector(res);
+				return NULL;
+			}
+			s[0] = (rx[k] * by - ry[k] * bx) / det;
+			s[1] = (ax * ry[k] - ay * rx[k]) / det;
+		}
+		for (int q = 0; q < 2 && j->member[2 * step + q] != -1; q++) {
+			int mb = j->member[2 * step + q];
+			res->vec[mb] = s[q];
+			other = f->beams[mb].n1_idx == k ? f->beams[mb].n2_idx : f->beams[mb].n1_idx;
+			RG_member_dir(f, mb, other, &ax, &ay);
+			rx[other] -= ax * s[q];
+			ry[other] -= ay * s[q];
+		}
+	}
+
+	free(rx);
+	free(ry);
+	return res;
+}
+
+void RG_free_joints(joints *j) {
+	free(j->node);
+	free(j->member);
+	free(j);
+}
\ No newline at end of file
@@ -0,0 +1,50 @@
+#ifndef _RIGIDUTIL_
+#define _RIGIDUTIL_
+
+#include "undefs.h"
+
+/*
+Combinatorial rigidity of pin-jointed frames by the 2D (2, 3) pebble game.
+Works on the beam graph alone, before anything is assembled, in O(n m) time at worst.
+Generic rigidity: the answer holds for almost every placement of the nodes, so special geometry
+   (collinear beams, parallel constraints on different nodes) can still make a generically rigid frame
+   singular. The stiffness solver catches those cases numerically.
+Constraints are bars to the ground, modelled as a rigid triangle of three extra vertices. Each
+   constraint ends on a ground vertex of its own, fixed to the triangle by two bars, so the answer
+   does not depend on how constraints are numbered. Parallel constraints at one node share a
+   vertex and so count as redundant, as they are physically.
+Module instances are expanded into their own nodes and beams.
+
+Simple trusses (built one node and two beams at a time, Henneberg type I) are also solved here by
+   the method of joints: with the three reactions known from whole-body equilibrium, peeling off a
+   node with at most two unknown beams at a time gives an order in which each joint is a 2x2
+   system, so the whole solve is O(n) with no factorization.
+*/
+
+typedef struct rigidity rigidity;
+struct rigidity {
+	int dof; // internal degrees of freedom left (0 for a rigid, fully supported frame)
+	int redundantcount; // beams that add no rigidity (the degree of static indeterminacy from beams)
+	int *redundant; // their ids (which beams of a redundant set are named depends on beam order)
+	int redundant_module; // module instance beams that add no rigidity
+	int redundant_constraints; // constraints that add no rigidity
+};
+
+typedef struct joints joints;
+struct joints {
+	// Method of joints solution order, after the reactions
+	int count;
+	int *node; // node index solved at each step
+	int *member; // member[2 k], member[2 k + 1]: beam indices solved at step k (the second may be -1)
+};
+
+void rigidutilerror(char *error_text);
+
+rigidity* RG_check(frame *f);
+void RG_free(rigidity *r);
+
+joints* RG_joint_order(frame *f);
+vector* RG_solve_joints(frame *f, joints *j, vector *node_forces);
+void RG_free_joints(joints *j);
+
+#endif
\ No newline at end of file
@@ -0,0 +1,117 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <math.h>
+#include "statutil.h"
+
+void statutilerror(char *error_text) {
+	printf("Critical error in statutil.c\nError message follows:\n");
+	printf("%s\n", error_text);
+	exit(1);
+}
+
+static unsigned long long STAT_splitmix(unsigned long long *x) {
+	unsigned long long z = (*x += 0x9e3779b97f4a7c15ULL);
+	z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ULL;
+	z = (z ^ (z >> 27)) * 0x94d049bb133111ebULL;
+	return z ^ (z >> 31);
+}
+
+void STAT_seed(rng *r, unsigned long long seed, unsigned long long stream) {
+	// Independent generator for (seed, stream). Giving every sample (or thread) its own
+	//    stream number makes results reproducible regardless of how work is scheduled.
+	unsigned long long x = seed ^ STAT_splitmix(&stream);
+	for (int i = 0; i < 4; i++) r->s[i] = STAT_splitmix(&x);
+}
+
+static unsigned long long STAT_rotl(unsigned long long x, int k) {
+	return (x << k) | (x >> (64 - k));
+}
+
+unsigned long long STAT_next(rng *r) {
+	unsigned long long *s = r->s;
+	unsigned long long res = STAT_rotl(s[1] * 5, 7) * 9;
+	unsigned long long t = s[1] << 17;
+	s[2] ^= s[0];
+	s[3] ^= s[1];
+	s[1] ^= s[2];
+	s[0] ^= s[3];
+	s[2] ^= t;
+	s[3] = STAT_rotl(s[3], 45);
+	return res;
+}
+
+double STAT_uniform(rng *r) {
+	// Uniform on [0, 1)
+	return (STAT_next(r) >> 11) * (1.0 / 9007199254740992.0);
+}
+
+double STAT_normal(rng *r) {
+	// Standard normal by Box-Muller (the second value is discarded to keep the state simple)
+	double u1 = 1.0 - STAT_uniform(r); // (0, 1]
+	double u2 = STAT_uniform(r);
+	return sqrt(-2.0 * log(u1)) * cos(2.0 * M_PI * u2);
+}
+
+void STAT_init_accum(accum *a, float lo, float hi) {
+	if (!(hi > lo)) hi = lo + 1;
+	a->count = 0;
+	a->mean = 0;
+	a->m2 = 0;
+	a->min = INFINITY;
+	a->max = -INFINITY;
+	a->lo = lo;
+	a->hi = hi;
+	for (int i = 0; i < STAT_BINS; i++) a->bins[i] = 0;
+}
+
+void STAT_add(accum *a, float x) {
+	a->count++;
+	double delta = x - a->mean;
+	a->mean += delta / a->count;
+	a->m2 += delta * (x - a->mean);
+	if (x < a->min) a->min = x;
+	if (x > a->max) a->max = x;
+
+	int bin = (int) ((x - a->lo) / (a->hi - a->lo) * STAT_BINS);
+	if (bin < 0) bin = 0;
+	if (bin >= STAT_BINS) bin = STAT_BINS - 1;
+	a->bins[bin]++;
+}
+
+void STAT_merge(accum *a, accum *b) {
+	// Folds b into a (Chan et al. pairwise update). Both must share a histogram range.
+	if (a->lo != b->lo || a->hi != b->hi) statutilerror("STAT_merge: histogram ranges differ");
+	if (!b->count) return;
+	long long n = a->count + b->count;
+	double delta = b->mean - a->mean;
+	a->m2 += b->m2 + delta * delta * a->count * b->count / n;
+	a->mean += delta * b->count / n;
+	a->count = n;
+	if (b->min < a->min) a->min = b->min;
+	if (b->max > a->max) a->max = b->max;
+	for (int i = 0; i < STAT_BINS; i++) a->bins[i] += b->bins[i];
+}
+
+double STAT_variance(accum *a) {
+	if (a->count < 2) return 0;
+	return a->m2 / (a->count - 1);
+}
+
+float STAT_quantile(accum *a, double q) {
+	// Interpolates within the histogram bin holding the q-th quantile, clamped to the observed range
+	if (!a->count) return 0;
+	double target = q * a->count;
+	double width = (a->hi - a->lo) / STAT_BINS;
+	long long seen = 0;
+	float res = a->max;
+	for (int i = 0; i < STAT_BINS; i++) {
+		if (seen + a->bins[i] >= target && a->bins[i]) {
+			res = a->lo + width * (i + (target - seen) / a->bins[i]);
+			break;
+		}
+		seen += a->bins[i];
+	}
+	if (res < a->min) res = a->min;
+	if (res > a->max) res = a->max;
+	return res;
+}
\ No newline at end of file
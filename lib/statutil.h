@@ -0,0 +1,40 @@
+#ifndef _STATUTIL_
+#define _STATUTIL_
+
+// Random sampling and streaming statistics for reliability studies
+// Nothing here stores individual samples: accumulators keep running moments and a
+//    fixed-range histogram, and accumulators from separate threads can be merged.
+
+#define STAT_BINS 1024
+
+typedef struct rng rng;
+struct rng {
+	unsigned long long s[4]; // xoshiro256** state
+};
+
+typedef struct accum accum;
+struct accum {
+	long long count;
+	double mean;
+	double m2; // sum of squared deviations from the mean (Welford)
+	float min;
+	float max;
+	float lo; // histogram range
+	float hi;
+	long long bins[STAT_BINS]; // samples outside [lo, hi] land in the end bins
+};
+
+void statutilerror(char *error_text);
+
+void STAT_seed(rng *r, unsigned long long seed, unsigned long long stream);
+unsigned long long STAT_next(rng *r);
+double STAT_uniform(rng *r);
+double STAT_normal(rng *r);
+
+void STAT_init_accum(accum *a, float lo, float hi);
+void STAT_add(accum *a, float x);
+void STAT_merge(accum *a, accum *b);
+double STAT_variance(accum *a);
+float STAT_quantile(accum *a, double q);
+
+#endif
\ No newline at end of file
@@ -0,0 +1,1756 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <math.h>
+#include "stiffutil.h"
+
+#define ST_SUPERNODAL_MIN 2000 // reduced DOF count from which the supernodal factorization is used
+#define ST_DD_TOL 1e-7 // relative residual of the interface solve in ST_solve_dd
+#define ST_CAPACITANCE_TOL 1e-10 // relative pivot below which a set of beam edits counts as singular
+#define ST_CHAIN_TOL 1e-12 // relative difference below which two bay blocks of a chain count as equal
+// Geometrically nonlinear solves
+#define ST_NL_TOL 1e-8 // residual (relative to the full load plus the beam end forces) at which a step has converged
+#define ST_NL_MAXITER 40 // iterations before a load step is cut in half
+#define ST_NL_SLOW 0.5 // an iteration that leaves more of the residual than this refactors the tangent
+#define ST_NL_CUTS 12 // step halvings before a solve gives up
+#define ST_NL_TARGET 4 // iterations per arc-length step the arc length is tuned for
+#define ST_NL_MAX_STEPS 10000 // arc-length steps before a solve gives up
+#define ST_BUCKLING_TOL 1e-8 // Lanczos residual of converged buckling modes, relative to 1 / lambda
+#define ST_BUCKLING_EXTRA 20 // Lanczos steps allowed beyond four per mode requested (the spectrum is not shifted)
+
+void stiffutilerror(char *error_text) {
+	printf("Critical error in stiffutil.c\nError message follows:\n");
+	printf("%s\n", error_text);
+	exit(1);
+}
+
+dofmap* ST_dofmap(frame *f) {
+	int n = f->nodecount;
+	dofmap *d = (dofmap *) malloc(sizeof (dofmap));
+	if (!d) stiffutilerror("ST_dofmap: failure to allocate d");
+	d->nodecount = n;
+	d->first = (int *) malloc(n * sizeof (int));
+	d->ndof = (int *) malloc(n * sizeof (int));
+	d->basis = (coor *) malloc(2 * n * sizeof (coor));
+	int *ccount = (int *) calloc(n, sizeof (int));
+	float *ctheta = (float *) malloc(n * sizeof (float));
+	if (!d->first || !d->ndof || !d->basis || !ccount || !ctheta) stiffutilerror("ST_dofmap: failure to allocate map");
+
+	// Count independent constraint directions per node
+	int idx;
+	for (int i = 0; i < f->constraintcount; i++) {
+		idx = UN_get_node_idx(f, f->constraints[i].n_id);
+		if (idx == -1) stiffutilerror("ST_dofmap: bad node reference in constraint");
+		if (ccount[idx] == 0) {
+			ctheta[idx] = f->constraints[i].theta;
+			ccount[idx] = 1;
+		}
+		else if (fabsf(sinf(f->constraints[i].theta - ctheta[idx])) > UN_PARALLEL_TOL) {
+			ccount[idx] = 2;
+		}
+	}
+
+	int dof = 0;
+	for (int i = 0; i < n; i++) {
+		d->first[i] = dof;
+		if (ccount[i] == 0) {
+			d->ndof[i] = 2;
+			d->basis[2 * i] = (coor) {1, 0};
+			d->basis[2 * i + 1] = (coor) {0, 1};
+		}
+		else if (ccount[i] == 1) {
+			d->ndof[i] = 1;
+			d->basis[2 * i] = (coor) {-sinf(ctheta[i]), cosf(ctheta[i])};
+		}
+		else d->ndof[i] = 0;
+		dof += d->ndof[i];
+	}
+	d->dofcount = dof;
+
+	free(ccount);
+	free(ctheta);
+	return d;
+}
+
+void ST_free_dofmap(dofmap *d) {
+	free(d->first);
+	free(d->ndof);
+	free(d->basis);
+	free(d);
+}
+
+void ST_condense_module(module *m) {
+	// Static condensation of a module onto its interface nodes (Schur complement), done once per module.
+	// The module stiffness is assembled densely with the internal dofs first; factoring the internal
+	//    block leaves K_bb - K_bi K_ii^-1 K_ib in the trailing block and keeps what is needed to recover
+	//    internal displacements. Module beam lengths and node indices must be set.
+	int ni = 2 * m->icount;
+	int nb = 2 * m->bcount;
+	int fm = ni + nb;
+	int *pos = (int *) malloc((m->nodecount + 1) * sizeof (int));
+	m->front = (double *) calloc((long long) fm * fm + 1, sizeof (double));
+	if (!pos || !m->front) stiffutilerror("ST_condense_module: failure to allocate");
+	for (int k = 0; k < m->icount; k++) pos[m->inodes[k]] = 2 * k;
+	for (int k = 0; k < m->bcount; k++) pos[m->bnodes[k]] = ni + 2 * k;
+
+	beam *b;
+	double ex, ey, k, amax = 0;
+	int dofs[4];
+	double proj[4];
+	for (int i = 0; i < m->beamcount; i++) {
+		b = m->beams + i;
+		if (b->length <= 0) stiffutilerror("ST_condense_module: zero length beam");
+		if (b->stiffness <= 0) stiffutilerror("ST_condense_module: beam stiffness must be positive");
+		ex = (double) m->nodes[b->n2_idx].loc.x - m->nodes[b->n1_idx].loc.x;
+		ey = (double) m->nodes[b->n2_idx].loc.y - m->nodes[b->n1_idx].loc.y;
+		k = sqrt(ex * ex + ey * ey);
+		ex /= k;
+		ey /= k;
+		k = b->stiffness / k;
+		if (k > amax) amax = k;
+		dofs[0] = pos[b->n1_idx];
+		dofs[1] = pos[b->n1_idx] + 1;
+		dofs[2] = pos[b->n2_idx];
+		dofs[3] = pos[b->n2_idx] + 1;
+		proj[0] = -ex;
+		proj[1] = -ey;
+		proj[2] = ex;
+		proj[3] = ey;
+		for (int r = 0; r < 4; r++) {
+			for (int c = 0; c < 4; c++) m->front[dofs[r] + (long long) dofs[c] * fm] += k * proj[r] * proj[c];
+		}
+	}
+
+	int bad = MAT_kernel_potrf(m->front, ni, fm) != -1;
+	for (int j = 0; j < ni && !bad; j++) bad = m->front[j + (long long) j * fm] * m->front[j + (long long) j * fm] <= 1e-12 * amax;
+	if (bad) stiffutilerror("ST_condense_module: module internal nodes are not held in place by its interface nodes");
+	if (ni && nb) {
+		MAT_kernel_trsm(m->front, ni, fm, m->front + ni, nb, fm);
+		MAT_kernel_syrk(m->front + ni, nb, ni, fm, m->front + ni + (long long) ni * fm, fm);
+	}
+	free(pos);
+}
+
+static double ST_condensed(module *m, int r, int c) {
+	// Entry of the condensed interface stiffness (only the lower triangle is stored)
+	int ni = 2 * m->icount;
+	int fm = ni + 2 * m->bcount;
+	if (r < c) {
+		int t = r;
+		r = c;
+		c = t;
+	}
+	return m->front[ni + r + (long long) (ni + c) * fm];
+}
+
+static int ST_end_projection(dofmap *d, beam *b, double ex, double ey, int *dofs, double *proj) {
+	// Fills the free dofs of a beam's ends and the projection of a = (-e, e) onto each, for a unit
+	//    direction e. Returns the number of free dofs (at most 4).
+	int nodes[2] = {b->n1_idx, b->n2_idx};
+	int count = 0;
+	coor v;
+	for (int end = 0; end < 2; end++) {
+		for (int q = 0; q < d->ndof[nodes[end]]; q++) {
+			v = d->basis[2 * nodes[end] + q];
+			dofs[count] = d->first[nodes[end]] + q;
+			proj[count] = (end ? 1 : -1) * (ex * v.x + ey * v.y);
+			count++;
+		}
+	}
+	return count;
+}
+
+static int ST_beam_projection(frame *f, dofmap *d, beam *b, int *dofs, double *proj, double *k) {
+	// Element stiffness of a beam is k a a^T with a = (-e, e). Restricted to the free dofs, this fills
+	//    the dofs a touches and a's projection onto each (signed by beam end), sets k = EA / L,
+	//    and returns the number of free dofs (at most 4).
+	if (b->length <= 0) stiffutilerror("ST_beam_projection: zero length beam");
+	// Direction and length in double precision; the coordinates themselves are exact floats
+	double ex = (double) f->nodes[b->n2_idx].loc.x - f->nodes[b->n1_idx].loc.x;
+	double ey = (double) f->nodes[b->n2_idx].loc.y - f->nodes[b->n1_idx].loc.y;
+	double len = sqrt(ex * ex + ey * ey);
+	ex /= len;
+	ey /= len;
+	*k = b->stiffness / len;
+	return ST_end_projection(d, b, ex, ey, dofs, proj);
+}
+
+static int ST_instance_dofs(frame *f, dofmap *d, instance *in, int *idofs, int *irow, coor *idir) {
+	// Lists the free dofs of an instance's interface nodes: the dof, its interface node, and its
+	//    direction rotated into module axes (so the condensed matrix itself never needs rotating).
+	// Returns the count (at most 2 bcount).
+	float cs = cosf(in->theta);
+	float sn = sinf(in->theta);
+	int count = 0, node_idx;
+	coor v;
+	for (int q = 0; q < f->module->bcount; q++) {
+		node_idx = in->frame_idx[q];
+		for (int r = 0; r < d->ndof[node_idx]; r++) {
+			v = d->basis[2 * node_idx + r];
+			idofs[count] = d->first[node_idx] + r;
+			irow[count] = q;
+			idir[count] = (coor) {cs * v.x + sn * v.y, -sn * v.x + cs * v.y};
+			count++;
+		}
+	}
+	return count;
+}
+
+static double ST_instance_entry(module *m, int *irow, coor *idir, int r, int c) {
+	// Condensed stiffness between instance dofs r and c listed by ST_instance_dofs
+	return idir[r].x * (ST_condensed(m, 2 * irow[r], 2 * irow[c]) * idir[c].x
+		+ ST_condensed(m, 2 * irow[r], 2 * irow[c] + 1) * idir[c].y)
+		+ idir[r].y * (ST_condensed(m, 2 * irow[r] + 1, 2 * irow[c]) * idir[c].x
+		+ ST_condensed(m, 2 * irow[r] + 1, 2 * irow[c] + 1) * idir[c].y);
+}
+
+spmatrix* ST_assemble_stiffness(frame *f, dofmap *d) {
+	// Assembles the reduced stiffness matrix (both triangles stored).
+	// Beam lengths and node indices must be current (UN_compute_beam_vals).
+	int cap = 16 * f->beamcount + d->dofcount;
+	if (f->instancecount) cap += f->instancecount * 4 * f->module->bcount * f->module->bcount;
+	triplet *t = MAT_triplet(d->dofcount, d->dofcount, cap);
+
+	int dofs[4];
+	double proj[4];
+	double k;
+	int count;
+	for (int i = 0; i < f->beamcount; i++) {
+		if (f->beams[i].stiffness <= 0) stiffutilerror("ST_assemble_stiffness: beam stiffness must be positive");
+		count = ST_beam_projection(f, d, f->beams + i, dofs, proj, &k);
+		for (int r = 0; r < count; r++) {
+			for (int c = 0; c < count; c++) {
+				MAT_triplet_add(t, dofs[r], dofs[c], k * proj[r] * proj[c]);
+			}
+		}
+	}
+
+	// Module instances add their condensed interface stiffness
+	if (f->instancecount) {
+		module *mod = f->module;
+		int *idofs = (int *) malloc((2 * mod->bcount + 1) * sizeof (int));
+		int *irow = (int *) malloc((2 * mod->bcount + 1) * sizeof (int));
+		coor *idir = (coor *) malloc((2 * mod->bcount + 1) * sizeof (coor));
+		if (!idofs || !irow || !idir) stiffutilerror("ST_assemble_stiffness: failure to allocate");
+		for (int i = 0; i < f->instancecount; i++) {
+			count = ST_instance_dofs(f, d, f->instances + i, idofs, irow, idir);
+			for (int r = 0; r < count; r++) {
+				for (int c = 0; c < count; c++) {
+					MAT_triplet_add(t, idofs[r], idofs[c], ST_instance_entry(mod, irow, idir, r, c));
+				}
+			}
+		}
+		free(idofs);
+		free(irow);
+		free(idir);
+	}
+
+	spmatrix *m = MAT_compress(t);
+	MAT_freetriplet(t);
+	return m;
+}
+
+spmatrix* ST_assemble_geometric(frame *f, dofmap *d) {
+	// Assembles the reduced geometric stiffness of the solved beam forces (both triangles stored):
+	//    a beam carrying tension N adds N / L (n n^T) across its ends for the normal n to its axis,
+	//    so tension stiffens the frame sideways and compression softens it
+	if (f->instancecount) stiffutilerror("ST_assemble_geometric: module instances are not supported");
+	triplet *t = MAT_triplet(d->dofcount, d->dofcount, 16 * f->beamcount + d->dofcount);
+	int dofs[4];
+	double proj[4];
+	double ex, ey, len, g;
+	int count;
+	beam *b;
+	for (int i = 0; i < f->beamcount; i++) {
+		b = f->beams + i;
+		ex = (double) f->nodes[b->n2_idx].loc.x - f->nodes[b->n1_idx].loc.x;
+		ey = (double) f->nodes[b->n2_idx].loc.y - f->nodes[b->n1_idx].loc.y;
+		len = sqrt(ex * ex + ey * ey);
+		if (len <= 0) stiffutilerror("ST_assemble_geometric: zero length beam");
+		g = b->force / len;
+		count = ST_end_projection(d, b, -ey / len, ex / len, dofs, proj);
+		for (int r = 0; r < count; r++) {
+			for (int c = 0; c < count; c++) {
+				MAT_triplet_add(t, dofs[r], dofs[c], g * proj[r] * proj[c]);
+			}
+		}
+	}
+	spmatrix *m = MAT_compress(t);
+	MAT_freetriplet(t);
+	return m;
+}
+
+vector* ST_load_vector(frame *f, dofmap *d) {
+	// Applied forces projected onto the free dofs
+	vector *full = UN_get_forces(f);
+	vector *res = MAT_vector(d->dofcount, MAT_NO);
+	int n = f->nodecount;
+	coor v;
+	for (int i = 0; i < n; i++) {
+		for (int q = 0; q < d->ndof[i]; q++) {
+			v = d->basis[2 * i + q];
+			res->vec[d->first[i] + q] = full->vec[i] * v.x + full->vec[i + n] * v.y;
+		}
+	}
+	MAT_freevector(full);
+	return res;
+}
+
+void ST_set_displacements(frame *f, dofmap *d, vector *u) {
+	// Expands reduced dofs into node displacements
+	coor v;
+	float q;
+	for (int i = 0; i < f->nodecount; i++) {
+		f->nodes[i].disp = (coor) {0, 0};
+		for (int k = 0; k < d->ndof[i]; k++) {
+			v = d->basis[2 * i + k];
+			q = u->vec[d->first[i] + k];
+			f->nodes[i].disp.x += q * v.x;
+			f->nodes[i].disp.y += q * v.y;
+		}
+	}
+}
+
+static void ST_recover_instance(frame *f, instance *in, float *resid) {
+	// Recovers one instance's internal displacements and beam forces from its interface displacements,
+	//    and subtracts the forces it exerts on the frame nodes from resid
+	module *m = f->module;
+	int n = f->nodecount;
+	int ni = 2 * m->icount;
+	int nb = 2 * m->bcount;
+	int fm = ni + nb;
+	double *ub = (double *) malloc((nb + 1) * sizeof (double));
+	double *ui = (double *) malloc((ni + 1) * sizeof (double));
+	coor *disp = (coor *) malloc((m->nodecount + 1) * sizeof (coor)); // module axes
+	if (!ub || !ui || !disp) stiffutilerror("ST_recover_instance: failure to allocate");
+
+	float cs = cosf(in->theta);
+	float sn = sinf(in->theta);
+	coor u;
+	for (int q = 0; q < m->bcount; q++) {
+		u = f->nodes[in->frame_idx[q]].disp;
+		ub[2 * q] = cs * u.x + sn * u.y;
+		ub[2 * q + 1] = -sn * u.x + cs * u.y;
+		disp[m->bnodes[q]] = (coor) {ub[2 * q], ub[2 * q + 1]};
+	}
+
+	// Interface forces S . ub, rotated back into frame axes
+	double fx, fy;
+	int idx;
+	for (int q = 0; q < m->bcount; q++) {
+		fx = 0;
+		fy = 0;
+		for (int c = 0; c < nb; c++) {
+			fx += ST_condensed(m, 2 * q, c) * ub[c];
+			fy += ST_condensed(m, 2 * q + 1, c) * ub[c];
+		}
+		idx = in->frame_idx[q];
+		resid[idx] -= cs * fx - sn * fy;
+		resid[idx + n] -= sn * fx + cs * fy;
+	}
+
+	// Internal displacements ui = -K_ii^-1 K_ib ub = -L^-T (W^T ub), with W stored below L
+	double temp;
+	for (int j = 0; j < ni; j++) {
+		temp = 0;
+		for (int r = 0; r < nb; r++) temp += m->front[ni + r + (long long) j * fm] * ub[r];
+		ui[j] = temp;
+	}
+	for (int j = ni - 1; j >= 0; j--) {
+		temp = ui[j];
+		for (int i = j + 1; i < ni; i++) temp -= m->front[i + (long long) j * fm] * ui[i];
+		ui[j] = temp / m->front[j + (long long) j * fm];
+	}
+	for (int k = 0; k < m->icount; k++) disp[m->inodes[k]] = (coor) {-ui[2 * k], -ui[2 * k + 1]};
+
+	beam *b;
+	coor e, u1, u2;
+	for (int i = 0; i < m->beamcount; i++) {
+		b = m->beams + i;
+		e.x = (m->nodes[b->n1_idx].loc.x - m->nodes[b->n2_idx].loc.x) / b->length;
+		e.y = (m->nodes[b->n1_idx].loc.y - m->nodes[b->n2_idx].loc.y) / b->length;
+		u1 = disp[b->n1_idx];
+		u2 = disp[b->n2_idx];
+		in->forces[i] = b->stiffness / b->length * -(e.x * (u2.x - u1.x) + e.y * (u2.y - u1.y));
+	}
+	free(ub);
+	free(ui);
+	free(disp);
+}
+
+void ST_split_reactions(frame *f, float *resid) {
+	// Splits each node's residual force (applied minus beam forces, x then y) between its constraints
+	int n = f->nodecount;
+	int idx, other;
+	float c1, s1, c2, s2, det;
+	char *done = (char *) calloc(f->constraintcount + 1, sizeof (char));
+	if (!done) stiffutilerror("ST_split_reactions: failure to allocate done");
+	for (int i = 0; i < f->constraintcount; i++) {
+		if (done[i]) continue;
+		idx = UN_get_node_idx(f, f->constraints[i].n_id);
+		c1 = cosf(f->constraints[i].theta);
+		s1 = sinf(f->constraints[i].theta);
+		other = -1;
+		for (int j = i + 1; j < f->constraintcount; j++) {
+			if (f->constraints[j].n_id != f->constraints[i].n_id) continue;
+			if (other != -1 || fabsf(sinf(f->constraints[j].theta - f->constraints[i].theta)) <= UN_PARALLEL_TOL) {
+				stiffutilerror("ST_split_reactions: constraint forces at a node with redundant constraints are indeterminate");
+			}
+			other = j;
+		}
+		if (other == -1) {
+			f->constraints[i].force = resid[idx] * c1 + resid[idx + n] * s1;
+		}
+		else {
+			c2 = cosf(f->constraints[other].theta);
+			s2 = sinf(f->constraints[other].theta);
+			det = c1 * s2 - c2 * s1;
+			f->constraints[i].force = (resid[idx] * s2 - resid[idx + n] * c2) / det;
+			f->constraints[other].force = (c1 * resid[idx + n] - s1 * resid[idx]) / det;
+			done[other] = 1;
+		}
+		done[i] = 1;
+	}
+	free(done);
+}
+
+void ST_recover_forces(frame *f) {
+	// Beam tensions from node displacements (including those inside module instances), then
+	//    constraint forces from the residual at each node
+	vector *applied = UN_get_forces(f);
+	ST_recover_forces_from(f, applied->vec);
+	MAT_freevector(applied);
+}
+
+void ST_recover_forces_from(frame *f, float *applied) {
+	// As ST_recover_forces, with the given node forces (x then y) in place of the applied loads
+	int n = f->nodecount;
+	float *resid = (float *) malloc(2 * n * sizeof (float)); // applied force minus beam contributions
+	if (!resid) stiffutilerror("ST_recover_forces_from: failure to allocate resid");
+	for (int i = 0; i < 2 * n; i++) resid[i] = applied[i];
+
+	beam *b;
+	coor e, u1, u2;
+	for (int i = 0; i < f->beamcount; i++) {
+		b = f->beams + i;
+		e.x = (f->nodes[b->n1_idx].loc.x - f->nodes[b->n2_idx].loc.x) / b->length;
+		e.y = (f->nodes[b->n1_idx].loc.y - f->nodes[b->n2_idx].loc.y) / b->length;
+		u1 = f->nodes[b->n1_idx].disp;
+		u2 = f->nodes[b->n2_idx].disp;
+		// Elongation is the relative displacement along the axis from node 1 to node 2
+		b->force = b->stiffness / b->length * -(e.x * (u2.x - u1.x) + e.y * (u2.y - u1.y));
+		resid[b->n1_idx] -= b->force * e.x;
+		resid[b->n1_idx + n] -= b->force * e.y;
+		resid[b->n2_idx] += b->force * e.x;
+		resid[b->n2_idx + n] += b->force * e.y;
+	}
+	for (int i = 0; i < f->instancecount; i++) ST_recover_instance(f, f->instances + i, resid);
+	ST_split_reactions(f, resid);
+	free(resid);
+}
+
+static void ST_symbolic_with(spsymbolic **sym, spmatrix *k) {
+	// Refreshes the symbolic analysis in *sym unless it already matches k's pattern
+	if (*sym && !MAT_symbolic_matches(*sym, k)) {
+		MAT_freesymbolic(*sym);
+		*sym = NULL;
+	}
+	if (!*sym) *sym = MAT_analyse_sym(k);
+}
+
+static spfactor* ST_factor_with(spsymbolic **sym, spmatrix *k) {
+	// Factors k, reusing (or refreshing) the symbolic analysis in *sym
+	ST_symbolic_with(sym, k);
+
+	// Large systems use the supernodal factorization; small ones are faster with the simplicial LDL
+	spfactor *lf = k->rows >= ST_SUPERNODAL_MIN ? MAT_factor_chol_sn(k, *sym) : MAT_try_factor_ldl(k, *sym);
+	if (!lf) stiffutilerror("ST_factor: stiffness matrix is singular (the frame is a mechanism or not fully constrained)");
+	return lf;
+}
+
+spfactor* ST_factor(frame *f, spmatrix *k) {
+	// Factors the reduced stiffness matrix, reusing (or refreshing) the symbolic analysis cached on f
+	return ST_factor_with(&f->symbolic, k);
+}
+
+spsymbolic* ST_symbolic(frame *f, spmatrix *k) {
+	// The symbolic analysis cached on f, refreshed for k's pattern (owned by f), for factoring
+	//    other matrices on the stiffness pattern such as shifted ones
+	ST_symbolic_with(&f->symbolic, k);
+	return f->symbolic;
+}
+
+static vector* ST_solve_parts(frame *f, int nparts) {
+	dofmap *d = ST_dofmap(f);
+	if (d->dofcount == 0) stiffutilerror("ST_solve: frame has no free degrees of freedom");
+	spmatrix *k = ST_assemble_stiffness(f, d);
+	vector *load = ST_load_vector(f, d);
+	vector *u;
+	if (nparts > 1) u = MAT_solve_dd(k, nparts, load, ST_DD_TOL, k->rows);
+	else {
+		spfactor *lf = ST_factor(f, k);
+		u = MAT_solve_ldl(lf, load);
+		MAT_freeldl(lf);
+	}
+
+	ST_set_displacements(f, d, u);
+	ST_recover_forces(f);
+
+	MAT_freevector(load);
+	MAT_freespmatrix(k);
+	ST_free_dofmap(d);
+	return u;
+}
+
+vector* ST_solve(frame *f) {
+	// Full static solve: assemble, solve K . u = F, fill node.disp, beam.force and constraint.force.
+	// Returns the reduced displacement vector.
+	return ST_solve_parts(f, 1);
+}
+
+vector* ST_solve_dd(frame *f, int nparts) {
+	// As ST_solve, but by domain decomposition into nparts subdomains (factored in parallel)
+	return ST_solve_parts(f, nparts);
+}
+
+vector* ST_solve_sym(frame *f, mirror **m, int count, int *blocks) {
+	// Static solve of a frame with one or two mirror symmetries (UN_find_mirror). In the
+	//    symmetry-adapted basis of the free dofs K splits into 2^count independent blocks, each
+	//    about 1 / 2^count of the size; every block with a nonzero share of the load is factored
+	//    and solved on its own, and the parts are added back together.
+	// Fills node.disp, beam.force and constraint.force like ST_solve and returns the reduced
+	//    displacements, or NULL if the free dofs do not map onto each other (constraint bases that
+	//    do not reflect). blocks (if not NULL) receives the number of blocks solved.
+	dofmap *d = ST_dofmap(f);
+	int nd = d->dofcount;
+	if (nd == 0) stiffutilerror("ST_solve_sym: frame has no free degrees of freedom");
+	int *perm[2], *sign[2];
+	int ok = 1, j;
+	coor v, w;
+	double dot;
+	for (int g = 0; g < count; g++) {
+		perm[g] = (int *) malloc((nd + 1) * sizeof (int));
+		sign[g] = (int *) malloc((nd + 1) * sizeof (int));
+		if (!perm[g] || !sign[g]) stiffutilerror("ST_solve_sym: failure to allocate");
+		// Each free dof direction, reflected, must be (minus) a free dof direction of the image node
+		for (int i = 0; i < f->nodecount && ok; i++) {
+			j = m[g]->node[i];
+			ok = d->ndof[i] == d->ndof[j];
+			for (int q = 0; q < d->ndof[i] && ok; q++) {
+				v = d->basis[2 * i + q];
+				if (m[g]->axis == UN_MIRROR_X) v.x = -v.x;
+				else v.y = -v.y;
+				perm[g][d->first[i] + q] = -1;
+				for (int r = 0; r < d->ndof[j]; r++) {
+					w = d->basis[2 * j + r];
+					dot = v.x * w.x + v.y * w.y;
+					if (fabs(dot) < 1 - UN_PARALLEL_TOL) continue;
+					perm[g][d->first[i] + q] = d->first[j] + r;
+					sign[g][d->first[i] + q] = dot > 0 ? 1 : -1;
+				}
+				ok = perm[g][d->first[i] + q] != -1;
+			}
+		}
+	}
+	symbasis *b = ok ? MAT_symbasis(nd, count, perm, sign) : NULL;
+	for (int g = 0; g < count; g++) {
+		free(perm[g]);
+		free(sign[g]);
+	}
+	if (!b) {
+		ST_free_dofmap(d);
+		return NULL;
+	}
+
+	spmatrix *k = ST_assemble_stiffness(f, d);
+	vector *load = ST_load_vector(f, d);
+	vector *u = MAT_vector(nd, MAT_YES);
+	float lmax = 0, pmax;
+	for (int i = 0; i < nd; i++) if (fabsf(load->vec[i]) > lmax) lmax = fabsf(load->vec[i]);
+	int solved = 0;
+	for (int c = 0; c < b->nblock; c++) {
+		if (!b->size[c]) continue;
+		vector *lc = MAT_symmetry_project(b, c, load);
+		pmax = 0;
+		for (int i = 0; i < lc->rows; i++) if (fabsf(lc->vec[i]) > pmax) pmax = fabsf(lc->vec[i]);
+		if (pmax <= 1e-7 * lmax) {
+			// No load of this symmetry type, so no response either
+			MAT_freevector(lc);
+			continue;
+		}
+		spmatrix *kc = MAT_symmetry_spblock(k, b, b, c);
+		spsymbolic *sym = NULL;
+		spfactor *lf = ST_factor_with(&sym, kc);
+		vector *uc = MAT_solve_ldl(lf, lc);
+		MAT_symmetry_expand(b, c, uc, u);
+		solved++;
+		MAT_freevector(uc);
+		MAT_freeldl(lf);
+		MAT_freesymbolic(sym);
+		MAT_freespmatrix(kc);
+		MAT_freevector(lc);
+	}
+	if (blocks) *blocks = solved;
+
+	ST_set_displacements(f, d, u);
+	ST_recover_forces(f);
+
+	MAT_freesymbasis(b);
+	MAT_freevector(load);
+	MAT_freespmatrix(k);
+	ST_free_dofmap(d);
+	return u;
+}
+
+static int ST_chain_sections(frame *f, int *sec) {
+	// Recognises a frame built as a chain of module instances: instance i's right interface nodes
+	//    are instance i + 1's left ones, every frame node is on one of these sections, and frame
+	//    beams join nodes in the same or adjacent sections. Fills sec with each node's section.
+	// Returns the number of sections (bays + 1), or 0 if the frame is not such a chain.
+	int n = f->nodecount;
+	int nb = f->instancecount;
+	if (nb < 2) return 0;
+	module *m = f->module;
+	int b = m->bcount;
+	int *first = (int *) malloc((n + 1) * sizeof (int)); // instance 0 interface position of each frame node
+	int *rpos = (int *) malloc((b + 1) * sizeof (int)); // paired interface positions: right side of
+	int *lpos = (int *) malloc((b + 1) * sizeof (int)); //    instance i meets left side of instance i + 1
+	int *slot = (int *) malloc((n + 1) * sizeof (int));
+	char *side = (char *) calloc(b + 1, sizeof (char));
+	if (!first || !rpos || !lpos || !slot || !side) stiffutilerror("ST_chain_sections: failure to allocate");
+	for (int i = 0; i < n; i++) first[i] = -1;
+	for (int q = 0; q < b; q++) first[f->instances[0].frame_idx[q]] = q;
+	int w = 0, ok = 1;
+	for (int q = 0; q < b; q++) {
+		int r = first[f->instances[1].frame_idx[q]];
+		if (r == -1) continue;
+		rpos[w] = r;
+		lpos[w++] = q;
+		side[r] |= 2;
+		side[q] |= 1;
+	}
+	for (int q = 0; q < b; q++) ok &= side[q] == 1 || side[q] == 2;
+	ok &= 2 * w == b;
+
+	for (int i = 0; i < n; i++) sec[i] = -1;
+	for (int i = 0; i < nb && ok; i++) {
+		for (int j = 0; j < w && ok; j++) {
+			int l = f->instances[i].frame_idx[lpos[j]];
+			int r = f->instances[i].frame_idx[rpos[j]];
+			if (sec[l] == -1) {
+				sec[l] = i;
+				slot[l] = j;
+			}
+			ok &= sec[l] == i && slot[l] == j && sec[r] == -1;
+			sec[r] = i + 1;
+			slot[r] = j;
+		}
+	}
+	for (int i = 0; i < n && ok; i++) ok = sec[i] != -1;
+	for (int i = 0; i < f->beamcount && ok; i++) ok = abs(sec[f->beams[i].n1_idx] - sec[f->beams[i].n2_idx]) <= 1;
+
+	free(first);
+	free(rpos);
+	free(lpos);
+	free(slot);
+	free(side);
+	return ok ? nb + 1 : 0;
+}
+
+static int ST_blocks_equal(double *a, double *b, int n) {
+	// Whether two blocks of n entries agree to ST_CHAIN_TOL relative to the larger entry
+	double amax = 0, diff = 0, t;
+	for (int i = 0; i < n; i++) {
+		if (fabs(a[i]) > amax) amax = fabs(a[i]);
+		t = fabs(a[i] - b[i]);
+		if (t > diff) diff = t;
+	}
+	return diff <= ST_CHAIN_TOL * amax;
+}
+
+static double* ST_pool_add(double ***pool, int *count, int *cap, double *block, int n) {
+	// Keeps a copy of a factor or coupling block; returns the copy
+	if (*count == *cap) {
+		*cap = 2 * *cap + 4;
+		*pool = (double **) realloc(*pool, *cap * sizeof (double *));
+		if (!*pool) stiffutilerror("ST_solve_chain: failure to allocate block pool");
+	}
+	double *copy = (double *) malloc((n + 1) * sizeof (double));
+	if (!copy) stiffutilerror("ST_solve_chain: failure to allocate block");
+	for (int i = 0; i < n; i++) copy[i] = block[i];
+	(*pool)[(*count)++] = copy;
+	return copy;
+}
+
+vector* ST_solve_chain(frame *f, int *factors) {
+	// Static solve of a periodic chain of module instances (see ST_chain_sections) by block Cholesky
+	//    along the chain. With sections as blocks, K is block tridiagonal: D_k on the diagonal and
+	//    E_k coupling sections k and k + 1. Eliminating section by section gives
+	//    S_0 = D_0,  S_k+1 = D_k+1 - W_k^T W_k  with  W_k = L_k^-1 E_k,  L_k L_k^T = S_k.
+	// Time is O(bays). For identical bays the recurrence converges as end effects decay, and from
+	//    then on every bay shares one factor and one W, so only the distinct blocks are kept. Chains
+	//    held at every bay converge geometrically and need a handful of factors however long they
+	//    are; free spans converge only algebraically (their soft modes run the whole length), so
+	//    most of their bays keep their own blocks.
+	// Fills node.disp, beam.force and constraint.force like ST_solve, and returns the reduced
+	//    displacements, or NULL if the frame is not a chain. factors (if not NULL) receives the
+	//    number of bay factorizations done.
+	if (!f->instancecount) return NULL;
+	int *sec = (int *) malloc((f->nodecount + 1) * sizeof (int));
+	if (!sec) stiffutilerror("ST_solve_chain: failure to allocate");
+	int ns = ST_chain_sections(f, sec);
+	if (!ns) {
+		free(sec);
+		return NULL;
+	}
+	dofmap *d = ST_dofmap(f);
+	if (d->dofcount == 0) stiffutilerror("ST_solve_chain: frame has no free degrees of freedom");
+	module *mod = f->module;
+
+	// Section sizes, local position of each reduced dof, and section offsets in the work vector
+	int *size = (int *) calloc(ns + 1, sizeof (int));
+	int *off = (int *) malloc((ns + 1) * sizeof (int));
+	int *dsec = (int *) malloc((d->dofcount + 1) * sizeof (int));
+	int *dloc = (int *) malloc((d->dofcount + 1) * sizeof (int));
+	int *bstart = (int *) calloc(ns + 1, sizeof (int)); // frame beams by lower section
+	int *blist = (int *) malloc((f->beamcount + 1) * sizeof (int));
+	if (!size || !off || !dsec || !dloc || !bstart || !blist) stiffutilerror("ST_solve_chain: failure to allocate");
+	for (int i = 0; i < f->nodecount; i++) {
+		for (int q = 0; q < d->ndof[i]; q++) {
+			dsec[d->first[i] + q] = sec[i];
+			dloc[d->first[i] + q] = size[sec[i]]++;
+		}
+	}
+	int smax = 0;
+	off[0] = 0;
+	for (int k = 0; k < ns; k++) {
+		if (size[k] > smax) smax = size[k];
+		if (k) off[k] = off[k - 1] + size[k - 1];
+	}
+	int lo;
+	for (int i = 0; i < f->beamcount; i++) {
+		lo = sec[f->beams[i].n1_idx] < sec[f->beams[i].n2_idx] ? sec[f->beams[i].n1_idx] : sec[f->beams[i].n2_idx];
+		bstart[lo + 1]++;
+	}
+	for (int k = 0; k < ns; k++) bstart[k + 1] += bstart[k];
+	for (int i = 0; i < f->beamcount; i++) {
+		lo = sec[f->beams[i].n1_idx] < sec[f->beams[i].n2_idx] ? sec[f->beams[i].n1_idx] : sec[f->beams[i].n2_idx];
+		blist[bstart[lo]++] = i;
+	}
+	for (int k = ns; k > 0; k--) bstart[k] = bstart[k - 1];
+	bstart[0] = 0;
+
+	// Right-hand side gathered by section; it becomes y_k = L_k^-1 g_k, then the solution
+	vector *load = ST_load_vector(f, d);
+	double *y = (double *) malloc((d->dofcount + 1) * sizeof (double));
+	if (!y) stiffutilerror("ST_solve_chain: failure to allocate");
+	for (int i = 0; i < d->dofcount; i++) y[off[dsec[i]] + dloc[i]] = load->vec[i];
+	MAT_freevector(load);
+
+	long long sq = (long long) smax * smax + 1;
+	double *dcur = (double *) malloc(sq * sizeof (double));
+	double *dnext = (double *) malloc(sq * sizeof (double));
+	double *dprev = (double *) malloc(sq * sizeof (double));
+	double *ecur = (double *) malloc(sq * sizeof (double)); // E_k^T, size[k + 1] x size[k]
+	double *eprev = (double *) malloc(sq * sizeof (double));
+	double *scur = (double *) malloc(sq * sizeof (double));
+	double *sprev = (double *) malloc(sq * sizeof (double));
+	int *lidx = (int *) malloc((ns + 1) * sizeof (int)); // factor used by each section
+	int *widx = (int *) malloc((ns + 1) * sizeof (int)); // coupling block used by each section
+	int *idofs = (int *) malloc((2 * mod->bcount + 1) * sizeof (int));
+	int *irow = (int *) malloc((2 * mod->bcount + 1) * sizeof (int));
+	coor *idir = (coor *) malloc((2 * mod->bcount + 1) * sizeof (coor));
+	if (!dcur || !dnext || !dprev || !ecur || !eprev || !scur || !sprev || !lidx || !widx || !idofs || !irow || !idir) {
+		stiffutilerror("ST_solve_chain: failure to allocate");
+	}
+	double **lpool = NULL, **wpool = NULL;
+	int lcount = 0, lcap = 0, wcount = 0, wcap = 0;
+
+	for (int i = 0; i < size[0] * size[0]; i++) dcur[i] = 0;
+	int sk, sn, count, r, c, sr, sc;
+	int dofs[4];
+	double proj[4], k, val, amax, *lk, *wk, *tmp;
+	for (int s = 0; s < ns; s++) {
+		sk = size[s];
+		sn = s + 1 < ns ? size[s + 1] : 0;
+		for (int i = 0; i < sn * sn; i++) dnext[i] = 0;
+		for (int i = 0; i < sn * sk; i++) ecur[i] = 0;
+
+		// Blocks touched by instance s and by the frame beams starting in section s. Entries
+		//    between sections s and s + 1 are kept once, as E_s^T.
+		amax = 0;
+		for (int b = bstart[s]; b < bstart[s + 1]; b++) {
+			count = ST_beam_projection(f, d, f->beams + blist[b], dofs, proj, &k);
+			for (r = 0; r < count; r++) {
+				for (c = 0; c < count; c++) {
+					val = k * proj[r] * proj[c];
+					sr = dsec[dofs[r]];
+					sc = dsec[dofs[c]];
+					if (sr == s && sc == s) dcur[dloc[dofs[r]] + dloc[dofs[c]] * sk] += val;
+					else if (sr == s + 1 && sc == s + 1) dnext[dloc[dofs[r]] + dloc[dofs[c]] * sn] += val;
+					else if (sr == s + 1) ecur[dloc[dofs[r]] + dloc[dofs[c]] * sn] += val;
+				}
+			}
+		}
+		if (s + 1 < ns) {
+			count = ST_instance_dofs(f, d, f->instances + s, idofs, irow, idir);
+			for (r = 0; r < count; r++) {
+				for (c = 0; c < count; c++) {
+					val = ST_instance_entry(mod, irow, idir, r, c);
+					sr = dsec[idofs[r]];
+					sc = dsec[idofs[c]];
+					if (sr == s && sc == s) dcur[dloc[idofs[r]] + dloc[idofs[c]] * sk] += val;
+					else if (sr == s + 1 && sc == s + 1) dnext[dloc[idofs[r]] + dloc[idofs[c]] * sn] += val;
+					else if (sr == s + 1) ecur[dloc[idofs[r]] + dloc[idofs[c]] * sn] += val;
+				}
+			}
+		}
+
+		// S_s: the same as S_s-1 when D and W repeat; otherwise computed, and matched to the
+		//    previous factor if the recurrence has converged
+		int same_d = s > 0 && size[s - 1] == sk && ST_blocks_equal(dcur, dprev, sk * sk);
+		if (s >= 2 && same_d && widx[s - 1] == widx[s - 2]) lidx[s] = lidx[s - 1];
+		else {
+			for (int i = 0; i < sk * sk; i++) scur[i] = dcur[i];
+			if (s > 0) MAT_kernel_syrk(wpool[widx[s - 1]], sk, size[s - 1], sk, scur, sk);
+			for (int j = 0; j < sk; j++) {
+				for (int i = 0; i < j; i++) scur[i + j * sk] = scur[j + i * sk];
+			}
+			if (s > 0 && size[s - 1] == sk && ST_blocks_equal(scur, sprev, sk * sk)) lidx[s] = lidx[s - 1];
+			else {
+				tmp = sprev;
+				sprev = scur;
+				scur = tmp;
+				for (int i = 0; i < sk * sk; i++) scur[i] = sprev[i];
+				amax = 0;
+				for (int j = 0; j < sk; j++) if (scur[j + j * sk] > amax) amax = scur[j + j * sk];
+				int bad = MAT_kernel_potrf(scur, sk, sk) != -1;
+				for (int j = 0; j < sk && !bad; j++) bad = scur[j + j * sk] * scur[j + j * sk] <= 1e-12 * amax;
+				if (bad) stiffutilerror("ST_solve_chain: stiffness matrix is singular (the frame is a mechanism or not fully constrained)");
+				ST_pool_add(&lpool, &lcount, &lcap, scur, sk * sk);
+				lidx[s] = lcount - 1;
+			}
+		}
+		lk = lpool[lidx[s]];
+
+		// W_s^T = E_s^T L_s^-T, shared with the previous section when both factors agree
+		if (s + 1 < ns) {
+			if (s > 0 && lidx[s] == lidx[s - 1] && size[s + 1] == size[s] && ST_blocks_equal(ecur, eprev, sn * sk)) {
+				widx[s] = widx[s - 1];
+			}
+			else {
+				for (int i = 0; i < sn * sk; i++) eprev[i] = ecur[i];
+				MAT_kernel_trsm(lk, sk, sk, ecur, sn, sn);
+				ST_pool_add(&wpool, &wcount, &wcap, ecur, sn * sk);
+				widx[s] = wcount - 1;
+			}
+		}
+
+		// Forward substitution: y_s = L_s^-1 g_s, then g_s+1 -= W_s^T y_s
+		double *ys = y + off[s];
+		for (int j = 0; j < sk; j++) {
+			ys[j] /= lk[j + j * sk];
+			for (int i = j + 1; i < sk; i++) ys[i] -= lk[i + j * sk] * ys[j];
+		}
+		if (s + 1 < ns) {
+			wk = wpool[widx[s]];
+			for (c = 0; c < sk; c++) {
+				for (r = 0; r < sn; r++) y[off[s + 1] + r] -= wk[r + c * sn] * ys[c];
+			}
+		}
+
+		tmp = dprev;
+		dprev = dcur;
+		dcur = dnext;
+		dnext = tmp;
+	}
+
+	// Back substitution: u_s = L_s^-T (y_s - W_s u_s+1)
+	for (int s = ns - 1; s >= 0; s--) {
+		sk = size[s];
+		double *ys = y + off[s];
+		lk = lpool[lidx[s]];
+		if (s + 1 < ns) {
+			sn = size[s + 1];
+			wk = wpool[widx[s]];
+			for (c = 0; c < sk; c++) {
+				for (r = 0; r < sn; r++) ys[c] -= wk[r + c * sn] * y[off[s + 1] + r];
+			}
+		}
+		for (int j = sk - 1; j >= 0; j--) {
+			for (int i = j + 1; i < sk; i++) ys[j] -= lk[i + j * sk] * ys[i];
+			ys[j] /= lk[j + j * sk];
+		}
+	}
+
+	vector *u = MAT_vector(d->dofcount, MAT_NO);
+	for (int i = 0; i < d->dofcount; i++) u->vec[i] = y[off[dsec[i]] + dloc[i]];
+	ST_set_displacements(f, d, u);
+	ST_recover_forces(f);
+	if (factors) *factors = lcount;
+
+	for (int i = 0; i < lcount; i++) free(lpool[i]);
+	for (int i = 0; i < wcount; i++) free(wpool[i]);
+	free(lpool);
+	free(wpool);
+	free(dcur);
+	free(dnext);
+	free(dprev);
+	free(ecur);
+	free(eprev);
+	free(scur);
+	free(sprev);
+	free(lidx);
+	free(widx);
+	free(idofs);
+	free(irow);
+	free(idir);
+	free(y);
+	free(sec);
+	free(size);
+	free(off);
+	free(dsec);
+	free(dloc);
+	free(bstart);
+	free(blist);
+	ST_free_dofmap(d);
+	return u;
+}
+
+static int ST_spring_projection(dofmap *d, int idx, coor dir, int *dofs, double *proj) {
+	// A ground spring's stiffness is k n n^T on its node: fills the node's free dofs and n's
+	//    projection onto each, and returns their number (at most 2)
+	int count = 0;
+	coor v;
+	for (int q = 0; q < d->ndof[idx]; q++) {
+		v = d->basis[2 * idx + q];
+		dofs[count] = d->first[idx] + q;
+		proj[count] = (double) dir.x * v.x + (double) dir.y * v.y;
+		count++;
+	}
+	return count;
+}
+
+static void ST_solver_refactor(stsolver *s) {
+	// Assembles and factors K for the frame and springs as they stand, dropping any absorbed edits
+	if (s->lf) MAT_freeldl(s->lf);
+	spmatrix *k = ST_assemble_stiffness(s->f, s->d);
+
+	// Springs land on their node's diagonal block, which the node's beams already put in the pattern
+	int dofs[2], count, p;
+	double proj[2];
+	for (int i = 0; i < s->springcount; i++) {
+		if (s->sk[i] == 0) continue;
+		count = ST_spring_projection(s->d, s->snode[i], s->sdir[i], dofs, proj);
+		for (int c = 0; c < count; c++) {
+			for (int r = 0; r < count; r++) {
+				p = k->colptr[dofs[c]];
+				while (p < k->colptr[dofs[c] + 1] && k->rowidx[p] != dofs[r]) p++;
+				if (p == k->colptr[dofs[c] + 1]) stiffutilerror("ST_solver_refactor: spring on a node without beams");
+				k->val[p] += s->sk[i] * proj[r] * proj[c];
+			}
+		}
+	}
+
+	s->lf = ST_factor_with(&s->sym, k);
+	MAT_freespmatrix(k);
+	s->rank = 0;
+	s->stale = 0;
+	s->refactors++;
+}
+
+static stsolver* ST_solver_alloc(frame *f) {
+	stsolver *s = (stsolver *) malloc(sizeof (stsolver));
+	if (!s) stiffutilerror("ST_solver: failure to allocate solver");
+	s->f = f;
+	s->d = ST_dofmap(f);
+	if (s->d->dofcount == 0) stiffutilerror("ST_solver: frame has no free degrees of freedom");
+	int n = s->d->dofcount;
+	s->lf = NULL;
+	s->sym = NULL;
+	s->ucount = (int *) malloc(ST_MAX_RANK * sizeof (int));
+	s->udofs = (int *) malloc(4 * ST_MAX_RANK * sizeof (int));
+	s->uproj = (double *) malloc(4 * ST_MAX_RANK * sizeof (double));
+	s->dk = (double *) malloc(ST_MAX_RANK * sizeof (double));
+	s->w = (double *) malloc((long long) n * ST_MAX_RANK * sizeof (double));
+	s->work = (double *) malloc((n + 1) * sizeof (double));
+	if (!s->ucount || !s->udofs || !s->uproj || !s->dk || !s->w || !s->work) stiffutilerror("ST_solver: failure to allocate solver");
+	s->refactors = 0;
+	s->stale = 0;
+	s->springcount = 0;
+	s->springcap = 0;
+	s->snode = NULL;
+	s->sdir = NULL;
+	s->sk = NULL;
+	return s;
+}
+
+stsolver* ST_solver(frame *f) {
+	stsolver *s = ST_solver_alloc(f);
+	ST_solver_refactor(s);
+	return s;
+}
+
+stsolver* ST_solver_springs(frame *f, int count, int *idx, coor *dir, double *k) {
+	// An stsolver whose first factorization already holds count ground springs (spring i on node
+	//    index idx[i] along the unit direction dir[i], stiffness k[i]); they get handles 0 to count - 1.
+	// For frames that are only held by their springs, where K alone is singular.
+	stsolver *s = ST_solver_alloc(f);
+	s->springcap = count;
+	s->snode = (int *) malloc((count + 1) * sizeof (int));
+	s->sdir = (coor *) malloc((count + 1) * sizeof (coor));
+	s->sk = (double *) malloc((count + 1) * sizeof (double));
+	if (!s->snode || !s->sdir || !s->sk) stiffutilerror("ST_solver_springs: failure to allocate springs");
+	for (int i = 0; i < count; i++) {
+		if (idx[i] < 0 || idx[i] >= f->nodecount) stiffutilerror("ST_solver_springs: bad node index");
+		if (k[i] <= 0) stiffutilerror("ST_solver_springs: spring stiffness must be positive");
+		s->snode[i] = idx[i];
+		s->sdir[i] = dir[i];
+		s->sk[i] = k[i];
+	}
+	s->springcount = count;
+	ST_solver_refactor(s);
+	return s;
+}
+
+void ST_free_solver(stsolver *s) {
+	MAT_freeldl(s->lf);
+	MAT_freesymbolic(s->sym);
+	ST_free_dofmap(s->d);
+	free(s->ucount);
+	free(s->udofs);
+	free(s->uproj);
+	free(s->dk);
+	free(s->w);
+	free(s->work);
+	free(s->snode);
+	free(s->sdir);
+	free(s->sk);
+	free(s);
+}
+
+static void ST_absorb_slot(stsolver *s) {
+	// Finishes the edit recorded in slot s->rank (its dofs, projections and dk) by storing W = K^-1 a
+	int r = s->rank;
+	if (s->ucount[r] == 0 || s->dk[r] == 0) return; // touches only fixed dofs
+	int n = s->d->dofcount;
+	double *w = s->w + (long long) r * n;
+	for (int i = 0; i < n; i++) w[i] = 0;
+	for (int q = 0; q < s->ucount[r]; q++) w[s->udofs[4 * r + q]] = s->uproj[4 * r + q];
+	MAT_solve_ldl_array(s->lf, w, s->work);
+	s->rank++;
+}
+
+static void ST_absorb(stsolver *s, beam *b, float dstiffness) {
+	// Records K += dk a a^T for a stiffness change of dstiffness on beam b, or marks the solver stale
+	//    once too many edits have built up. The frame must already reflect the edit.
+	if (s->stale || s->rank == ST_MAX_RANK) {
+		s->stale = 1;
+		return;
+	}
+	int r = s->rank;
+	double k;
+	beam scaled = *b;
+	scaled.stiffness = dstiffness;
+	s->ucount[r] = ST_beam_projection(s->f, s->d, &scaled, s->udofs + 4 * r, s->uproj + 4 * r, &k);
+	s->dk[r] = k;
+	ST_absorb_slot(s);
+}
+
+static void ST_absorb_spring(stsolver *s, int spring, double dk) {
+	// As ST_absorb, for a stiffness change of dk on a ground spring (already recorded in s)
+	if (s->stale || s->rank == ST_MAX_RANK) {
+		s->stale = 1;
+		return;
+	}
+	int r = s->rank;
+	s->ucount[r] = ST_spring_projection(s->d, s->snode[spring], s->sdir[spring], s->udofs + 4 * r, s->uproj + 4 * r);
+	s->dk[r] = dk;
+	ST_absorb_slot(s);
+}
+
+void ST_add_beam(stsolver *s, beam b) {
+	// Adds a beam between existing nodes; b needs its id, node ids and stiffness
+	frame *f = s->f;
+	if (UN_get_beam(f, b.id)) stiffutilerror("ST_add_beam: beam id already in use");
+	if (b.stiffness <= 0) stiffutilerror("ST_add_beam: beam stiffness must be positive");
+	b.n1_idx = UN_get_node_idx(f, b.n1_id);
+	b.n2_idx = UN_get_node_idx(f, b.n2_id);
+	if (b.n1_idx == -1 || b.n2_idx == -1) stiffutilerror("ST_add_beam: bad node reference in beam");
+	b.length = UN_dist(f->nodes[b.n1_idx].loc, f->nodes[b.n2_idx].loc);
+	b.force = 0;
+	f->beams = (beam *) realloc(f->beams, (f->beamcount + 1) * sizeof (beam));
+	if (!f->beams) stiffutilerror("ST_add_beam: failure to grow beams");
+	f->beams[f->beamcount++] = b;
+	ST_absorb(s, f->beams + f->beamcount - 1, b.stiffness);
+}
+
+void ST_remove_beam(stsolver *s, int id) {
+	frame *f = s->f;
+	beam *b = UN_get_beam(f, id);
+	if (!b) stiffutilerror("ST_remove_beam: no beam with this id");
+	beam removed = *b;
+	int idx = b - f->beams;
+	for (int i = idx; i + 1 < f->beamcount; i++) f->beams[i] = f->beams[i + 1];
+	f->beamcount--;
+	ST_absorb(s, &removed, -removed.stiffness);
+}
+
+void ST_resize_beam(stsolver *s, int id, float stiffness) {
+	beam *b = UN_get_beam(s->f, id);
+	if (!b) stiffutilerror("ST_resize_beam: no beam with this id");
+	if (stiffness <= 0) stiffutilerror("ST_resize_beam: beam stiffness must be positive");
+	float old = b->stiffness;
+	b->stiffness = stiffness;
+	ST_absorb(s, b, stiffness - old);
+}
+
+int ST_add_spring(stsolver *s, int idx, coor dir, double k) {
+	// Adds a ground spring of stiffness k on node index idx along the unit direction dir.
+	// Returns a handle for ST_remove_spring; handles of removed springs are reused.
+	if (idx < 0 || idx >= s->f->nodecount) stiffutilerror("ST_add_spring: bad node index");
+	if (k <= 0) stiffutilerror("ST_add_spring: spring stiffness must be positive");
+	int i = 0;
+	while (i < s->springcount && s->sk[i] != 0) i++;
+	if (i == s->springcap) {
+		s->springcap = 2 * s->springcap + 8;
+		s->snode = (int *) realloc(s->snode, s->springcap * sizeof (int));
+		s->sdir = (coor *) realloc(s->sdir, s->springcap * sizeof (coor));
+		s->sk = (double *) realloc(s->sk, s->springcap * sizeof (double));
+		if (!s->snode || !s->sdir || !s->sk) stiffutilerror("ST_add_spring: failure to grow springs");
+	}
+	if (i == s->springcount) s->springcount++;
+	s->snode[i] = idx;
+	s->sdir[i] = dir;
+	s->sk[i] = k;
+	ST_absorb_spring(s, i, k);
+	return i;
+}
+
+void ST_remove_spring(stsolver *s, int spring) {
+	if (spring < 0 || spring >= s->springcount || s->sk[spring] == 0) stiffutilerror("ST_remove_spring: no spring with this handle");
+	double k = s->sk[spring];
+	s->sk[spring] = 0;
+	ST_absorb_spring(s, spring, -k);
+}
+
+static int ST_solve_dense(double *a, double *b, int n, double tol) {
+	// Gaussian elimination with partial pivoting on the n x n row major a, solving a . x = b in place.
+	// Returns 0 if a pivot is at or below tol.
+	int piv;
+	double temp, m;
+	for (int j = 0; j < n; j++) {
+		piv = j;
+		for (int i = j + 1; i < n; i++) {
+			if (fabs(a[i * n + j]) > fabs(a[piv * n + j])) piv = i;
+		}
+		if (fabs(a[piv * n + j]) <= tol) return 0;
+		if (piv != j) {
+			for (int c = 0; c < n; c++) {
+				temp = a[j * n + c];
+				a[j * n + c] = a[piv * n + c];
+				a[piv * n + c] = temp;
+			}
+			temp = b[j];
+			b[j] = b[piv];
+			b[piv] = temp;
+		}
+		for (int i = j + 1; i < n; i++) {
+			m = a[i * n + j] / a[j * n + j];
+			for (int c = j; c < n; c++) a[i * n + c] -= m * a[j * n + c];
+			b[i] -= m * b[j];
+		}
+	}
+	for (int j = n - 1; j >= 0; j--) {
+		for (int c = j + 1; c < n; c++) b[j] -= a[j * n + c] * b[c];
+		b[j] /= a[j * n + j];
+	}
+	return 1;
+}
+
+vector* ST_solver_solve(stsolver *s) {
+	// Solves the edited system under the frame's forces and fills node.disp, beam.force and
+	//    constraint.force like ST_solve
+	vector *load = ST_load_vector(s->f, s->d);
+	vector *u = ST_solver_solve_load(s, load);
+	MAT_freevector(load);
+	return u;
+}
+
+vector* ST_solver_solve_load(stsolver *s, vector *load) {
+	// As ST_solver_solve, for a given reduced load vector (ST_load_vector plus any extra terms).
+	// With edits U C U^T on top of the factored K, the Woodbury identity gives
+	//    x = y - W (C^-1 + U^T W)^-1 U^T y, where y = K^-1 b and W = K^-1 U.
+	int n = s->d->dofcount;
+	if (load->rows != n) stiffutilerror("ST_solver_solve_load: load does not match the free dofs");
+	if (s->stale) ST_solver_refactor(s);
+	int r = s->rank;
+	double *x = (double *) malloc((n + 1) * sizeof (double));
+	double *cap = (double *) malloc((r * r + 1) * sizeof (double));
+	double *t = (double *) malloc((r + 1) * sizeof (double));
+	if (!x || !cap || !t) stiffutilerror("ST_solver_solve: failure to allocate workspace");
+	for (int i = 0; i < n; i++) x[i] = load->vec[i];
+	MAT_solve_ldl_array(s->lf, x, s->work);
+
+	// Capacitance matrix and U^T y
+	double scale = 0, dot;
+	double *w;
+	for (int e = 0; e < r; e++) {
+		t[e] = 0;
+		for (int q = 0; q < s->ucount[e]; q++) t[e] += s->uproj[4 * e + q] * x[s->udofs[4 * e + q]];
+		for (int c = 0; c < r; c++) {
+			w = s->w + (long long) c * n;
+			dot = 0;
+			for (int q = 0; q < s->ucount[e]; q++) dot += s->uproj[4 * e + q] * w[s->udofs[4 * e + q]];
+			cap[e * r + c] = dot;
+		}
+		cap[e * r + e] += 1 / s->dk[e];
+		if (fabs(1 / s->dk[e]) > scale) scale = fabs(1 / s->dk[e]);
+	}
+
+	if (r && !ST_solve_dense(cap, t, r, ST_CAPACITANCE_TOL * scale)) {
+		// The edits leave the update system singular (for instance a mechanism); refactor from scratch,
+		//    which reports a singular frame properly
+		free(x);
+		free(cap);
+		free(t);
+		ST_solver_refactor(s);
+		return ST_solver_solve_load(s, load);
+	}
+	for (int e = 0; e < r; e++) {
+		w = s->w + (long long) e * n;
+		for (int i = 0; i < n; i++) x[i] -= w[i] * t[e];
+	}
+
+	vector *u = MAT_vector(n, MAT_NO);
+	for (int i = 0; i < n; i++) u->vec[i] = (float) x[i];
+	ST_set_displacements(s->f, s->d, u);
+	ST_recover_forces(s->f);
+
+	free(x);
+	free(cap);
+	free(t);
+	return u;
+}
+
+// ---- Geometrically nonlinear solves ----
+// Equilibrium on the deformed geometry. Each beam is a bar with force N = EA (l - L) / L in its
+//    current direction e, where l is its current length and L its unloaded length, so any rotation
+//    of the beam is exact. Its tangent stiffness is EA / L e e^T + N / l (I - e e^T), block signed
+//    by beam end as in the linear case; the second term is the geometric stiffness, which softens
+//    compressed beams and stiffens tensioned ones.
+
+typedef struct ST_nl ST_nl;
+struct ST_nl {
+	// Working state of ST_solve_nonlinear. Element tangents and forces are computed in parallel
+	//    over beams, one slot per beam, then gathered into K and the internal force vector in
+	//    parallel over entries, so no two threads write the same value.
+	frame *f;
+	dofmap *d;
+	int n; // free dofs
+	spmatrix *k; // tangent stiffness; its pattern never changes, so its analysis is reused
+	spsymbolic *sym;
+	spfactor *lf;
+	int *ecount; // free dofs of each beam (at most 4)
+	int *edofs; // 4 per beam
+	double *len; // unloaded beam lengths
+	double *ke; // 16 per beam: element tangent
+	double *fe; // 4 per beam: element internal forces on its dofs
+	double *axial; // force N in each beam
+	int *kstart; // ke entries summed into k->val[p] are ke[kitem[kstart[p]] ... kitem[kstart[p + 1] - 1]]
+	int *kitem;
+	int *fstart; // fe entries summed into internal force i, likewise
+	int *fitem;
+	double *load; // reference load F (reduced), scaled by the load factor
+	double fnorm;
+	double rtol; // converged residual: ST_NL_TOL (|F| + |beam end forces|), rounding grows with both
+	double *u;
+	double *r; // residual lambda F - internal forces
+	double *uf; // K^-1 F for the current factor
+	double *du;
+	double *work;
+	double *nd; // node displacements, x and y per node
+	int track; // node and direction whose displacement the path records
+	coor tdir;
+	stpath *path;
+};
+
+static void ST_nl_elements(ST_nl *s) {
+	// Node displacements, then every beam's force, internal forces and tangent at the current u
+	frame *f = s->f;
+	dofmap *d = s->d;
+	#pragma omp parallel for schedule(static)
+	for (int i = 0; i < f->nodecount; i++) {
+		double x = 0, y = 0;
+		for (int q = 0; q < d->ndof[i]; q++) {
+			x += s->u[d->first[i] + q] * d->basis[2 * i + q].x;
+			y += s->u[d->first[i] + q] * d->basis[2 * i + q].y;
+		}
+		s->nd[2 * i] = x;
+		s->nd[2 * i + 1] = y;
+	}
+	int collapsed = 0;
+	#pragma omp parallel for schedule(static)
+	for (int i = 0; i < f->beamcount; i++) {
+		beam *b = f->beams + i;
+		int ends[2] = {b->n1_idx, b->n2_idx};
+		double ex = (double) f->nodes[b->n2_idx].loc.x + s->nd[2 * b->n2_idx]
+			- f->nodes[b->n1_idx].loc.x - s->nd[2 * b->n1_idx];
+		double ey = (double) f->nodes[b->n2_idx].loc.y + s->nd[2 * b->n2_idx + 1]
+			- f->nodes[b->n1_idx].loc.y - s->nd[2 * b->n1_idx + 1];
+		double l = sqrt(ex * ex + ey * ey);
+		if (l <= 0) {
+			#pragma omp atomic write
+			collapsed = 1;
+			continue;
+		}
+		ex /= l;
+		ey /= l;
+		double ka = b->stiffness / s->len[i];
+		double n = ka * (l - s->len[i]);
+		double g = n / l;
+		s->axial[i] = n;
+
+		coor v[4];
+		double proj[4];
+		int end[4], count = 0;
+		for (int e = 0; e < 2; e++) {
+			for (int q = 0; q < d->ndof[ends[e]]; q++) {
+				v[count] = d->basis[2 * ends[e] + q];
+				proj[count] = ex * v[count].x + ey * v[count].y;
+				end[count] = e;
+				count++;
+			}
+		}
+		for (int r = 0; r < count; r++) {
+			s->fe[4 * i + r] = (end[r] ? 1 : -1) * n * proj[r];
+			for (int c = 0; c < count; c++) {
+				s->ke[16 * i + 4 * r + c] = (end[r] == end[c] ? 1 : -1) * (ka * proj[r] * proj[c]
+					+ g * ((double) v[r].x * v[c].x + (double) v[r].y * v[c].y - proj[r] * proj[c]));
+			}
+		}
+	}
+	if (collapsed) stiffutilerror("ST_solve_nonlinear: a beam has collapsed to zero length");
+}
+
+static double ST_nl_residual(ST_nl *s, double lambda) {
+	// Updates the elements, r = lambda F - internal forces and the converged residual; returns |r|
+	ST_nl_elements(s);
+	double norm = 0, fe = 0;
+	#pragma omp parallel for schedule(static) reduction(+:norm, fe)
+	for (int i = 0; i < s->n; i++) {
+		double fi = 0;
+		for (int q = s->fstart[i]; q < s->fstart[i + 1]; q++) {
+			fi += s->fe[s->fitem[q]];
+			fe += s->fe[s->fitem[q]] * s->fe[s->fitem[q]];
+		}
+		s->r[i] = lambda * s->load[i] - fi;
+		norm += s->r[i] * s->r[i];
+	}
+	s->rtol = ST_NL_TOL * (s->fnorm + sqrt(fe));
+	return sqrt(norm);
+}
+
+static int ST_nl_refactor(ST_nl *s) {
+	// Gathers the element tangents into K and factors it, then updates K^-1 F.
+	// A singular tangent (exactly at a limit point) keeps the previous factor; returns 0 if there
+	//    is none.
+	spmatrix *k = s->k;
+	#pragma omp parallel for schedule(static)
+	for (int p = 0; p < k->nnz; p++) {
+		double v = 0;
+		for (int q = s->kstart[p]; q < s->kstart[p + 1]; q++) v += s->ke[s->kitem[q]];
+		k->val[p] = v;
+	}
+
+	// Stable frames use the supernodal Cholesky where it pays; past a limit point the tangent is
+	//    indefinite and only the simplicial LDL^T (no pivoting) will factor it
+	spfactor *lf = NULL;
+	if (s->n >= ST_SUPERNODAL_MIN) lf = MAT_factor_chol_sn(k, s->sym);
+	if (!lf) lf = MAT_try_factor_ldl(k, s->sym);
+	if (!lf) return s->lf != NULL;
+	if (s->lf) MAT_freeldl(s->lf);
+	s->lf = lf;
+	s->path->factors++;
+
+	for (int i = 0; i < s->n; i++) s->uf[i] = s->load[i];
+	MAT_solve_ldl_array(s->lf, s->uf, s->work);
+	s->path->solves++;
+	return 1;
+}
+
+static void ST_nl_record(ST_nl *s, double lambda) {
+	stpath *p = s->path;
+	if (p->count == p->cap) {
+		p->cap *= 2;
+		p->lambda = (double *) realloc(p->lambda, p->cap * sizeof (double));
+		p->disp = (double *) realloc(p->disp, p->cap * sizeof (double));
+		if (!p->lambda || !p->disp) stiffutilerror("ST_solve_nonlinear: failure to grow path");
+	}
+	p->lambda[p->count] = lambda;
+	p->disp[p->count] = s->nd[2 * s->track] * s->tdir.x + s->nd[2 * s->track + 1] * s->tdir.y;
+	p->count++;
+}
+
+static int ST_nl_newton(ST_nl *s, double lambda) {
+	// Modified Newton at a fixed load factor: the factor is reused for as long as each iteration
+	//    cuts the residual by ST_NL_SLOW, and refactored at the current state when one does not.
+	// Returns 1 once |r| is down to rtol, 0 if that takes more than ST_NL_MAXITER iterations.
+	double rnorm = ST_nl_residual(s, lambda), prev;
+	for (int it = 0; it < ST_NL_MAXITER; it++) {
+		if (rnorm <= s->rtol) return 1;
+		for (int i = 0; i < s->n; i++) s->du[i] = s->r[i];
+		MAT_solve_ldl_array(s->lf, s->du, s->work);
+		s->path->solves++;
+		s->path->iterations++;
+		for (int i = 0; i < s->n; i++) s->u[i] += s->du[i];
+		prev = rnorm;
+		rnorm = ST_nl_residual(s, lambda);
+		if (rnorm > ST_NL_SLOW * prev && !ST_nl_refactor(s)) return 0;
+	}
+	return rnorm <= s->rtol;
+}
+
+static double ST_nl_load_steps(ST_nl *s, double lambda, double target, int steps, double *saved) {
+	// Load control from lambda up to target in steps equal increments, halving an increment (up to
+	//    ST_NL_CUTS times in all) whenever it fails to converge and growing it back after each
+	//    success. Returns the load factor reached.
+	double full = (target - lambda) / steps, dl = full, next;
+	int cuts = 0;
+	while (lambda < target) {
+		next = fmin(target, lambda + dl);
+		if (target - next < 1e-12 * target) next = target;
+		for (int i = 0; i < s->n; i++) saved[i] = s->u[i];
+		if (ST_nl_newton(s, next)) {
+			lambda = next;
+			ST_nl_record(s, lambda);
+			dl = fmin(full, 2 * dl);
+			continue;
+		}
+		for (int i = 0; i < s->n; i++) s->u[i] = saved[i];
+		if (++cuts > ST_NL_CUTS) break;
+		dl /= 2;
+		ST_nl_elements(s);
+		ST_nl_refactor(s);
+	}
+	return lambda;
+}
+
+static double ST_nl_arc_steps(ST_nl *s, int steps, double *saved) {
+	// Arc-length continuation (Riks, with the correction kept in the plane normal to each step's
+	//    predictor), so the path can pass limit points where the load has to fall for equilibrium
+	//    to continue. Each iteration takes two back substitutions with the same factor: K^-1 r,
+	//    and K^-1 F, which is kept with the factor. The predictor follows the previous step's
+	//    direction through limit points. The arc length starts at 1 / steps of the linear
+	//    displacement under F and adapts to the iterations each step takes.
+	// Stops once the load factor passes 1, finishing with a load controlled step to exactly 1.
+	// Returns the load factor reached.
+	int n = s->n;
+	double *dup = (double *) malloc((n + 1) * sizeof (double));
+	double *prevstep = (double *) calloc(n + 1, sizeof (double));
+	if (!dup || !prevstep) stiffutilerror("ST_solve_nonlinear: failure to allocate workspace");
+	double norm = 0;
+	for (int i = 0; i < n; i++) norm += s->uf[i] * s->uf[i];
+	double ds = sqrt(norm) / steps;
+	double lambda = 0, lsaved, dl, dot, dotf, rnorm, prev;
+	int cuts = 0, it, converged, first = 1;
+	for (int step = 0; step < ST_NL_MAX_STEPS && lambda < 1; step++) {
+		for (int i = 0; i < n; i++) saved[i] = s->u[i];
+		lsaved = lambda;
+
+		// Predictor along the tangent, in the direction the path was already going
+		norm = dot = 0;
+		for (int i = 0; i < n; i++) {
+			norm += s->uf[i] * s->uf[i];
+			dot += s->uf[i] * prevstep[i];
+		}
+		dl = (first || dot >= 0 ? 1 : -1) * ds / sqrt(norm);
+		for (int i = 0; i < n; i++) {
+			dup[i] = dl * s->uf[i];
+			s->u[i] += dup[i];
+		}
+		lambda += dl;
+
+		// Corrector: modified Newton with the load factor as an extra unknown
+		rnorm = ST_nl_residual(s, lambda);
+		converged = 0;
+		for (it = 0; it < ST_NL_MAXITER; it++) {
+			if (rnorm <= s->rtol) {
+				converged = 1;
+				break;
+			}
+			for (int i = 0; i < n; i++) s->du[i] = s->r[i];
+			MAT_solve_ldl_array(s->lf, s->du, s->work);
+			s->path->solves++;
+			s->path->iterations++;
+			dot = dotf = 0;
+			for (int i = 0; i < n; i++) {
+				dot += dup[i] * s->du[i];
+				dotf += dup[i] * s->uf[i];
+			}
+			dl = -dot / dotf;
+			for (int i = 0; i < n; i++) s->u[i] += s->du[i] + dl * s->uf[i];
+			lambda += dl;
+			prev = rnorm;
+			rnorm = ST_nl_residual(s, lambda);
+			if (rnorm > ST_NL_SLOW * prev && !ST_nl_refactor(s)) break;
+		}
+		if (!converged) {
+			for (int i = 0; i < n; i++) s->u[i] = saved[i];
+			lambda = lsaved;
+			ST_nl_elements(s);
+			ST_nl_refactor(s);
+			if (++cuts > ST_NL_CUTS) break;
+			ds /= 2;
+			step--;
+			continue;
+		}
+		if (lambda > 1) {
+			// Overshot the full load: back to the last point, then load control up to it
+			for (int i = 0; i < n; i++) s->u[i] = saved[i];
+			ST_nl_elements(s);
+			ST_nl_refactor(s);
+			lambda = ST_nl_load_steps(s, lsaved, 1, 1, saved);
+			break;
+		}
+		for (int i = 0; i < n; i++) prevstep[i] = s->u[i] - saved[i];
+		first = 0;
+		ST_nl_record(s, lambda);
+		ds *= fmin(2, fmax(0.5, sqrt((double) ST_NL_TARGET / (it + 1))));
+	}
+	free(dup);
+	free(prevstep);
+	return lambda;
+}
+
+stpath* ST_solve_nonlinear(frame *f, int steps, int arclength) {
+	// Geometrically nonlinear static solve under the frame's forces, applied in steps increments
+	//    of the load factor (load control), or traced by arc-length continuation. Fills node.disp,
+	//    beam.force and constraint.force at the last converged point, and returns the path.
+	//    The path stops short of load factor 1 if load control meets a limit point (the frame
+	//    buckles or snaps through) or continuation runs out of steps.
+	// Factorizations are reused across iterations and steps for as long as convergence stays fast,
+	//    so most of the work is back substitutions.
+	if (f->instancecount) stiffutilerror("ST_solve_nonlinear: module instances are not supported");
+	if (steps < 1) steps = 1;
+	ST_nl *s = (ST_nl *) malloc(sizeof (ST_nl));
+	if (!s) stiffutilerror("ST_solve_nonlinear: failure to allocate state");
+	s->f = f;
+	s->d = ST_dofmap(f);
+	int n = s->n = s->d->dofcount;
+	if (n == 0) stiffutilerror("ST_solve_nonlinear: frame has no free degrees of freedom");
+	int nb = f->beamcount;
+	s->ecount = (int *) malloc((nb + 1) * sizeof (int));
+	s->edofs = (int *) malloc((4 * nb + 1) * sizeof (int));
+	s->len = (double *) malloc((nb + 1) * sizeof (double));
+	s->ke = (double *) calloc(16 * nb + 1, sizeof (double));
+	s->fe = (double *) calloc(4 * nb + 1, sizeof (double));
+	s->axial = (double *) malloc((nb + 1) * sizeof (double));
+	s->load = (double *) malloc((n + 1) * sizeof (double));
+	s->u = (double *) calloc(n + 1, sizeof (double));
+	s->r = (double *) malloc((n + 1) * sizeof (double));
+	s->uf = (double *) malloc((n + 1) * sizeof (double));
+	s->du = (double *) malloc((n + 1) * sizeof (double));
+	s->work = (double *) malloc((n + 1) * sizeof (double));
+	s->nd = (double *) malloc((2 * f->nodecount + 1) * sizeof (double));
+	double *saved = (double *) malloc((n + 1) * sizeof (double));
+	if (!s->ecount || !s->edofs || !s->len || !s->ke || !s->fe || !s->axial || !s->load || !s->u
+		|| !s->r || !s->uf || !s->du || !s->work || !s->nd || !saved) {
+		stiffutilerror("ST_solve_nonlinear: failure to allocate state");
+	}
+
+	// Pattern of K, and the gather lists of element entries into it
+	triplet *t = MAT_triplet(n, n, 16 * nb + 1);
+	int dofs[4], count;
+	double proj[4], k;
+	for (int i = 0; i < nb; i++) {
+		count = ST_beam_projection(f, s->d, f->beams + i, dofs, proj, &k);
+		s->len[i] = f->beams[i].stiffness / k;
+		s->ecount[i] = count;
+		for (int r = 0; r < count; r++) {
+			s->edofs[4 * i + r] = dofs[r];
+			for (int c = 0; c < count; c++) MAT_triplet_add(t, dofs[r], dofs[c], 1);
+		}
+	}
+	s->k = MAT_compress(t);
+	MAT_freetriplet(t);
+	int nnz = s->k->nnz;
+	s->kstart = (int *) calloc(nnz + 1, sizeof (int));
+	s->kitem = (int *) malloc((16 * nb + 1) * sizeof (int));
+	s->fstart = (int *) calloc(n + 1, sizeof (int));
+	s->fitem = (int *) malloc((4 * nb + 1) * sizeof (int));
+	int *epos = (int *) malloc((16 * nb + 1) * sizeof (int));
+	if (!s->kstart || !s->kitem || !s->fstart || !s->fitem || !epos) stiffutilerror("ST_solve_nonlinear: failure to allocate state");
+	int p, dr, dc;
+	for (int i = 0; i < nb; i++) {
+		for (int r = 0; r < s->ecount[i]; r++) {
+			dr = s->edofs[4 * i + r];
+			s->fstart[dr + 1]++;
+			for (int c = 0; c < s->ecount[i]; c++) {
+				dc = s->edofs[4 * i + c];
+				p = s->k->colptr[dc];
+				while (s->k->rowidx[p] != dr) p++;
+				epos[16 * i + 4 * r + c] = p;
+				s->kstart[p + 1]++;
+			}
+		}
+	}
+	for (int q = 0; q < nnz; q++) s->kstart[q + 1] += s->kstart[q];
+	for (int q = 0; q < n; q++) s->fstart[q + 1] += s->fstart[q];
+	int *kfill = (int *) malloc((nnz + 1) * sizeof (int));
+	int *ffill = (int *) malloc((n + 1) * sizeof (int));
+	if (!kfill || !ffill) stiffutilerror("ST_solve_nonlinear: failure to allocate state");
+	for (int q = 0; q < nnz; q++) kfill[q] = s->kstart[q];
+	for (int q = 0; q < n; q++) ffill[q] = s->fstart[q];
+	for (int i = 0; i < nb; i++) {
+		for (int r = 0; r < s->ecount[i]; r++) {
+			s->fitem[ffill[s->edofs[4 * i + r]]++] = 4 * i + r;
+			for (int c = 0; c < s->ecount[i]; c++) {
+				s->kitem[kfill[epos[16 * i + 4 * r + c]]++] = 16 * i + 4 * r + c;
+			}
+		}
+	}
+	free(epos);
+	free(kfill);
+	free(ffill);
+	s->sym = MAT_analyse_sym(s->k);
+	s->lf = NULL;
+
+	vector *load = ST_load_vector(f, s->d);
+	s->fnorm = 0;
+	for (int i = 0; i < n; i++) {
+		s->load[i] = load->vec[i];
+		s->fnorm += s->load[i] * s->load[i];
+	}
+	MAT_freevector(load);
+	s->fnorm = sqrt(s->fnorm);
+	if (s->fnorm == 0) s->fnorm = 1;
+
+	// The path follows the most heavily loaded node along its load
+	vector *full = UN_get_forces(f);
+	float fmax = -1, fx, fy;
+	s->track = 0;
+	s->tdir = (coor) {1, 0};
+	for (int i = 0; i < f->nodecount; i++) {
+		fx = full->vec[i];
+		fy = full->vec[i + f->nodecount];
+		if (sqrtf(fx * fx + fy * fy) <= fmax) continue;
+		fmax = sqrtf(fx * fx + fy * fy);
+		s->track = i;
+		if (fmax > 0) s->tdir = (coor) {fx / fmax, fy / fmax};
+	}
+
+	s->path = (stpath *) malloc(sizeof (stpath));
+	if (!s->path) stiffutilerror("ST_solve_nonlinear: failure to allocate path");
+	stpath *path = s->path;
+	path->count = 0;
+	path->cap = 16;
+	path->lambda = (double *) malloc(path->cap * sizeof (double));
+	path->disp = (double *) malloc(path->cap * sizeof (double));
+	if (!path->lambda || !path->disp) stiffutilerror("ST_solve_nonlinear: failure to allocate path");
+	path->iterations = 0;
+	path->solves = 0;
+	path->factors = 0;
+
+	ST_nl_elements(s);
+	if (!ST_nl_refactor(s)) stiffutilerror("ST_solve_nonlinear: stiffness matrix is singular (the frame is a mechanism or not fully constrained)");
+	ST_nl_record(s, 0);
+	if (arclength) ST_nl_arc_steps(s, steps, saved);
+	else ST_nl_load_steps(s, 0, 1, steps, saved);
+
+	// Results at the last converged point
+	ST_nl_elements(s);
+	for (int i = 0; i < f->nodecount; i++) f->nodes[i].disp = (coor) {s->nd[2 * i], s->nd[2 * i + 1]};
+	int nn = f->nodecount;
+	float *resid = (float *) malloc(2 * nn * sizeof (float));
+	if (!resid) stiffutilerror("ST_solve_nonlinear: failure to allocate resid");
+	double lambda = path->lambda[path->count - 1];
+	for (int i = 0; i < 2 * nn; i++) resid[i] = lambda * full->vec[i];
+	MAT_freevector(full);
+	beam *b;
+	double ex, ey, l;
+	for (int i = 0; i < nb; i++) {
+		b = f->beams + i;
+		b->force = s->axial[i];
+		ex = (double) f->nodes[b->n1_idx].loc.x + s->nd[2 * b->n1_idx] - f->nodes[b->n2_idx].loc.x - s->nd[2 * b->n2_idx];
+		ey = (double) f->nodes[b->n1_idx].loc.y + s->nd[2 * b->n1_idx + 1] - f->nodes[b->n2_idx].loc.y - s->nd[2 * b->n2_idx + 1];
+		l = sqrt(ex * ex + ey * ey);
+		resid[b->n1_idx] -= s->axial[i] * ex / l;
+		resid[b->n1_idx + nn] -= s->axial[i] * ey / l;
+		resid[b->n2_idx] += s->axial[i] * ex / l;
+		resid[b->n2_idx + nn] += s->axial[i] * ey / l;
+	}
+	ST_split_reactions(f, resid);
+	free(resid);
+
+	MAT_freeldl(s->lf);
+	MAT_freesymbolic(s->sym);
+	MAT_freespmatrix(s->k);
+	ST_free_dofmap(s->d);
+	free(s->ecount);
+	free(s->edofs);
+	free(s->len);
+	free(s->ke);
+	free(s->fe);
+	free(s->axial);
+	free(s->kstart);
+	free(s->kitem);
+	free(s->fstart);
+	free(s->fitem);
+	free(s->load);
+	free(s->u);
+	free(s->r);
+	free(s->uf);
+	free(s->du);
+	free(s->work);
+	free(s->nd);
+	free(saved);
+	free(s);
+	return path;
+}
+
+void ST_free_path(stpath *p) {
+	free(p->lambda);
+	free(p->disp);
+	free(p);
+}
+
+eigen* ST_buckling(frame *f, dofmap *d, int count) {
+	// Linear buckling of the solved frame: the count smallest positive load factors lambda at which
+	//    K + lambda Kg turns singular, Kg being the geometric stiffness of the current beam forces,
+	//    and their mode shapes (K-orthonormal, over the free dofs of d). K is factored once, reusing
+	//    the analysis cached on the frame, and each Lanczos step is one back substitution with it.
+	// Fewer than count modes come back if fewer beams are in compression than that needs.
+	if (d->dofcount == 0) stiffutilerror("ST_buckling: frame has no free degrees of freedom");
+	spmatrix *k = ST_assemble_stiffness(f, d);
+	spmatrix *g = ST_assemble_geometric(f, d);
+	spfactor *lf = ST_factor(f, k);
+	int dim = 4 * count + ST_BUCKLING_EXTRA;
+	eigen *e = MAT_eigs_buckling(k, lf, g, count, ST_BUCKLING_TOL, dim);
+	MAT_freeldl(lf);
+	MAT_freespmatrix(k);
+	MAT_freespmatrix(g);
+	return e;
+}
+
+void ST_set_mode(frame *f, dofmap *d, eigen *e, int mode) {
+	// Puts eigenvector mode of e (over the free dofs of d) into node.disp, scaled to a largest node
+	//    displacement of 1
+	double big = 0, s;
+	coor u, v;
+	for (int i = 0; i < f->nodecount; i++) {
+		u = (coor) {0, 0};
+		for (int k = 0; k < d->ndof[i]; k++) {
+			v = d->basis[2 * i + k];
+			s = e->vectors[(long long) mode * e->n + d->first[i] + k];
+			u.x += s * v.x;
+			u.y += s * v.y;
+		}
+		f->nodes[i].disp = u;
+		big = fmax(big, sqrt(u.x * u.x + u.y * u.y));
+	}
+	if (big <= 0) return;
+	for (int i = 0; i < f->nodecount; i++) {
+		f->nodes[i].disp.x /= big;
+		f->nodes[i].disp.y /= big;
+	}
+}
\ No newline at end of file
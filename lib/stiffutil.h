@@ -0,0 +1,134 @@
+#ifndef _STIFFUTIL_
+#define _STIFFUTIL_
+
+#include "matutil.h"
+#include "undefs.h"
+
+/*
+Direct stiffness method for pin-jointed frames.
+Each beam contributes EA/L along its axis. Constraints are rollers: a constraint at angle theta
+   stops a node moving along (cos theta, sin theta). Constrained directions are removed exactly
+   by giving every node a local basis of its free directions:
+ - no constraints: 2 free dofs along x and y
+ - one constraint: 1 free dof perpendicular to the constraint
+ - two or more independent constraints: fixed
+The reduced stiffness matrix K is symmetric positive definite for any stable frame,
+   statically determinate or not.
+K is factored by sparse LDL^T. The symbolic analysis is kept on the frame and reused for as long
+   as the pattern of K stays the same (same beams and constraints), so refactoring after geometry or
+   stiffness changes only repeats the numeric phase.
+Beam edits (adding, removing or resizing beams) re-solve through an stsolver, which corrects the
+   existing factor by low-rank updates instead of refactoring. Ground springs on single nodes
+   (contacts against walls in unsafe) go through the same updates.
+For the largest frames ST_solve_dd splits K into subdomains instead (MAT_solve_dd): each interior is
+   factored on its own thread and only the interface is solved iteratively.
+Repeated substructures (modules) are condensed onto their interface nodes once by
+   ST_condense_module. Each instance then adds only the rotated interface stiffness to K, and its
+   internal displacements and beam forces are recovered after the solve.
+Mirror-symmetric frames (UN_find_mirror) are solved by ST_solve_sym on the symmetric and
+   antisymmetric halves (quarters for two mirrors) of the dof space separately: the loads are split
+   by symmetry type, each part goes through a factorization about half (a quarter) the size, and
+   the parts are added back together.
+When the instances form a chain (bridges, towers: each bay's far interface is the next bay's near
+   one), ST_solve_chain eliminates bay by bay instead, in O(bays) time, and stops storing new bay
+   factors once the elimination has settled into the periodic part of the chain.
+ST_buckling finds the critical load factors of a solved frame from the geometric stiffness of its
+   beam forces (linear buckling), with one factorization of K.
+ST_solve_nonlinear finds equilibrium on the deformed geometry (large displacements and rotations,
+   linear bars), by load stepping with modified Newton iterations or by arc-length continuation
+   through limit points (snap-through, buckling).
+Reaction convention matches the connectivity solver in unsafe-r: applied forces equal the sum of
+   beam tensions times their direction cosines plus constraint forces times (cos theta, sin theta).
+*/
+
+typedef struct dofmap dofmap;
+struct dofmap {
+	int nodecount;
+	int dofcount;
+	int *first; // first reduced dof of node i
+	int *ndof; // number of free dofs of node i (0, 1 or 2)
+	coor *basis; // basis[2 * i + k] is the direction of free dof k of node i
+};
+
+// Beam edits absorbed as low-rank corrections before an stsolver refactors
+#define ST_MAX_RANK 32
+
+typedef struct stsolver stsolver;
+struct stsolver {
+	// A factored stiffness system that takes beam edits without refactoring.
+	// Each edit changes K by dk a a^T for one beam. Up to ST_MAX_RANK edits are applied through the
+	//    Sherman-Morrison-Woodbury identity against the original factor; past that the solver goes
+	//    stale and the next solve refactors, once, however many more edits come first.
+	frame *f; // not owned; edits are applied to it
+	dofmap *d;
+	spfactor *lf;
+	spsymbolic *sym; // lf's analysis, owned here so that other solves of f cannot replace it
+	int rank;
+	int *ucount; // free dofs touched by each edit (at most 4)
+	int *udofs; // 4 per edit
+	double *uproj; // 4 per edit: the beam's projection a onto those dofs
+	double *dk; // stiffness change EA / L of each edit
+	double *w; // K^-1 a of each edit, dofcount per edit
+	double *work;
+	int refactors; // number of refactorizations so far (including the first)
+	int stale; // nonzero once edits have overflowed the update slots
+	// Springs from single nodes to the ground (contacts), K += k n n^T along direction n. They are
+	//    absorbed like beam edits when added or removed, and assembled into K on every refactor.
+	int springcount; // slots in use, including removed springs (k == 0)
+	int springcap;
+	int *snode;
+	coor *sdir;
+	double *sk;
+};
+
+typedef struct stpath stpath;
+struct stpath {
+	// Equilibrium path traced by ST_solve_nonlinear, one point per converged step
+	int count;
+	int cap;
+	double *lambda; // load factor (1 is the applied load)
+	double *disp; // displacement of the most heavily loaded node along its load
+	int iterations;
+	int solves; // back substitutions
+	int factors; // tangent factorizations
+};
+
+void stiffutilerror(char *error_text);
+
+dofmap* ST_dofmap(frame *f);
+void ST_free_dofmap(dofmap *d);
+
+void ST_condense_module(module *m);
+spmatrix* ST_assemble_stiffness(frame *f, dofmap *d);
+spmatrix* ST_assemble_geometric(frame *f, dofmap *d);
+vector* ST_load_vector(frame *f, dofmap *d);
+void ST_set_displacements(frame *f, dofmap *d, vector *u);
+void ST_split_reactions(frame *f, float *resid);
+void ST_recover_forces(frame *f);
+void ST_recover_forces_from(frame *f, float *applied);
+
+spfactor* ST_factor(frame *f, spmatrix *k);
+spsymbolic* ST_symbolic(frame *f, spmatrix *k);
+vector* ST_solve(frame *f);
+vector* ST_solve_dd(frame *f, int nparts);
+vector* ST_solve_chain(frame *f, int *factors);
+vector* ST_solve_sym(frame *f, mirror **m, int count, int *blocks);
+
+stsolver* ST_solver(frame *f);
+stsolver* ST_solver_springs(frame *f, int count, int *idx, coor *dir, double *k);
+void ST_free_solver(stsolver *s);
+void ST_add_beam(stsolver *s, beam b);
+void ST_remove_beam(stsolver *s, int id);
+void ST_resize_beam(stsolver *s, int id, float stiffness);
+int ST_add_spring(stsolver *s, int idx, coor dir, double k);
+void ST_remove_spring(stsolver *s, int spring);
+vector* ST_solver_solve(stsolver *s);
+vector* ST_solver_solve_load(stsolver *s, vector *load);
+
+stpath* ST_solve_nonlinear(frame *f, int steps, int arclength);
+void ST_free_path(stpath *p);
+
+eigen* ST_buckling(frame *f, dofmap *d, int count);
+void ST_set_mode(frame *f, dofmap *d, eigen *e, int mode);
+
+#endif
\ No newline at end of file
@@ -3,6 +3,12 @@
 #include <math.h>
 #include "undefs.h"
 
+void undefserror(char *error_text) {
+	printf("Critical error in undefs.c\nError message follows:\n");
+	printf("%s\n", error_text);
+	exit(1);
+}
+
 void UN_printcoor(coor c) {
 	printf("<Coordinate X%8.4f Y%8.4f>", c.x, c.y);
 }
@@ -65,6 +71,12 @@ void UN_init_frame(frame *res, int bcount, int ncount, int fcount, int ccount, i
 	res->constraintcount = ccount;
 	res->walls = (wall *) malloc(wcount * sizeof (wall));
 	res->wallcount = wcount;
+	res->historycount = 0;
+	res->histories = NULL;
+	res->symbolic = NULL;
+	res->module = NULL;
+	res->instancecount = 0;
+	res->instances = NULL;
 }
 
 void UN_free_frame(frame *f) {
@@ -73,10 +85,41 @@ void UN_free_frame(frame *f) {
 	free(f->forces);
 	free(f->constraints);
 	free(f->walls);
+	for (int i = 0; i < f->historycount; i++) {
+		free(f->histories[i].t);
+		free(f->histories[i].s);
+	}
+	free(f->histories);
+	if (f->symbolic) MAT_freesymbolic(f->symbolic);
+	for (int i = 0; i < f->instancecount; i++) {
+		free(f->instances[i].frame_idx);
+		free(f->instances[i].forces);
+	}
+	free(f->instances);
+	if (f->module) UN_free_module(f->module);
 	free(f);
 }
 
+void UN_free_module(module *m) {
+	free(m->nodes);
+	free(m->interface);
+	free(m->beams);
+	free(m->bnodes);
+	free(m->inodes);
+	free(m->front);
+	free(m);
+}
+
+coor UN_instance_loc(instance *in, coor module_loc) {
+	// Frame coordinates of a point given in module coordinates
+	float c = cosf(in->theta);
+	float s = sinf(in->theta);
+	return (coor) {in->offset.x + c * module_loc.x - s * module_loc.y, in->offset.y + s * module_loc.x + c * module_loc.y};
+}
+
 node* UN_get_node(frame *f, int id) {
+	// Ids usually match positions in normalised frames; check there before scanning
+	if (id >= 0 && id < f->nodecount && f->nodes[id].id == id) return f->nodes + id;
 	for (int i = 0; i < f->nodecount; i++) {
 		if (f->nodes[i].id == id) {
 			return f->nodes + i;
@@ -86,6 +129,7 @@ node* UN_get_node(frame *f, int id) {
 }
 
 int UN_get_node_idx(frame *f, int id) {
+	if (id >= 0 && id < f->nodecount && f->nodes[id].id == id) return id;
 	for (int i = 0; i < f->nodecount; i++) {
 		if (f->nodes[i].id == id) {
 			return i;
@@ -95,6 +139,7 @@ int UN_get_node_idx(frame *f, int id) {
 }
 
 beam* UN_get_beam(frame *f, int id) {
+	if (id >= 0 && id < f->beamcount && f->beams[id].id == id) return f->beams + id;
 	for (int i = 0; i < f->beamcount; i++) {
 		if (f->beams[i].id == id) {
 			return f->beams + i;
@@ -103,13 +148,70 @@ beam* UN_get_beam(frame *f, int id) {
 	return NULL;
 }
 
+history* UN_get_history(frame *f, int id) {
+	for (int i = 0; i < f->historycount; i++) {
+		if (f->histories[i].id == id) {
+			return f->histories + i;
+		}
+	}
+	return NULL;
+}
+
+float UN_history_factor(history *h, float t) {
+	// Factor of the history at time t, by binary search for the interval holding t
+	if (!h) return 1;
+	if (t <= h->t[0]) return h->s[0];
+	if (t >= h->t[h->count - 1]) return h->s[h->count - 1];
+	int lo = 0, hi = h->count - 1, mid;
+	while (hi - lo > 1) {
+		mid = (lo + hi) / 2;
+		if (h->t[mid] <= t) lo = mid;
+		else hi = mid;
+	}
+	return h->s[lo] + (h->s[hi] - h->s[lo]) * (t - h->t[lo]) / (h->t[hi] - h->t[lo]);
+}
+
+typedef struct UN_id_idx UN_id_idx;
+struct UN_id_idx {
+	int id;
+	int idx;
+};
+
+static int UN_cmp_id_idx(const void *a, const void *b) {
+	int ia = ((const UN_id_idx *) a)->id;
+	int ib = ((const UN_id_idx *) b)->id;
+	return (ia > ib) - (ia < ib);
+}
+
 void UN_compute_beam_vals(frame *f) {
+	// Resolves beam node references to indices and computes beam lengths (and unstressed lengths,
+	//    where not already set).
+	// Node lookups go through a sorted id table, so this is O((n + b) log n) rather than O(n b).
+	UN_id_idx *lookup = (UN_id_idx *) malloc((f->nodecount + 1) * sizeof (UN_id_idx));
+	if (!lookup) undefserror("UN_compute_beam_vals: failure to allocate lookup");
+	for (int i = 0; i < f->nodecount; i++) lookup[i] = (UN_id_idx) {f->nodes[i].id, i};
+	qsort(lookup, f->nodecount, sizeof (UN_id_idx), UN_cmp_id_idx);
+
+	UN_id_idx key;
+	UN_id_idx *hit1, *hit2;
 	coor a, b;
 	for (int i = 0; i < f->beamcount; i++) {
-		a = UN_get_node(f, f->beams[i].n1_id)->loc;
-		b = UN_get_node(f, f->beams[i].n2_id)->loc;
+		key.id = f->beams[i].n1_id;
+		hit1 = bsearch(&key, lookup, f->nodecount, sizeof (UN_id_idx), UN_cmp_id_idx);
+		key.id = f->beams[i].n2_id;
+		hit2 = bsearch(&key, lookup, f->nodecount, sizeof (UN_id_idx), UN_cmp_id_idx);
+		if (!hit1 || !hit2) {
+			fprintf(stderr, "Beam id %d\n", f->beams[i].id);
+			undefserror("UN_compute_beam_vals: bad node reference in beam");
+		}
+		f->beams[i].n1_idx = hit1->idx;
+		f->beams[i].n2_idx = hit2->idx;
+		a = f->nodes[hit1->idx].loc;
+		b = f->nodes[hit2->idx].loc;
 		f->beams[i].length = UN_dist(a, b);
+		if (f->beams[i].orig_length <= 0) f->beams[i].orig_length = f->beams[i].length;
 	}
+	free(lookup);
 }
 
 vector* UN_get_forces(frame *f) {
@@ -125,4 +227,281 @@ vector* UN_get_forces(frame *f) {
 		res->vec[idx + offset] += frc.mag * sin(frc.theta);
 	}
 	return res;
+}
+
+// Comparison functions for UN_sort_frame. Every frame member struct leads with its id.
+static int UN_cmp_id(const void *a, const void *b) {
+	int ia = *(const int *) a;
+	int ib = *(const int *) b;
+	return (ia > ib) - (ia < ib);
+}
+
+void UN_sort_frame(frame *f) {
+	// Normalises a frame by putting every member array in id order, so that two files
+	//    describing the same frame with lines in a different order produce the same frame
+	qsort(f->nodes, f->nodecount, sizeof (node), UN_cmp_id);
+	qsort(f->beams, f->beamcount, sizeof (beam), UN_cmp_id);
+	qsort(f->forces, f->forcecount, sizeof (force), UN_cmp_id);
+	qsort(f->constraints, f->constraintcount, sizeof (constraint), UN_cmp_id);
+	qsort(f->walls, f->wallcount, sizeof (wall), UN_cmp_id);
+}
+
+// Tolerance on node positions when matching mirror images, relative to the frame's extent
+#define UN_MIRROR_TOL 1e-5
+
+typedef struct un_mkey un_mkey;
+struct un_mkey {
+	long long qa; // coordinate across the axis, in units of the matching tolerance
+	float b; // coordinate along the axis
+	int idx;
+};
+
+static int UN_cmp_mkey(const void *a, const void *b) {
+	const un_mkey *ka = (const un_mkey *) a;
+	const un_mkey *kb = (const un_mkey *) b;
+	if (ka->qa != kb->qa) return (ka->qa > kb->qa) - (ka->qa < kb->qa);
+	return (ka->b > kb->b) - (ka->b < kb->b);
+}
+
+static int UN_cmp_pair(const void *a, const void *b) {
+	// Beams by (lower, higher) node index, as int triples {lo, hi, beam index}
+	const int *pa = (const int *) a;
+	const int *pb = (const int *) b;
+	if (pa[0] != pb[0]) return (pa[0] > pb[0]) - (pa[0] < pb[0]);
+	return (pa[1] > pb[1]) - (pa[1] < pb[1]);
+}
+
+mirror* UN_find_mirror(frame *f, int axis) {
+	// Looks for a reflection of the frame about the vertical (UN_MIRROR_X) or horizontal
+	//    (UN_MIRROR_Y) line through the middle of its bounding box.
+	// Returns NULL if the frame is not symmetric about it. Frames with module instances are not
+	//    checked. Beam node indices must be set (UN_compute_beam_vals).
+	int n = f->nodecount;
+	if (n < 2 || f->instancecount) return NULL;
+	float lo = 1e30, hi = -1e30, blo = 1e30, bhi = -1e30, a, b;
+	for (int i = 0; i < n; i++) {
+		a = axis == UN_MIRROR_X ? f->nodes[i].loc.x : f->nodes[i].loc.y;
+		b = axis == UN_MIRROR_X ? f->nodes[i].loc.y : f->nodes[i].loc.x;
+		if (a < lo) lo = a;
+		if (a > hi) hi = a;
+		if (b < blo) blo = b;
+		if (b > bhi) bhi = b;
+	}
+	float tol = UN_MIRROR_TOL * (hi - lo > bhi - blo ? hi - lo : bhi - blo);
+	if (tol <= 0) return NULL;
+
+	mirror *m = (mirror *) malloc(sizeof (mirror));
+	un_mkey *keys = (un_mkey *) malloc(n * sizeof (un_mkey));
+	if (!m || !keys) undefserror("UN_find_mirror: failure to allocate");
+	m->axis = axis;
+	m->c = 0.5 * (lo + hi);
+	m->node = (int *) malloc(n * sizeof (int));
+	m->beam = (int *) malloc((f->beamcount + 1) * sizeof (int));
+	m->constraint = (int *) malloc((f->constraintcount + 1) * sizeof (int));
+	m->csign = (int *) malloc((f->constraintcount + 1) * sizeof (int));
+	if (!m->node || !m->beam || !m->constraint || !m->csign) undefserror("UN_find_mirror: failure to allocate");
+
+	// Nodes: sorted by (quantised distance across the axis, position along it), each image is
+	//    searched for in the three neighbouring quanta
+	for (int i = 0; i < n; i++) {
+		a = axis == UN_MIRROR_X ? f->nodes[i].loc.x : f->nodes[i].loc.y;
+		keys[i] = (un_mkey) {llroundf(a / tol), axis == UN_MIRROR_X ? f->nodes[i].loc.y : f->nodes[i].loc.x, i};
+	}
+	qsort(keys, n, sizeof (un_mkey), UN_cmp_mkey);
+	int ok = 1;
+	float ta, tb;
+	for (int i = 0; i < n && ok; i++) {
+		a = axis == UN_MIRROR_X ? f->nodes[i].loc.x : f->nodes[i].loc.y;
+		tb = axis == UN_MIRROR_X ? f->nodes[i].loc.y : f->nodes[i].loc.x;
+		ta = 2 * m->c - a;
+		m->node[i] = -1;
+		for (long long q = llroundf(ta / tol) - 1; q <= llroundf(ta / tol) + 1 && m->node[i] == -1; q++) {
+			un_mkey probe = {q, tb - tol, -1};
+			int l = 0, r = n;
+			while (l < r) {
+				int mid = (l + r) / 2;
+				if (UN_cmp_mkey(keys + mid, &probe) < 0) l = mid + 1;
+				else r = mid;
+			}
+			for (; l < n && keys[l].qa == q && keys[l].b <= tb + tol; l++) {
+				coor loc = f->nodes[keys[l].idx].loc;
+				if (fabsf((axis == UN_MIRROR_X ? loc.x : loc.y) - ta) <= tol) {
+					m->node[i] = keys[l].idx;
+					break;
+				}
+			}
+		}
+		ok = m->node[i] != -1;
+	}
+	for (int i = 0; i < n && ok; i++) ok = m->node[m->node[i]] == i;
+	free(keys);
+
+	// Beams: the image of a beam joins the images of its nodes and has the same stiffness
+	int *pairs = (int *) malloc((3 * f->beamcount + 1) * sizeof (int));
+	if (!pairs) undefserror("UN_find_mirror: failure to allocate");
+	beam *bm;
+	for (int i = 0; i < f->beamcount; i++) {
+		bm = f->beams + i;
+		pairs[3 * i] = bm->n1_idx < bm->n2_idx ? bm->n1_idx : bm->n2_idx;
+		pairs[3 * i + 1] = bm->n1_idx < bm->n2_idx ? bm->n2_idx : bm->n1_idx;
+		pairs[3 * i + 2] = i;
+	}
+	qsort(pairs, f->beamcount, 3 * sizeof (int), UN_cmp_pair);
+	for (int i = 0; i < f->beamcount && ok; i++) {
+		bm = f->beams + i;
+		int key[2] = {m->node[bm->n1_idx], m->node[bm->n2_idx]};
+		if (key[0] > key[1]) {
+			key[1] = key[0];
+			key[0] = m->node[bm->n2_idx];
+		}
+		int *hit = (int *) bsearch(key, pairs, f->beamcount, 3 * sizeof (int), UN_cmp_pair);
+		m->beam[i] = -1;
+		if (hit) {
+			// Rewind to the first beam on this pair, then take one of equal stiffness
+			while (hit > pairs && UN_cmp_pair(hit - 3, key) == 0) hit -= 3;
+			for (; hit < pairs + 3 * f->beamcount && UN_cmp_pair(hit, key) == 0; hit += 3) {
+				float s1 = bm->stiffness, s2 = f->beams[hit[2]].stiffness;
+				if (fabsf(s1 - s2) <= UN_MIRROR_TOL * fabsf(s1)) {
+					m->beam[i] = hit[2];
+					break;
+				}
+			}
+		}
+		ok = m->beam[i] != -1;
+	}
+	for (int i = 0; i < f->beamcount && ok; i++) ok = m->beam[m->beam[i]] == i;
+	free(pairs);
+
+	// Constraints: at the image node, parallel to the reflected direction
+	int *cnode = (int *) malloc((f->constraintcount + 1) * sizeof (int));
+	int *chead = (int *) malloc(n * sizeof (int)); // constraints by node, as linked lists
+	int *cnext = (int *) malloc((f->constraintcount + 1) * sizeof (int));
+	if (!cnode || !chead || !cnext) undefserror("UN_find_mirror: failure to allocate");
+	for (int i = 0; i < n; i++) chead[i] = -1;
+	for (int i = 0; i < f->constraintcount; i++) {
+		cnode[i] = UN_get_node_idx(f, f->constraints[i].n_id);
+		if (cnode[i] == -1) undefserror("UN_find_mirror: bad node reference in constraint");
+		cnext[i] = chead[cnode[i]];
+		chead[cnode[i]] = i;
+	}
+	float rx, ry, cross, dot;
+	for (int i = 0; i < f->constraintcount && ok; i++) {
+		rx = cosf(f->constraints[i].theta);
+		ry = sinf(f->constraints[i].theta);
+		if (axis == UN_MIRROR_X) rx = -rx;
+		else ry = -ry;
+		m->constraint[i] = -1;
+		for (int j = chead[m->node[cnode[i]]]; j != -1; j = cnext[j]) {
+			cross = rx * sinf(f->constraints[j].theta) - ry * cosf(f->constraints[j].theta);
+			dot = rx * cosf(f->constraints[j].theta) + ry * sinf(f->constraints[j].theta);
+			if (fabsf(cross) > 10 * UN_MIRROR_TOL) continue;
+			m->constraint[i] = j;
+			m->csign[i] = dot > 0 ? 1 : -1;
+			break;
+		}
+		ok = m->constraint[i] != -1;
+	}
+	free(cnode);
+	free(chead);
+	free(cnext);
+	for (int i = 0; i < f->constraintcount && ok; i++) ok = m->constraint[m->constraint[i]] == i;
+
+	if (!ok) {
+		UN_free_mirror(m);
+		return NULL;
+	}
+	return m;
+}
+
+void UN_free_mirror(mirror *m) {
+	free(m->node);
+	free(m->beam);
+	free(m->constraint);
+	free(m->csign);
+	free(m);
+}
+
+// 64 bit FNV-1a, fed one value at a time
+#define UN_HASH_SEED 14695981039346656037ULL
+#define UN_HASH_PRIME 1099511628211ULL
+
+static unsigned long long UN_hash_bytes(unsigned long long h, const void *data, int len) {
+	const unsigned char *c = (const unsigned char *) data;
+	for (int i = 0; i < len; i++) {
+		h ^= c[i];
+		h *= UN_HASH_PRIME;
+	}
+	return h;
+}
+
+static unsigned long long UN_hash_int(unsigned long long h, int v) {
+	return UN_hash_bytes(h, &v, sizeof (int));
+}
+
+static unsigned long long UN_hash_float(unsigned long long h, float v) {
+	if (v == 0) v = 0; // -0.0 and 0.0 hash identically
+	return UN_hash_bytes(h, &v, sizeof (float));
+}
+
+unsigned long long UN_hash_geometry(frame *f) {
+	// Hash of everything that goes into the connectivity matrix: nodes, beams and constraints,
+	//    plus any module instances.
+	// The frame should be normalised with UN_sort_frame first.
+	unsigned long long h = UN_HASH_SEED;
+	h = UN_hash_int(h, f->nodecount);
+	for (int i = 0; i < f->nodecount; i++) {
+		h = UN_hash_int(h, f->nodes[i].id);
+		h = UN_hash_float(h, f->nodes[i].loc.x);
+		h = UN_hash_float(h, f->nodes[i].loc.y);
+	}
+	h = UN_hash_int(h, f->beamcount);
+	for (int i = 0; i < f->beamcount; i++) {
+		h = UN_hash_int(h, f->beams[i].id);
+		h = UN_hash_int(h, f->beams[i].n1_id);
+		h = UN_hash_int(h, f->beams[i].n2_id);
+		h = UN_hash_float(h, f->beams[i].stiffness);
+	}
+	h = UN_hash_int(h, f->constraintcount);
+	for (int i = 0; i < f->constraintcount; i++) {
+		h = UN_hash_int(h, f->constraints[i].id);
+		h = UN_hash_int(h, f->constraints[i].n_id);
+		h = UN_hash_float(h, f->constraints[i].theta);
+	}
+	if (f->module) {
+		module *m = f->module;
+		h = UN_hash_int(h, m->nodecount);
+		for (int i = 0; i < m->nodecount; i++) {
+			h = UN_hash_int(h, m->interface[i]);
+			h = UN_hash_float(h, m->nodes[i].loc.x);
+			h = UN_hash_float(h, m->nodes[i].loc.y);
+		}
+		h = UN_hash_int(h, m->beamcount);
+		for (int i = 0; i < m->beamcount; i++) {
+			h = UN_hash_int(h, m->beams[i].n1_idx);
+			h = UN_hash_int(h, m->beams[i].n2_idx);
+			h = UN_hash_float(h, m->beams[i].stiffness);
+		}
+		h = UN_hash_int(h, f->instancecount);
+		for (int i = 0; i < f->instancecount; i++) {
+			h = UN_hash_int(h, f->instances[i].id);
+			h = UN_hash_float(h, f->instances[i].offset.x);
+			h = UN_hash_float(h, f->instances[i].offset.y);
+			h = UN_hash_float(h, f->instances[i].theta);
+			for (int k = 0; k < m->bcount; k++) h = UN_hash_int(h, f->instances[i].frame_idx[k]);
+		}
+	}
+	return h;
+}
+
+unsigned long long UN_hash_loads(frame *f) {
+	// Hash of the applied forces only
+	unsigned long long h = UN_HASH_SEED;
+	h = UN_hash_int(h, f->forcecount);
+	for (int i = 0; i < f->forcecount; i++) {
+		h = UN_hash_int(h, f->forces[i].id);
+		h = UN_hash_int(h, f->forces[i].n_id);
+		h = UN_hash_float(h, f->forces[i].theta);
+		h = UN_hash_float(h, f->forces[i].mag);
+	}
+	return h;
 }
\ No newline at end of file
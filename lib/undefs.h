@@ -14,6 +14,7 @@ typedef struct node node;
 struct node {
 	int id;
 	coor loc;
+	coor disp; // displacement under load (stiffness solvers)
 };
 
 typedef struct beam beam;
@@ -22,8 +23,22 @@ struct beam {
 	int n1_id;
 	int n2_id;
 	float length;
-	float orig_length; // For unsafe
+	float orig_length; // unstressed length (dynamics); UN_compute_beam_vals sets it to length if unset
 	float force;
+	float stiffness; // axial stiffness EA
+	int n1_idx; // node indices, filled in by UN_compute_beam_vals
+	int n2_idx;
+	float density; // mass per unit length (dynamics)
+};
+
+typedef struct history history;
+struct history {
+	// Time history of a load (dynamics): a factor on its magnitude, linear between the points
+	//    (t[i], s[i]) and held at the end values outside them
+	int id;
+	int count;
+	float *t; // ascending
+	float *s;
 };
 
 typedef struct force force;
@@ -32,8 +47,13 @@ struct force {
 	int n_id;
 	float theta;
 	float mag;
+	history *hist; // time history of mag (dynamics), or NULL for a constant load
 };
 
+// Tolerance on |sin| of the angle between two constraints at one node for them to count as
+//    independent, shared by the rigidity check and the stiffness dof map so that they agree
+#define UN_PARALLEL_TOL 1e-4
+
 typedef struct constraint constraint;
 struct constraint {
 	int id;
@@ -51,6 +71,34 @@ struct wall {
 	char above; // nonzero if points are constrained to above line
 };
 
+typedef struct module module;
+struct module {
+	// A substructure defined once and instanced many times (superelement).
+	// Nodes and beams are in module coordinates; beam n1_idx / n2_idx index the module nodes.
+	int nodecount;
+	node *nodes;
+	char *interface; // nonzero for nodes shared with the frame
+	int beamcount;
+	beam *beams;
+	int bcount; // interface nodes, in module node order
+	int *bnodes;
+	int icount; // internal nodes
+	int *inodes;
+	// Partially factored stiffness (stiffutil), column major over the 2 icount internal dofs followed
+	//    by the 2 bcount interface dofs. The leading block holds the Cholesky factor of the internal
+	//    stiffness, and the trailing lower triangle holds the condensed interface stiffness.
+	double *front;
+};
+
+typedef struct instance instance;
+struct instance {
+	int id;
+	coor offset; // rigid transform of the module: rotate by theta, then translate
+	float theta;
+	int *frame_idx; // frame node index of each module interface node
+	float *forces; // module beam forces in this instance
+};
+
 typedef struct frame frame;
 struct frame {
 	int beamcount;
@@ -63,8 +111,32 @@ struct frame {
 	constraint *constraints;
 	int wallcount;
 	wall *walls;
+	int historycount;
+	history *histories;
+	spsymbolic *symbolic; // cached sparse analysis of the stiffness matrix (stiffutil), or NULL
+	module *module; // repeated substructure, or NULL
+	int instancecount;
+	instance *instances;
 };
 
+// Mirror axes for UN_find_mirror
+#define UN_MIRROR_X 0 // x -> 2 c - x, about a vertical line
+#define UN_MIRROR_Y 1 // y -> 2 c - y, about a horizontal line
+
+typedef struct mirror mirror;
+struct mirror {
+	// A reflection that maps the frame onto itself: nodes onto nodes, beams onto beams of equal
+	//    stiffness and constraints onto constraints. Loads need not be symmetric.
+	int axis; // UN_MIRROR_X or UN_MIRROR_Y
+	float c; // position of the axis
+	int *node; // index of the image of each node (itself on the axis)
+	int *beam;
+	int *constraint;
+	int *csign; // +1 if a constraint's image points along its reflected direction, -1 if against it
+};
+
+void undefserror(char *error_text);
+
 void UN_printcoor(coor c);
 void UN_printnode(node n);
 void UN_printbeam(beam b);
@@ -76,11 +148,21 @@ float UN_dist(coor a, coor b);
 
 void UN_init_frame(frame *res, int bcount, int ncount, int fcount, int ccount, int wcount);
 void UN_free_frame(frame *f);
+void UN_free_module(module *m);
+coor UN_instance_loc(instance *in, coor module_loc);
 node* UN_get_node(frame *f, int id);
 int UN_get_node_idx(frame *f, int id);
 beam* UN_get_beam(frame *f, int id);
+history* UN_get_history(frame *f, int id);
+float UN_history_factor(history *h, float t);
 
 void UN_compute_beam_vals(frame *f);
 vector* UN_get_forces(frame *f);
 
+void UN_sort_frame(frame *f);
+mirror* UN_find_mirror(frame *f, int axis);
+void UN_free_mirror(mirror *m);
+unsigned long long UN_hash_geometry(frame *f);
+unsigned long long UN_hash_loads(frame *f);
+
 #endif
\ No newline at end of file
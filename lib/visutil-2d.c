@@ -84,6 +84,17 @@ void VIS_set_scale(plot *p, frame *f) {
 		}
 	}
 
+	// Module instances can reach beyond the frame's own nodes
+	for (int i = 0; i < f->instancecount; i++) {
+		for (int j = 0; j < f->module->nodecount; j++) {
+			c = UN_instance_loc(f->instances + i, f->module->nodes[j].loc);
+			if (c.x > xmax) xmax = c.x;
+			if (c.x < xmin) xmin = c.x;
+			if (c.y > ymax) ymax = c.y;
+			if (c.y < ymin) ymin = c.y;
+		}
+	}
+
 	float xrange = xmax - xmin;
 	float yrange = ymax - ymin;
 
@@ -106,13 +117,12 @@ void VIS_set_scale(plot *p, frame *f) {
 
 
 void VIS_add_beam(plot *p, frame *f, int beam_id) {
-	coor c1, c2;
-
 	beam *b = UN_get_beam(f, beam_id);
-	c1 = UN_get_node(f, b->n1_id)->loc;
-	c2 = UN_get_node(f, b->n2_id)->loc;
-	float force = b->force; // Assuming the frame has already been solved! TODO fix this
+	// Assuming the frame has already been solved! TODO fix this
+	VIS_add_line(p, UN_get_node(f, b->n1_id)->loc, UN_get_node(f, b->n2_id)->loc, b->force);
+}
 
+void VIS_add_line(plot *p, coor c1, coor c2, float force) {
 	float xdiff = c2.x - c1.x;
 	float ydiff = c2.y - c1.y;
 
@@ -150,6 +160,15 @@ void VIS_add_frame(plot *p, frame *f) {
 		VIS_add_beam(p, f, f->beams[i].id);
 	}
 
+	// plot module instances
+	module *m = f->module;
+	for (int i = 0; i < f->instancecount; i++) {
+		for (int j = 0; j < m->beamcount; j++) {
+			VIS_add_line(p, UN_instance_loc(f->instances + i, m->nodes[m->beams[j].n1_idx].loc),
+				UN_instance_loc(f->instances + i, m->nodes[m->beams[j].n2_idx].loc), f->instances[i].forces[j]);
+		}
+	}
+
 	//plot nodes
 	for (int i = 0; i < f->nodecount; i++) {
 		VIS_add_node(p, f, f->nodes[i].id);
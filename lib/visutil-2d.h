@@ -23,6 +23,7 @@ void VIS_set_scale(plot *p, frame *f);
 void VIS_add_pixel(plot *p, coor c, unsigned char *color);
 
 void VIS_add_beam(plot *p, frame *f, int beam_id);
+void VIS_add_line(plot *p, coor c1, coor c2, float force);
 void VIS_add_node(plot *p, frame *f, int node_id);
 
 void VIS_add_frame(plot *p, frame *f);
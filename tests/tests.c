@@ -1,7 +1,13 @@
 #include <stdio.h>
 #include <stdlib.h>
+#include <math.h>
 #include "../lib/matutil.h"
 #include "../lib/inutil-r.h"
+#include "../lib/statutil.h"
+#include "../lib/rigidutil.h"
+#include "../lib/gridutil.h"
+#include "../lib/stiffutil.h"
+#include "../lib/dynutil.h"
 
 int matutil() {
 	printf("Testing Matutil ...\n");
@@ -48,6 +54,36 @@ int matutil() {
 	printf("Recreated b vector from original A:\n");
 	MAT_printvector(rec_b);
 
+	printf("LU factorization solve (should match the solution values)\n");
+	lu_factor *lu = MAT_factor_lu(backupmat);
+	vector *lu_res = MAT_solve_lu(lu, backupvec);
+	MAT_printvector(lu_res);
+	MAT_freevector(lu_res);
+
+	printf("Block solve of b and 2b (columns should be the solution values and their double)\n");
+	matrix *block_b = MAT_matrix(3, 2, MAT_NO);
+	for (int i = 0; i < 3; i++) {
+		block_b->mat[i][0] = testvec_def[i];
+		block_b->mat[i][1] = 2 * testvec_def[i];
+	}
+	matrix *block_x = MAT_solve_lu_block(lu, block_b);
+	MAT_printmatrix(block_x);
+	MAT_freematrix(block_x);
+
+	printf("Transposed block solve, recreated from transpose(A) . X (should match b and 2b)\n");
+	block_x = MAT_solve_lu_transpose_block(lu, block_b);
+	matrix *block_rec = MAT_matrix(3, 2, MAT_YES);
+	for (int i = 0; i < 3; i++) {
+		for (int c = 0; c < 2; c++) {
+			for (int j = 0; j < 3; j++) block_rec->mat[i][c] += backupmat->mat[j][i] * block_x->mat[j][c];
+		}
+	}
+	MAT_printmatrix(block_rec);
+	MAT_freematrix(block_rec);
+	MAT_freematrix(block_b);
+	MAT_freematrix(block_x);
+	MAT_freelu(lu);
+
 	printf("Freeing memory ... ");
 	MAT_freematrix(testmatrix);
 	MAT_freematrix(backupmat);
@@ -60,6 +96,265 @@ int matutil() {
 	return 0;
 }
 
+int sparse() {
+	printf("Testing sparse Matutil ...\n");
+	// 1D Laplacian with duplicate triplets (each off-diagonal added in two halves)
+	int n = 6;
+	triplet *t = MAT_triplet(n, n, 4);
+	for (int i = 0; i < n; i++) {
+		MAT_triplet_add(t, i, i, 2);
+		if (i + 1 < n) {
+			MAT_triplet_add(t, i, i + 1, -0.5);
+			MAT_triplet_add(t, i + 1, i, -0.5);
+			MAT_triplet_add(t, i, i + 1, -0.5);
+			MAT_triplet_add(t, i + 1, i, -0.5);
+		}
+	}
+	spmatrix *m = MAT_compress(t);
+	MAT_freetriplet(t);
+	printf("Compressed nonzeros: %d (16)\n", m->nnz);
+
+	vector *b = MAT_vector(n, MAT_YES);
+	b->vec[0] = 1;
+	b->vec[n - 1] = 1;
+	vector *x = MAT_solve_pcg(m, b, 1e-6, 100);
+	printf("PCG solution (all ones)\n");
+	MAT_printvector(x);
+	vector *rec_b = MAT_multiply_spv(m, x);
+	printf("Recreated b vector (1 0 0 0 0 1)\n");
+	MAT_printvector(rec_b);
+	MAT_freevector(x);
+
+	printf("LDL solution (all ones)\n");
+	spsymbolic *sym = MAT_analyse_sym(m);
+	spfactor *ldl = MAT_factor_ldl(m, sym);
+	x = MAT_solve_ldl(ldl, b);
+	MAT_printvector(x);
+	MAT_freevector(x);
+
+	printf("Refactored with doubled values, reusing the analysis (all 0.5)\n");
+	for (int p = 0; p < m->nnz; p++) m->val[p] *= 2;
+	printf("Pattern still matches: %d (1)\n", MAT_symbolic_matches(sym, m));
+	printf("Refactor status: %d (-1)\n", MAT_refactor_ldl(ldl, m));
+	x = MAT_solve_ldl(ldl, b);
+	MAT_printvector(x);
+
+	// The chain is symmetric under reversal: solve a lopsided load one symmetry block at a time
+	int *rev = (int *) malloc(n * sizeof (int));
+	int *ones = (int *) malloc(n * sizeof (int));
+	for (int i = 0; i < n; i++) {
+		rev[i] = n - 1 - i;
+		ones[i] = 1;
+	}
+	symbasis *sb = MAT_symbasis(n, 1, &rev, &ones);
+	printf("Symmetry blocks: %d of sizes %d %d (2 of sizes 3 3)\n", sb->nblock, sb->size[0], sb->size[1]);
+	vector *b_sym = MAT_vector(n, MAT_YES);
+	b_sym->vec[0] = 1;
+	vector *x_sym = MAT_vector(n, MAT_YES);
+	for (int c = 0; c < sb->nblock; c++) {
+		spmatrix *mc = MAT_symmetry_spblock(m, sb, sb, c);
+		spsymbolic *symc = MAT_analyse_sym(mc);
+		spfactor *ldlc = MAT_factor_ldl(mc, symc);
+		vector *bc = MAT_symmetry_project(sb, c, b_sym);
+		vector *xc = MAT_solve_ldl(ldlc, bc);
+		MAT_symmetry_expand(sb, c, xc, x_sym);
+		MAT_freevector(xc);
+		MAT_freevector(bc);
+		MAT_freeldl(ldlc);
+		MAT_freesymbolic(symc);
+		MAT_freespmatrix(mc);
+	}
+	vector *x_full = MAT_solve_ldl(ldl, b_sym);
+	float sym_diff = 0;
+	for (int i = 0; i < n; i++) {
+		if (fabsf(x_full->vec[i] - x_sym->vec[i]) > sym_diff) sym_diff = fabsf(x_full->vec[i] - x_sym->vec[i]);
+	}
+	printf("Symmetry blocks vs LDL max difference: %g (~0)\n", sym_diff);
+	MAT_freevector(x_full);
+	MAT_freevector(x_sym);
+	MAT_freevector(b_sym);
+	MAT_freesymbasis(sb);
+	free(rev);
+	free(ones);
+
+	MAT_freeldl(ldl);
+	MAT_freesymbolic(sym);
+	MAT_freevector(b);
+	MAT_freevector(x);
+	MAT_freevector(rec_b);
+	MAT_freespmatrix(m);
+
+	// 2D grid Laplacian (plus a small shift), large enough for real supernodes
+	int g = 40;
+	n = g * g;
+	t = MAT_triplet(n, n, 5 * n);
+	for (int i = 0; i < g; i++) {
+		for (int j = 0; j < g; j++) {
+			MAT_triplet_add(t, i * g + j, i * g + j, 4.01);
+			if (i + 1 < g) {
+				MAT_triplet_add(t, i * g + j, (i + 1) * g + j, -1);
+				MAT_triplet_add(t, (i + 1) * g + j, i * g + j, -1);
+			}
+			if (j + 1 < g) {
+				MAT_triplet_add(t, i * g + j, i * g + j + 1, -1);
+				MAT_triplet_add(t, i * g + j + 1, i * g + j, -1);
+			}
+		}
+	}
+	m = MAT_compress(t);
+	MAT_freetriplet(t);
+	b = MAT_vector(n, MAT_NO);
+	for (int i = 0; i < n; i++) b->vec[i] = (float) (i % 7) - 3;
+
+	sym = MAT_analyse_sym(m);
+	printf("Grid supernodes: %d of %d columns (fewer)\n", sym->nsuper, n);
+	ldl = MAT_factor_ldl(m, sym);
+	spfactor *sn = MAT_factor_chol_sn(m, sym);
+	x = MAT_solve_ldl(ldl, b);
+	vector *x_sn = MAT_solve_ldl(sn, b);
+	float diff = 0;
+	for (int i = 0; i < n; i++) {
+		if (fabsf(x->vec[i] - x_sn->vec[i]) > diff) diff = fabsf(x->vec[i] - x_sn->vec[i]);
+	}
+	printf("Supernodal vs LDL max difference: %g (~0)\n", diff);
+
+	int *part = (int *) malloc(n * sizeof (int));
+	MAT_partition(m, 4, part);
+	int interface = 0, coupled = 0;
+	for (int i = 0; i < n; i++) interface += part[i] == -1;
+	for (int j = 0; j < n; j++) {
+		for (int p = m->colptr[j]; p < m->colptr[j + 1]; p++) {
+			if (part[j] != -1 && part[m->rowidx[p]] != -1 && part[j] != part[m->rowidx[p]]) coupled++;
+		}
+	}
+	printf("Partition into 4: %d interface vertices, %d couplings between interiors (0)\n", interface, coupled);
+	free(part);
+	vector *x_dd = MAT_solve_dd(m, 4, b, 1e-10, 1000);
+	diff = 0;
+	for (int i = 0; i < n; i++) {
+		if (fabsf(x->vec[i] - x_dd->vec[i]) > diff) diff = fabsf(x->vec[i] - x_dd->vec[i]);
+	}
+	printf("Domain decomposition vs LDL max difference: %g (~0)\n", diff);
+	MAT_freevector(x_dd);
+
+	for (int p = 0; p < m->nnz; p++) m->val[p] = -m->val[p];
+	spfactor *bad = MAT_factor_chol_sn(m, sym);
+	printf("Negative definite matrix rejected: %d (1)\n", bad == NULL);
+
+	// Rectangular systems: a least squares line fit, and a minimum-norm solution
+	t = MAT_triplet(4, 2, 8);
+	for (int i = 0; i < 4; i++) {
+		MAT_triplet_add(t, i, 0, 1);
+		MAT_triplet_add(t, i, 1, i);
+	}
+	spmatrix *fit = MAT_compress(t);
+	MAT_freetriplet(t);
+	vector *y = MAT_vector(4, MAT_YES);
+	y->vec[1] = 1;
+	y->vec[2] = 2;
+	y->vec[3] = 4;
+	lsq_report rep;
+	vector *line = MAT_solve_lsqr(fit, y, 1e-8, 100, &rep);
+	printf("LSQR line fit: intercept %f (-0.2) slope %f (1.3) residual %f (0.548) converged %d (1)\n",
+		line->vec[0], line->vec[1], rep.rnorm, rep.converged);
+	t = MAT_triplet(1, 3, 3);
+	MAT_triplet_add(t, 0, 0, 1);
+	MAT_triplet_add(t, 0, 1, 1);
+	MAT_triplet_add(t, 0, 2, 2);
+	spmatrix *under = MAT_compress(t);
+	MAT_freetriplet(t);
+	vector *six = MAT_vector(1, MAT_NO);
+	six->vec[0] = 6;
+	vector *minnorm = MAT_solve_lsqr(under, six, 1e-8, 100, NULL);
+	printf("LSQR minimum-norm solution (1 1 2)\n");
+	MAT_printvector(minnorm);
+	MAT_freespmatrix(fit);
+	MAT_freespmatrix(under);
+	MAT_freevector(y);
+	MAT_freevector(line);
+	MAT_freevector(six);
+	MAT_freevector(minnorm);
+
+	// Fixed-fixed spring chain with masses 2: lambda_j = 2 sin^2(j pi / 402)
+	t = MAT_triplet(200, 200, 600);
+	triplet *tm = MAT_triplet(200, 200, 200);
+	for (int i = 0; i < 200; i++) {
+		MAT_triplet_add(t, i, i, 2);
+		if (i) MAT_triplet_add(t, i, i - 1, -1);
+		if (i < 199) MAT_triplet_add(t, i, i + 1, -1);
+		MAT_triplet_add(tm, i, i, 2);
+	}
+	spmatrix *chain = MAT_compress(t);
+	spmatrix *mass = MAT_compress(tm);
+	MAT_freetriplet(t);
+	MAT_freetriplet(tm);
+	eigen *lowest = MAT_eigs_sym(chain, mass, 0, 3, 1e-10, 60);
+	printf("Lanczos lowest modes: %g (0.000122143) %g (0.000488542) %g (0.00109911) converged %d (3)\n",
+		lowest->values[0], lowest->values[1], lowest->values[2], lowest->converged);
+	double mnorm = 0;
+	for (int i = 0; i < 200; i++) mnorm += 2 * lowest->vectors[i] * lowest->vectors[i];
+	printf("First mode M-norm %f (1)\n", mnorm);
+	eigen *inner = MAT_eigs_sym(chain, mass, 0.995, 2, 1e-10, 60);
+	printf("Lanczos modes nearest 0.995: %f (0.992185) %f (1.007815)\n", inner->values[0], inner->values[1]);
+	// As buckling, (K + lambda G) x = 0 with G = -M has the same lambda; with G = M there are none
+	spsymbolic *csym = MAT_analyse_sym(chain);
+	spfactor *cf = MAT_factor_chol_sn(chain, csym);
+	for (int p = 0; p < mass->nnz; p++) mass->val[p] = -2;
+	eigen *buckle = MAT_eigs_buckling(chain, cf, mass, 2, 1e-10, 60);
+	printf("Buckling factors: %g (0.000122143) %g (0.000488542)\n", buckle->values[0], buckle->values[1]);
+	for (int p = 0; p < mass->nnz; p++) mass->val[p] = 2;
+	eigen *none = MAT_eigs_buckling(chain, cf, mass, 2, 1e-10, 20);
+	printf("Buckling factors under tension: %d (0)\n", none->count);
+	// Complex shift K - M + 0.1 i M at the singular shift of the real LDL^T, refactored on its analysis
+	double *shiftre = (double *) malloc(chain->nnz * sizeof (double));
+	double *shiftim = (double *) calloc(chain->nnz, sizeof (double));
+	for (int j = 0; j < 200; j++) {
+		for (int p = chain->colptr[j]; p < chain->colptr[j + 1]; p++) {
+			shiftre[p] = chain->val[p];
+			if (chain->rowidx[p] == j) {
+				chain->val[p] -= 2;
+				shiftim[p] = 0.2;
+			}
+		}
+	}
+	spzfactor *zf = MAT_factor_ldl_z(chain, shiftim, csym);
+	double zr[200], zi[200], ar[200] = {0}, ai[200] = {0}, zwork[400], zres = 0;
+	for (int i = 0; i < 200; i++) {
+		zr[i] = i % 3;
+		zi[i] = 0;
+	}
+	MAT_solve_ldl_z(zf, zr, zi, zwork);
+	for (int j = 0; j < 200; j++) {
+		for (int p = chain->colptr[j]; p < chain->colptr[j + 1]; p++) {
+			ar[chain->rowidx[p]] += chain->val[p] * zr[j] - shiftim[p] * zi[j];
+			ai[chain->rowidx[p]] += chain->val[p] * zi[j] + shiftim[p] * zr[j];
+		}
+	}
+	for (int i = 0; i < 200; i++) zres = fmax(zres, hypot(ar[i] - i % 3, ai[i]));
+	printf("Complex shifted solve residual: %g (0)\n", zres);
+	for (int p = 0; p < chain->nnz; p++) chain->val[p] = shiftre[p];
+	free(shiftre);
+	free(shiftim);
+	MAT_freeldl_z(zf);
+	MAT_freeeigen(buckle);
+	MAT_freeeigen(none);
+	MAT_freeldl(cf);
+	MAT_freesymbolic(csym);
+	MAT_freeeigen(lowest);
+	MAT_freeeigen(inner);
+	MAT_freespmatrix(chain);
+	MAT_freespmatrix(mass);
+
+	MAT_freeldl(sn);
+	MAT_freeldl(ldl);
+	MAT_freesymbolic(sym);
+	MAT_freevector(b);
+	MAT_freevector(x);
+	MAT_freevector(x_sn);
+	MAT_freespmatrix(m);
+	return 0;
+}
+
 int inutil() {
 	printf("Testing Inutil ... \n");
 	table *framevals = IN_load_table("frame1.us");
@@ -88,8 +383,612 @@ int inutil() {
 	return 0;
 }
 
+int statutil() {
+	printf("Testing Statutil ...\n");
+	accum *a = (accum *) malloc(sizeof (accum));
+	accum *b = (accum *) malloc(sizeof (accum));
+	STAT_init_accum(a, 0, 1);
+	STAT_init_accum(b, 0, 1);
+	rng r;
+	STAT_seed(&r, 42, 0);
+	for (int i = 0; i < 50000; i++) STAT_add(a, STAT_uniform(&r));
+	STAT_seed(&r, 42, 1);
+	for (int i = 0; i < 50000; i++) STAT_add(b, STAT_uniform(&r));
+	STAT_merge(a, b);
+	printf("Merged uniform samples: count %lld (100000)\n", a->count);
+	printf("Mean %f (0.5) variance %f (0.0833) median %f (0.5) q95 %f (0.95)\n",
+		a->mean, STAT_variance(a), STAT_quantile(a, 0.5), STAT_quantile(a, 0.95));
+
+	STAT_init_accum(a, -5, 5);
+	for (int i = 0; i < 100000; i++) STAT_add(a, STAT_normal(&r));
+	printf("Normal samples: mean %f (0) variance %f (1) q95 %f (1.645)\n",
+		a->mean, STAT_variance(a), STAT_quantile(a, 0.95));
+
+	free(a);
+	free(b);
+	return 0;
+}
+
+int rigidutil() {
+	printf("Testing Rigidutil ...\n");
+	// Unit square on three constraints, with beams added one at a time: 4 sides, then both diagonals
+	int ends[6][2] = {{0, 1}, {1, 2}, {2, 3}, {3, 0}, {0, 2}, {1, 3}};
+	frame *f;
+	for (int bc = 4; bc <= 6; bc++) {
+		f = (frame *) malloc(sizeof (frame));
+		UN_init_frame(f, bc, 4, 0, 3, 0);
+		for (int i = 0; i < 4; i++) f->nodes[i] = (node) {i, {(float) (i == 1 || i == 2), (float) (i >= 2)}, {0, 0}};
+		for (int i = 0; i < bc; i++) f->beams[i] = (beam) {.id = i, .n1_id = ends[i][0], .n2_id = ends[i][1], .stiffness = 1};
+		f->constraints[0] = (constraint) {0, 0, 0, 0};
+		f->constraints[1] = (constraint) {1, 0, M_PI / 2, 0};
+		f->constraints[2] = (constraint) {2, 1, M_PI / 2, 0};
+		UN_compute_beam_vals(f);
+		rigidity *r = RG_check(f);
+		printf("%d beams: dof %d redundant beams %d constraints %d\n", bc, r->dof, r->redundantcount, r->redundant_constraints);
+		RG_free(r);
+		UN_free_frame(f);
+	}
+	printf("Expected: (1 0 0) (0 0 0) (0 1 0)\n");
+
+	// A fourth constraint parallel to an existing one at the same node is redundant
+	f = (frame *) malloc(sizeof (frame));
+	UN_init_frame(f, 3, 3, 0, 4, 0);
+	for (int i = 0; i < 3; i++) {
+		f->nodes[i] = (node) {i, {(float) (i == 1), (float) (i == 2)}, {0, 0}};
+		f->beams[i] = (beam) {.id = i, .n1_id = ends[i][0], .n2_id = i == 2 ? 0 : ends[i][1], .stiffness = 1};
+	}
+	f->constraints[0] = (constraint) {0, 0, 0, 0};
+	f->constraints[1] = (constraint) {1, 0, M_PI / 2, 0};
+	f->constraints[2] = (constraint) {2, 1, M_PI / 2, 0};
+	f->constraints[3] = (constraint) {3, 1, -M_PI / 2, 0};
+	UN_compute_beam_vals(f);
+	rigidity *r = RG_check(f);
+	printf("Triangle: dof %d (0) redundant constraints %d (1)\n", r->dof, r->redundant_constraints);
+	RG_free(r);
+	UN_free_frame(f);
+
+	// Two vertical rollers and one horizontal, at three different nodes
+	f = (frame *) malloc(sizeof (frame));
+	UN_init_frame(f, 3, 3, 0, 3, 0);
+	for (int i = 0; i < 3; i++) {
+		f->nodes[i] = (node) {i, {(float) (i == 1), (float) (i == 2)}, {0, 0}};
+		f->beams[i] = (beam) {.id = i, .n1_id = ends[i][0], .n2_id = i == 2 ? 0 : ends[i][1], .stiffness = 1};
+	}
+	f->constraints[0] = (constraint) {0, 0, M_PI / 2, 0};
+	f->constraints[1] = (constraint) {1, 1, M_PI / 2, 0};
+	f->constraints[2] = (constraint) {2, 2, 0, 0};
+	UN_compute_beam_vals(f);
+	r = RG_check(f);
+	printf("Rollers at three nodes: dof %d (0) redundant constraints %d (0)\n", r->dof, r->redundant_constraints);
+	RG_free(r);
+	UN_free_frame(f);
+
+	// Three separate triangles on three rollers each, constraints numbered across the triangles
+	f = (frame *) malloc(sizeof (frame));
+	UN_init_frame(f, 9, 9, 0, 9, 0);
+	for (int t = 0; t < 3; t++) {
+		for (int i = 0; i < 3; i++) {
+			f->nodes[3 * t + i] = (node) {3 * t + i, {(float) (3 * t + (i == 1)), (float) (i == 2)}, {0, 0}};
+			f->beams[3 * t + i] = (beam) {.id = 3 * t + i, .n1_id = 3 * t + i, .n2_id = 3 * t + (i + 1) % 3, .stiffness = 1};
+			f->constraints[3 * i + t] = (constraint) {3 * i + t, 3 * t + i, i ? M_PI / 2 : 0, 0};
+		}
+	}
+	UN_compute_beam_vals(f);
+	r = RG_check(f);
+	printf("Three triangles: dof %d (0) redundant constraints %d (0)\n", r->dof, r->redundant_constraints);
+	RG_free(r);
+	UN_free_frame(f);
+
+	// Method of joints on a Warren truss: 5 bottom nodes, 4 top nodes, loads on the top
+	f = (frame *) malloc(sizeof (frame));
+	UN_init_frame(f, 15, 9, 4, 3, 0);
+	int b = 0;
+	for (int i = 0; i < 5; i++) f->nodes[i] = (node) {i, {i, 0}, {0, 0}};
+	for (int i = 0; i < 4; i++) f->nodes[5 + i] = (node) {5 + i, {i + 0.5, 1}, {0, 0}};
+	for (int i = 0; i < 4; i++) f->beams[b] = (beam) {.id = b, .n1_id = i, .n2_id = i + 1}, b++;
+	for (int i = 0; i < 3; i++) f->beams[b] = (beam) {.id = b, .n1_id = 5 + i, .n2_id = 6 + i}, b++;
+	for (int i = 0; i < 4; i++) {
+		f->beams[b] = (beam) {.id = b, .n1_id = i, .n2_id = 5 + i}, b++;
+		f->beams[b] = (beam) {.id = b, .n1_id = i + 1, .n2_id = 5 + i}, b++;
+		f->forces[i] = (force) {i, 5 + i, -M_PI / 2, 1};
+	}
+	f->constraints[0] = (constraint) {0, 0, 0, 0};
+	f->constraints[1] = (constraint) {1, 0, M_PI / 2, 0};
+	f->constraints[2] = (constraint) {2, 4, M_PI / 2, 0};
+	UN_compute_beam_vals(f);
+	joints *jt = RG_joint_order(f);
+	printf("Warren truss is simple: %d (1)\n", jt != NULL);
+	vector *loads = UN_get_forces(f);
+	vector *s = RG_solve_joints(f, jt, loads);
+	printf("Reactions %f %f %f (0 -2 -2), mid bottom chord %f (2)\n",
+		s->vec[15], s->vec[16], s->vec[17], s->vec[1]);
+	// Joint residuals: loads minus member forces on every node
+	for (int i = 0; i < 15; i++) {
+		beam *bm = f->beams + i;
+		node *n1 = f->nodes + bm->n1_idx, *n2 = f->nodes + bm->n2_idx;
+		float cx = (n1->loc.x - n2->loc.x) / bm->length, cy = (n1->loc.y - n2->loc.y) / bm->length;
+		loads->vec[bm->n1_idx] -= cx * s->vec[i];
+		loads->vec[bm->n1_idx + 9] -= cy * s->vec[i];
+		loads->vec[bm->n2_idx] += cx * s->vec[i];
+		loads->vec[bm->n2_idx + 9] += cy * s->vec[i];
+	}
+	for (int c = 0; c < 3; c++) {
+		int k = UN_get_node_idx(f, f->constraints[c].n_id);
+		loads->vec[k] -= cos(f->constraints[c].theta) * s->vec[15 + c];
+		loads->vec[k + 9] -= sin(f->constraints[c].theta) * s->vec[15 + c];
+	}
+	float worst = 0;
+	for (int i = 0; i < 18; i++) if (fabsf(loads->vec[i]) > worst) worst = fabsf(loads->vec[i]);
+	printf("Largest joint residual %g (~0)\n", worst);
+	MAT_freevector(loads);
+	MAT_freevector(s);
+	RG_free_joints(jt);
+	UN_free_frame(f);
+
+	// Two triangles joined by three parallel bars: determinate but not simple
+	f = (frame *) malloc(sizeof (frame));
+	UN_init_frame(f, 9, 6, 0, 3, 0);
+	int prism[9][2] = {{0, 1}, {1, 2}, {2, 0}, {3, 4}, {4, 5}, {5, 3}, {0, 3}, {1, 4}, {2, 5}};
+	for (int i = 0; i < 3; i++) {
+		f->nodes[i] = (node) {i, {cos(2 * M_PI * i / 3), sin(2 * M_PI * i / 3)}, {0, 0}};
+		f->nodes[3 + i] = (node) {3 + i, {3 * cos(2 * M_PI * i / 3 + 0.3), 3 * sin(2 * M_PI * i / 3 + 0.3)}, {0, 0}};
+	}
+	for (int i = 0; i < 9; i++) f->beams[i] = (beam) {.id = i, .n1_id = prism[i][0], .n2_id = prism[i][1]};
+	f->constraints[0] = (constraint) {0, 3, 0, 0};
+	f->constraints[1] = (constraint) {1, 3, M_PI / 2, 0};
+	f->constraints[2] = (constraint) {2, 4, M_PI / 2, 0};
+	UN_compute_beam_vals(f);
+	jt = RG_joint_order(f);
+	printf("Prism is simple: %d (0)\n", jt != NULL);
+	UN_free_frame(f);
+	return 0;
+}
+
+int gridutil() {
+	printf("Testing Gridutil ...\n");
+	wall walls[3];
+	walls[0] = (wall) {0, 0, 0, M_PI / 2, 1}; // y = 0
+	walls[1] = (wall) {1, 1, 0, 3 * M_PI / 4, 1}; // y = x
+	walls[2] = (wall) {2, 0, 8, M_PI / 2, 0}; // y = 8
+	grid *g = GR_grid(walls, 3, -10, -10, 10, 10, 1);
+	int res[3];
+	int count = GR_near_walls(g, (coor) {5, 0.5}, res);
+	printf("Walls near (5, 0.5): %d (1) first %d (0)\n", count, res[0]);
+	count = GR_near_walls(g, (coor) {0.2, 0.4}, res);
+	printf("Walls near (0.2, 0.4): %d (2)\n", count);
+	count = GR_near_walls(g, (coor) {-5, 7.5}, res);
+	printf("Walls near (-5, 7.5): %d (1) first %d (2)\n", count, res[0]);
+	count = GR_near_walls(g, (coor) {-5, 4}, res);
+	printf("Walls near (-5, 4): %d (0)\n", count);
+	printf("Near the edge: %d (-1)\n", GR_near_walls(g, (coor) {-9.5, 0}, res));
+	GR_free(g);
+	return 0;
+}
+
+frame* panel_frame() {
+	// The frame of examples/edits.us: 8 nodes, 15 beams and 4 constraints, 20 down at node 7
+	float xy[8][2] = {{0, 3}, {2, 3}, {4, 3}, {0, 1}, {2, 1}, {4, 1}, {6, 1}, {2, 0}};
+	int ends[15][2] = {{0, 1}, {0, 3}, {0, 4}, {1, 2}, {1, 4}, {1, 5}, {2, 5}, {2, 6}, {3, 4}, {3, 7},
+		{4, 5}, {5, 6}, {5, 7}, {4, 7}, {3, 1}};
+	frame *f = (frame *) malloc(sizeof (frame));
+	UN_init_frame(f, 15, 8, 1, 4, 0);
+	for (int i = 0; i < 8; i++) f->nodes[i] = (node) {i, {xy[i][0], xy[i][1]}, {0, 0}};
+	for (int i = 0; i < 15; i++) {
+		f->beams[i] = (beam) {.id = i, .n1_id = ends[i][0], .n2_id = ends[i][1], .stiffness = i < 13 ? 100 : 50, .density = 1};
+	}
+	f->forces[0] = (force) {0, 7, 3 * M_PI / 2, 20, NULL};
+	f->constraints[0] = (constraint) {0, 3, 0, 0};
+	f->constraints[1] = (constraint) {1, 3, M_PI / 2, 0};
+	f->constraints[2] = (constraint) {2, 6, M_PI / 2, 0};
+	f->constraints[3] = (constraint) {3, 6, 0, 0};
+	UN_compute_beam_vals(f);
+	return f;
+}
+
+frame* snap_arch() {
+	// The shallow two-bar arch of examples/snap.us: half span 1, rise 0.1, EA 1000, and a unit load
+	//    down at the apex, well past its limit load of about 0.385
+	frame *f = (frame *) malloc(sizeof (frame));
+	UN_init_frame(f, 2, 3, 1, 4, 0);
+	f->nodes[0] = (node) {0, {0, 0}, {0, 0}};
+	f->nodes[1] = (node) {1, {1, 0.1}, {0, 0}};
+	f->nodes[2] = (node) {2, {2, 0}, {0, 0}};
+	f->beams[0] = (beam) {.id = 0, .n1_id = 0, .n2_id = 1, .stiffness = 1000};
+	f->beams[1] = (beam) {.id = 1, .n1_id = 1, .n2_id = 2, .stiffness = 1000};
+	f->forces[0] = (force) {0, 1, 3 * M_PI / 2, 1, NULL};
+	f->constraints[0] = (constraint) {0, 0, 0, 0};
+	f->constraints[1] = (constraint) {1, 0, M_PI / 2, 0};
+	f->constraints[2] = (constraint) {2, 2, 0, 0};
+	f->constraints[3] = (constraint) {3, 2, M_PI / 2, 0};
+	UN_compute_beam_vals(f);
+	return f;
+}
+
+frame* spring_mass() {
+	// One bar along x, EA / L = 100 and mass 2 per unit length, so the free end carries mass 1 and
+	//    oscillates along the bar at omega = 10. A unit force pulls it along the bar.
+	frame *f = (frame *) malloc(sizeof (frame));
+	UN_init_frame(f, 1, 2, 1, 3, 0);
+	f->nodes[0] = (node) {0, {0, 0}, {0, 0}};
+	f->nodes[1] = (node) {1, {1, 0}, {0, 0}};
+	f->beams[0] = (beam) {.id = 0, .n1_id = 0, .n2_id = 1, .stiffness = 100, .density = 2};
+	f->forces[0] = (force) {0, 1, 0, 1, NULL};
+	f->constraints[0] = (constraint) {0, 0, 0, 0};
+	f->constraints[1] = (constraint) {1, 0, M_PI / 2, 0};
+	f->constraints[2] = (constraint) {2, 1, M_PI / 2, 0};
+	UN_compute_beam_vals(f);
+	return f;
+}
+
+frame* bay_chain(int expanded) {
+	// The six bay bridge of examples/bays.us: posts in the frame, and each bay's chords and bracing
+	//    an instance of a module condensed onto the post ends. With expanded, the same beams are
+	//    written out as frame beams on three internal nodes per bay instead.
+	float mxy[7][2] = {{0, 0}, {2, 0}, {0, 1.5}, {2, 1.5}, {1, 0}, {1, 1.5}, {1, 0.75}};
+	int mends[9][2] = {{0, 4}, {4, 1}, {2, 5}, {5, 3}, {4, 6}, {6, 5}, {0, 6}, {2, 6}, {1, 6}};
+	float mk[9] = {100, 100, 100, 100, 80, 80, 60, 60, 60};
+	frame *f = (frame *) malloc(sizeof (frame));
+	UN_init_frame(f, expanded ? 7 + 6 * 9 : 7, expanded ? 14 + 6 * 3 : 14, 5, 3, 0);
+	for (int i = 0; i < 14; i++) f->nodes[i] = (node) {i, {2 * (i / 2), 1.5 * (i % 2)}, {0, 0}};
+	for (int i = 0; i < 7; i++) f->beams[i] = (beam) {.id = i, .n1_id = 2 * i, .n2_id = 2 * i + 1, .stiffness = 100};
+	for (int i = 0; i < 5; i++) f->forces[i] = (force) {i, 2 * i + 2, 3 * M_PI / 2, 6 + i, NULL};
+	f->constraints[0] = (constraint) {0, 0, 0, 0};
+	f->constraints[1] = (constraint) {1, 0, M_PI / 2, 0};
+	f->constraints[2] = (constraint) {2, 12, M_PI / 2, 0};
+	int map[7];
+	if (expanded) {
+		for (int b = 0; b < 6; b++) {
+			map[0] = 2 * b;
+			map[1] = 2 * b + 2;
+			map[2] = 2 * b + 1;
+			map[3] = 2 * b + 3;
+			for (int j = 0; j < 3; j++) {
+				map[4 + j] = 14 + 3 * b + j;
+				f->nodes[map[4 + j]] = (node) {map[4 + j], {2 * b + mxy[4 + j][0], mxy[4 + j][1]}, {0, 0}};
+			}
+			for (int j = 0; j < 9; j++) {
+				f->beams[7 + 9 * b + j] = (beam) {.id = 7 + 9 * b + j, .n1_id = map[mends[j][0]], .n2_id = map[mends[j][1]], .stiffness = mk[j]};
+			}
+		}
+		UN_compute_beam_vals(f);
+		return f;
+	}
+	module *m = (module *) malloc(sizeof (module));
+	m->nodecount = 7;
+	m->nodes = (node *) malloc(7 * sizeof (node));
+	m->interface = (char *) malloc(7 * sizeof (char));
+	m->bnodes = (int *) malloc(4 * sizeof (int));
+	m->inodes = (int *) malloc(3 * sizeof (int));
+	m->beamcount = 9;
+	m->beams = (beam *) malloc(9 * sizeof (beam));
+	m->front = NULL;
+	m->bcount = 4;
+	m->icount = 3;
+	for (int i = 0; i < 7; i++) {
+		m->nodes[i] = (node) {i, {mxy[i][0], mxy[i][1]}, {0, 0}};
+		m->interface[i] = i < 4;
+		if (i < 4) m->bnodes[i] = i;
+		else m->inodes[i - 4] = i;
+	}
+	for (int j = 0; j < 9; j++) {
+		m->beams[j] = (beam) {.id = j, .n1_id = mends[j][0], .n2_id = mends[j][1], .n1_idx = mends[j][0], .n2_idx = mends[j][1], .stiffness = mk[j]};
+		m->beams[j].length = UN_dist(m->nodes[mends[j][0]].loc, m->nodes[mends[j][1]].loc);
+	}
+	f->module = m;
+	f->instancecount = 6;
+	f->instances = (instance *) malloc(6 * sizeof (instance));
+	for (int b = 0; b < 6; b++) {
+		f->instances[b] = (instance) {b, {2 * b, 0}, 0, (int *) malloc(4 * sizeof (int)), (float *) calloc(9, sizeof (float))};
+		f->instances[b].frame_idx[0] = 2 * b;
+		f->instances[b].frame_idx[1] = 2 * b + 2;
+		f->instances[b].frame_idx[2] = 2 * b + 1;
+		f->instances[b].frame_idx[3] = 2 * b + 3;
+	}
+	ST_condense_module(m);
+	UN_compute_beam_vals(f);
+	return f;
+}
+
+double relative_difference(vector *a, vector *b) {
+	double diff = 0, size = 0;
+	for (int i = 0; i < a->rows; i++) {
+		diff = fmax(diff, fabs(a->vec[i] - b->vec[i]));
+		size = fmax(size, fabs(b->vec[i]));
+	}
+	return diff / size;
+}
+
+double chain_difference(frame *f, frame *expanded, double *forces) {
+	// Relative difference of the post displacements of a bay_chain frame from its expanded frame;
+	//    forces receives that of the instance beam forces from the written out beams
+	vector *a = MAT_vector(28, 0), *b = MAT_vector(28, 0);
+	for (int i = 0; i < 14; i++) {
+		a->vec[2 * i] = f->nodes[i].disp.x;
+		a->vec[2 * i + 1] = f->nodes[i].disp.y;
+		b->vec[2 * i] = expanded->nodes[i].disp.x;
+		b->vec[2 * i + 1] = expanded->nodes[i].disp.y;
+	}
+	double disp = relative_difference(a, b);
+	MAT_freevector(a);
+	MAT_freevector(b);
+	a = MAT_vector(54, 0);
+	b = MAT_vector(54, 0);
+	for (int i = 0; i < 54; i++) {
+		a->vec[i] = f->instances[i / 9].forces[i % 9];
+		b->vec[i] = expanded->beams[7 + i].force;
+	}
+	*forces = relative_difference(a, b);
+	MAT_freevector(a);
+	MAT_freevector(b);
+	return disp;
+}
+
+int stiffutil() {
+	printf("Testing Stiffutil ...\n");
+	// Beam edits by low-rank updates against a fresh solve of the edited frame
+	frame *f = panel_frame();
+	stsolver *s = ST_solver(f);
+	ST_add_beam(s, (beam) {.id = 15, .n1_id = 0, .n2_id = 5, .stiffness = 70});
+	ST_resize_beam(s, 13, 200);
+	ST_remove_beam(s, 14);
+	vector *u = ST_solver_solve(s);
+	vector *fresh = ST_solve(f);
+	printf("Add, resize and remove: difference %g (~0) refactors %d (1)\n", relative_difference(u, fresh), s->refactors);
+	MAT_freevector(u);
+	MAT_freevector(fresh);
+	// Past ST_MAX_RANK edits the solver refactors once
+	for (int i = 0; i <= ST_MAX_RANK; i++) ST_resize_beam(s, f->beams[i % f->beamcount].id, 100 + i);
+	u = ST_solver_solve(s);
+	fresh = ST_solve(f);
+	printf("%d resizes: difference %g (~0) refactors %d (2)\n", ST_MAX_RANK + 1, relative_difference(u, fresh), s->refactors);
+	MAT_freevector(u);
+	MAT_freevector(fresh);
+	ST_free_solver(s);
+	UN_free_frame(f);
+
+	// Module instances condensed onto their interface nodes against the same beams written out
+	frame *expanded = bay_chain(1);
+	MAT_freevector(ST_solve(expanded));
+	f = bay_chain(0);
+	MAT_freevector(ST_solve(f));
+	double forces, disp = chain_difference(f, expanded, &forces);
+	printf("Condensed module: displacements %g (~0) instance beam forces %g (~0)\n", disp, forces);
+	UN_free_frame(f);
+	// The same bays eliminated one after another along the chain; a span this short and free between
+	//    its supports keeps a factor for each of its seven posts
+	f = bay_chain(0);
+	int factors;
+	vector *chain = ST_solve_chain(f, &factors);
+	disp = chain_difference(f, expanded, &forces);
+	printf("Chain of bays: solved %d (1) displacements %g (~0) instance beam forces %g (~0) section factors %d (7)\n",
+		chain != NULL, disp, forces, factors);
+	if (chain) MAT_freevector(chain);
+	UN_free_frame(f);
+
+	// Mirror symmetric, indeterminate two bay truss (braced both ways, pinned at both ends) under
+	//    a load that is not symmetric, so both the symmetric and antisymmetric blocks are solved
+	float txy[6][2] = {{0, 0}, {2, 0}, {4, 0}, {0, 2}, {2, 2}, {4, 2}};
+	int tends[11][2] = {{0, 1}, {1, 2}, {3, 4}, {4, 5}, {0, 3}, {1, 4}, {2, 5}, {0, 4}, {1, 3}, {1, 5}, {2, 4}};
+	f = (frame *) malloc(sizeof (frame));
+	UN_init_frame(f, 11, 6, 2, 4, 0);
+	for (int i = 0; i < 6; i++) f->nodes[i] = (node) {i, {txy[i][0], txy[i][1]}, {0, 0}};
+	for (int i = 0; i < 11; i++) f->beams[i] = (beam) {.id = i, .n1_id = tends[i][0], .n2_id = tends[i][1], .stiffness = i < 7 ? 100 : 50};
+	f->forces[0] = (force) {0, 4, 5.5, 10, NULL};
+	f->forces[1] = (force) {1, 3, 3 * M_PI / 2, 4, NULL};
+	f->constraints[0] = (constraint) {0, 0, 0, 0};
+	f->constraints[1] = (constraint) {1, 0, M_PI / 2, 0};
+	f->constraints[2] = (constraint) {2, 2, 0, 0};
+	f->constraints[3] = (constraint) {3, 2, M_PI / 2, 0};
+	UN_compute_beam_vals(f);
+	mirror *m = UN_find_mirror(f, UN_MIRROR_X);
+	int blocks = 0;
+	vector *full = ST_solve(f);
+	vector *full_forces = MAT_vector(f->beamcount, 0), *sym_forces = MAT_vector(f->beamcount, 0);
+	for (int i = 0; i < f->beamcount; i++) full_forces->vec[i] = f->beams[i].force;
+	vector *sym = m ? ST_solve_sym(f, &m, 1, &blocks) : NULL;
+	for (int i = 0; i < f->beamcount; i++) sym_forces->vec[i] = f->beams[i].force;
+	printf("Symmetric truss: mirror %d (1) blocks %d (2) displacements %g (~0) beam forces %g (~0)\n", m != NULL,
+		blocks, sym ? relative_difference(sym, full) : 1, relative_difference(sym_forces, full_forces));
+	if (sym) MAT_freevector(sym);
+	if (m) UN_free_mirror(m);
+	MAT_freevector(full);
+	MAT_freevector(full_forces);
+	MAT_freevector(sym_forces);
+	UN_free_frame(f);
+
+	// Contact of the spring_mass bar's free end with a wall at x = 1, by the active set passes of
+	//    unsafe.c: the contact is a ground spring added or removed through the solver's updates.
+	//    Its penalty stiffness leaves a penetration of load / (kc + EA / L) and the bar 1e-4 of the load.
+	f = spring_mass();
+	s = ST_solver(f);
+	coor normal = {-1, 0};
+	double kc = 1e4 * 100;
+	int spring = -1, passes;
+	float pen;
+	for (int load = 0; load < 2; load++) {
+		f->forces[0].theta = load ? M_PI : 0;
+		passes = 0;
+		for (int changes = 1; changes; passes++) {
+			MAT_freevector(ST_solver_solve(s));
+			pen = normal.x * f->nodes[1].disp.x + normal.y * f->nodes[1].disp.y;
+			changes = 0;
+			if (spring == -1 && pen < 0) {
+				spring = ST_add_spring(s, 1, normal, kc);
+				changes = 1;
+			}
+			else if (spring != -1 && pen > 1e-3 / kc) {
+				ST_remove_spring(s, spring);
+				spring = -1;
+				changes = 1;
+			}
+		}
+		if (load) printf("Pulled off the wall: contact %d (0) disp %.4f (-0.0100) passes %d (2)\n", spring != -1, f->nodes[1].disp.x, passes);
+		else printf("Pressed into the wall: penetration %.2e (1.00e-06) reaction %.3f (1.000) passes %d (2)\n", -pen, -kc * pen, passes);
+	}
+	printf("Contact updates: refactors %d (1)\n", s->refactors);
+	ST_free_solver(s);
+	UN_free_frame(f);
+
+	// Large displacements of the two-bar arch of examples/snap.us
+	f = snap_arch();
+	stpath *arc = ST_solve_nonlinear(f, 10, 1);
+	// Equilibrium of the apex on the deformed geometry: 2 N sin(angle) = P, N = EA (l - L) / L
+	double y = 0.1 + f->nodes[1].disp.y;
+	double l = sqrt(1 + y * y), len = sqrt(1.01);
+	double tension = 1000 * (l - len) / len;
+	printf("Arch apex %.4f (-0.2330) load %.6f (1.000000) tension %.4f (%.4f)\n", f->nodes[1].disp.y,
+		-2 * tension * y / l, f->beams[0].force, tension);
+	// The load factor rises to the first limit point, falls past the second and comes back up to 1
+	int limits = 0, top = 0, bottom = 0;
+	for (int i = 2; i < arc->count; i++) {
+		if ((arc->lambda[i] - arc->lambda[i - 1]) * (arc->lambda[i - 1] - arc->lambda[i - 2]) >= 0) continue;
+		if (limits++) bottom = i - 1;
+		else top = i - 1;
+	}
+	printf("Arc-length: final load factor %.6f (1.000000) limit points %d (2)\n", arc->lambda[arc->count - 1], limits);
+	// Load control can only stop at the first limit point or jump across the unstable branch
+	UN_free_frame(f);
+	f = snap_arch();
+	stpath *load = ST_solve_nonlinear(f, 10, 0);
+	int jumped = 0;
+	for (int i = 1; i < load->count; i++) {
+		if (load->disp[i - 1] <= arc->disp[top] && load->disp[i] >= arc->disp[bottom]) jumped = 1;
+	}
+	printf("Load control: final load factor %.6f stopped below 1 or jumped past the snap %d (1)\n",
+		load->lambda[load->count - 1], load->lambda[load->count - 1] < 1 || jumped);
+	ST_free_path(arc);
+	ST_free_path(load);
+	UN_free_frame(f);
+	UN_free_frame(expanded);
+
+	// Linear buckling of two collinear bars of length 1 under end thrust P, their middle node held
+	//    sideways by a bar of stiffness k = EA / L = 100: the node buckles sideways at P = k L / 2
+	f = (frame *) malloc(sizeof (frame));
+	UN_init_frame(f, 3, 4, 1, 5, 0);
+	f->nodes[0] = (node) {0, {0, 0}, {0, 0}};
+	f->nodes[1] = (node) {1, {1, 0}, {0, 0}};
+	f->nodes[2] = (node) {2, {2, 0}, {0, 0}};
+	f->nodes[3] = (node) {3, {1, -1}, {0, 0}};
+	f->beams[0] = (beam) {.id = 0, .n1_id = 0, .n2_id = 1, .stiffness = 100};
+	f->beams[1] = (beam) {.id = 1, .n1_id = 1, .n2_id = 2, .stiffness = 100};
+	f->beams[2] = (beam) {.id = 2, .n1_id = 1, .n2_id = 3, .stiffness = 100};
+	f->forces[0] = (force) {0, 2, M_PI, 1, NULL};
+	f->constraints[0] = (constraint) {0, 0, 0, 0};
+	f->constraints[1] = (constraint) {1, 0, M_PI / 2, 0};
+	f->constraints[2] = (constraint) {2, 2, M_PI / 2, 0};
+	f->constraints[3] = (constraint) {3, 3, 0, 0};
+	f->constraints[4] = (constraint) {4, 3, M_PI / 2, 0};
+	UN_compute_beam_vals(f);
+	MAT_freevector(ST_solve(f));
+	dofmap *dm = ST_dofmap(f);
+	eigen *e = ST_buckling(f, dm, 1);
+	if (e->count) ST_set_mode(f, dm, e, 0);
+	printf("Buckling: modes %d (1) critical load factor %.4f (50.0000) mode sideways %.4f (1.0000)\n",
+		e->count, e->count ? e->values[0] : 0, fabsf(f->nodes[1].disp.y));
+	MAT_freeeigen(e);
+	ST_free_dofmap(dm);
+	UN_free_frame(f);
+	return 0;
+}
+
+int dynutil() {
+	printf("Testing Dynutil ...\n");
+	frame *f = spring_mass();
+	dyframe *d = DY_frame(f);
+	// Gershgorin bounds omega_max^2 by 2 k / m = 200, below the stability limit 2 / omega = 0.2
+	double dt = DY_critical_step(d);
+	printf("Critical step %f (0.127279) stable %d (1)\n", dt, dt < 2 / 10.0);
+	// Released from rest under the step load: x = (1 - cos 10 t) / 100, peaking at the half period
+	d->dt = 1e-4;
+	double x, peak = 0, half = 0;
+	while (!half) {
+		DY_step(d, 1, 1);
+		x = d->x[1] - 1;
+		if (x < peak) half = d->t - d->dt;
+		else peak = x;
+	}
+	printf("Explicit period %.4f (0.6283) peak %.5f (0.02000)\n", 2 * half, peak);
+	DY_free(d);
+
+	// Average acceleration Newmark keeps the amplitude and stretches the period to 2 pi / omega',
+	//    omega' dt = 2 atan(omega dt / 2): at dt = 0.05, x(1) = (1 - cos 9.79915) / 100 rather than
+	//    (1 - cos 10) / 100 = 0.018391
+	dynewmark *nm = DY_newmark(f, 0.05, 0);
+	DY_newmark_step(nm, 20);
+	DY_newmark_store(nm);
+	printf("Newmark x(1) %.6f (0.019307)\n", f->nodes[1].disp.x);
+	DY_free_newmark(nm);
+	UN_free_frame(f);
+
+	// Dynamic relaxation of the (indeterminate) edits.us frame against the linear solve, with beams
+	//    stiff enough that the geometric nonlinearity (about 1e-7) is below the tolerance. The
+	//    tolerance bounds the out-of-balance force; the displacements follow to within a small factor.
+	f = panel_frame();
+	for (int i = 0; i < f->beamcount; i++) f->beams[i].stiffness *= 1e7;
+	d = DY_frame(f);
+	dyrelax rep;
+	DY_relax(d, 1, DY_RELAX_TOL, 100000, &rep);
+	DY_store(d);
+	DY_free(d);
+	vector *relaxed = MAT_vector(2 * f->nodecount, 0);
+	for (int i = 0; i < f->nodecount; i++) {
+		relaxed->vec[2 * i] = f->nodes[i].disp.x;
+		relaxed->vec[2 * i + 1] = f->nodes[i].disp.y;
+	}
+	MAT_freevector(ST_solve(f));
+	vector *linear = MAT_vector(2 * f->nodecount, 0);
+	for (int i = 0; i < f->nodecount; i++) {
+		linear->vec[2 * i] = f->nodes[i].disp.x;
+		linear->vec[2 * i + 1] = f->nodes[i].disp.y;
+	}
+	printf("Relaxation converged %d (1) out of balance %g (< %g) against the linear solve %g (< 1e-05)\n",
+		rep.converged, rep.rnorm / rep.fnorm, DY_RELAX_TOL, relative_difference(relaxed, linear));
+	MAT_freevector(relaxed);
+	MAT_freevector(linear);
+	UN_free_frame(f);
+
+	// Steady state harmonic response of the edits.us frame: at omega = 0 it is the static solve, and
+	//    superposing every mode matches the direct solves below, among and above the natural frequencies
+	//    (1.1 to 6.7 rad per unit time)
+	f = panel_frame();
+	vector *u = ST_solve(f);
+	dyharmonic *h = DY_harmonic(f, 0.2, 0);
+	DY_harmonic_solve(h, 0);
+	vector *ur = MAT_vector(h->n, 0), *ui = MAT_vector(h->n, 0);
+	for (int i = 0; i < h->n; i++) ur->vec[i] = h->ur[i];
+	printf("Harmonic at omega 0 against the static solve %g (~0)\n", relative_difference(ur, u));
+	dyharmonic *hm = DY_harmonic(f, 0.2, h->n);
+	double omega[3] = {0.5, 5, 8}, dr = 0, di = 0;
+	for (int w = 0; w < 3; w++) {
+		DY_harmonic_solve(h, omega[w]);
+		DY_harmonic_solve(hm, omega[w]);
+		for (int i = 0; i < h->n; i++) {
+			ur->vec[i] = hm->ur[i];
+			ui->vec[i] = hm->ui[i];
+			u->vec[i] = h->ur[i];
+		}
+		dr = fmax(dr, relative_difference(ur, u));
+		for (int i = 0; i < h->n; i++) u->vec[i] = h->ui[i];
+		di = fmax(di, relative_difference(ui, u));
+	}
+	printf("All %d (%d) modes against direct solves: real %g (~0) imaginary %g (~0)\n", hm->modes->count, h->n, dr, di);
+	DY_free_harmonic(h);
+	DY_free_harmonic(hm);
+	MAT_freevector(u);
+	MAT_freevector(ur);
+	MAT_freevector(ui);
+	UN_free_frame(f);
+	return 0;
+}
+
 int main() {
 	matutil();
+	sparse();
 	inutil();
+	statutil();
+	rigidutil();
+	gridutil();
+	stiffutil();
+	dynutil();
 	return 0;
 }
\ No newline at end of file
@@ -1,10 +1,16 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <math.h>
+#include <string.h>
 #include "lib/matutil.h"
 #include "lib/inutil-r.h"
 #include "lib/undefs.h"
 #include "lib/visutil-2d.h"
+#include "lib/cacheutil.h"
+#include "lib/statutil.h"
+#include "lib/stiffutil.h"
+#include "lib/rigidutil.h"
+#include "lib/dynutil.h"
 
 void unsafeerror(char *error_text) {
 	printf("Critical error in unsafe-r.c\nError message follows:\n");
@@ -12,7 +18,7 @@ void unsafeerror(char *error_text) {
 	exit(1);
 }
 
-matrix* build_connectivity_matrix(frame *f) {
+matrix* build_connectivity_matrix(frame *f, matrix *cmat) {
 	// Takes cmat (either NULL or preinitialized matrix) and fills out with connectivity matrix
 	//    described by the beam-node connections in f
 	// Such that for the resulting matrix M, node_net_forces = M . [beam_net_forces, constraint_forces]
@@ -29,7 +35,11 @@ matrix* build_connectivity_matrix(frame *f) {
 		unsafeerror("Could not build connectivity matrix.\nBeamcount must be 2n - 3 for solvable matrix");
 	}
 	
-	matrix *cmat = MAT_matrix(nodecount * 2, nodecount * 2, MAT_YES);
+	if (!cmat) cmat = MAT_matrix(nodecount * 2, nodecount * 2, MAT_YES);
+	else if (cmat->rows != nodecount * 2 || cmat->cols != nodecount * 2) {
+		unsafeerror("Preinitialized connectivity matrix has the wrong size");
+	}
+	else MAT_zeromatrix(cmat);
 
 	// Done with format/error checking
 
@@ -43,11 +53,10 @@ matrix* build_connectivity_matrix(frame *f) {
 	int offset = nodecount; // Y forces are node_number + offset
 	for (int i = 0; i < beamcount; i++) {
 		b = f->beams[i];
-		n_1 = UN_get_node(f, b.n1_id); // Get the nodes the beam connects to
-		n_2 = UN_get_node(f, b.n2_id);
-
-		n1_idx = UN_get_node_idx(f, b.n1_id);
-		n2_idx = UN_get_node_idx(f, b.n2_id);
+		n1_idx = b.n1_idx; // Resolved by UN_compute_beam_vals
+		n2_idx = b.n2_idx;
+		n_1 = f->nodes + n1_idx; // Get the nodes the beam connects to
+		n_2 = f->nodes + n2_idx;
 
 		coeff_x = (float) (n_1->loc.x - n_2->loc.x) / (float) b.length;
 		cmat->mat[n1_idx][i] = coeff_x; // Node 1 x force adds coeff of beam[i] stress
@@ -80,11 +89,95 @@ matrix* build_connectivity_matrix(frame *f) {
 	return cmat;
 }
 
-void setup(frame *f, char *fileloc) {
-	// Read in the file and carry the inutil data over into the unsafe frame
-	printf("Reading file ... ");
-	table *ftable = IN_load_table(fileloc);
+// Relative tolerance on instance interface nodes landing on their frame nodes
+#define MODULE_LOC_TOL 1e-4
+
+int module_node_idx(module *m, int id) {
+	for (int i = 0; i < m->nodecount; i++) {
+		if (m->nodes[i].id == id) return i;
+	}
+	return -1;
+}
+
+void setup_module(frame *f, table *ftable) {
+	// Reads the optional repeated substructure (ModuleNodes, ModuleBeams) and its Instances,
+	//    and condenses the module onto its interface nodes. The frame must already be sorted.
+	section *isect = IN_find_section(ftable, "Instances");
+	if (!isect) return;
+	section *nsect = IN_find_section(ftable, "ModuleNodes");
+	section *bsect = IN_find_section(ftable, "ModuleBeams");
+	if (!nsect || !bsect) unsafeerror("Instances need ModuleNodes and ModuleBeams sections");
+	printf("Condensing module ... ");
+
+	module *m = (module *) malloc(sizeof (module));
+	if (!m) unsafeerror("Could not allocate module");
+	m->nodecount = nsect->itemcount;
+	m->nodes = (node *) malloc(m->nodecount * sizeof (node));
+	m->interface = (char *) malloc(m->nodecount * sizeof (char));
+	m->bnodes = (int *) malloc(m->nodecount * sizeof (int));
+	m->inodes = (int *) malloc(m->nodecount * sizeof (int));
+	m->beamcount = bsect->itemcount;
+	m->beams = (beam *) malloc(m->beamcount * sizeof (beam));
+	m->front = NULL;
+	if (!m->nodes || !m->interface || !m->bnodes || !m->inodes || !m->beams) unsafeerror("Could not allocate module");
+
+	item *it;
+	m->bcount = 0;
+	m->icount = 0;
+	for (int i = 0; i < m->nodecount; i++) {
+		it = nsect->items + i;
+		m->nodes[i] = (node) {it->id, (coor) {IN_get_float(it, 0), IN_get_float(it, 1)}};
+		m->interface[i] = (char) IN_get_int(it, 2);
+		if (m->interface[i]) m->bnodes[m->bcount++] = i;
+		else m->inodes[m->icount++] = i;
+	}
+	if (m->bcount == 0) unsafeerror("Module has no interface nodes");
+	float stiffness;
+	for (int i = 0; i < m->beamcount; i++) {
+		it = bsect->items + i;
+		stiffness = it->quantcount > 2 ? IN_get_float(it, 2) : 1;
+		m->beams[i] = (beam) {it->id, IN_get_int(it, 0), IN_get_int(it, 1), 0, 0, 0, stiffness};
+		m->beams[i].n1_idx = module_node_idx(m, m->beams[i].n1_id);
+		m->beams[i].n2_idx = module_node_idx(m, m->beams[i].n2_id);
+		if (m->beams[i].n1_idx == -1 || m->beams[i].n2_idx == -1) unsafeerror("Bad module node reference in ModuleBeams");
+		m->beams[i].length = UN_dist(m->nodes[m->beams[i].n1_idx].loc, m->nodes[m->beams[i].n2_idx].loc);
+	}
+	f->module = m;
+
+	// Instances: offset, rotation, then the frame node joined to each interface node in turn
+	f->instancecount = isect->itemcount;
+	f->instances = (instance *) malloc(f->instancecount * sizeof (instance));
+	if (!f->instances) unsafeerror("Could not allocate instances");
+	instance *in;
+	coor expected, actual;
+	for (int i = 0; i < f->instancecount; i++) {
+		it = isect->items + i;
+		in = f->instances + i;
+		if (it->quantcount != 3 + m->bcount) unsafeerror("Each instance needs an offset, a rotation and one frame node per interface node");
+		in->id = it->id;
+		in->offset = (coor) {IN_get_float(it, 0), IN_get_float(it, 1)};
+		in->theta = IN_get_float(it, 2);
+		in->frame_idx = (int *) malloc(m->bcount * sizeof (int));
+		in->forces = (float *) calloc(m->beamcount + 1, sizeof (float));
+		if (!in->frame_idx || !in->forces) unsafeerror("Could not allocate instances");
+		for (int q = 0; q < m->bcount; q++) {
+			in->frame_idx[q] = UN_get_node_idx(f, IN_get_int(it, 3 + q));
+			if (in->frame_idx[q] == -1) unsafeerror("Bad frame node reference in Instances");
+			expected = UN_instance_loc(in, m->nodes[m->bnodes[q]].loc);
+			actual = f->nodes[in->frame_idx[q]].loc;
+			if (UN_dist(expected, actual) > MODULE_LOC_TOL * (1 + fabsf(actual.x) + fabsf(actual.y))) {
+				fprintf(stderr, "Instance id %d, frame node id %d\n", in->id, f->nodes[in->frame_idx[q]].id);
+				unsafeerror("Instance interface node does not land on its frame node");
+			}
+		}
+	}
+
+	ST_condense_module(m);
 	printf("Done.\n");
+}
+
+void setup(frame *f, table *ftable) {
+	// Carry the inutil data over into the unsafe frame
 	printf("Filling out table ... ");
 	int ncount, bcount, fcount, ccount;
 	section *nsect, *bsect, *fsect, *csect;
@@ -104,18 +197,48 @@ void setup(frame *f, char *fileloc) {
 		temp_coor = (coor) {IN_get_float(temp_item_ptr, 0), IN_get_float(temp_item_ptr, 1)};
 		f->nodes[i] = (node) {temp_item_ptr->id, temp_coor};
 	}
-	// Populate beams
+	// Populate beams (the axial stiffness EA is optional and defaults to 1)
+	float stiffness, density;
 	for (int i = 0; i<bsect->itemcount; i++) {
 		temp_item_ptr = bsect->items + i;
+		stiffness = temp_item_ptr->quantcount > 2 ? IN_get_float(temp_item_ptr, 2) : 1;
+		density = temp_item_ptr->quantcount > 3 ? IN_get_float(temp_item_ptr, 3) : 1;
 		f->beams[i] = (beam) {temp_item_ptr->id, IN_get_int(temp_item_ptr, 0), 
-			IN_get_int(temp_item_ptr, 1), 0, 0, 0};
+			IN_get_int(temp_item_ptr, 1), 0, 0, 0, stiffness, 0, 0, density};
 	}
 	// Beam length still needs seperate evaluation once frame is loaded
-	// Populate forces
+	// Populate load time histories (dynamics): each item lists time / factor pairs
+	section *hsect = IN_find_section(ftable, "Histories");
+	if (hsect) {
+		f->historycount = hsect->itemcount;
+		f->histories = (history *) malloc(hsect->itemcount * sizeof (history));
+		if (!f->histories) unsafeerror("Could not allocate load histories");
+		history *h;
+		for (int i = 0; i < hsect->itemcount; i++) {
+			temp_item_ptr = hsect->items + i;
+			h = f->histories + i;
+			h->id = temp_item_ptr->id;
+			h->count = temp_item_ptr->quantcount / 2;
+			if (h->count < 1 || temp_item_ptr->quantcount % 2) unsafeerror("Histories need time / factor pairs");
+			h->t = (float *) malloc(h->count * sizeof (float));
+			h->s = (float *) malloc(h->count * sizeof (float));
+			if (!h->t || !h->s) unsafeerror("Could not allocate load histories");
+			for (int j = 0; j < h->count; j++) {
+				h->t[j] = IN_get_float(temp_item_ptr, 2 * j);
+				h->s[j] = IN_get_float(temp_item_ptr, 2 * j + 1);
+				if (j && h->t[j] < h->t[j - 1]) unsafeerror("History times must be in ascending order");
+			}
+		}
+	}
+	// Populate forces (the optional fourth value names the force's time history)
 	for (int i = 0; i<fsect->itemcount; i++) {
 		temp_item_ptr = fsect->items + i;
 		f->forces[i] = (force) {temp_item_ptr->id, IN_get_int(temp_item_ptr, 0), 
 			IN_get_float(temp_item_ptr, 1), IN_get_float(temp_item_ptr, 2)};
+		if (temp_item_ptr->quantcount > 3) {
+			f->forces[i].hist = UN_get_history(f, IN_get_int(temp_item_ptr, 3));
+			if (!f->forces[i].hist) unsafeerror("Force names a missing history");
+		}
 	}
 	// Populate constraints
 	for (int i = 0; i<csect->itemcount; i++) {
@@ -124,66 +247,1254 @@ void setup(frame *f, char *fileloc) {
 			IN_get_float(temp_item_ptr, 1), 0};
 	}
 
-	// Ensure beam references are all sanitary
-	for (int i = 0; i < f->beamcount; i++) {
-		if (UN_get_node_idx(f, f->beams[i].n1_id) == -1) unsafeerror("Bad node reference in beam");
-		if (UN_get_node_idx(f, f->beams[i].n2_id) == -1) unsafeerror("Bad node reference in beam");
-	}
+	// Beam references are checked when UN_compute_beam_vals resolves them to node indices
 	printf("Done.\n");
 
+	// Normalise member order so equivalent files give identical frames (and frame hashes)
+	UN_sort_frame(f);
+
 	printf("Computing beam values ... ");
 	// Calculate beam values (other precomputation should occur here)
 	UN_compute_beam_vals(f);
 	printf("Done.\n");
 
-	// Free all allocated inutil space
-	IN_free_table(ftable);
+	setup_module(f, ftable);
 }
 
-int main() {
-	frame *f = (frame *) malloc(sizeof (frame));
-	setup(f, "examples/boxframe.us");
+lu_factor* factor_frame(frame *f, cache *c, unsigned long long geom) {
+	// Returns the factored connectivity matrix of f, from the cache if possible
+	lu_factor *lu = NULL;
+	if (c) lu = CA_load_factor(c, geom);
+	if (lu && lu->n != 2 * f->nodecount) {
+		MAT_freelu(lu);
+		lu = NULL;
+	}
+	if (lu) {
+		printf("Connectivity factorization found in cache.\n");
+		return lu;
+	}
+
 	printf("Building connectivity matrix ... ");
-	matrix *con_mat = build_connectivity_matrix(f);
+	matrix *con_mat = build_connectivity_matrix(f, NULL);
 	printf("Done.\n");
-	printf("Setup complete.\n");
 
-	UN_printframe(f);
+	printf("Completed connectivity matrix:");
+	MAT_printmatrix(con_mat);
+
+	printf("Factoring connectivity matrix ... ");
+	lu = MAT_factor_lu(con_mat);
+	printf("Done.\n");
+	MAT_freematrix(con_mat);
+
+	if (c) CA_store_factor(c, geom, lu);
+	return lu;
+}
+
+int find_mirrors(frame *f, mirror **m) {
+	// Mirror symmetries of f about its vertical and horizontal centre lines; returns how many
+	int count = 0;
+	for (int axis = UN_MIRROR_X; axis <= UN_MIRROR_Y; axis++) {
+		m[count] = UN_find_mirror(f, axis);
+		if (!m[count]) continue;
+		printf("Frame is mirror symmetric about %c = %g.\n", axis == UN_MIRROR_X ? 'x' : 'y', m[count]->c);
+		count++;
+	}
+	return count;
+}
+
+vector* solve_frame_sym(frame *f, mirror **m, int count, vector *node_forces) {
+	// Solves the connectivity system of a mirror symmetric frame block by block in the
+	//    symmetry-adapted bases of node forces (rows) and member forces (columns). Each block is
+	//    1 / 2^count of the size, so factoring them all costs 1 / 4^count of the full matrix, and
+	//    blocks the load does not excite are skipped.
+	// Returns NULL if the blocks do not come out square (the frame cannot be determinate then).
+	int n = f->nodecount;
+	int bc = f->beamcount;
+	int *rperm[2], *rsign[2], *cperm[2], *csign[2];
+	for (int g = 0; g < count; g++) {
+		rperm[g] = (int *) malloc(2 * n * sizeof (int));
+		rsign[g] = (int *) malloc(2 * n * sizeof (int));
+		cperm[g] = (int *) malloc(2 * n * sizeof (int));
+		csign[g] = (int *) malloc(2 * n * sizeof (int));
+		if (!rperm[g] || !rsign[g] || !cperm[g] || !csign[g]) unsafeerror("Could not allocate symmetry maps");
+		for (int i = 0; i < n; i++) {
+			rperm[g][i] = m[g]->node[i];
+			rperm[g][i + n] = m[g]->node[i] + n;
+			rsign[g][i] = m[g]->axis == UN_MIRROR_X ? -1 : 1;
+			rsign[g][i + n] = -rsign[g][i];
+		}
+		for (int i = 0; i < bc; i++) {
+			cperm[g][i] = m[g]->beam[i];
+			csign[g][i] = 1;
+		}
+		for (int i = 0; i < f->constraintcount; i++) {
+			cperm[g][bc + i] = bc + m[g]->constraint[i];
+			csign[g][bc + i] = m[g]->csign[i];
+		}
+	}
+	symbasis *rows = MAT_symbasis(2 * n, count, rperm, rsign);
+	symbasis *cols = MAT_symbasis(2 * n, count, cperm, csign);
+	for (int g = 0; g < count; g++) {
+		free(rperm[g]);
+		free(rsign[g]);
+		free(cperm[g]);
+		free(csign[g]);
+	}
+	int ok = rows && cols;
+	for (int c = 0; ok && c < rows->nblock; c++) ok = rows->size[c] == cols->size[c];
+	if (!ok) {
+		if (rows) MAT_freesymbasis(rows);
+		if (cols) MAT_freesymbasis(cols);
+		return NULL;
+	}
+
+	matrix *con_mat = build_connectivity_matrix(f, NULL);
+	vector *res = MAT_vector(2 * n, MAT_YES);
+	float fmax = 0, pmax;
+	for (int i = 0; i < 2 * n; i++) if (fabsf(node_forces->vec[i]) > fmax) fmax = fabsf(node_forces->vec[i]);
+	for (int c = 0; c < rows->nblock; c++) {
+		if (!rows->size[c]) continue;
+		vector *fc = MAT_symmetry_project(rows, c, node_forces);
+		pmax = 0;
+		for (int i = 0; i < fc->rows; i++) if (fabsf(fc->vec[i]) > pmax) pmax = fabsf(fc->vec[i]);
+		if (pmax > 1e-7 * fmax) {
+			printf("block %d (%d unknowns) ... ", c, fc->rows);
+			matrix *mc = MAT_symmetry_block(con_mat, rows, cols, c);
+			lu_factor *lc = MAT_factor_lu(mc);
+			vector *sc = MAT_solve_lu(lc, fc);
+			MAT_symmetry_expand(cols, c, sc, res);
+			MAT_freevector(sc);
+			MAT_freelu(lc);
+			MAT_freematrix(mc);
+		}
+		MAT_freevector(fc);
+	}
+	MAT_freematrix(con_mat);
+	MAT_freesymbasis(rows);
+	MAT_freesymbasis(cols);
+	return res;
+}
+
+vector* solve_frame(frame *f, cache *c, lu_factor **lu) {
+	// Solves beam and constraint forces for f, skipping assembly and solve on a cache hit
+	// If a factorization is needed it is left in *lu for later analyses (caller frees)
+	unsigned long long geom = UN_hash_geometry(f);
+	unsigned long long load = UN_hash_loads(f);
+	vector *stress_solutions = NULL;
+
+	if (c) {
+		printf("Frame hash %016llx-%016llx\n", geom, load);
+		stress_solutions = CA_load_solution(c, geom, load);
+		if (stress_solutions && stress_solutions->rows != 2 * f->nodecount) {
+			MAT_freevector(stress_solutions);
+			stress_solutions = NULL;
+		}
+		if (stress_solutions) {
+			printf("Solution found in cache.\n");
+			return stress_solutions;
+		}
+	}
 
 	printf("Collecting node forces ... ");
-	vector * node_forces = UN_get_forces(f);
+	vector *node_forces = UN_get_forces(f);
 	printf("Done.\n");
 
 	MAT_printvector(node_forces);
 
-	printf("Completed connectivity matrix:");
-	MAT_printmatrix(con_mat);
+	// Simple trusses are solved joint by joint, with no connectivity matrix at all
+	joints *jt = *lu ? NULL : RG_joint_order(f);
+	if (jt) {
+		printf("Frame is a simple truss. Solving by the method of joints ... ");
+		stress_solutions = RG_solve_joints(f, jt, node_forces);
+		RG_free_joints(jt);
+		if (stress_solutions) printf("Done.\n");
+		else printf("degenerate joint, falling back to the connectivity matrix.\n");
+	}
+
+	// Mirror symmetric frames split into independent blocks of the connectivity matrix
+	if (!stress_solutions && !*lu) {
+		mirror *m[2];
+		int count = find_mirrors(f, m);
+		if (count) {
+			printf("Solving beam stresses by symmetry blocks ... ");
+			stress_solutions = solve_frame_sym(f, m, count, node_forces);
+			printf(stress_solutions ? "Done.\n" : "blocks not square, falling back to the full matrix.\n");
+		}
+		for (int i = 0; i < count; i++) UN_free_mirror(m[i]);
+	}
+
+	if (!stress_solutions) {
+		if (!*lu) *lu = factor_frame(f, c, geom);
+		printf("Here goes. Solving beam stresses ... ");
+		stress_solutions = MAT_solve_lu(*lu, node_forces);
+		printf("\nDone.");
+	}
+
+	if (c) CA_store_solution(c, geom, load, stress_solutions);
+
+	MAT_freevector(node_forces);
+	return stress_solutions;
+}
+
+void sweep_frame(frame *f, section *ssect, lu_factor *lu, char *outloc) {
+	// Parametric sweep over force angles / magnitudes. Each line of the Sweep section
+	//    expands into a run of right hand sides; all of them are solved as one block
+	//    against the single factorization of the (unchanged) connectivity matrix.
+	int total = 0;
+	item *it;
+	for (int i = 0; i < ssect->itemcount; i++) {
+		it = ssect->items + i;
+		if (IN_get_int(it, 4) < 1) unsafeerror("Sweep step count must be positive");
+		total += IN_get_int(it, 4);
+	}
+
+	int n = 2 * f->nodecount;
+	matrix *rhs = MAT_matrix(n, total, MAT_NO);
+	float *values = (float *) malloc(total * sizeof (float));
+	int *sweep_ids = (int *) malloc(total * sizeof (int));
+	if (!values || !sweep_ids) unsafeerror("Could not allocate sweep");
+
+	force *frc;
+	float saved, start, stop;
+	int param, steps;
+	int col = 0;
+	vector *node_forces;
+	for (int i = 0; i < ssect->itemcount; i++) {
+		it = ssect->items + i;
+		frc = NULL;
+		for (int j = 0; j < f->forcecount; j++) {
+			if (f->forces[j].id == IN_get_int(it, 0)) frc = f->forces + j;
+		}
+		if (!frc) unsafeerror("Bad force reference in sweep");
+		param = IN_get_int(it, 1);
+		if (param != 0 && param != 1) unsafeerror("Sweep parameter must be 0 (theta) or 1 (magnitude)");
+		start = IN_get_float(it, 2);
+		stop = IN_get_float(it, 3);
+		steps = IN_get_int(it, 4);
+
+		saved = param ? frc->mag : frc->theta;
+		for (int s = 0; s < steps; s++) {
+			values[col] = steps > 1 ? start + (stop - start) * s / (float) (steps - 1) : start;
+			sweep_ids[col] = it->id;
+			if (param) frc->mag = values[col];
+			else frc->theta = values[col];
+
+			node_forces = UN_get_forces(f);
+			for (int r = 0; r < n; r++) rhs->mat[r][col] = node_forces->vec[r];
+			MAT_freevector(node_forces);
+			col++;
+		}
+		if (param) frc->mag = saved;
+		else frc->theta = saved;
+	}
+
+	printf("Solving %d sweep points ... ", total);
+	matrix *res = MAT_solve_lu_block(lu, rhs);
+	printf("Done.\n");
+
+	FILE *fp = fopen(outloc, "w");
+	if (!fp) unsafeerror("Could not open sweep output file");
+	fprintf(fp, "# sweep value");
+	for (int i = 0; i < f->beamcount; i++) fprintf(fp, " b%d", f->beams[i].id);
+	for (int i = 0; i < f->constraintcount; i++) fprintf(fp, " c%d", f->constraints[i].id);
+	fprintf(fp, "\n");
+	for (int c = 0; c < total; c++) {
+		fprintf(fp, "%d %g", sweep_ids[c], values[c]);
+		for (int r = 0; r < n; r++) fprintf(fp, " %g", res->mat[r][c]);
+		fprintf(fp, "\n");
+	}
+	fclose(fp);
+	printf("Sweep table written to %s\n", outloc);
+
+	MAT_freematrix(rhs);
+	MAT_freematrix(res);
+	free(values);
+	free(sweep_ids);
+}
+
+void influence_frame(frame *f, section *isect, section *bsect, lu_factor *lu, char *outloc) {
+	// Influence lines: the force in each beam (and constraint) as a unit load visits every
+	//    position listed in the Influence section. Written as a (beams + constraints) x positions table.
+	// With an InfluenceBeams section naming fewer members than there are positions, the
+	//    transpose system is solved instead: one solve per member yields its whole row.
+	int n = 2 * f->nodecount;
+	int offset = f->nodecount;
+	int positions = isect->itemcount;
+	if (positions < 1) unsafeerror("Influence section has no positions");
+
+	int *pos_idx = (int *) malloc(positions * sizeof (int));
+	float *pos_x = (float *) malloc(positions * sizeof (float));
+	float *pos_y = (float *) malloc(positions * sizeof (float));
+	if (!pos_idx || !pos_x || !pos_y) unsafeerror("Could not allocate influence positions");
+	item *it;
+	for (int p = 0; p < positions; p++) {
+		it = isect->items + p;
+		pos_idx[p] = UN_get_node_idx(f, IN_get_int(it, 0));
+		if (pos_idx[p] == -1) unsafeerror("Bad node reference in influence position");
+		pos_x[p] = cos(IN_get_float(it, 1));
+		pos_y[p] = sin(IN_get_float(it, 1));
+	}
+
+	// Rows of the solution vector to report
+	int rowcount = n;
+	int *rows = (int *) malloc(n * sizeof (int));
+	if (!rows) unsafeerror("Could not allocate influence rows");
+	if (bsect) {
+		rowcount = bsect->itemcount;
+		for (int r = 0; r < rowcount; r++) {
+			rows[r] = -1;
+			for (int i = 0; i < f->beamcount; i++) {
+				if (f->beams[i].id == IN_get_int(bsect->items + r, 0)) rows[r] = i;
+			}
+			if (rows[r] == -1) unsafeerror("Bad beam reference in InfluenceBeams");
+		}
+	}
+	else {
+		for (int r = 0; r < n; r++) rows[r] = r;
+	}
+
+	matrix *table = MAT_matrix(rowcount, positions, MAT_NO);
+	matrix *rhs, *res;
+	if (rowcount < positions) {
+		printf("Solving %d transposed influence systems ... ", rowcount);
+		rhs = MAT_matrix(n, rowcount, MAT_YES);
+		for (int r = 0; r < rowcount; r++) rhs->mat[rows[r]][r] = 1;
+		res = MAT_solve_lu_transpose_block(lu, rhs);
+		// Column r of res is row rows[r] of the inverse; dot it with each unit load
+		for (int r = 0; r < rowcount; r++) {
+			for (int p = 0; p < positions; p++) {
+				table->mat[r][p] = res->mat[pos_idx[p]][r] * pos_x[p]
+					+ res->mat[pos_idx[p] + offset][r] * pos_y[p];
+			}
+		}
+	}
+	else {
+		printf("Solving %d influence positions ... ", positions);
+		rhs = MAT_matrix(n, positions, MAT_YES);
+		for (int p = 0; p < positions; p++) {
+			rhs->mat[pos_idx[p]][p] = pos_x[p];
+			rhs->mat[pos_idx[p] + offset][p] = pos_y[p];
+		}
+		res = MAT_solve_lu_block(lu, rhs);
+		for (int r = 0; r < rowcount; r++) {
+			for (int p = 0; p < positions; p++) table->mat[r][p] = res->mat[rows[r]][p];
+		}
+	}
+	printf("Done.\n");
+
+	FILE *fp = fopen(outloc, "w");
+	if (!fp) unsafeerror("Could not open influence output file");
+	fprintf(fp, "# member");
+	for (int p = 0; p < positions; p++) fprintf(fp, " n%d", f->nodes[pos_idx[p]].id);
+	fprintf(fp, "\n");
+	for (int r = 0; r < rowcount; r++) {
+		if (rows[r] < f->beamcount) fprintf(fp, "b%d", f->beams[rows[r]].id);
+		else fprintf(fp, "c%d", f->constraints[rows[r] - f->beamcount].id);
+		for (int p = 0; p < positions; p++) fprintf(fp, " %g", table->mat[r][p]);
+		fprintf(fp, "\n");
+	}
+	fclose(fp);
+	printf("Influence lines written to %s\n", outloc);
+
+	MAT_freematrix(rhs);
+	MAT_freematrix(res);
+	MAT_freematrix(table);
+	free(rows);
+	free(pos_idx);
+	free(pos_x);
+	free(pos_y);
+}
+
+void sensitivity_frame(frame *f, section *ssect, lu_factor *lu, vector *stress_solutions, char *outloc) {
+	// Adjoint sensitivities d(beam force)/d(node coordinate) for the beams listed in the
+	//    Sensitivity section. With A . s = F and F independent of geometry,
+	//    d(s_b)/dp = -transpose(lambda_b) . (dA/dp) . s  where  transpose(A) . lambda_b = e_b,
+	//    so the cost is one transposed solve per beam of interest on the existing factors.
+	// Only the beam columns of A depend on node positions, through the direction cosines
+	//    coeff_x = (x1 - x2) / L and coeff_y = (y1 - y2) / L.
+	int n = 2 * f->nodecount;
+	int offset = f->nodecount;
+	int count = ssect->itemcount;
+	if (count < 1) unsafeerror("Sensitivity section has no beams");
+
+	int *rows = (int *) malloc(count * sizeof (int));
+	if (!rows) unsafeerror("Could not allocate sensitivity rows");
+	for (int r = 0; r < count; r++) {
+		rows[r] = -1;
+		for (int i = 0; i < f->beamcount; i++) {
+			if (f->beams[i].id == IN_get_int(ssect->items + r, 0)) rows[r] = i;
+		}
+		if (rows[r] == -1) unsafeerror("Bad beam reference in Sensitivity");
+	}
+
+	printf("Solving %d adjoint systems ... ", count);
+	matrix *rhs = MAT_matrix(n, count, MAT_YES);
+	for (int r = 0; r < count; r++) rhs->mat[rows[r]][r] = 1;
+	matrix *lambda = MAT_solve_lu_transpose_block(lu, rhs);
+	printf("Done.\n");
+
+	// grad->mat[r][node] is d(s_rows[r])/dx_node, grad->mat[r][node + offset] is d/dy_node
+	matrix *grad = MAT_matrix(count, n, MAT_YES);
+	beam b;
+	coor c1, c2;
+	int n1_idx, n2_idx;
+	float dx, dy, l3, dcx_dx, dcx_dy, dcy_dy, lx, ly, sb;
+	for (int i = 0; i < f->beamcount; i++) {
+		b = f->beams[i];
+		n1_idx = b.n1_idx;
+		n2_idx = b.n2_idx;
+		c1 = f->nodes[n1_idx].loc;
+		c2 = f->nodes[n2_idx].loc;
+		dx = c1.x - c2.x;
+		dy = c1.y - c2.y;
+		l3 = b.length * b.length * b.length;
+		// Derivatives of the direction cosines with respect to node 1 (node 2 is the negative)
+		dcx_dx = dy * dy / l3;
+		dcx_dy = -dx * dy / l3; // equal to dcy_dx
+		dcy_dy = dx * dx / l3;
+		sb = stress_solutions->vec[i];
+		if (sb == 0) continue;
+
+		for (int r = 0; r < count; r++) {
+			// The column entries are +c at node 1 and -c at node 2, hence the differences
+			lx = lambda->mat[n1_idx][r] - lambda->mat[n2_idx][r];
+			ly = lambda->mat[n1_idx + offset][r] - lambda->mat[n2_idx + offset][r];
+			dx = -sb * (lx * dcx_dx + ly * dcx_dy); // d(s)/dx1
+			dy = -sb * (lx * dcx_dy + ly * dcy_dy); // d(s)/dy1
+			grad->mat[r][n1_idx] += dx;
+			grad->mat[r][n1_idx + offset] += dy;
+			grad->mat[r][n2_idx] -= dx;
+			grad->mat[r][n2_idx + offset] -= dy;
+		}
+	}
+
+	FILE *fp = fopen(outloc, "w");
+	if (!fp) unsafeerror("Could not open sensitivity output file");
+	fprintf(fp, "# beam");
+	for (int i = 0; i < f->nodecount; i++) fprintf(fp, " n%dx n%dy", f->nodes[i].id, f->nodes[i].id);
+	fprintf(fp, "\n");
+	for (int r = 0; r < count; r++) {
+		fprintf(fp, "b%d", f->beams[rows[r]].id);
+		for (int i = 0; i < f->nodecount; i++) {
+			fprintf(fp, " %g %g", grad->mat[r][i], grad->mat[r][i + offset]);
+		}
+		fprintf(fp, "\n");
+	}
+	fclose(fp);
+	printf("Beam force sensitivities written to %s\n", outloc);
+
+	MAT_freematrix(rhs);
+	MAT_freematrix(lambda);
+	MAT_freematrix(grad);
+	free(rows);
+}
+
+// Monte Carlo perturbation of one frame parameter (see the Perturbations section)
+#define MC_NODE_X 0
+#define MC_NODE_Y 1
+#define MC_FORCE_THETA 2
+#define MC_FORCE_MAG 3
+#define MC_NORMAL 0
+#define MC_UNIFORM 1
+#define MC_PILOT 256
+
+typedef struct perturbation perturbation;
+struct perturbation {
+	int kind;
+	int idx; // node or force index in the frame
+	int dist;
+	float a; // normal: mean offset, uniform: low offset
+	float b; // normal: standard deviation, uniform: high offset
+};
+
+frame* mc_workspace(frame *f) {
+	// Private copy of the frame members a sample modifies (constraints are shared)
+	frame *w = (frame *) malloc(sizeof (frame));
+	if (!w) unsafeerror("Could not allocate sampling workspace");
+	*w = *f;
+	w->nodes = (node *) malloc(f->nodecount * sizeof (node));
+	w->beams = (beam *) malloc(f->beamcount * sizeof (beam));
+	w->forces = (force *) malloc(f->forcecount * sizeof (force));
+	if (!w->nodes || !w->beams || !w->forces) unsafeerror("Could not allocate sampling workspace");
+	for (int i = 0; i < f->beamcount; i++) w->beams[i] = f->beams[i];
+	return w;
+}
+
+void mc_free_workspace(frame *w) {
+	free(w->nodes);
+	free(w->beams);
+	free(w->forces);
+	free(w);
+}
+
+vector* mc_solve_sample(frame *f, frame *w, perturbation *p, int pcount, unsigned long long seed,
+		long long sample, joints *jt, matrix *cmat, lu_factor **lu) {
+	// Draws one sample into workspace w from its own RNG stream and solves it
+	// Simple trusses (jt not NULL) are solved by the method of joints unless the sample is degenerate
+	rng r;
+	STAT_seed(&r, seed, sample);
+	for (int i = 0; i < f->nodecount; i++) w->nodes[i] = f->nodes[i];
+	for (int i = 0; i < f->forcecount; i++) w->forces[i] = f->forces[i];
+
+	float delta;
+	for (int i = 0; i < pcount; i++) {
+		if (p[i].dist == MC_NORMAL) delta = p[i].a + p[i].b * STAT_normal(&r);
+		else delta = p[i].a + (p[i].b - p[i].a) * STAT_uniform(&r);
+		switch (p[i].kind) {
+			case MC_NODE_X: w->nodes[p[i].idx].loc.x += delta; break;
+			case MC_NODE_Y: w->nodes[p[i].idx].loc.y += delta; break;
+			case MC_FORCE_THETA: w->forces[p[i].idx].theta += delta; break;
+			case MC_FORCE_MAG: w->forces[p[i].idx].mag += delta; break;
+		}
+	}
+	UN_compute_beam_vals(w);
+
+	vector *node_forces = UN_get_forces(w);
+	vector *res = jt ? RG_solve_joints(w, jt, node_forces) : NULL;
+	if (!res) {
+		build_connectivity_matrix(w, cmat);
+		if (!*lu) *lu = MAT_factor_lu(cmat);
+		else MAT_refactor_lu(*lu, cmat);
+		res = MAT_solve_lu(*lu, node_forces);
+	}
+	MAT_freevector(node_forces);
+	return res;
+}
 
-	printf("Here goes. Solving beam stresses ... ");
-	vector *stress_solutions = MAT_solve_gausselim(con_mat, node_forces);
-	printf("\nDone.");
+void montecarlo_frame(frame *f, section *msect, section *psect, char *outloc) {
+	// Reliability study: perturbs node coordinates and loads per the Perturbations section,
+	//    solves every sample, and keeps only streaming statistics per member.
+	// Samples are spread across threads, each with its own frame copy, matrix and factor.
+	// Sample k always draws from RNG stream k, so results do not depend on the thread count.
+	if (msect->itemcount != 1) unsafeerror("MonteCarlo section must have exactly one line");
+	item *it = msect->items;
+	long long samples = IN_get_int(it, 0);
+	unsigned long long seed = (unsigned long long) IN_get_int(it, 1);
+	float limit = IN_get_float(it, 2);
+	if (samples < 1) unsafeerror("MonteCarlo sample count must be positive");
 
-	// Fill in the force values
+	int pcount = psect ? psect->itemcount : 0;
+	perturbation *p = (perturbation *) malloc((pcount + 1) * sizeof (perturbation));
+	if (!p) unsafeerror("Could not allocate perturbations");
+	for (int i = 0; i < pcount; i++) {
+		it = psect->items + i;
+		p[i] = (perturbation) {IN_get_int(it, 0), -1, IN_get_int(it, 2), IN_get_float(it, 3), IN_get_float(it, 4)};
+		if (p[i].kind == MC_NODE_X || p[i].kind == MC_NODE_Y) {
+			p[i].idx = UN_get_node_idx(f, IN_get_int(it, 1));
+		}
+		else if (p[i].kind == MC_FORCE_THETA || p[i].kind == MC_FORCE_MAG) {
+			for (int j = 0; j < f->forcecount; j++) {
+				if (f->forces[j].id == IN_get_int(it, 1)) p[i].idx = j;
+			}
+		}
+		else unsafeerror("Unknown perturbation kind");
+		if (p[i].idx == -1) unsafeerror("Bad reference in perturbation");
+		if (p[i].dist != MC_NORMAL && p[i].dist != MC_UNIFORM) unsafeerror("Unknown perturbation distribution");
+	}
+
+	int n = 2 * f->nodecount;
+	accum *stats = (accum *) malloc(n * sizeof (accum));
+	long long *fails = (long long *) calloc(f->beamcount + 1, sizeof (long long)); // last entry: any beam
+	if (!stats || !fails) unsafeerror("Could not allocate sampling statistics");
+
+	// A short serial pilot run fixes the histogram ranges used for quantiles
+	long long pilot = samples < MC_PILOT ? samples : MC_PILOT;
+	float *pilot_res = (float *) malloc(pilot * n * sizeof (float));
+	if (!pilot_res) unsafeerror("Could not allocate pilot samples");
+	// The joint order depends on connectivity only, so it holds for every sample
+	joints *jt = RG_joint_order(f);
+	if (jt) printf("Frame is a simple truss; samples are solved by the method of joints.\n");
+	frame *w = mc_workspace(f);
+	matrix *cmat = MAT_matrix(n, n, MAT_NO);
+	lu_factor *lu = NULL;
+	vector *res;
+	for (long long k = 0; k < pilot; k++) {
+		res = mc_solve_sample(f, w, p, pcount, seed, k, jt, cmat, &lu);
+		for (int r = 0; r < n; r++) pilot_res[k * n + r] = res->vec[r];
+		MAT_freevector(res);
+	}
+	float lo, hi, span;
+	for (int r = 0; r < n; r++) {
+		lo = hi = pilot_res[r];
+		for (long long k = 1; k < pilot; k++) {
+			if (pilot_res[k * n + r] < lo) lo = pilot_res[k * n + r];
+			if (pilot_res[k * n + r] > hi) hi = pilot_res[k * n + r];
+		}
+		span = hi - lo;
+		if (span <= 1e-6 * fabsf(hi)) span = fabsf(hi) > 0 ? 0.1 * fabsf(hi) : 1;
+		STAT_init_accum(stats + r, lo - span, hi + span);
+		for (long long k = 0; k < pilot; k++) STAT_add(stats + r, pilot_res[k * n + r]);
+	}
+	for (long long k = 0; k < pilot; k++) {
+		int any = 0;
+		for (int i = 0; i < f->beamcount; i++) {
+			if (fabsf(pilot_res[k * n + i]) > limit) {
+				fails[i]++;
+				any = 1;
+			}
+		}
+		fails[f->beamcount] += any;
+	}
+	free(pilot_res);
+	MAT_freematrix(cmat);
+	if (lu) MAT_freelu(lu);
+	mc_free_workspace(w);
+
+	printf("Sampling %lld frames ... ", samples);
+	fflush(stdout);
+	#pragma omp parallel
+	{
+		frame *tw = mc_workspace(f);
+		matrix *tcmat = MAT_matrix(n, n, MAT_NO);
+		lu_factor *tlu = NULL;
+		accum *tstats = (accum *) malloc(n * sizeof (accum));
+		long long *tfails = (long long *) calloc(f->beamcount + 1, sizeof (long long));
+		if (!tstats || !tfails) unsafeerror("Could not allocate sampling statistics");
+		for (int r = 0; r < n; r++) STAT_init_accum(tstats + r, stats[r].lo, stats[r].hi);
+		vector *tres;
+		int any;
+
+		#pragma omp for schedule(static)
+		for (long long k = pilot; k < samples; k++) {
+			tres = mc_solve_sample(f, tw, p, pcount, seed, k, jt, tcmat, &tlu);
+			for (int r = 0; r < n; r++) STAT_add(tstats + r, tres->vec[r]);
+			any = 0;
+			for (int i = 0; i < f->beamcount; i++) {
+				if (fabsf(tres->vec[i]) > limit) {
+					tfails[i]++;
+					any = 1;
+				}
+			}
+			tfails[f->beamcount] += any;
+			MAT_freevector(tres);
+		}
+
+		#pragma omp critical
+		{
+			for (int r = 0; r < n; r++) STAT_merge(stats + r, tstats + r);
+			for (int i = 0; i <= f->beamcount; i++) fails[i] += tfails[i];
+		}
+
+		free(tstats);
+		free(tfails);
+		MAT_freematrix(tcmat);
+		if (tlu) MAT_freelu(tlu);
+		mc_free_workspace(tw);
+	}
+	printf("Done.\n");
+
+	FILE *fp = fopen(outloc, "w");
+	if (!fp) unsafeerror("Could not open Monte Carlo output file");
+	fprintf(fp, "# %lld samples, seed %llu, allowable beam force %g\n", samples, seed, limit);
+	fprintf(fp, "# system failure probability %g\n", fails[f->beamcount] / (double) samples);
+	fprintf(fp, "# member mean stddev min q05 q50 q95 max pfail\n");
+	for (int r = 0; r < n; r++) {
+		if (r < f->beamcount) fprintf(fp, "b%d", f->beams[r].id);
+		else fprintf(fp, "c%d", f->constraints[r - f->beamcount].id);
+		fprintf(fp, " %g %g %g %g %g %g %g", stats[r].mean, sqrt(STAT_variance(stats + r)), stats[r].min,
+			STAT_quantile(stats + r, 0.05), STAT_quantile(stats + r, 0.5), STAT_quantile(stats + r, 0.95),
+			stats[r].max);
+		if (r < f->beamcount) fprintf(fp, " %g\n", fails[r] / (double) samples);
+		else fprintf(fp, " -\n");
+	}
+	fclose(fp);
+	printf("System failure probability %g. Statistics written to %s\n",
+		fails[f->beamcount] / (double) samples, outloc);
+
+	free(stats);
+	free(fails);
+	free(p);
+	if (jt) RG_free_joints(jt);
+}
+
+void print_results(frame *f) {
+	// Node displacements, beam forces and constraint forces of the solved frame
+	printf("Node displacements:\n");
+	for (int i = 0; i < f->nodecount; i++) {
+		printf("    Node id %05d ", f->nodes[i].id);
+		UN_printcoor(f->nodes[i].disp);
+		printf("\n");
+	}
+	printf("Beam forces (tension positive):\n");
 	for (int i = 0; i < f->beamcount; i++) {
-		f->beams[i].force = stress_solutions->vec[i];
+		printf("    Beam id %05d %10.4f\n", f->beams[i].id, f->beams[i].force);
+	}
+	printf("Constraint forces:\n");
+	for (int i = 0; i < f->constraintcount; i++) {
+		printf("    Constraint id %05d %10.4f\n", f->constraints[i].id, f->constraints[i].force);
+	}
+}
+
+void stiffness_frame(frame *f, int nparts) {
+	// Direct stiffness solve: handles statically indeterminate frames and gives displacements
+	mirror *m[2];
+	int count = nparts > 1 ? 0 : find_mirrors(f, m);
+	printf("Solving displacements by the stiffness method ... ");
+	int factors, blocks;
+	vector *u = nparts > 1 ? NULL : ST_solve_chain(f, &factors);
+	if (u) printf("periodic chain of %d bays, %d bay factorizations ... ", f->instancecount, factors);
+	if (!u && count) u = ST_solve_sym(f, m, count, &blocks);
+	if (u && count) printf("%d of %d symmetry blocks loaded ... ", blocks, 1 << count);
+	for (int i = 0; i < count; i++) UN_free_mirror(m[i]);
+	if (!u) u = nparts > 1 ? ST_solve_dd(f, nparts) : ST_solve(f);
+	printf("Done.\n");
+
+	print_results(f);
+	if (f->instancecount) printf("Module beam forces by instance:\n");
+	for (int i = 0; i < f->instancecount; i++) {
+		for (int j = 0; j < f->module->beamcount; j++) {
+			printf("    Instance id %05d beam id %05d %10.4f\n", f->instances[i].id, f->module->beams[j].id, f->instances[i].forces[j]);
+		}
+	}
+	MAT_freevector(u);
+}
+
+void nonlinear_frame(frame *f, int steps, int arclength, char *outloc) {
+	// Large displacement solve: equilibrium on the deformed geometry (stiffutil ST_solve_nonlinear),
+	//    by load control in steps increments or by arc-length continuation through limit points.
+	//    The equilibrium path is written to outloc.
+	printf("Solving large displacements by %s, %d steps ... ", arclength ? "arc-length continuation" : "load control", steps);
+	stpath *p = ST_solve_nonlinear(f, steps, arclength);
+	printf("Done.\n");
+	printf("%d steps, %d iterations, %d back substitutions, %d factorizations\n",
+		p->count - 1, p->iterations, p->solves, p->factors);
+	double lambda = p->lambda[p->count - 1];
+	if (lambda < 1) {
+		printf("Stopped at load factor %g: ", lambda);
+		if (arclength) printf("continuation did not reach the full load.\n");
+		else printf("the frame reaches a limit point (buckling or snap-through); try -a.\n");
+	}
+	// A limit point is where the load factor turns back along the path
+	int limits = 0;
+	for (int i = 2; i < p->count; i++) {
+		limits += (p->lambda[i] - p->lambda[i - 1]) * (p->lambda[i - 1] - p->lambda[i - 2]) < 0;
+	}
+	if (limits) printf("Passed %d limit points along the path.\n", limits);
+
+	FILE *fp = fopen(outloc, "w");
+	if (!fp) unsafeerror("Could not open path output file");
+	fprintf(fp, "# step load_factor displacement\n");
+	for (int i = 0; i < p->count; i++) fprintf(fp, "%d %g %g\n", i, p->lambda[i], p->disp[i]);
+	fclose(fp);
+	ST_free_path(p);
+
+	print_results(f);
+}
+
+#define DYN_SAMPLES 1000 // rows of the time history written by dynamics_frame
+
+int dynamics_track(frame *f, double *tx, double *ty) {
+	// Time histories follow the most heavily loaded node (at full magnitude) along its load
+	vector *applied = UN_get_forces(f);
+	int n = f->nodecount, track = 0;
+	double fmax = -1, mag;
+	*tx = 1;
+	*ty = 0;
+	for (int i = 0; i < n; i++) {
+		mag = sqrt(applied->vec[i] * applied->vec[i] + applied->vec[i + n] * applied->vec[i + n]);
+		if (mag <= fmax) continue;
+		fmax = mag;
+		track = i;
+		if (mag > 0) {
+			*tx = applied->vec[i] / mag;
+			*ty = applied->vec[i + n] / mag;
+		}
+	}
+	MAT_freevector(applied);
+	return track;
+}
+
+void dynamics_frame(frame *f, int steps, char *outloc) {
+	// Explicit time-domain response to the applied forces switched on at t = 0 (dynutil), from
+	//    rest, at the largest stable time step. The time history is written to outloc.
+	dyframe *d = DY_frame(f);
+	printf("Explicit dynamics: %d beam colours, time step %g, %d steps to t = %g ... ",
+		d->colourcount, d->dt, steps, steps * d->dt);
+	double tx, ty;
+	int track = dynamics_track(f, &tx, &ty);
+
+	FILE *fp = fopen(outloc, "w");
+	if (!fp) unsafeerror("Could not open dynamics output file");
+	fprintf(fp, "# step time displacement kinetic_energy\n");
+	int every = steps > DYN_SAMPLES ? steps / DYN_SAMPLES : 1, chunk;
+	fprintf(fp, "0 0 0 0\n");
+	for (int s = 0; s < steps; s += chunk) {
+		chunk = steps - s < every ? steps - s : every;
+		DY_step(d, chunk, 1);
+		fprintf(fp, "%lld %g %g %g\n", d->steps, d->t,
+			(d->x[track] - f->nodes[track].loc.x) * tx + (d->y[track] - f->nodes[track].loc.y) * ty,
+			DY_kinetic_energy(d));
+	}
+	fclose(fp);
+	printf("Done.\n");
+	double t = d->t;
+	DY_store(d);
+	DY_free(d);
+	printf("State at t = %g\n", t);
+	print_results(f);
+}
+
+void modal_frame(frame *f, int count, char *outloc) {
+	// Lowest natural frequencies and mode shapes of the linear frame (dynutil, lumped masses).
+	// The shapes are written to outloc, scaled to a largest node displacement of 1, and the first
+	//    is left in node.disp.
+	dofmap *dm = ST_dofmap(f);
+	printf("Modal analysis: %d lowest modes of %d free dofs ... ", count, dm->dofcount);
+	eigen *e = DY_modes(f, dm, count);
+	printf("Done.\n");
+	printf("%d Lanczos steps, %d of %d modes converged\n", e->steps, e->converged, e->count);
+	FILE *fp = fopen(outloc, "w");
+	if (!fp) unsafeerror("Could not open modes output file");
+	fprintf(fp, "# mode omega^2 omega frequency\n");
+	printf("Natural frequencies:\n");
+	double w;
+	for (int i = 0; i < e->count; i++) {
+		w = sqrt(fmax(e->values[i], 0));
+		printf("    Mode %3d omega %12.6g frequency %12.6g\n", i + 1, w, w / (2 * M_PI));
+		fprintf(fp, "%d %g %g %g\n", i + 1, e->values[i], w, w / (2 * M_PI));
+	}
+	fprintf(fp, "# mode node dx dy\n");
+	for (int i = e->count - 1; i >= 0; i--) {
+		ST_set_mode(f, dm, e, i);
+		for (int j = 0; j < f->nodecount; j++) {
+			fprintf(fp, "%d %d %g %g\n", i + 1, f->nodes[j].id, f->nodes[j].disp.x, f->nodes[j].disp.y);
+		}
+	}
+	fclose(fp);
+	printf("Mode shapes written to %s\n", outloc);
+	MAT_freeeigen(e);
+	ST_free_dofmap(dm);
+}
+
+void buckling_frame(frame *f, int count, char *outloc) {
+	// Linear buckling of the solved frame (stiffutil ST_buckling): critical load factors from the
+	//    geometric stiffness of the beam forces. The mode shapes are written to outloc, scaled to a
+	//    largest node displacement of 1. The solved displacements are left in node.disp.
+	if (f->instancecount) {
+		printf("Buckling analysis does not support module instances.\n");
+		return;
+	}
+	dofmap *dm = ST_dofmap(f);
+	coor *disp = (coor *) malloc(f->nodecount * sizeof (coor));
+	if (!disp) unsafeerror("Could not allocate displacements");
+	for (int i = 0; i < f->nodecount; i++) disp[i] = f->nodes[i].disp;
+	printf("Buckling analysis: %d lowest load factors ... ", count);
+	eigen *e = ST_buckling(f, dm, count);
+	printf("Done.\n");
+	printf("%d Lanczos steps, %d of %d modes converged\n", e->steps, e->converged, e->count);
+	if (!e->count) printf("No positive critical load factor (too little of the frame in compression).\n");
+	FILE *fp = fopen(outloc, "w");
+	if (!fp) unsafeerror("Could not open buckling output file");
+	fprintf(fp, "# mode load_factor\n");
+	printf("Critical load factors:\n");
+	for (int i = 0; i < e->count; i++) {
+		printf("    Mode %3d load factor %12.6g\n", i + 1, e->values[i]);
+		fprintf(fp, "%d %g\n", i + 1, e->values[i]);
+	}
+	fprintf(fp, "# mode node dx dy\n");
+	for (int i = 0; i < e->count; i++) {
+		ST_set_mode(f, dm, e, i);
+		for (int j = 0; j < f->nodecount; j++) {
+			fprintf(fp, "%d %d %g %g\n", i + 1, f->nodes[j].id, f->nodes[j].disp.x, f->nodes[j].disp.y);
+		}
+	}
+	fclose(fp);
+	printf("Buckling modes written to %s\n", outloc);
+	for (int i = 0; i < f->nodecount; i++) f->nodes[i].disp = disp[i];
+	free(disp);
+	MAT_freeeigen(e);
+	ST_free_dofmap(dm);
+}
+
+void relax_frame(frame *f, int maxsteps) {
+	// Static equilibrium on the deformed frame by dynamic relaxation (dynutil), matrix free
+	dyframe *d = DY_frame(f);
+	dyrelax rep;
+	printf("Dynamic relaxation: up to %d steps ... ", maxsteps);
+	DY_relax(d, 1, DY_RELAX_TOL, maxsteps, &rep);
+	printf("Done.\n");
+	printf("%s after %d steps, %d kinetic energy peaks: out-of-balance force %g (applied %g)\n",
+		rep.converged ? "Converged" : "Not converged", rep.steps, rep.peaks, rep.rnorm, rep.fnorm);
+	DY_store(d);
+	DY_free(d);
+	print_results(f);
+}
+
+void implicit_frame(frame *f, int steps, double dt, double damping, char *outloc) {
+	// Implicit (Newmark) time-domain response of the linear frame from rest, at time step dt and
+	//    mass proportional damping, to the applied forces and their time histories. The time
+	//    history is written to outloc.
+	printf("Implicit dynamics: factoring effective stiffness ... ");
+	dynewmark *d = DY_newmark(f, dt, damping);
+	printf("Done.\n");
+	printf("%d free dofs, time step %g, %d steps to t = %g ... ", d->n, dt, steps, steps * dt);
+	double tx, ty;
+	int track = dynamics_track(f, &tx, &ty);
+	coor e;
+	double w;
+
+	FILE *fp = fopen(outloc, "w");
+	if (!fp) unsafeerror("Could not open dynamics output file");
+	fprintf(fp, "# step time displacement kinetic_energy\n");
+	int every = steps > DYN_SAMPLES ? steps / DYN_SAMPLES : 1, chunk;
+	fprintf(fp, "0 0 0 0\n");
+	for (int s = 0; s < steps; s += chunk) {
+		chunk = steps - s < every ? steps - s : every;
+		DY_newmark_step(d, chunk);
+		w = 0;
+		for (int k = 0; k < d->dm->ndof[track]; k++) {
+			e = d->dm->basis[2 * track + k];
+			w += d->u[d->dm->first[track] + k] * (e.x * tx + e.y * ty);
+		}
+		fprintf(fp, "%lld %g %g %g\n", d->steps, d->t, w, DY_newmark_kinetic_energy(d));
 	}
-	for (int i = 0; i < 3; i++) {
-		f->constraints[i].force = stress_solutions->vec[f->beamcount + i];
+	fclose(fp);
+	printf("Done.\n");
+	double t = d->t;
+	DY_newmark_store(d);
+	DY_free_newmark(d);
+	printf("State at t = %g\n", t);
+	print_results(f);
+}
+
+void frequency_frame(frame *f, int count, double wmin, double wmax, int modes, double damping, char *outloc) {
+	// Steady state response of the linear frame to the applied forces varying harmonically, at count
+	//    circular frequencies from wmin to wmax (dynutil DY_harmonic). With modes > 0 it superposes
+	//    that many natural modes; otherwise each frequency refactors the dynamic stiffness. Each
+	//    frequency's beam force amplitudes are written to outloc as soon as they are solved.
+	if (modes > 0) printf("Frequency response: finding %d modes ... ", modes);
+	else printf("Frequency response: analysing stiffness ... ");
+	dyharmonic *h = DY_harmonic(f, damping, modes);
+	printf("Done.\n");
+	if (h->modes) printf("%d Lanczos steps, %d of %d modes converged\n", h->modes->steps, h->modes->converged, h->modes->count);
+	printf("%d free dofs, %d frequencies from %g to %g, damping %g ... ", h->n, count, wmin, wmax, damping);
+	double tx, ty;
+	int track = dynamics_track(f, &tx, &ty);
+	double *amp = (double *) malloc((f->beamcount + 1) * sizeof (double));
+	if (!amp) unsafeerror("Could not allocate force amplitudes");
+
+	FILE *fp = fopen(outloc, "w");
+	if (!fp) unsafeerror("Could not open frequency output file");
+	fprintf(fp, "# omega frequency displacement max|force| then |force| of beams");
+	for (int i = 0; i < f->beamcount; i++) fprintf(fp, " %d", f->beams[i].id);
+	fprintf(fp, "\n");
+	double w, ur, ui, amax, peak = -1, wpeak = 0;
+	coor e;
+	for (int s = 0; s < count; s++) {
+		w = count > 1 ? wmin + (wmax - wmin) * s / (count - 1) : wmin;
+		DY_harmonic_solve(h, w);
+		DY_harmonic_forces(h, amp);
+		ur = ui = 0;
+		for (int k = 0; k < h->dm->ndof[track]; k++) {
+			e = h->dm->basis[2 * track + k];
+			ur += h->ur[h->dm->first[track] + k] * (e.x * tx + e.y * ty);
+			ui += h->ui[h->dm->first[track] + k] * (e.x * tx + e.y * ty);
+		}
+		amax = 0;
+		for (int i = 0; i < f->beamcount; i++) amax = fmax(amax, amp[i]);
+		if (amax > peak) {
+			peak = amax;
+			wpeak = w;
+		}
+		fprintf(fp, "%g %g %g %g", w, w / (2 * M_PI), hypot(ur, ui), amax);
+		for (int i = 0; i < f->beamcount; i++) fprintf(fp, " %g", amp[i]);
+		fprintf(fp, "\n");
 	}
+	fclose(fp);
+	printf("Done.\n");
+	if (!h->modes) printf("%d refactorizations on one symbolic analysis\n", h->solves);
+	printf("Largest beam force amplitude %g at omega %g\n", peak, wpeak);
+	printf("Frequency response written to %s\n", outloc);
+	free(amp);
+	DY_free_harmonic(h);
+}
+
+void edit_frame(frame *f, section *esect, char *outloc) {
+	// Applies the Edits section one beam at a time and re-solves after each edit, correcting the
+	//    factored stiffness matrix by low-rank updates rather than refactoring (stiffutil stsolver).
+	// Each line names a beam and its nodes: a new beam label adds it, an existing label resizes it
+	//    to the given EA, and an EA of 0 removes it. The frame is left in its final edited state.
+	printf("Applying %d beam edits ... ", esect->itemcount);
+	FILE *fp = fopen(outloc, "w");
+	if (!fp) unsafeerror("Could not open edit output file");
+	fprintf(fp, "# edit beam action compliance max|force| max|disp| refactors\n");
 
-	MAT_printvector(stress_solutions);
+	stsolver *s = ST_solver(f);
+	item *it;
+	beam *b;
+	char *action;
+	int id;
+	float stiffness, compliance, maxforce, maxdisp, d;
+	vector *forces;
+	for (int i = 0; i < esect->itemcount; i++) {
+		it = esect->items + i;
+		id = IN_get_int(it, 0);
+		stiffness = IN_get_float(it, 3);
+		b = UN_get_beam(f, id);
+		if (!b) {
+			if (stiffness <= 0) unsafeerror("Edits can only remove existing beams");
+			ST_add_beam(s, (beam) {id, IN_get_int(it, 1), IN_get_int(it, 2), 0, 0, 0, stiffness});
+			action = "add";
+		}
+		else {
+			if (!((b->n1_id == IN_get_int(it, 1) && b->n2_id == IN_get_int(it, 2))
+					|| (b->n1_id == IN_get_int(it, 2) && b->n2_id == IN_get_int(it, 1)))) {
+				unsafeerror("Edited beam does not join the nodes given");
+			}
+			if (stiffness <= 0) {
+				ST_remove_beam(s, id);
+				action = "remove";
+			}
+			else {
+				ST_resize_beam(s, id, stiffness);
+				action = "resize";
+			}
+		}
+		MAT_freevector(ST_solver_solve(s));
 
+		// Compliance F . u, the usual topology optimisation objective
+		forces = UN_get_forces(f);
+		compliance = 0;
+		maxdisp = 0;
+		for (int j = 0; j < f->nodecount; j++) {
+			compliance += forces->vec[j] * f->nodes[j].disp.x + forces->vec[j + f->nodecount] * f->nodes[j].disp.y;
+			d = sqrtf(f->nodes[j].disp.x * f->nodes[j].disp.x + f->nodes[j].disp.y * f->nodes[j].disp.y);
+			if (d > maxdisp) maxdisp = d;
+		}
+		MAT_freevector(forces);
+		maxforce = 0;
+		for (int j = 0; j < f->beamcount; j++) {
+			if (fabsf(f->beams[j].force) > maxforce) maxforce = fabsf(f->beams[j].force);
+		}
+		fprintf(fp, "%d %d %s %g %g %g %d\n", it->id, id, action, compliance, maxforce, maxdisp, s->refactors);
+	}
+	fclose(fp);
+	ST_free_solver(s);
+	printf("Done.\n");
+	printf("Edit results written to %s\n", outloc);
+}
+
+void render_frame(frame *f, cache *c) {
 	// Visualize the resulting frame and save to file
+	unsigned long long geom = UN_hash_geometry(f);
+	unsigned long long load = UN_hash_loads(f);
+	if (c && CA_load_image(c, geom, load, "out.png")) {
+		printf("Image found in cache.\n");
+		return;
+	}
 	plot *plt = VIS_init_plot(400, 200);
 	VIS_set_scale(plt, f); // TODO Make this more intuitive / hide this function - check if performed at first add_frame?
 	VIS_add_frame(plt, f);
 	VIS_save_png(plt);
 
 	VIS_free_plot(plt);
+	if (c) CA_store_image(c, geom, load, "out.png");
+}
 
-	MAT_freevector(node_forces);
-	MAT_freevector(stress_solutions);
-	MAT_freematrix(con_mat);
+void usage() {
+	printf("Usage: unsafe-r [-c cache_dir] [-k] [-d parts] [-b modes] [-n steps | -a steps | -e steps | -t steps | -i steps dt | -m modes | -w count w0 w1] [-z c] [file.us]\n");
+	printf("    -c cache_dir    reuse factorizations, solutions and images stored in cache_dir\n");
+	printf("    -k              use the stiffness method even for statically determinate frames\n");
+	printf("    -d parts        solve stiffness systems by domain decomposition into parts subdomains\n");
+	printf("    -r              only run the rigidity check (pebble game) and report the result\n");
+	printf("    -b modes        after the static solve, the lowest critical load factors for linear\n");
+	printf("                    buckling, from the geometric stiffness of the beam forces; modes are\n");
+	printf("                    written to buckling.txt\n");
+	printf("    -n steps        solve for large displacements (equilibrium on the deformed frame)\n");
+	printf("                    in steps load increments; the path is written to path.txt\n");
+	printf("    -a steps        as -n, by arc-length continuation through snap-through and buckling\n");
+	printf("    -e steps        as -n, by dynamic relaxation (matrix free, at most steps steps)\n");
+	printf("    -t steps        explicit time-domain response to the forces applied at t = 0, from rest;\n");
+	printf("                    the time history is written to dynamics.txt (mass per unit length is\n");
+	printf("                    the optional fourth Beams value)\n");
+	printf("    -i steps dt     as -t, by implicit (Newmark) steps of dt on the linear frame; forces\n");
+	printf("                    may name a time history (fourth Forces value, an id in Histories,\n");
+	printf("                    whose items list time / load factor pairs)\n");
+	printf("    -m modes        lowest natural frequencies and mode shapes (lumped masses), written\n");
+	printf("                    to modes.txt\n");
+	printf("    -w count w0 w1  steady state response to the forces varying as cos(omega t), at count\n");
+	printf("                    circular frequencies omega from w0 to w1; beam force amplitudes are\n");
+	printf("                    written to frequency.txt (with -m, by superposing the lowest modes)\n");
+	printf("    -z c            mass proportional damping c (per unit time) for -i and -w\n");
+	printf("Frames that are not statically determinate (2n - 3 beams, 3 constraints) are solved by\n");
+	printf("    the stiffness method, using the optional beam stiffness EA (third Beams value).\n");
+	printf("    So are frames with Instances of a module (ModuleNodes, ModuleBeams), which is condensed\n");
+	printf("    onto its interface nodes once and reused by every instance.\n");
+	printf("An Edits section re-solves after each of a list of beam additions, removals and resizes,\n");
+	printf("    by low-rank updates of the stiffness factorization; results are written to edits.txt.\n");
+	printf("Optional sections in file.us select extra analyses of determinate frames:\n");
+	printf("    Sweep           force sweep table, written to sweep.txt\n");
+	printf("    Influence       unit load influence lines, written to influence.txt\n");
+	printf("                    (InfluenceBeams restricts the reported beams)\n");
+	printf("    Sensitivity     beam force gradients w.r.t. node coordinates, written to sensitivity.txt\n");
+	printf("    MonteCarlo      reliability sampling over Perturbations, written to montecarlo.txt\n");
+	exit(1);
+}
+
+int main(int argc, char **argv) {
+	char *fileloc = "examples/boxframe.us";
+	char *cachedir = NULL;
+	int use_stiffness = 0;
+	int nparts = 1;
+	int check_only = 0;
+	int nl_steps = 0;
+	int arclength = 0;
+	int dyn_steps = 0;
+	int imp_steps = 0;
+	int relax_steps = 0;
+	int modes = 0;
+	int buckling = 0;
+	int freq_count = 0;
+	double imp_dt = 0;
+	double freq_min = 0, freq_max = 0;
+	double damping = 0;
+	for (int i = 1; i < argc; i++) {
+		if (!strcmp(argv[i], "-c") && i + 1 < argc) cachedir = argv[++i];
+		else if (!strcmp(argv[i], "-k")) use_stiffness = 1;
+		else if (!strcmp(argv[i], "-r")) check_only = 1;
+		else if (!strcmp(argv[i], "-d") && i + 1 < argc) nparts = atoi(argv[++i]);
+		else if (!strcmp(argv[i], "-n") && i + 1 < argc) nl_steps = atoi(argv[++i]);
+		else if (!strcmp(argv[i], "-t") && i + 1 < argc) dyn_steps = atoi(argv[++i]);
+		else if (!strcmp(argv[i], "-m") && i + 1 < argc) modes = atoi(argv[++i]);
+		else if (!strcmp(argv[i], "-b") && i + 1 < argc) buckling = atoi(argv[++i]);
+		else if (!strcmp(argv[i], "-e") && i + 1 < argc) relax_steps = atoi(argv[++i]);
+		else if (!strcmp(argv[i], "-z") && i + 1 < argc) damping = atof(argv[++i]);
+		else if (!strcmp(argv[i], "-w") && i + 3 < argc) {
+			freq_count = atoi(argv[++i]);
+			freq_min = atof(argv[++i]);
+			freq_max = atof(argv[++i]);
+		}
+		else if (!strcmp(argv[i], "-i") && i + 2 < argc) {
+			imp_steps = atoi(argv[++i]);
+			imp_dt = atof(argv[++i]);
+		}
+		else if (!strcmp(argv[i], "-a") && i + 1 < argc) {
+			nl_steps = atoi(argv[++i]);
+			arclength = 1;
+		}
+		else if (argv[i][0] == '-') usage();
+		else fileloc = argv[i];
+	}
+
+	printf("Reading file ... ");
+	table *ftable = IN_load_table(fileloc);
+	printf("Done.\n");
+
+	frame *f = (frame *) malloc(sizeof (frame));
+	setup(f, ftable);
+	printf("Setup complete.\n");
+
+	UN_printframe(f);
+
+	// Combinatorial rigidity check: rejects mechanisms before any matrix is built
+	rigidity *rg = RG_check(f);
+	printf("Rigidity check: %d internal degrees of freedom, %d redundant beams, %d redundant constraints\n",
+		rg->dof, rg->redundantcount + rg->redundant_module, rg->redundant_constraints);
+	if (rg->redundantcount) {
+		printf("Redundant beams (one choice):");
+		for (int i = 0; i < rg->redundantcount; i++) printf(" %d", rg->redundant[i]);
+		printf("\n");
+	}
+	int mechanism = rg->dof > 0;
+	RG_free(rg);
+	if (check_only || mechanism) {
+		if (mechanism) printf("Frame is a mechanism and cannot carry load.\n");
+		else printf("Frame is rigid.\n");
+		UN_free_frame(f);
+		IN_free_table(ftable);
+		return 1;
+	}
+
+	cache *c = NULL;
+	if (cachedir) c = CA_open(cachedir);
+
+	if (f->beamcount != 2 * f->nodecount - 3 || f->constraintcount != 3) {
+		printf("Frame is not statically determinate; switching to the stiffness method.\n");
+		use_stiffness = 1;
+	}
+	if (f->instancecount && !use_stiffness) {
+		printf("Frame has module instances; switching to the stiffness method.\n");
+		use_stiffness = 1;
+	}
+
+	if (freq_count > 0) {
+		frequency_frame(f, freq_count, freq_min, freq_max, modes, damping, "frequency.txt");
+	}
+	else if (modes > 0) {
+		modal_frame(f, modes, "modes.txt");
+		render_frame(f, NULL);
+	}
+	else if (relax_steps > 0) {
+		relax_frame(f, relax_steps);
+		render_frame(f, NULL);
+	}
+	else if (imp_steps > 0) {
+		implicit_frame(f, imp_steps, imp_dt, damping, "dynamics.txt");
+		render_frame(f, NULL);
+	}
+	else if (dyn_steps > 0) {
+		dynamics_frame(f, dyn_steps, "dynamics.txt");
+		render_frame(f, NULL);
+	}
+	else if (nl_steps > 0) {
+		nonlinear_frame(f, nl_steps, arclength, "path.txt");
+		render_frame(f, NULL);
+	}
+	else if (use_stiffness) {
+		stiffness_frame(f, nparts);
+		render_frame(f, c);
+		if (buckling > 0) buckling_frame(f, buckling, "buckling.txt");
+		section *esect = IN_find_section(ftable, "Edits");
+		if (esect) edit_frame(f, esect, "edits.txt");
+	}
+	else {
+		lu_factor *lu = NULL;
+		vector *stress_solutions = solve_frame(f, c, &lu);
+		unsigned long long geom = UN_hash_geometry(f);
+
+		// Fill in the force values
+		for (int i = 0; i < f->beamcount; i++) {
+			f->beams[i].force = stress_solutions->vec[i];
+		}
+		for (int i = 0; i < 3; i++) {
+			f->constraints[i].force = stress_solutions->vec[f->beamcount + i];
+		}
+
+		MAT_printvector(stress_solutions);
+
+		render_frame(f, c);
+
+		if (buckling > 0) buckling_frame(f, buckling, "buckling.txt");
+
+		section *ssect = IN_find_section(ftable, "Sweep");
+		if (ssect) {
+			if (!lu) lu = factor_frame(f, c, geom);
+			sweep_frame(f, ssect, lu, "sweep.txt");
+		}
+
+		section *isect = IN_find_section(ftable, "Influence");
+		if (isect) {
+			if (!lu) lu = factor_frame(f, c, geom);
+			influence_frame(f, isect, IN_find_section(ftable, "InfluenceBeams"), lu, "influence.txt");
+		}
+
+		section *dsect = IN_find_section(ftable, "Sensitivity");
+		if (dsect) {
+			if (!lu) lu = factor_frame(f, c, geom);
+			sensitivity_frame(f, dsect, lu, stress_solutions, "sensitivity.txt");
+		}
+
+		section *msect = IN_find_section(ftable, "MonteCarlo");
+		if (msect) {
+			montecarlo_frame(f, msect, IN_find_section(ftable, "Perturbations"), "montecarlo.txt");
+		}
+
+		if (lu) MAT_freelu(lu);
+		MAT_freevector(stress_solutions);
+	}
+
+	if (c) CA_close(c);
 	UN_free_frame(f);
+	IN_free_table(ftable);
 	return 1;
 }
\ No newline at end of file
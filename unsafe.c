@@ -1,10 +1,23 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <math.h>
+#include <string.h>
 #include "lib/matutil.h"
 #include "lib/inutil-r.h"
 #include "lib/undefs.h"
 #include "lib/visutil-2d.h"
+#include "lib/stiffutil.h"
+#include "lib/gridutil.h"
+
+// Contact springs are this many times stiffer than the stiffest beam (EA / L); a contact then
+//    penetrates its wall by about 1 / CONTACT_PENALTY of the beam deflections it carries
+#define CONTACT_PENALTY 1e4
+#define CONTACT_TOL 1e-6 // gap (relative to the frame's size) within which a node counts as touching
+// Tension (relative to the largest applied force) a contact must carry before it lets go. Contact
+//    forces are penalty times float displacements, good to about this much, and contacts that only
+//    hold a direction with no load in it (a floor's end walls) carry nothing but this noise.
+#define CONTACT_RELEASE 1e-3
+#define CONTACT_MAX_PASSES 1000
 
 void unsafeerror(char *error_text) {
 	printf("Critical error in unsafe.c\nError message follows:\n");
@@ -12,15 +25,16 @@ void unsafeerror(char *error_text) {
 	exit(1);
 }
 
-matrix* build_connectivity_matrix(frame *f) {
+spmatrix* build_connectivity_matrix(frame *f) {
 	// returns a connectivity matrix for frame f
 	// This particular matrix is not square; it is rectangular such that
 	//    M <beam forces> = <node forces (x then y)>
+	// Stored sparse (four entries per beam) and solved by least squares, MAT_solve_lsqr.
 
 	int beamcount = f->beamcount;
 	int nodecount = f->nodecount;
 	
-	matrix *cmat = MAT_matrix(nodecount * 2, beamcount);
+	triplet *t = MAT_triplet(nodecount * 2, beamcount, 4 * beamcount);
 
 	// Populate the matrix
 	// A row has one equation. The column index is the same as the beam index
@@ -32,21 +46,22 @@ matrix* build_connectivity_matrix(frame *f) {
 	int offset = nodecount; // Y forces are node_number + offset
 	for (int i = 0; i < beamcount; i++) {
 		b = f->beams[i];
-		n_1 = UN_get_node(f, b.n1_id); // Get the nodes the beam connects to
-		n_2 = UN_get_node(f, b.n2_id);
-
-		n1_idx = UN_get_node_idx(f, b.n1_id);
-		n2_idx = UN_get_node_idx(f, b.n2_id);
+		n1_idx = b.n1_idx; // Resolved by UN_compute_beam_vals
+		n2_idx = b.n2_idx;
+		n_1 = f->nodes + n1_idx; // Get the nodes the beam connects to
+		n_2 = f->nodes + n2_idx;
 
 		coeff_x = (float) (n_1->loc.x - n_2->loc.x) / (float) b.length;
-		cmat->mat[n1_idx][i] = coeff_x; // Node 1 x force adds coeff of beam[i] stress
-		cmat->mat[n2_idx][i] = -1 * coeff_x; // Node 2 x force is the inverse of the force on node 1
+		MAT_triplet_add(t, n1_idx, i, coeff_x); // Node 1 x force adds coeff of beam[i] stress
+		MAT_triplet_add(t, n2_idx, i, -1 * coeff_x); // Node 2 x force is the inverse of the force on node 1
 
 		coeff_y = (float) (n_1->loc.y - n_2->loc.y) / (float) b.length;
-		cmat->mat[n1_idx + offset][i] = coeff_y; // Set the y coefficient
-		cmat->mat[n2_idx + offset][i] = -1 * coeff_y;
+		MAT_triplet_add(t, n1_idx + offset, i, coeff_y); // Set the y coefficient
+		MAT_triplet_add(t, n2_idx + offset, i, -1 * coeff_y);
 	}
 	// x and y connections should now be populated.
+	spmatrix *cmat = MAT_compress(t);
+	MAT_freetriplet(t);
 	return cmat;
 }
 
@@ -63,7 +78,8 @@ void setup(frame *f, char *fileloc) {
 	bsect = IN_find_section(ftable, "Beams");
 	fsect = IN_find_section(ftable, "Forces");
 	wsect = IN_find_section(ftable, "Walls");
-	UN_init_frame(f, bsect->itemcount, nsect->itemcount, fsect->itemcount, 0, fsect->wallcount);
+	if (!nsect || !bsect || !fsect || !wsect) unsafeerror("Missing Nodes, Beams, Forces or Walls section");
+	UN_init_frame(f, bsect->itemcount, nsect->itemcount, fsect->itemcount, 0, wsect->itemcount);
 
 	item* temp_item_ptr;
 
@@ -75,11 +91,13 @@ void setup(frame *f, char *fileloc) {
 		temp_coor = (coor) {IN_get_float(temp_item_ptr, 0), IN_get_float(temp_item_ptr, 1)};
 		f->nodes[i] = (node) {temp_item_ptr->id, temp_coor};
 	}
-	// Populate beams
+	// Populate beams (the axial stiffness EA is optional and defaults to 1)
+	float stiffness;
 	for (int i = 0; i<bsect->itemcount; i++) {
 		temp_item_ptr = bsect->items + i;
+		stiffness = temp_item_ptr->quantcount > 2 ? IN_get_float(temp_item_ptr, 2) : 1;
 		f->beams[i] = (beam) {temp_item_ptr->id, IN_get_int(temp_item_ptr, 0), 
-			IN_get_int(temp_item_ptr, 1)};
+			IN_get_int(temp_item_ptr, 1), 0, 0, 0, stiffness};
 	}
 	// Beam length still needs seperate evaluation once frame is loaded
 	// Populate forces
@@ -105,6 +123,7 @@ void setup(frame *f, char *fileloc) {
 
 	printf("Computing beam values ... ");
 	// Calculate beam values (other precomputation should occur here)
+	UN_sort_frame(f);
 	UN_compute_beam_vals(f);
 	printf("Done.\n");
 
@@ -112,9 +131,350 @@ void setup(frame *f, char *fileloc) {
 	IN_free_table(ftable);
 }
 
-int main() {
+typedef struct contact contact;
+struct contact {
+	// A node that may touch a wall
+	int node; // node index
+	int wall; // wall index
+	coor n; // unit wall normal, pointing to the side the node has to stay on
+	float gap; // distance from the wall before loading (negative if already through it)
+	int spring; // stsolver spring handle while the contact is active, -1 otherwise
+	int next; // next contact of the same node, -1 if none
+};
+
+typedef struct contactset contactset;
+struct contactset {
+	// The node-wall pairs met so far. Pairs are only tested between a node and the walls near it in
+	//    a broad phase grid (gridutil); each node's near walls are kept, and listed again only when
+	//    the node moves into another cell.
+	int count;
+	int cap;
+	contact *c;
+	int *head; // first contact of each node, -1 if none
+	grid *g;
+	int *cell; // grid cell each node's near walls were listed for, -1 if not listed
+	int **near; // near walls of each node
+	int *nearcount;
+	int *buf; // room for every wall
+	long long tested; // node-wall pairs tested so far
+};
+
+coor wall_normal(wall *w) {
+	// Unit normal of the line y = m x + b, pointing into the side nodes are kept on
+	float len = sqrtf(1 + w->m * w->m);
+	float side = w->above ? 1 : -1;
+	return (coor) {-side * w->m / len, side / len};
+}
+
+float wall_gap(wall *w, coor p) {
+	// Signed distance of p from the wall, positive on the allowed side
+	float side = w->above ? 1 : -1;
+	return side * (p.y - w->m * p.x - w->b) / sqrtf(1 + w->m * w->m);
+}
+
+coor node_position(node *n) {
+	return (coor) {n->loc.x + n->disp.x, n->loc.y + n->disp.y};
+}
+
+contactset* contact_set(frame *f) {
+	contactset *cs = (contactset *) malloc(sizeof (contactset));
+	if (!cs) unsafeerror("Could not allocate contacts");
+	int n = f->nodecount;
+	cs->count = 0;
+	cs->cap = n + 16;
+	cs->c = (contact *) malloc(cs->cap * sizeof (contact));
+	cs->head = (int *) malloc((n + 1) * sizeof (int));
+	cs->cell = (int *) malloc((n + 1) * sizeof (int));
+	cs->near = (int **) calloc(n + 1, sizeof (int *));
+	cs->nearcount = (int *) calloc(n + 1, sizeof (int));
+	cs->buf = (int *) malloc((f->wallcount + 1) * sizeof (int));
+	if (!cs->c || !cs->head || !cs->cell || !cs->near || !cs->nearcount || !cs->buf) unsafeerror("Could not allocate contacts");
+	for (int i = 0; i < n; i++) cs->head[i] = -1;
+	cs->g = NULL;
+	cs->tested = 0;
+	return cs;
+}
+
+void free_contact_set(contactset *cs, frame *f) {
+	for (int i = 0; i < f->nodecount; i++) free(cs->near[i]);
+	if (cs->g) GR_free(cs->g);
+	free(cs->c);
+	free(cs->head);
+	free(cs->cell);
+	free(cs->near);
+	free(cs->nearcount);
+	free(cs->buf);
+	free(cs);
+}
+
+void contact_grid(contactset *cs, frame *f, float h) {
+	// (Re)builds the broad phase grid with cell size h over the nodes where they are now, with a
+	//    margin of three cells, and forgets every node's near walls
+	coor p = node_position(f->nodes);
+	float lo_x = p.x, hi_x = p.x, lo_y = p.y, hi_y = p.y;
+	for (int i = 1; i < f->nodecount; i++) {
+		p = node_position(f->nodes + i);
+		lo_x = fminf(lo_x, p.x);
+		hi_x = fmaxf(hi_x, p.x);
+		lo_y = fminf(lo_y, p.y);
+		hi_y = fmaxf(hi_y, p.y);
+	}
+	if (cs->g) GR_free(cs->g);
+	cs->g = GR_grid(f->walls, f->wallcount, lo_x - 3 * h, lo_y - 3 * h, hi_x + 3 * h, hi_y + 3 * h, h);
+	for (int i = 0; i < f->nodecount; i++) cs->cell[i] = -1;
+}
+
+int contact_pair(contactset *cs, frame *f, int i, int w) {
+	// The contact between node index i and wall index w, added if it is new
+	for (int q = cs->head[i]; q != -1; q = cs->c[q].next) {
+		if (cs->c[q].wall == w) return q;
+	}
+	if (cs->count == cs->cap) {
+		cs->cap *= 2;
+		cs->c = (contact *) realloc(cs->c, cs->cap * sizeof (contact));
+		if (!cs->c) unsafeerror("Could not grow contacts");
+	}
+	cs->c[cs->count] = (contact) {i, w, wall_normal(f->walls + w), wall_gap(f->walls + w, f->nodes[i].loc), -1, cs->head[i]};
+	cs->head[i] = cs->count;
+	return cs->count++;
+}
+
+int contact_sweep(contactset *cs, frame *f, float limit, stsolver *s, double kc, int *initial) {
+	// Activates every inactive contact whose node is nearer than limit to the wrong side of its wall
+	//    (limit > 0 takes in touching nodes), as a spring on s or, without a solver yet, by numbering
+	//    it in *initial. Tests only the walls near each node.
+	// Returns the number activated, or -1 if a node has left the grid (rebuild it and sweep again).
+	int changes = 0, c, q;
+	coor p;
+	float pen;
+	for (int i = 0; i < f->nodecount; i++) {
+		p = node_position(f->nodes + i);
+		c = GR_cell(cs->g, p);
+		if (c == -1) return -1;
+		if (c != cs->cell[i]) {
+			cs->nearcount[i] = GR_near_walls(cs->g, p, cs->buf);
+			cs->near[i] = (int *) realloc(cs->near[i], (cs->nearcount[i] + 1) * sizeof (int));
+			if (!cs->near[i]) unsafeerror("Could not allocate near walls");
+			memcpy(cs->near[i], cs->buf, cs->nearcount[i] * sizeof (int));
+			cs->cell[i] = c;
+		}
+		for (int j = 0; j < cs->nearcount[i]; j++) {
+			cs->tested++;
+			pen = wall_gap(f->walls + cs->near[i][j], p);
+			if (pen >= limit) continue;
+			q = contact_pair(cs, f, i, cs->near[i][j]);
+			if (cs->c[q].spring != -1) continue;
+			cs->c[q].spring = s ? ST_add_spring(s, i, cs->c[q].n, kc) : (*initial)++;
+			changes++;
+		}
+	}
+	return changes;
+}
+
+void statics_check(frame *f, contactset *cs, double kc) {
+	// Beam forces from the node loads alone (applied plus contact forces), by least squares on the
+	//    connectivity matrix. A frame with more beams than it needs has many equilibrium sets of
+	//    beam forces, and LSQR returns the one of least norm; the compliant forces differ from it by
+	//    a self-equilibrated set. The residual is how far the contacts are from balancing the loads.
+	vector *load = UN_get_forces(f);
+	contact *c = cs->c;
+	float pen;
+	for (int i = 0; i < cs->count; i++) {
+		if (c[i].spring == -1) continue;
+		coor disp = f->nodes[c[i].node].disp;
+		pen = c[i].gap + c[i].n.x * disp.x + c[i].n.y * disp.y;
+		load->vec[c[i].node] += -kc * pen * c[i].n.x;
+		load->vec[c[i].node + f->nodecount] += -kc * pen * c[i].n.y;
+	}
+	float fnorm = 0;
+	for (int i = 0; i < load->rows; i++) fnorm += load->vec[i] * load->vec[i];
+	fnorm = sqrtf(fnorm);
+	if (fnorm == 0) fnorm = 1;
+
+	spmatrix *cmat = build_connectivity_matrix(f);
+	lsq_report rep;
+	vector *t = MAT_solve_lsqr(cmat, load, 1e-6, 10 * (cmat->rows + cmat->cols), &rep);
+
+	// Residual of the compliant beam forces, for comparison
+	vector *compliant = MAT_vector(f->beamcount, MAT_NO);
+	for (int i = 0; i < f->beamcount; i++) compliant->vec[i] = f->beams[i].force;
+	vector *r = MAT_multiply_spv(cmat, compliant);
+	float cnorm = 0;
+	for (int i = 0; i < r->rows; i++) cnorm += (r->vec[i] - load->vec[i]) * (r->vec[i] - load->vec[i]);
+	cnorm = sqrtf(cnorm);
+
+	printf("Statics check (least squares on the %d x %d connectivity matrix, %d iterations):\n",
+		cmat->rows, cmat->cols, rep.iter);
+	printf("    Least-norm beam forces: |M t - f| = %g |f|, |M^T (M t - f)| = %g\n",
+		rep.rnorm / fnorm, rep.arnorm);
+	printf("    Compliant beam forces:  |M t - f| = %g |f|\n", cnorm / fnorm);
+	printf("Beam forces from statics alone (least norm):\n");
+	for (int i = 0; i < f->beamcount; i++) {
+		printf("    Beam id %05d %10.4f\n", f->beams[i].id, t->vec[i]);
+	}
+
+	MAT_freespmatrix(cmat);
+	MAT_freevector(load);
+	MAT_freevector(t);
+	MAT_freevector(compliant);
+	MAT_freevector(r);
+}
+
+void contact_frame(frame *f, int statics) {
+	// Solves the frame pressed against its walls. Walls are unilateral: a node may leave a wall
+	//    but not pass through it. An active contact is a stiff spring along the wall normal,
+	//    compressed by however far the node ends up past the wall, so with active contacts A
+	//    (K + kc sum_A n n^T) u = f - kc sum_A gap n.
+	// Active set passes: solve, add every contact that ends up through its wall, drop every active
+	//    contact that pulls (its node ends up off the wall), and repeat until nothing changes.
+	//    Each change is a rank one update of the stsolver factorization, not a refactorization.
+	// Loads that press the frame down settle in a few passes. Where a load lifts part of the frame
+	//    off, only the contacts next to the lifted part pull at each pass, so the lifted part grows
+	//    by about one contact per side per pass; passes are cheap, being update solves.
+	// Nodes start on the allowed side of every wall (or within the touching tolerance of it), so a
+	//    node that has moved by u can only be through walls within |u| of it. The grid cells are
+	//    kept larger than the largest displacement, which makes those walls near walls.
+	float lo_x = f->nodes[0].loc.x, hi_x = lo_x, lo_y = f->nodes[0].loc.y, hi_y = lo_y;
+	for (int i = 1; i < f->nodecount; i++) {
+		lo_x = fminf(lo_x, f->nodes[i].loc.x);
+		hi_x = fmaxf(hi_x, f->nodes[i].loc.x);
+		lo_y = fminf(lo_y, f->nodes[i].loc.y);
+		hi_y = fmaxf(hi_y, f->nodes[i].loc.y);
+	}
+	float extent = fmaxf(fmaxf(hi_x - lo_x, hi_y - lo_y), 1);
+	float tol = CONTACT_TOL * extent;
+	double kc = 0;
+	for (int i = 0; i < f->beamcount; i++) {
+		if (f->beams[i].stiffness / f->beams[i].length > kc) kc = f->beams[i].stiffness / f->beams[i].length;
+	}
+	kc *= CONTACT_PENALTY;
+	float release = 0;
+	for (int i = 0; i < f->forcecount; i++) release = fmaxf(release, fabsf(f->forces[i].mag));
+	release *= CONTACT_RELEASE / kc; // as a gap
+
+	// Nodes touching (or through) a wall before loading start out in contact. Cells start at
+	//    about one per node over the frame's extent.
+	for (int i = 0; i < f->nodecount; i++) f->nodes[i].disp = (coor) {0, 0};
+	contactset *cs = contact_set(f);
+	float h = fmaxf(extent / sqrtf(f->nodecount), 2 * tol);
+	contact_grid(cs, f, h);
+	int active = 0;
+	contact_sweep(cs, f, tol, NULL, kc, &active);
+	if (!active) unsafeerror("Frame does not touch any wall, so nothing holds it in place");
+	int *idx = (int *) malloc((active + 1) * sizeof (int));
+	coor *dir = (coor *) malloc((active + 1) * sizeof (coor));
+	double *k = (double *) malloc((active + 1) * sizeof (double));
+	if (!idx || !dir || !k) unsafeerror("Could not allocate contacts");
+	contact *c = cs->c;
+	for (int i = 0; i < cs->count; i++) {
+		if (c[i].spring == -1) continue;
+		idx[c[i].spring] = c[i].node;
+		dir[c[i].spring] = c[i].n;
+		k[c[i].spring] = kc;
+	}
+	printf("Solving contact with %d walls: %d node-wall pairs touching ... ", f->wallcount, active);
+	stsolver *s = ST_solver_springs(f, active, idx, dir, k);
+	free(idx);
+	free(dir);
+	free(k);
+
+	dofmap *d = s->d;
+	vector *load, *u;
+	float pen, maxdisp;
+	int passes = 0, changes = 1, found;
+	while (changes && passes < CONTACT_MAX_PASSES) {
+		load = ST_load_vector(f, d);
+		for (int i = 0; i < cs->count; i++) {
+			if (c[i].spring == -1) continue;
+			for (int q = 0; q < d->ndof[c[i].node]; q++) {
+				coor v = d->basis[2 * c[i].node + q];
+				load->vec[d->first[c[i].node] + q] -= kc * c[i].gap * (c[i].n.x * v.x + c[i].n.y * v.y);
+			}
+		}
+		u = ST_solver_solve_load(s, load);
+		MAT_freevector(load);
+		MAT_freevector(u);
+		passes++;
+
+		changes = 0;
+		for (int i = 0; i < cs->count; i++) {
+			coor disp = f->nodes[c[i].node].disp;
+			pen = c[i].gap + c[i].n.x * disp.x + c[i].n.y * disp.y;
+			if (c[i].spring != -1 && pen > release) {
+				ST_remove_spring(s, c[i].spring);
+				c[i].spring = -1;
+				changes++;
+			}
+		}
+
+		// Cells stay larger than the displacements; nodes that leave the grid get a new one
+		maxdisp = 0;
+		for (int i = 0; i < f->nodecount; i++) {
+			maxdisp = fmaxf(maxdisp, fmaxf(fabsf(f->nodes[i].disp.x), fabsf(f->nodes[i].disp.y)));
+		}
+		if (maxdisp + tol > h) {
+			h = 2 * (maxdisp + tol);
+			contact_grid(cs, f, h);
+		}
+		while ((found = contact_sweep(cs, f, -tol, s, kc, NULL)) == -1) contact_grid(cs, f, h);
+		c = cs->c;
+		changes += found;
+	}
+	if (changes) printf("no settled contact set after %d passes ... ", passes);
+	printf("Done.\n");
+	active = 0;
+	for (int i = 0; i < cs->count; i++) active += c[i].spring != -1;
+	printf("%d active contacts after %d passes, %d factorizations\n", active, passes, s->refactors);
+	printf("Broad phase: %lld node-wall tests, against %lld for every pair at every pass\n",
+		cs->tested, (long long) (passes + 1) * f->nodecount * f->wallcount);
+
+	printf("Node displacements:\n");
+	for (int i = 0; i < f->nodecount; i++) {
+		printf("    Node id %05d ", f->nodes[i].id);
+		UN_printcoor(f->nodes[i].disp);
+		printf("\n");
+	}
+	printf("Beam forces (tension positive):\n");
+	for (int i = 0; i < f->beamcount; i++) {
+		printf("    Beam id %05d %10.4f\n", f->beams[i].id, f->beams[i].force);
+	}
+	printf("Contact forces (compression positive):\n");
+	for (int i = 0; i < cs->count; i++) {
+		if (c[i].spring == -1) continue;
+		coor disp = f->nodes[c[i].node].disp;
+		pen = c[i].gap + c[i].n.x * disp.x + c[i].n.y * disp.y;
+		printf("    Node id %05d wall id %05d %10.4f\n", f->nodes[c[i].node].id, f->walls[c[i].wall].id, -kc * pen);
+	}
+
+	if (statics) statics_check(f, cs, kc);
+
+	ST_free_solver(s);
+	free_contact_set(cs, f);
+}
+
+int main(int argc, char **argv) {
+	char *fileloc = "examples/walls.us";
+	int statics = 0;
+	for (int i = 1; i < argc; i++) {
+		if (!strcmp(argv[i], "-s")) {
+			statics = 1;
+			continue;
+		}
+		if (argv[i][0] == '-') {
+			printf("Usage: unsafe [-s] [file.us]\n");
+			printf("Solves a frame held only by its Walls (lines y = m x + b that nodes stay above, or\n");
+			printf("    below, of), with contact found by an active set of node-wall springs.\n");
+			printf("    -s  also recovers beam forces from statics alone (least squares) and reports residuals\n");
+			return 1;
+		}
+		fileloc = argv[i];
+	}
 	frame *f = (frame *) malloc(sizeof (frame));
-	setup(f, "examples/unsafetest.us");
+	setup(f, fileloc);
+	printf("Setup complete.\n");
+
+	contact_frame(f, statics);
 
+	UN_free_frame(f);
 	return 1;
 }
\ No newline at end of file